@@ -0,0 +1,88 @@
+#include "BatchRenderer.h"
+#include "FrameBuffer.h"
+#include "Rasterizer.h"
+#include "Scene.h"
+#include "../Utils/Mesh.h"
+#include "Graphics/Color.h"
+
+namespace EDX
+{
+	namespace RasterRenderer
+	{
+		BatchRenderer::BatchRenderer(const uint width, const uint height, WorkerPool* pWorkerPool, const WorkContextDesc& desc)
+			: mWorkContext(pWorkerPool, desc)
+			, mWidth(width)
+			, mHeight(height)
+		{
+			// The pool workers and the thread calling RenderBatch
+			const int rendererCount = pWorkerPool ? pWorkerPool->GetThreadCount() + 1 : 1;
+			for (auto i = 0; i < rendererCount; i++)
+			{
+				mRenderers.Add(MakeUnique<Renderer>());
+				mRenderers[i]->Initialize(width, height, nullptr);
+				mFreeRenderers.Add(i);
+			}
+		}
+
+		void BatchRenderer::RenderBatch(const Mesh& mesh, const BatchFrame* pFrames, const int frameCount)
+		{
+			mWorkContext.ParallelFor(0, frameCount, [&](int frameId)
+			{
+				int rendererId;
+				{
+					std::unique_lock<std::mutex> lock(mLock);
+					mRendererFreed.wait(lock, [this] { return mFreeRenderers.Size() > 0; });
+					rendererId = mFreeRenderers[mFreeRenderers.Size() - 1];
+					mFreeRenderers.Resize(mFreeRenderers.Size() - 1);
+				}
+
+				const BatchFrame& frame = pFrames[frameId];
+				Renderer* pRenderer = mRenderers[rendererId].Get();
+				pRenderer->SetTransform(frame.ModelView, frame.Proj, frame.ToRaster);
+				pRenderer->RenderMesh(mesh);
+				memcpy(frame.pColorBuffer, pRenderer->GetBackBuffer(), mWidth * mHeight * sizeof(Color4b));
+
+				{
+					std::lock_guard<std::mutex> lock(mLock);
+					mFreeRenderers.Add(rendererId);
+				}
+				mRendererFreed.notify_one();
+			});
+		}
+
+		bool BatchRenderer::SetShaderPrograms(const std::shared_ptr<const ShaderProgram>& pVertexProgram, const std::shared_ptr<const ShaderProgram>& pPixelProgram)
+		{
+			// Every renderer gets the same programs, so either all of them take them or none do
+			for (auto i = 0; i < mRenderers.Size(); i++)
+			{
+				if (!mRenderers[i]->SetShaderPrograms(pVertexProgram, pPixelProgram))
+					return false;
+			}
+			return true;
+		}
+
+		void BatchRenderer::SetLightConstants(const ConstantBuffer<LightConstants>* pBuffer)
+		{
+			for (auto i = 0; i < mRenderers.Size(); i++)
+				mRenderers[i]->SetLightConstants(pBuffer);
+		}
+
+		void BatchRenderer::SetMSAAMode(const int msaaCountLog2)
+		{
+			for (auto i = 0; i < mRenderers.Size(); i++)
+				mRenderers[i]->SetMSAAMode(msaaCountLog2);
+		}
+
+		void BatchRenderer::SetTextureFilter(const TextureFilter filter)
+		{
+			for (auto i = 0; i < mRenderers.Size(); i++)
+				mRenderers[i]->SetTextureFilter(filter);
+		}
+
+		void BatchRenderer::SetHierarchicalRasterize(const bool hRas)
+		{
+			for (auto i = 0; i < mRenderers.Size(); i++)
+				mRenderers[i]->SetHierarchicalRasterize(hRas);
+		}
+	}
+}
\ No newline at end of file
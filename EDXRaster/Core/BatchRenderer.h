@@ -0,0 +1,67 @@
+#pragma once
+
+#include "EDXPrerequisites.h"
+#include "Renderer.h"
+#include "WorkerPool.h"
+
+#include <mutex>
+#include <condition_variable>
+
+namespace EDX
+{
+	namespace RasterRenderer
+	{
+		// One frame of a batch. The image goes to pColorBuffer, width * height Color4b laid out like
+		// Renderer::GetBackBuffer
+		struct BatchFrame
+		{
+			Matrix ModelView;
+			Matrix Proj;
+			Matrix ToRaster;
+			_byte* pColorBuffer;
+		};
+
+		// Renders many small frames of the same mesh with one frame per thread rather than the tiles of one
+		// frame spread over all threads. Frames of a few dozen tiles cost more in fork and join than in work
+		// when every stage is split up, so each thread renders whole frames on a renderer of its own whose
+		// stages stay on that thread. The mesh and its textures are only read and shared by all frames
+		class BatchRenderer
+		{
+		private:
+			Array<UniquePtr<Renderer>> mRenderers;	// One for each thread that can work on the batch at once
+			Array<int> mFreeRenderers;
+			std::mutex mLock;
+			std::condition_variable mRendererFreed;
+
+			WorkContext mWorkContext;
+			uint mWidth, mHeight;
+
+		public:
+			BatchRenderer(const uint width,
+				const uint height,
+				WorkerPool* pWorkerPool = WorkerPool::Instance(),
+				const WorkContextDesc& desc = WorkContextDesc());
+
+			// Returns once every frame has been written to its buffer. Batches from several threads at once share
+			// the renderers, a frame waits when all of them are busy
+			void RenderBatch(const Mesh& mesh, const BatchFrame* pFrames, const int frameCount);
+
+			// Settings apply to every frame of later batches
+			template<typename VertexShaderType, typename PixelShaderType>
+			void SetShaders()
+			{
+				for (auto i = 0; i < mRenderers.Size(); i++)
+					mRenderers[i]->SetShaders<VertexShaderType, PixelShaderType>();
+			}
+			bool SetShaderPrograms(const std::shared_ptr<const ShaderProgram>& pVertexProgram, const std::shared_ptr<const ShaderProgram>& pPixelProgram);
+			void SetLightConstants(const ConstantBuffer<LightConstants>* pBuffer);
+			void SetMSAAMode(const int msaaCountLog2);
+			void SetTextureFilter(const TextureFilter filter);
+			void SetHierarchicalRasterize(const bool hRas);
+			void SetWorkContextDesc(const WorkContextDesc& desc) { mWorkContext.SetDesc(desc); }
+
+			uint GetWidth() const { return mWidth; }
+			uint GetHeight() const { return mHeight; }
+		};
+	}
+}
\ No newline at end of file
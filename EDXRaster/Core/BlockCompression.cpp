@@ -0,0 +1,544 @@
+#include "BlockCompression.h"
+
+namespace EDX
+{
+	namespace RasterRenderer
+	{
+		namespace
+		{
+			struct BC7ModeInfo
+			{
+				uint SubsetCount;
+				uint PartitionBits;
+				uint RotationBits;
+				uint IndexSelectionBits;
+				uint ColorBits;
+				uint AlphaBits;
+				uint EndpointPBits;
+				uint SharedPBits;
+				uint IndexBits;
+				uint SecondaryIndexBits;
+			};
+
+			const BC7ModeInfo BC7_MODES[8] =
+			{
+				{ 3, 4, 0, 0, 4, 0, 1, 0, 3, 0 },
+				{ 2, 6, 0, 0, 6, 0, 0, 1, 3, 0 },
+				{ 3, 6, 0, 0, 5, 0, 0, 0, 2, 0 },
+				{ 2, 6, 0, 0, 7, 0, 1, 0, 2, 0 },
+				{ 1, 0, 2, 1, 5, 6, 0, 0, 2, 3 },
+				{ 1, 0, 2, 0, 7, 8, 0, 0, 2, 2 },
+				{ 1, 0, 0, 0, 7, 7, 1, 0, 4, 0 },
+				{ 2, 6, 0, 0, 5, 5, 1, 0, 2, 0 }
+			};
+
+			// One bit per texel selecting the subset
+			const ushort BC7_PARTITIONS_2[64] =
+			{
+				0xcccc, 0x8888, 0xeeee, 0xecc8, 0xc880, 0xfeec, 0xfec8, 0xec80,
+				0xc800, 0xffec, 0xfe80, 0xe800, 0xffe8, 0xff00, 0xfff0, 0xf000,
+				0xf710, 0x008e, 0x7100, 0x08ce, 0x008c, 0x7310, 0x3100, 0x8cce,
+				0x088c, 0x3110, 0x6666, 0x366c, 0x17e8, 0x0ff0, 0x718e, 0x399c,
+				0xaaaa, 0xf0f0, 0x5a5a, 0x33cc, 0x3c3c, 0x55aa, 0x9696, 0xa55a,
+				0x73ce, 0x13c8, 0x324c, 0x3bdc, 0x6996, 0xc33c, 0x9966, 0x0660,
+				0x0272, 0x04e4, 0x4e40, 0x2720, 0xc936, 0x936c, 0x39c6, 0x639c,
+				0x9336, 0x9cc6, 0x817e, 0xe718, 0xccf0, 0x0fcc, 0x7744, 0xee22
+			};
+
+			// Two bits per texel selecting the subset
+			const uint BC7_PARTITIONS_3[64] =
+			{
+				0xaa685050, 0x6a5a5040, 0x5a5a4200, 0x5450a0a8, 0xa5a50000, 0xa0a05050, 0x5555a0a0, 0x5a5a5050,
+				0xaa550000, 0xaa555500, 0xaaaa5500, 0x90909090, 0x94949494, 0xa4a4a4a4, 0xa9a59450, 0x2a0a4250,
+				0xa5945040, 0x0a425054, 0xa5a5a500, 0x55a0a0a0, 0xa8a85454, 0x6a6a4040, 0xa4a45000, 0x1a1a0500,
+				0x0050a4a4, 0xaaa59090, 0x14696914, 0x69691400, 0xa08585a0, 0xaa821414, 0x50a4a450, 0x6a5a0200,
+				0xa9a58000, 0x5090a0a8, 0xa8a09050, 0x24242424, 0x00aa5500, 0x24924924, 0x24499224, 0x50a50a50,
+				0x500aa550, 0xaaaa4444, 0x66660000, 0xa5a0a5a0, 0x50a050a0, 0x69286928, 0x44aaaa44, 0x66666600,
+				0xaa444444, 0x54a854a8, 0x95809580, 0x96969600, 0xa85454a8, 0x80959580, 0xaa141414, 0x96960000,
+				0xaaaa1414, 0xa05050a0, 0xa0a5a5a0, 0x96000000, 0x40804080, 0xa9a8a9a8, 0xaaaaaa44, 0x2a4a5254
+			};
+
+			// Texels whose index has an implicit zero top bit, the first subset always anchors at texel 0
+			const _byte BC7_ANCHORS_2[64] =
+			{
+				15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+				15, 2, 8, 2, 2, 8, 8, 15, 2, 8, 2, 2, 8, 8, 2, 2,
+				15, 15, 6, 8, 2, 8, 15, 15, 2, 8, 2, 2, 2, 15, 15, 6,
+				6, 2, 6, 8, 15, 15, 2, 2, 15, 15, 15, 15, 15, 2, 2, 15
+			};
+
+			const _byte BC7_ANCHORS_3_SECOND[64] =
+			{
+				3, 3, 15, 15, 8, 3, 15, 15, 8, 8, 6, 6, 6, 5, 3, 3,
+				3, 3, 8, 15, 3, 3, 6, 10, 5, 8, 8, 6, 8, 5, 15, 15,
+				8, 15, 3, 5, 6, 10, 8, 15, 15, 3, 15, 5, 15, 15, 15, 15,
+				3, 15, 5, 5, 5, 8, 5, 10, 5, 10, 8, 13, 15, 12, 3, 3
+			};
+
+			const _byte BC7_ANCHORS_3_THIRD[64] =
+			{
+				15, 8, 8, 3, 15, 15, 3, 8, 15, 15, 15, 15, 15, 15, 15, 8,
+				15, 8, 15, 3, 15, 8, 15, 8, 3, 15, 6, 10, 15, 15, 10, 8,
+				15, 3, 15, 10, 10, 8, 9, 10, 6, 15, 8, 15, 3, 6, 6, 8,
+				15, 3, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 3, 15, 15, 8
+			};
+
+			const _byte BC7_WEIGHTS_2[4] = { 0, 21, 43, 64 };
+			const _byte BC7_WEIGHTS_3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+			const _byte BC7_WEIGHTS_4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+			class BitReader
+			{
+			private:
+				const _byte* mpData;
+				uint mPosition;
+
+			public:
+				BitReader(const _byte* pData)
+					: mpData(pData)
+					, mPosition(0)
+				{
+				}
+
+				uint Read(const uint count)
+				{
+					uint ret = 0;
+					for (auto i = 0; i < count; i++)
+					{
+						ret |= ((mpData[mPosition >> 3] >> (mPosition & 7)) & 1) << i;
+						mPosition++;
+					}
+
+					return ret;
+				}
+			};
+
+			__forceinline _byte Interpolate(const uint e0, const uint e1, const uint index, const uint indexBits)
+			{
+				const _byte* pWeights = indexBits == 2 ? BC7_WEIGHTS_2 : (indexBits == 3 ? BC7_WEIGHTS_3 : BC7_WEIGHTS_4);
+				const uint weight = pWeights[index];
+				return _byte(((64 - weight) * e0 + weight * e1 + 32) >> 6);
+			}
+
+			__forceinline Color4b Expand565(const uint color)
+			{
+				const uint r = (color >> 11) & 0x1f;
+				const uint g = (color >> 5) & 0x3f;
+				const uint b = color & 0x1f;
+				return Color4b((r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2), 255);
+			}
+
+			__forceinline ushort Quantize565(const float r, const float g, const float b)
+			{
+				const uint r5 = uint(Math::Clamp(r, 0.0f, 255.0f) * 31.0f / 255.0f + 0.5f);
+				const uint g6 = uint(Math::Clamp(g, 0.0f, 255.0f) * 63.0f / 255.0f + 0.5f);
+				const uint b5 = uint(Math::Clamp(b, 0.0f, 255.0f) * 31.0f / 255.0f + 0.5f);
+				return ushort((r5 << 11) | (g6 << 5) | b5);
+			}
+
+			__forceinline int ColorDistance(const Color4b& c0, const Color4b& c1)
+			{
+				const int dr = int(c0.r) - int(c1.r);
+				const int dg = int(c0.g) - int(c1.g);
+				const int db = int(c0.b) - int(c1.b);
+				return dr * dr + dg * dg + db * db;
+			}
+		}
+
+		void BlockCompression::DecodeBlock(const BlockFormat format, const _byte* pBlock, Color4b texels[16])
+		{
+			switch (format)
+			{
+			case BlockFormat::BC1:
+				DecodeColorBlock(pBlock, texels, true);
+				break;
+
+			case BlockFormat::BC3:
+			{
+				_byte alpha[16];
+				DecodeAlphaBlock(pBlock, alpha);
+				DecodeColorBlock(pBlock + 8, texels, false);
+				for (auto i = 0; i < 16; i++)
+					texels[i].a = alpha[i];
+				break;
+			}
+
+			case BlockFormat::BC5:
+			{
+				_byte red[16], green[16];
+				DecodeAlphaBlock(pBlock, red);
+				DecodeAlphaBlock(pBlock + 8, green);
+				for (auto i = 0; i < 16; i++)
+					texels[i] = Color4b(red[i], green[i], 0, 255);
+				break;
+			}
+
+			case BlockFormat::BC7:
+				DecodeBC7(pBlock, texels);
+				break;
+			}
+		}
+
+		void BlockCompression::DecodeColorBlock(const _byte* pBlock, Color4b texels[16], const bool allowPunchThrough)
+		{
+			const uint color0 = pBlock[0] | (pBlock[1] << 8);
+			const uint color1 = pBlock[2] | (pBlock[3] << 8);
+
+			Color4b palette[4];
+			palette[0] = Expand565(color0);
+			palette[1] = Expand565(color1);
+			if (color0 > color1 || !allowPunchThrough)
+			{
+				palette[2] = Color4b((2 * palette[0].r + palette[1].r) / 3, (2 * palette[0].g + palette[1].g) / 3, (2 * palette[0].b + palette[1].b) / 3, 255);
+				palette[3] = Color4b((palette[0].r + 2 * palette[1].r) / 3, (palette[0].g + 2 * palette[1].g) / 3, (palette[0].b + 2 * palette[1].b) / 3, 255);
+			}
+			else
+			{
+				palette[2] = Color4b((palette[0].r + palette[1].r) / 2, (palette[0].g + palette[1].g) / 2, (palette[0].b + palette[1].b) / 2, 255);
+				palette[3] = Color4b(0, 0, 0, 0);
+			}
+
+			const uint indices = pBlock[4] | (pBlock[5] << 8) | (pBlock[6] << 16) | (uint(pBlock[7]) << 24);
+			for (auto i = 0; i < 16; i++)
+				texels[i] = palette[(indices >> (2 * i)) & 3];
+		}
+
+		void BlockCompression::DecodeAlphaBlock(const _byte* pBlock, _byte values[16])
+		{
+			const uint alpha0 = pBlock[0];
+			const uint alpha1 = pBlock[1];
+
+			_byte palette[8];
+			palette[0] = alpha0;
+			palette[1] = alpha1;
+			if (alpha0 > alpha1)
+			{
+				for (auto i = 1; i < 7; i++)
+					palette[i + 1] = ((7 - i) * alpha0 + i * alpha1) / 7;
+			}
+			else
+			{
+				for (auto i = 1; i < 5; i++)
+					palette[i + 1] = ((5 - i) * alpha0 + i * alpha1) / 5;
+				palette[6] = 0;
+				palette[7] = 255;
+			}
+
+			uint64 indices = 0;
+			for (auto i = 0; i < 6; i++)
+				indices |= uint64(pBlock[2 + i]) << (8 * i);
+			for (auto i = 0; i < 16; i++)
+				values[i] = palette[(indices >> (3 * i)) & 7];
+		}
+
+		void BlockCompression::DecodeBC7(const _byte* pBlock, Color4b texels[16])
+		{
+			BitReader reader = BitReader(pBlock);
+
+			uint mode = 0;
+			while (mode < 8 && !reader.Read(1))
+				mode++;
+
+			// Reserved mode, decodes to transparent black
+			if (mode == 8)
+			{
+				for (auto i = 0; i < 16; i++)
+					texels[i] = Color4b(0, 0, 0, 0);
+				return;
+			}
+
+			const BC7ModeInfo& info = BC7_MODES[mode];
+			const uint partition = reader.Read(info.PartitionBits);
+			const uint rotation = reader.Read(info.RotationBits);
+			const uint indexSelection = reader.Read(info.IndexSelectionBits);
+
+			// Endpoints ordered subset by subset, two per subset
+			uint endpoints[6][4];
+			const uint endpointCount = info.SubsetCount * 2;
+			for (auto c = 0; c < 3; c++)
+			{
+				for (auto e = 0; e < endpointCount; e++)
+					endpoints[e][c] = reader.Read(info.ColorBits);
+			}
+			for (auto e = 0; e < endpointCount; e++)
+				endpoints[e][3] = info.AlphaBits ? reader.Read(info.AlphaBits) : 255;
+
+			uint colorBits = info.ColorBits;
+			uint alphaBits = info.AlphaBits;
+			if (info.EndpointPBits || info.SharedPBits)
+			{
+				uint pBits[6];
+				if (info.EndpointPBits)
+				{
+					for (auto e = 0; e < endpointCount; e++)
+						pBits[e] = reader.Read(1);
+				}
+				else
+				{
+					for (auto s = 0; s < info.SubsetCount; s++)
+						pBits[2 * s] = pBits[2 * s + 1] = reader.Read(1);
+				}
+
+				for (auto e = 0; e < endpointCount; e++)
+				{
+					for (auto c = 0; c < 3; c++)
+						endpoints[e][c] = (endpoints[e][c] << 1) | pBits[e];
+					if (alphaBits)
+						endpoints[e][3] = (endpoints[e][3] << 1) | pBits[e];
+				}
+				colorBits++;
+				if (alphaBits)
+					alphaBits++;
+			}
+
+			// Expand to 8 bits by replicating the top bits
+			for (auto e = 0; e < endpointCount; e++)
+			{
+				for (auto c = 0; c < 3; c++)
+				{
+					endpoints[e][c] <<= 8 - colorBits;
+					endpoints[e][c] |= endpoints[e][c] >> colorBits;
+				}
+				if (alphaBits)
+				{
+					endpoints[e][3] <<= 8 - alphaBits;
+					endpoints[e][3] |= endpoints[e][3] >> alphaBits;
+				}
+			}
+
+			uint subsets[16];
+			uint anchors[3] = { 0, 0, 0 };
+			for (auto i = 0; i < 16; i++)
+			{
+				if (info.SubsetCount == 1)
+					subsets[i] = 0;
+				else if (info.SubsetCount == 2)
+					subsets[i] = (BC7_PARTITIONS_2[partition] >> i) & 1;
+				else
+					subsets[i] = (BC7_PARTITIONS_3[partition] >> (2 * i)) & 3;
+			}
+			if (info.SubsetCount == 2)
+			{
+				anchors[1] = BC7_ANCHORS_2[partition];
+			}
+			else if (info.SubsetCount == 3)
+			{
+				anchors[1] = BC7_ANCHORS_3_SECOND[partition];
+				anchors[2] = BC7_ANCHORS_3_THIRD[partition];
+			}
+
+			uint indices[16];
+			for (auto i = 0; i < 16; i++)
+				indices[i] = reader.Read(info.IndexBits - (i == anchors[subsets[i]] ? 1 : 0));
+
+			uint secondaryIndices[16];
+			if (info.SecondaryIndexBits)
+			{
+				for (auto i = 0; i < 16; i++)
+					secondaryIndices[i] = reader.Read(info.SecondaryIndexBits - (i == 0 ? 1 : 0));
+			}
+
+			for (auto i = 0; i < 16; i++)
+			{
+				const uint* pEndpoint0 = endpoints[2 * subsets[i]];
+				const uint* pEndpoint1 = endpoints[2 * subsets[i] + 1];
+
+				// Modes with separate alpha indices may swap which set drives color
+				uint colorIndex = indices[i], colorIndexBits = info.IndexBits;
+				uint alphaIndex = indices[i], alphaIndexBits = info.IndexBits;
+				if (info.SecondaryIndexBits)
+				{
+					if (indexSelection)
+					{
+						colorIndex = secondaryIndices[i];
+						colorIndexBits = info.SecondaryIndexBits;
+					}
+					else
+					{
+						alphaIndex = secondaryIndices[i];
+						alphaIndexBits = info.SecondaryIndexBits;
+					}
+				}
+
+				_byte channels[4];
+				for (auto c = 0; c < 3; c++)
+					channels[c] = Interpolate(pEndpoint0[c], pEndpoint1[c], colorIndex, colorIndexBits);
+				channels[3] = Interpolate(pEndpoint0[3], pEndpoint1[3], alphaIndex, alphaIndexBits);
+
+				if (rotation)
+					Swap(channels[3], channels[rotation - 1]);
+
+				texels[i] = Color4b(channels[0], channels[1], channels[2], channels[3]);
+			}
+		}
+
+		void BlockCompression::EncodeBlock(const BlockFormat format, const Color4b texels[16], _byte* pBlock)
+		{
+			Assert(CanEncode(format));
+
+			switch (format)
+			{
+			case BlockFormat::BC1:
+				EncodeColorBlock(texels, pBlock);
+				break;
+
+			case BlockFormat::BC3:
+			{
+				_byte alpha[16];
+				for (auto i = 0; i < 16; i++)
+					alpha[i] = texels[i].a;
+				EncodeAlphaBlock(alpha, pBlock);
+				EncodeColorBlock(texels, pBlock + 8);
+				break;
+			}
+
+			case BlockFormat::BC5:
+			{
+				_byte red[16], green[16];
+				for (auto i = 0; i < 16; i++)
+				{
+					red[i] = texels[i].r;
+					green[i] = texels[i].g;
+				}
+				EncodeAlphaBlock(red, pBlock);
+				EncodeAlphaBlock(green, pBlock + 8);
+				break;
+			}
+			}
+		}
+
+		void BlockCompression::EncodeColorBlock(const Color4b texels[16], _byte* pBlock)
+		{
+			// Fit endpoints along the principal axis of the block's colors
+			float mean[3] = { 0.0f, 0.0f, 0.0f };
+			for (auto i = 0; i < 16; i++)
+			{
+				mean[0] += texels[i].r;
+				mean[1] += texels[i].g;
+				mean[2] += texels[i].b;
+			}
+			for (auto c = 0; c < 3; c++)
+				mean[c] /= 16.0f;
+
+			float covariance[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+			for (auto i = 0; i < 16; i++)
+			{
+				const float r = texels[i].r - mean[0];
+				const float g = texels[i].g - mean[1];
+				const float b = texels[i].b - mean[2];
+				covariance[0] += r * r;
+				covariance[1] += r * g;
+				covariance[2] += r * b;
+				covariance[3] += g * g;
+				covariance[4] += g * b;
+				covariance[5] += b * b;
+			}
+
+			float axis[3] = { 1.0f, 1.0f, 1.0f };
+			for (auto iter = 0; iter < 8; iter++)
+			{
+				const float x = covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2];
+				const float y = covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2];
+				const float z = covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2];
+				const float len = Math::Max(Math::Max(Math::Abs(x), Math::Abs(y)), Math::Abs(z));
+				if (len <= 0.0f)
+					break;
+
+				axis[0] = x / len;
+				axis[1] = y / len;
+				axis[2] = z / len;
+			}
+
+			float minProj = 1e30f, maxProj = -1e30f;
+			const float axisLenSqr = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+			for (auto i = 0; i < 16; i++)
+			{
+				const float proj = ((texels[i].r - mean[0]) * axis[0] + (texels[i].g - mean[1]) * axis[1] + (texels[i].b - mean[2]) * axis[2]) / axisLenSqr;
+				minProj = Math::Min(minProj, proj);
+				maxProj = Math::Max(maxProj, proj);
+			}
+
+			ushort color0 = Quantize565(mean[0] + maxProj * axis[0], mean[1] + maxProj * axis[1], mean[2] + maxProj * axis[2]);
+			ushort color1 = Quantize565(mean[0] + minProj * axis[0], mean[1] + minProj * axis[1], mean[2] + minProj * axis[2]);
+
+			// The four color mode needs color0 > color1
+			if (color0 < color1)
+				Swap(color0, color1);
+
+			uint indices = 0;
+			if (color0 != color1)
+			{
+				Color4b palette[4];
+				palette[0] = Expand565(color0);
+				palette[1] = Expand565(color1);
+				palette[2] = Color4b((2 * palette[0].r + palette[1].r) / 3, (2 * palette[0].g + palette[1].g) / 3, (2 * palette[0].b + palette[1].b) / 3, 255);
+				palette[3] = Color4b((palette[0].r + 2 * palette[1].r) / 3, (palette[0].g + 2 * palette[1].g) / 3, (palette[0].b + 2 * palette[1].b) / 3, 255);
+
+				for (auto i = 0; i < 16; i++)
+				{
+					uint best = 0;
+					int bestDist = ColorDistance(texels[i], palette[0]);
+					for (auto j = 1; j < 4; j++)
+					{
+						const int dist = ColorDistance(texels[i], palette[j]);
+						if (dist < bestDist)
+						{
+							best = j;
+							bestDist = dist;
+						}
+					}
+					indices |= best << (2 * i);
+				}
+			}
+
+			pBlock[0] = color0 & 0xff;
+			pBlock[1] = color0 >> 8;
+			pBlock[2] = color1 & 0xff;
+			pBlock[3] = color1 >> 8;
+			for (auto i = 0; i < 4; i++)
+				pBlock[4 + i] = (indices >> (8 * i)) & 0xff;
+		}
+
+		void BlockCompression::EncodeAlphaBlock(const _byte values[16], _byte* pBlock)
+		{
+			uint alpha0 = 0, alpha1 = 255;
+			for (auto i = 0; i < 16; i++)
+			{
+				alpha0 = Math::Max(alpha0, uint(values[i]));
+				alpha1 = Math::Min(alpha1, uint(values[i]));
+			}
+
+			uint64 indices = 0;
+			if (alpha0 != alpha1)
+			{
+				// Eight value mode, alpha0 > alpha1
+				_byte palette[8];
+				palette[0] = alpha0;
+				palette[1] = alpha1;
+				for (auto i = 1; i < 7; i++)
+					palette[i + 1] = ((7 - i) * alpha0 + i * alpha1) / 7;
+
+				for (auto i = 0; i < 16; i++)
+				{
+					uint best = 0;
+					int bestDist = Math::Abs(int(values[i]) - int(palette[0]));
+					for (auto j = 1; j < 8; j++)
+					{
+						const int dist = Math::Abs(int(values[i]) - int(palette[j]));
+						if (dist < bestDist)
+						{
+							best = j;
+							bestDist = dist;
+						}
+					}
+					indices |= uint64(best) << (3 * i);
+				}
+			}
+
+			pBlock[0] = alpha0;
+			pBlock[1] = alpha1;
+			for (auto i = 0; i < 6; i++)
+				pBlock[2 + i] = (indices >> (8 * i)) & 0xff;
+		}
+	}
+}
\ No newline at end of file
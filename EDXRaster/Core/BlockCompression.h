@@ -0,0 +1,45 @@
+#pragma once
+
+#include "EDXPrerequisites.h"
+#include "Graphics/Color.h"
+
+namespace EDX
+{
+	namespace RasterRenderer
+	{
+		enum class BlockFormat
+		{
+			BC1,
+			BC3,
+			BC5,
+			BC7
+		};
+
+		// Decoding and encoding of single 4x4 BCn blocks, texels are in row major order
+		class BlockCompression
+		{
+		public:
+			static uint BlockSize(const BlockFormat format)
+			{
+				return format == BlockFormat::BC1 ? 8 : 16;
+			}
+
+			static void DecodeBlock(const BlockFormat format, const _byte* pBlock, Color4b texels[16]);
+
+			// BC7 can only be loaded, there is no encoder for it
+			static bool CanEncode(const BlockFormat format)
+			{
+				return format != BlockFormat::BC7;
+			}
+			static void EncodeBlock(const BlockFormat format, const Color4b texels[16], _byte* pBlock);
+
+		private:
+			static void DecodeColorBlock(const _byte* pBlock, Color4b texels[16], const bool allowPunchThrough);
+			static void DecodeAlphaBlock(const _byte* pBlock, _byte values[16]);
+			static void DecodeBC7(const _byte* pBlock, Color4b texels[16]);
+
+			static void EncodeColorBlock(const Color4b texels[16], _byte* pBlock);
+			static void EncodeAlphaBlock(const _byte values[16], _byte* pBlock);
+		};
+	}
+}
\ No newline at end of file
@@ -1,7 +1,8 @@
 #pragma once
 
 #include "EDXPrerequisites.h"
-#include <ppl.h>
+#include "Math/BoundingBox.h"
+#include "WorkerPool.h"
 
 #define CLIP_ALL_PLANES 1
 
@@ -68,31 +69,70 @@ namespace EDX
 			}
 
 		public:
+			// True when the box lies entirely outside one of the planes in the clip space of clipMatrix
+			static bool IsBoxOutside(const BoundingBox& box, const Matrix& clipMatrix)
+			{
+				uint clipCode = ~0u;
+				for (auto i = 0; i < 8; i++)
+				{
+					const Vector4 corner = Vector4(i & 1 ? box.mMax.x : box.mMin.x,
+						i & 2 ? box.mMax.y : box.mMin.y,
+						i & 4 ? box.mMax.z : box.mMin.z,
+						1.0f);
+					clipCode &= ComputeClipCode(Matrix::TransformPoint(corner, clipMatrix));
+				}
+
+				return clipCode != 0;
+			}
+
+			// With a reprojection matrix the input positions are taken into another view's clip space first,
+			// the input buffer itself is left as it is. Instanced input holds instanceCount copies of the
+			// vertices one after another, each drawn with the index buffer and, unless pInstanceTexIds gives
+			// a slot of its own, the mesh's texture ids
 			static void Clip(Array<ProjectedVertex>& vertexBufferIn,
 				const IndexBuffer* pIndexBuf,
 				const Array<uint>& texIdBuf,
 				Array<ProjectedVertex>* pProjVertices,
 				Array<RasterTriangle>* pTrianglesBuf,
-				int numCores)
+				const Matrix& rasterMatrix,
+				const WorkContext& workers,
+				int numCores,
+				const Matrix* pReprojectMatrix = nullptr,
+				const int instanceCount = 1,
+				const int* pInstanceTexIds = nullptr)
 			{
-				concurrency::parallel_for(0, numCores, [&](int coreId)
+				const uint triangleCount = pIndexBuf->GetTriangleCount();
+				const uint instanceVertexCount = vertexBufferIn.Size() / instanceCount;
+				const uint totalCount = triangleCount * instanceCount;
+
+				workers.ParallelFor(0, numCores, [&](int coreId)
 				{
-					auto interval = (pIndexBuf->GetTriangleCount() + numCores - 1) / numCores;
+					auto interval = (totalCount + numCores - 1) / numCores;
 					auto startIdx = coreId * interval;
 					auto endIdx = (coreId + 1) * interval;
 
 					auto& currentVertexBuf = pProjVertices[coreId];
 
+					uint stripHint = 0;
 					for (auto i = startIdx; i < endIdx; i++)
 					{
-						if (i >= pIndexBuf->GetTriangleCount())
+						if (i >= totalCount)
 							return;
 
-						const uint* pIndex = pIndexBuf->GetIndex(i);
-						const Vector4& v0 = vertexBufferIn[pIndex[0]].projectedPos;
-						const Vector4& v1 = vertexBufferIn[pIndex[1]].projectedPos;
-						const Vector4& v2 = vertexBufferIn[pIndex[2]].projectedPos;
-						const uint texId = texIdBuf[i];
+						const uint instanceId = i / triangleCount;
+						const uint triId = i - instanceId * triangleCount;
+
+						uint pIndex[3];
+						pIndexBuf->GetIndex(triId, pIndex, &stripHint);
+						if (instanceId > 0)
+						{
+							const uint vertexOffset = instanceId * instanceVertexCount;
+							pIndex[0] += vertexOffset;
+							pIndex[1] += vertexOffset;
+							pIndex[2] += vertexOffset;
+						}
+
+						const uint texId = pInstanceTexIds && pInstanceTexIds[instanceId] >= 0 ? pInstanceTexIds[instanceId] : texIdBuf[triId];
 						int idx0 = currentVertexBuf.Size();
 						currentVertexBuf.Add(vertexBufferIn[pIndex[0]]);
 						int idx1 = currentVertexBuf.Size();
@@ -100,6 +140,20 @@ namespace EDX
 						int idx2 = currentVertexBuf.Size();
 						currentVertexBuf.Add(vertexBufferIn[pIndex[2]]);
 
+						if (pReprojectMatrix)
+						{
+							Vector4& pos0 = currentVertexBuf[idx0].projectedPos;
+							Vector4& pos1 = currentVertexBuf[idx1].projectedPos;
+							Vector4& pos2 = currentVertexBuf[idx2].projectedPos;
+							pos0 = Matrix::TransformPoint(pos0, *pReprojectMatrix);
+							pos1 = Matrix::TransformPoint(pos1, *pReprojectMatrix);
+							pos2 = Matrix::TransformPoint(pos2, *pReprojectMatrix);
+						}
+
+						const Vector4 v0 = currentVertexBuf[idx0].projectedPos;
+						const Vector4 v1 = currentVertexBuf[idx1].projectedPos;
+						const Vector4 v2 = currentVertexBuf[idx2].projectedPos;
+
 						uint clipCode0 = ComputeClipCode(v0);
 						uint clipCode1 = ComputeClipCode(v1);
 						uint clipCode2 = ComputeClipCode(v2);
@@ -163,7 +217,8 @@ namespace EDX
 										currentVertexBuf[clipVertIds[k]].projectedPos.HomogeneousProject(),
 										idx,
 										coreId,
-										texId))
+										texId,
+										rasterMatrix))
 									{
 										pTrianglesBuf[coreId].Add(tri);
 									}
@@ -180,7 +235,8 @@ namespace EDX
 							currentVertexBuf[idx2].projectedPos.HomogeneousProject(),
 							index,
 							coreId,
-							texId))
+							texId,
+							rasterMatrix))
 						{
 							pTrianglesBuf[coreId].Add(tri);
 						}
@@ -0,0 +1,589 @@
+#include "CompressedTexture.h"
+#include "Windows/Bitmap.h"
+#include "Core/Memory.h"
+
+#include <atomic>
+#include <stdio.h>
+#include <string.h>
+#include <ppl.h>
+
+namespace EDX
+{
+	namespace RasterRenderer
+	{
+		namespace
+		{
+			struct DDSPixelFormat
+			{
+				uint Size;
+				uint Flags;
+				uint FourCC;
+				uint RGBBitCount;
+				uint RBitMask, GBitMask, BBitMask, ABitMask;
+			};
+
+			struct DDSHeader
+			{
+				uint Size;
+				uint Flags;
+				uint Height;
+				uint Width;
+				uint PitchOrLinearSize;
+				uint Depth;
+				uint MipMapCount;
+				uint Reserved1[11];
+				DDSPixelFormat PixelFormat;
+				uint Caps, Caps2, Caps3, Caps4;
+				uint Reserved2;
+			};
+
+			struct DDSHeaderDX10
+			{
+				uint DXGIFormat;
+				uint ResourceDimension;
+				uint MiscFlag;
+				uint ArraySize;
+				uint MiscFlags2;
+			};
+
+			const uint DDS_MAGIC = 0x20534444; // "DDS "
+			const uint DDSD_MIPMAPCOUNT = 0x20000;
+			const uint DDPF_FOURCC = 0x4;
+
+			const uint DXGI_FORMAT_BC1_UNORM = 71;
+			const uint DXGI_FORMAT_BC1_UNORM_SRGB = 72;
+			const uint DXGI_FORMAT_BC3_UNORM = 77;
+			const uint DXGI_FORMAT_BC3_UNORM_SRGB = 78;
+			const uint DXGI_FORMAT_BC5_UNORM = 83;
+			const uint DXGI_FORMAT_BC7_UNORM = 98;
+			const uint DXGI_FORMAT_BC7_UNORM_SRGB = 99;
+
+			__forceinline uint MakeFourCC(const char c0, const char c1, const char c2, const char c3)
+			{
+				return uint(c0) | (uint(c1) << 8) | (uint(c2) << 16) | (uint(c3) << 24);
+			}
+
+			// Direct mapped, keyed by texture id, mip level and block index
+			struct DecodedBlockCache
+			{
+				static const uint ENTRY_COUNT = 64;
+
+				uint64 Keys[ENTRY_COUNT];
+				Color4b Texels[ENTRY_COUNT][16];
+			};
+
+			thread_local DecodedBlockCache tBlockCache;
+			std::atomic<uint> gNextTextureId(1);
+
+			// Reads the headers, the file is left at the data of the first level
+			FILE* OpenDDS(const char* path, BlockFormat* pFormat, uint* pWidth, uint* pHeight, uint* pMipCount)
+			{
+				FILE* pFile = nullptr;
+				if (fopen_s(&pFile, path, "rb") != 0 || !pFile)
+					return nullptr;
+
+				uint magic;
+				DDSHeader header;
+				if (fread(&magic, sizeof(magic), 1, pFile) != 1 || magic != DDS_MAGIC ||
+					fread(&header, sizeof(header), 1, pFile) != 1 || !(header.PixelFormat.Flags & DDPF_FOURCC))
+				{
+					fclose(pFile);
+					return nullptr;
+				}
+
+				bool supported = true;
+				const uint fourCC = header.PixelFormat.FourCC;
+				if (fourCC == MakeFourCC('D', 'X', 'T', '1'))
+					*pFormat = BlockFormat::BC1;
+				else if (fourCC == MakeFourCC('D', 'X', 'T', '5'))
+					*pFormat = BlockFormat::BC3;
+				else if (fourCC == MakeFourCC('A', 'T', 'I', '2') || fourCC == MakeFourCC('B', 'C', '5', 'U'))
+					*pFormat = BlockFormat::BC5;
+				else if (fourCC == MakeFourCC('D', 'X', '1', '0'))
+				{
+					DDSHeaderDX10 headerDX10;
+					if (fread(&headerDX10, sizeof(headerDX10), 1, pFile) != 1)
+						supported = false;
+					else if (headerDX10.DXGIFormat == DXGI_FORMAT_BC1_UNORM || headerDX10.DXGIFormat == DXGI_FORMAT_BC1_UNORM_SRGB)
+						*pFormat = BlockFormat::BC1;
+					else if (headerDX10.DXGIFormat == DXGI_FORMAT_BC3_UNORM || headerDX10.DXGIFormat == DXGI_FORMAT_BC3_UNORM_SRGB)
+						*pFormat = BlockFormat::BC3;
+					else if (headerDX10.DXGIFormat == DXGI_FORMAT_BC5_UNORM)
+						*pFormat = BlockFormat::BC5;
+					else if (headerDX10.DXGIFormat == DXGI_FORMAT_BC7_UNORM || headerDX10.DXGIFormat == DXGI_FORMAT_BC7_UNORM_SRGB)
+						*pFormat = BlockFormat::BC7;
+					else
+						supported = false;
+				}
+				else
+					supported = false;
+
+				if (!supported || header.Width == 0 || header.Height == 0)
+				{
+					fclose(pFile);
+					return nullptr;
+				}
+
+				*pWidth = header.Width;
+				*pHeight = header.Height;
+				*pMipCount = (header.Flags & DDSD_MIPMAPCOUNT) ? Math::Max(header.MipMapCount, 1u) : 1;
+				return pFile;
+			}
+		}
+
+		CompressedQuadTexture::CompressedQuadTexture(const char* path, const MipFilter mipFilter, const char* mipCachePath)
+			: mTextureId(gNextTextureId++)
+			, mUseBlockCache(true)
+			, mMipFilter(mipFilter)
+			, mResidentLevel(0)
+			, mPath(path)
+			, mMipCachePath(mipCachePath ? mipCachePath : "")
+		{
+			if (IsCompressedFile(path) && LoadDDS(path))
+				return;
+
+			if (!mMipCachePath.empty() && ReadMipCache())
+				return;
+
+			if (Import(path) && !mMipCachePath.empty())
+				WriteMipCache();
+		}
+
+		bool CompressedQuadTexture::IsCompressedFile(const char* path)
+		{
+			const size_t length = strlen(path);
+			return length > 4 && _stricmp(path + length - 4, ".dds") == 0;
+		}
+
+		bool CompressedQuadTexture::LoadDDS(const char* path)
+		{
+			uint mipCount, ddsWidth, ddsHeight;
+			FILE* pFile = OpenDDS(path, &mFormat, &ddsWidth, &ddsHeight, &mipCount);
+			if (!pFile)
+				return false;
+			mBlockSize = BlockCompression::BlockSize(mFormat);
+
+			int width = ddsWidth, height = ddsHeight;
+			for (auto i = 0; i < mipCount; i++)
+			{
+				MipLevel level;
+				level.Width = width;
+				level.Height = height;
+				level.BlockCountX = (width + 3) >> 2;
+				level.BlockCountY = (height + 3) >> 2;
+				level.Blocks.Resize(level.BlockCountX * level.BlockCountY * mBlockSize);
+				if (fread(level.Blocks.Data(), 1, level.Blocks.Size(), pFile) != level.Blocks.Size())
+				{
+					fclose(pFile);
+					mLevels.Clear();
+					return false;
+				}
+				mLevels.Add(level);
+
+				if (width == 1 && height == 1)
+					break;
+				width = Math::Max(width >> 1, 1);
+				height = Math::Max(height >> 1, 1);
+			}
+			fclose(pFile);
+
+			CompleteMipChain();
+			return true;
+		}
+
+		bool CompressedQuadTexture::LoadDDSLevels(const int firstLevel, const int endLevel, MipChain& levels) const
+		{
+			BlockFormat format;
+			uint mipCount, width, height;
+			FILE* pFile = OpenDDS(mPath.c_str(), &format, &width, &height, &mipCount);
+			if (!pFile)
+				return false;
+
+			// The file may have changed since the texture was created
+			if (format != mFormat || int(width) != Width() || int(height) != Height())
+			{
+				fclose(pFile);
+				return false;
+			}
+			const int storedCount = Math::Min(int(mipCount), int(mLevels.Size()));
+
+			// Levels the file does not store are generated again from the smallest stored one
+			const bool generate = endLevel > storedCount;
+			const int readFirst = generate ? Math::Min(firstLevel, storedCount - 1) : firstLevel;
+			const int readEnd = generate ? storedCount : endLevel;
+			for (auto i = 0; i < readEnd; i++)
+			{
+				const size_t size = GetLevelMemorySize(i);
+				if (i < readFirst)
+				{
+					if (_fseeki64(pFile, __int64(size), SEEK_CUR) != 0)
+					{
+						fclose(pFile);
+						return false;
+					}
+					continue;
+				}
+
+				Array<_byte>& blocks = levels.Levels[i].Data;
+				blocks.Resize(size);
+				if (fread(blocks.Data(), 1, size, pFile) != size)
+				{
+					fclose(pFile);
+					return false;
+				}
+			}
+			fclose(pFile);
+
+			if (generate)
+			{
+				Array<Color4b> texels;
+				DecodeBlocks(levels.Levels[storedCount - 1].Data.Data(), LevelWidth(storedCount - 1), LevelHeight(storedCount - 1), texels);
+				if (storedCount - 1 < firstLevel)
+					levels.Levels[storedCount - 1].Data.Clear();
+
+				for (auto i = storedCount; i < endLevel; i++)
+				{
+					Array<Color4b> nextLevel;
+					MipGenerator::Downsample(texels.Data(), LevelWidth(i - 1), LevelHeight(i - 1), nextLevel, mMipFilter);
+					texels = nextLevel;
+
+					if (i >= firstLevel)
+						EncodeBlocks(texels.Data(), LevelWidth(i), LevelHeight(i), levels.Levels[i].Data);
+				}
+			}
+
+			return true;
+		}
+
+		bool CompressedQuadTexture::Import(const char* path)
+		{
+			int width, height, channel;
+			Color4b* pTexels = Bitmap::ReadFromFile<Color4b>(path, &width, &height, &channel);
+			const bool loaded = pTexels != nullptr;
+
+			Array<Color4b> texels;
+			if (loaded)
+			{
+				texels.Resize(width * height);
+				memcpy(texels.Data(), pTexels, width * height * sizeof(Color4b));
+				Memory::SafeDeleteArray(pTexels);
+			}
+			else
+			{
+				width = height = 1;
+				texels.Resize(1);
+				texels[0] = Color4b(255, 255, 255);
+			}
+
+			mFormat = BlockFormat::BC1;
+			for (auto i = 0; i < texels.Size(); i++)
+			{
+				if (texels[i].a != 255)
+				{
+					mFormat = BlockFormat::BC3;
+					break;
+				}
+			}
+			mBlockSize = BlockCompression::BlockSize(mFormat);
+
+			// Mips are filtered from the uncompressed image, not from compressed levels
+			CompressLevel(texels.Data(), width, height);
+			while (width > 1 || height > 1)
+			{
+				Array<Color4b> nextLevel;
+				MipGenerator::Downsample(texels.Data(), width, height, nextLevel, mMipFilter);
+				width = Math::Max(width >> 1, 1);
+				height = Math::Max(height >> 1, 1);
+				texels = nextLevel;
+
+				CompressLevel(texels.Data(), width, height);
+			}
+
+			return loaded;
+		}
+
+		void CompressedQuadTexture::CompressLevel(const Color4b* pTexels, const int width, const int height)
+		{
+			MipLevel level;
+			level.Width = width;
+			level.Height = height;
+			level.BlockCountX = (width + 3) >> 2;
+			level.BlockCountY = (height + 3) >> 2;
+			EncodeBlocks(pTexels, width, height, level.Blocks);
+
+			mLevels.Add(level);
+		}
+
+		void CompressedQuadTexture::EncodeBlocks(const Color4b* pTexels, const int width, const int height, Array<_byte>& blocks) const
+		{
+			const int blockCountX = (width + 3) >> 2;
+			const int blockCountY = (height + 3) >> 2;
+			blocks.Resize(blockCountX * blockCountY * mBlockSize);
+
+			// Rows of blocks are encoded in parallel
+			concurrency::parallel_for(0, blockCountY, [&](int by)
+			{
+				for (auto bx = 0; bx < blockCountX; bx++)
+				{
+					// Partial blocks replicate the edge texels
+					Color4b block[16];
+					for (auto i = 0; i < 16; i++)
+					{
+						const int x = Math::Min(4 * bx + (i & 3), width - 1);
+						const int y = Math::Min(4 * by + (i >> 2), height - 1);
+						block[i] = pTexels[y * width + x];
+					}
+
+					BlockCompression::EncodeBlock(mFormat, block, &blocks[(by * blockCountX + bx) * mBlockSize]);
+				}
+			});
+		}
+
+		void CompressedQuadTexture::DecodeLevel(const int level, Array<Color4b>& texels) const
+		{
+			const MipLevel& mip = mLevels[level];
+			DecodeBlocks(mip.Blocks.Data(), mip.Width, mip.Height, texels);
+		}
+
+		void CompressedQuadTexture::DecodeBlocks(const _byte* pBlocks, const int width, const int height, Array<Color4b>& texels) const
+		{
+			const int blockCountX = (width + 3) >> 2;
+			const int blockCountY = (height + 3) >> 2;
+			texels.Resize(width * height);
+
+			for (auto by = 0; by < blockCountY; by++)
+			{
+				for (auto bx = 0; bx < blockCountX; bx++)
+				{
+					Color4b block[16];
+					BlockCompression::DecodeBlock(mFormat, &pBlocks[(by * blockCountX + bx) * mBlockSize], block);
+					for (auto i = 0; i < 16; i++)
+					{
+						const int x = 4 * bx + (i & 3);
+						const int y = 4 * by + (i >> 2);
+						if (x < width && y < height)
+							texels[y * width + x] = block[i];
+					}
+				}
+			}
+		}
+
+		void CompressedQuadTexture::CompleteMipChain()
+		{
+			// Files without a full chain get the missing levels generated from the smallest stored one
+			if (!BlockCompression::CanEncode(mFormat))
+				return;
+
+			const MipLevel& last = mLevels[mLevels.Size() - 1];
+			int width = last.Width, height = last.Height;
+			if (width == 1 && height == 1)
+				return;
+
+			Array<Color4b> texels;
+			DecodeLevel(mLevels.Size() - 1, texels);
+			while (width > 1 || height > 1)
+			{
+				Array<Color4b> nextLevel;
+				MipGenerator::Downsample(texels.Data(), width, height, nextLevel, mMipFilter);
+				width = Math::Max(width >> 1, 1);
+				height = Math::Max(height >> 1, 1);
+				texels = nextLevel;
+
+				CompressLevel(texels.Data(), width, height);
+			}
+		}
+
+		size_t CompressedQuadTexture::GetMemorySize() const
+		{
+			size_t size = 0;
+			for (auto i = 0; i < mLevels.Size(); i++)
+				size += mLevels[i].Blocks.Size();
+
+			return size;
+		}
+
+		bool CompressedQuadTexture::ReadMipCache()
+		{
+			MipChain chain;
+			if (!MipCache::Read(mMipCachePath.c_str(), chain) || chain.Kind != MipChainKind::Blocks || chain.Format > uint(BlockFormat::BC7))
+				return false;
+
+			mFormat = BlockFormat(chain.Format);
+			mBlockSize = BlockCompression::BlockSize(mFormat);
+			for (auto i = 0; i < chain.Levels.Size(); i++)
+			{
+				MipLevel level;
+				level.Width = chain.Levels[i].Width;
+				level.Height = chain.Levels[i].Height;
+				level.BlockCountX = (level.Width + 3) >> 2;
+				level.BlockCountY = (level.Height + 3) >> 2;
+				if (chain.Levels[i].Data.Size() != level.BlockCountX * level.BlockCountY * mBlockSize)
+				{
+					mLevels.Clear();
+					return false;
+				}
+
+				Swap(level.Blocks, chain.Levels[i].Data);
+				mLevels.Add(level);
+			}
+
+			return true;
+		}
+
+		void CompressedQuadTexture::WriteMipCache() const
+		{
+			MipChain chain;
+			chain.Kind = MipChainKind::Blocks;
+			chain.Format = uint(mFormat);
+			chain.Levels.Resize(mLevels.Size());
+			for (auto i = 0; i < mLevels.Size(); i++)
+			{
+				chain.Levels[i].Width = mLevels[i].Width;
+				chain.Levels[i].Height = mLevels[i].Height;
+				chain.Levels[i].Data = mLevels[i].Blocks;
+			}
+
+			MipCache::Write(mMipCachePath.c_str(), chain);
+		}
+
+		bool CompressedQuadTexture::LoadLevels(const int firstLevel, const int endLevel, MipChain& levels) const
+		{
+			levels.Kind = MipChainKind::Blocks;
+			levels.Format = uint(mFormat);
+			levels.Levels.Resize(mLevels.Size());
+			for (auto i = 0; i < mLevels.Size(); i++)
+			{
+				levels.Levels[i].Width = mLevels[i].Width;
+				levels.Levels[i].Height = mLevels[i].Height;
+				levels.Levels[i].Data.Clear();
+			}
+
+			if (IsCompressedFile(mPath.c_str()))
+				return LoadDDSLevels(firstLevel, endLevel, levels);
+
+			if (!mMipCachePath.empty() && MipCache::ReadLevels(mMipCachePath.c_str(), firstLevel, endLevel, levels))
+				return levels.Kind == MipChainKind::Blocks && levels.Format == uint(mFormat);
+
+			// Without a cached chain the image is decoded again, but filtering stops at the last level asked for
+			int width, height, channel;
+			Color4b* pTexels = Bitmap::ReadFromFile<Color4b>(mPath.c_str(), &width, &height, &channel);
+			if (!pTexels)
+				return false;
+
+			if (width != Width() || height != Height())
+			{
+				Memory::SafeDeleteArray(pTexels);
+				return false;
+			}
+
+			Array<Color4b> texels;
+			texels.Resize(width * height);
+			memcpy(texels.Data(), pTexels, width * height * sizeof(Color4b));
+			Memory::SafeDeleteArray(pTexels);
+
+			for (auto i = 0; i < endLevel; i++)
+			{
+				if (i > 0)
+				{
+					Array<Color4b> nextLevel;
+					MipGenerator::Downsample(texels.Data(), LevelWidth(i - 1), LevelHeight(i - 1), nextLevel, mMipFilter);
+					texels = nextLevel;
+				}
+
+				if (i >= firstLevel)
+					EncodeBlocks(texels.Data(), LevelWidth(i), LevelHeight(i), levels.Levels[i].Data);
+			}
+
+			return true;
+		}
+
+		bool CompressedQuadTexture::CommitLevels(MipChain& levels, const int firstLevel)
+		{
+			// The file may have changed since the texture was created
+			if (levels.Kind != MipChainKind::Blocks || levels.Format != uint(mFormat) || levels.Levels.Size() != mLevels.Size())
+				return false;
+
+			for (auto i = firstLevel; i < mResidentLevel; i++)
+			{
+				const MipChainLevel& level = levels.Levels[i];
+				if (level.Width != mLevels[i].Width || level.Height != mLevels[i].Height || level.Data.Size() != GetLevelMemorySize(i))
+					return false;
+			}
+
+			for (auto i = firstLevel; i < mResidentLevel; i++)
+				Swap(mLevels[i].Blocks, levels.Levels[i].Data);
+			mResidentLevel = Math::Min(mResidentLevel, firstLevel);
+
+			// Blocks decoded from the previous data must not be reused
+			mTextureId = gNextTextureId++;
+
+			return true;
+		}
+
+		void CompressedQuadTexture::EvictLevels(const int firstLevel)
+		{
+			// The coarsest level always stays resident
+			const int newResidentLevel = Math::Min(firstLevel, int(mLevels.Size()) - 1);
+			for (auto i = mResidentLevel; i < newResidentLevel; i++)
+				mLevels[i].Blocks.Clear();
+			mResidentLevel = Math::Max(mResidentLevel, newResidentLevel);
+		}
+
+		Vec3f_SSE CompressedQuadTexture::SampleQuad(const Vec2f_SSE& texCoord,
+			const Vector2& dUVdx,
+			const Vector2& dUVdy,
+			const SamplerState& sampler) const
+		{
+			return QuadFilter<CompressedQuadTexture>::Sample(*this, texCoord, dUVdx, dUVdy, sampler);
+		}
+
+		const Color4b* CompressedQuadTexture::DecodeCached(const int level, const int blockIdx) const
+		{
+			const uint64 key = (uint64(mTextureId) << 40) | (uint64(level) << 32) | uint(blockIdx);
+			const uint slot = uint((key * 0x9e3779b97f4a7c15ULL) >> 58);
+
+			if (tBlockCache.Keys[slot] != key)
+			{
+				const MipLevel& mip = mLevels[level];
+				BlockCompression::DecodeBlock(mFormat, &mip.Blocks[blockIdx * mBlockSize], tBlockCache.Texels[slot]);
+				tBlockCache.Keys[slot] = key;
+			}
+
+			return tBlockCache.Texels[slot];
+		}
+
+		int CompressedQuadTexture::FetchTexel(const int level, const int x, const int y) const
+		{
+			const MipLevel& mip = mLevels[level];
+			const int blockIdx = (y >> 2) * mip.BlockCountX + (x >> 2);
+			const int texelIdx = ((y & 3) << 2) | (x & 3);
+
+			if (mUseBlockCache)
+				return *(const int*)&DecodeCached(level, blockIdx)[texelIdx];
+
+			Color4b block[16];
+			BlockCompression::DecodeBlock(mFormat, &mip.Blocks[blockIdx * mBlockSize], block);
+			return *(const int*)&block[texelIdx];
+		}
+
+		__m128i CompressedQuadTexture::FetchTexels(const int level, const __m128 x, const __m128 y) const
+		{
+			int xi[4], yi[4];
+			_mm_storeu_si128((__m128i*)xi, _mm_cvttps_epi32(x));
+			_mm_storeu_si128((__m128i*)yi, _mm_cvttps_epi32(y));
+
+			return _mm_setr_epi32(FetchTexel(level, xi[0], yi[0]),
+				FetchTexel(level, xi[1], yi[1]),
+				FetchTexel(level, xi[2], yi[2]),
+				FetchTexel(level, xi[3], yi[3]));
+		}
+
+		void CompressedQuadTexture::FetchFootprint(const int level, const __m128 x0, const __m128 x1, const __m128 y0, const __m128 y1, __m128i texels[4]) const
+		{
+			texels[0] = FetchTexels(level, x0, y0);
+			texels[1] = FetchTexels(level, x1, y0);
+			texels[2] = FetchTexels(level, x0, y1);
+			texels[3] = FetchTexels(level, x1, y1);
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "EDXPrerequisites.h"
+#include "Texture.h"
+#include "BlockCompression.h"
+
+namespace EDX
+{
+	namespace RasterRenderer
+	{
+		// Keeps mip levels as BCn blocks, the sampler decodes only the blocks it touches
+		class CompressedQuadTexture : public QuadTexture
+		{
+		private:
+			struct MipLevel
+			{
+				int Width, Height;
+				int BlockCountX, BlockCountY;
+				Array<_byte> Blocks;
+			};
+
+			Array<MipLevel> mLevels;
+			BlockFormat mFormat;
+			uint mBlockSize;
+			uint mTextureId;
+			bool mUseBlockCache;
+			MipFilter mMipFilter;
+			int mResidentLevel;
+			string mPath;
+			string mMipCachePath; // Empty when imported chains are not cached on disk
+
+			friend class QuadFilter<CompressedQuadTexture>;
+
+		public:
+			// DDS files are loaded as stored, other images are compressed to BC1, or BC3 when they have alpha.
+			// Imported chains are loaded from the mip cache file when it holds one
+			CompressedQuadTexture(const char* path, const MipFilter mipFilter = MipFilter::Box, const char* mipCachePath = nullptr);
+
+			Vec3f_SSE SampleQuad(const Vec2f_SSE& texCoord,
+				const Vector2& dUVdx,
+				const Vector2& dUVdy,
+				const SamplerState& sampler) const;
+			size_t GetMemorySize() const;
+
+			int Width() const
+			{
+				return mLevels[0].Width;
+			}
+			int Height() const
+			{
+				return mLevels[0].Height;
+			}
+			BlockFormat GetFormat() const
+			{
+				return mFormat;
+			}
+
+			// Decoded blocks are kept in a small cache per sampling thread
+			void SetBlockCacheEnabled(const bool enabled)
+			{
+				mUseBlockCache = enabled;
+			}
+
+			int GetLevelCount() const
+			{
+				return mLevels.Size();
+			}
+			int GetResidentLevel() const
+			{
+				return mResidentLevel;
+			}
+			size_t GetLevelMemorySize(const int level) const
+			{
+				return mLevels[level].BlockCountX * mLevels[level].BlockCountY * mBlockSize;
+			}
+			bool LoadLevels(const int firstLevel, const int endLevel, MipChain& levels) const;
+			bool CommitLevels(MipChain& levels, const int firstLevel);
+			void EvictLevels(const int firstLevel);
+
+			static bool IsCompressedFile(const char* path);
+
+		private:
+			bool LoadDDS(const char* path);
+			bool LoadDDSLevels(const int firstLevel, const int endLevel, MipChain& levels) const;
+			bool Import(const char* path);
+			void CompressLevel(const Color4b* pTexels, const int width, const int height);
+			void EncodeBlocks(const Color4b* pTexels, const int width, const int height, Array<_byte>& blocks) const;
+			void DecodeLevel(const int level, Array<Color4b>& texels) const;
+			void DecodeBlocks(const _byte* pBlocks, const int width, const int height, Array<Color4b>& texels) const;
+			void CompleteMipChain();
+			bool ReadMipCache();
+			void WriteMipCache() const;
+
+			int LevelCount() const
+			{
+				return mLevels.Size();
+			}
+			int ResidentLevel() const
+			{
+				return mResidentLevel;
+			}
+			int LevelWidth(const int level) const
+			{
+				return mLevels[level].Width;
+			}
+			int LevelHeight(const int level) const
+			{
+				return mLevels[level].Height;
+			}
+			__m128i FetchTexels(const int level, const __m128 x, const __m128 y) const;
+			void FetchFootprint(const int level, const __m128 x0, const __m128 x1, const __m128 y0, const __m128 y1, __m128i texels[4]) const;
+
+			int FetchTexel(const int level, const int x, const int y) const;
+			const Color4b* DecodeCached(const int level, const int blockIdx) const;
+		};
+	}
+}
\ No newline at end of file
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "EDXPrerequisites.h"
+#include "Sampler.h"
+#include "Math/Matrix.h"
+#include "SIMD/SSE.h"
+#include "../Utils/TextureCache.h"
+
+namespace EDX
+{
+	namespace RasterRenderer
+	{
+		// Constant layouts follow HLSL cbuffer packing, no member straddles a 16 byte register
+		struct TransformConstants
+		{
+			Matrix ModelViewMatrix;
+			Matrix ProjMatrix;
+		};
+
+		struct LightConstants
+		{
+			Vector3 Direction; // Toward the light, need not be normalized
+			float Ambient;
+			float Intensity;
+
+			LightConstants()
+				: Direction(1.0f, 1.0f, -1.0f)
+				, Ambient(0.2f)
+				, Intensity(3.0f)
+			{
+			}
+		};
+
+		// Typed constants written by the application, the renderer reads whichever buffers are bound when a draw is issued
+		template<typename Constants>
+		class ConstantBuffer
+		{
+		private:
+			Constants mData;
+
+		public:
+			ConstantBuffer() {}
+			explicit ConstantBuffer(const Constants& data)
+				: mData(data)
+			{
+			}
+
+			void Update(const Constants& data) { mData = data; }
+			const Constants& GetData() const { return mData; }
+		};
+
+		// Per draw values shaders read, derived from the bound constant buffers once before the draw.
+		// Everything the pixel shaders use per quad is broadcast to all 4 lanes
+		struct TransformUniforms
+		{
+			Matrix ModelViewProjMatrix;
+			Matrix ModelViewInvMatrix;
+			Vec3f_SSE EyePos;
+
+			TransformUniforms() {}
+			explicit TransformUniforms(const TransformConstants& constants)
+				: ModelViewProjMatrix(constants.ProjMatrix * constants.ModelViewMatrix)
+				, ModelViewInvMatrix(Matrix::Inverse(constants.ModelViewMatrix))
+			{
+				EyePos = Vec3f_SSE(Matrix::TransformPoint(Vector3::ZERO, ModelViewInvMatrix));
+			}
+		};
+
+		struct LightUniforms
+		{
+			Vec3f_SSE Direction; // Normalized
+			FloatSSE Ambient;
+			FloatSSE Intensity;
+
+			LightUniforms() {}
+			explicit LightUniforms(const LightConstants& constants)
+				: Direction(Math::Normalize(constants.Direction))
+				, Ambient(constants.Ambient)
+				, Intensity(constants.Intensity)
+			{
+			}
+		};
+
+		struct DrawUniforms
+		{
+			TransformUniforms Transform;
+			LightUniforms Light;
+			const Array<TextureHandle>* pTextureSlots;
+			const SamplerState* pSampler;
+		};
+	}
+}
\ No newline at end of file
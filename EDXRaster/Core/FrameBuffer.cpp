@@ -2,9 +2,6 @@
 #include "Tile.h"
 #include "Math/EDXMath.h"
 
-#include <ppl.h>
-using namespace concurrency;
-
 namespace EDX
 {
 	namespace RasterRenderer
@@ -67,13 +64,26 @@ namespace EDX
 			return ret;
 		}
 
-		void FrameBuffer::Resolve()
+		BoolSSE FrameBuffer::ZTestQuadEqual(const FloatSSE& d, const int x, const int y, const uint sId) const
+		{
+			const int tileX = x >> Tile::SIZE_LOG_2;
+			const int tileY = y >> Tile::SIZE_LOG_2;
+			const DimensionalArray<3, FloatSSE>& currTileDepths = mTiledDepthBuffer[tileY * mTileDimX + tileX];
+
+			const int intraTileX = x & (Tile::SIZE - 1);
+			const int intraTileY = y & (Tile::SIZE - 1);
+			const FloatSSE& currDepth = currTileDepths[Vector3i(sId, intraTileX >> 1, (Tile::SIZE - 1 - intraTileY) >> 1)];
+
+			return d == currDepth;
+		}
+
+		void FrameBuffer::Resolve(const WorkContext& workers)
 		{
 			if (mSampleCount == 1)
 				return;
 
 			const float invSampleCount = 1.0f / float(mSampleCount);
-			parallel_for(0, (int)mColorBuffer.LinearSize(), [&](int i)
+			workers.ParallelFor(0, (int)mColorBuffer.LinearSize(), [&](int i)
 			{
 				const Vector2i idx = mColorBuffer.Index(i);
 				Color c = 0;
@@ -86,7 +96,7 @@ namespace EDX
 			});
 		}
 
-		void FrameBuffer::Clear(const bool clearColor, const bool clearDepth)
+		void FrameBuffer::Clear(const WorkContext& workers, const bool clearColor, const bool clearDepth)
 		{
 			if (clearColor)
 			{
@@ -94,8 +104,11 @@ namespace EDX
 				mColorBufferMS.Clear();
 			}
 
+			if (!clearDepth)
+				return;
+
 			int tileCount = mTileDimX * mTileDimY;
-			parallel_for(0, tileCount, [&](int i)
+			workers.ParallelFor(0, tileCount, [&](int i)
 			{
 				DimensionalArray<3, FloatSSE>& currTileDepths = mTiledDepthBuffer[i];
 
@@ -104,6 +117,26 @@ namespace EDX
 			});
 		}
 
+		void FrameBuffer::ReadDepth(float* pDepths) const
+		{
+			for (auto y = 0; y < mResY; y++)
+			{
+				for (auto x = 0; x < mResX; x++)
+				{
+					const int tileX = x >> Tile::SIZE_LOG_2;
+					const int tileY = y >> Tile::SIZE_LOG_2;
+					const DimensionalArray<3, FloatSSE>& currTileDepths = mTiledDepthBuffer[tileY * mTileDimX + tileX];
+
+					// Lanes step along x first, like the quads the rasterizer tests
+					const int intraTileX = x & (Tile::SIZE - 1);
+					const int intraTileY = y & (Tile::SIZE - 1);
+					const FloatSSE& quadDepth = currTileDepths[Vector3i(0, intraTileX >> 1, (Tile::SIZE - 1 - intraTileY) >> 1)];
+
+					pDepths[y * mResX + x] = quadDepth[(x & 1) + 2 * (y & 1)];
+				}
+			}
+		}
+
 		const int FrameBuffer::MultiSampleOffsets[][64] =
 		{
 			{
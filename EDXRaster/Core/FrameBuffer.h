@@ -4,6 +4,7 @@
 #include "Containers/DimensionalArray.h"
 #include "Graphics/Color.h"
 #include "SIMD/SSE.h"
+#include "WorkerPool.h"
 
 namespace EDX
 {
@@ -34,7 +35,8 @@ namespace EDX
 			void SetPixel(const Color4b& c, const int x, const int y, const uint sId);
 			bool ZTest(const float d, const int x, const int y, const uint sId);
 			BoolSSE ZTestQuad(const FloatSSE& d, const int x, const int y, const uint sId, const BoolSSE& mask);
-			void Resolve();
+			BoolSSE ZTestQuadEqual(const FloatSSE& d, const int x, const int y, const uint sId) const;
+			void Resolve(const WorkContext& workers);
 
 			uint GetSampleCount() const
 			{
@@ -57,7 +59,10 @@ namespace EDX
 				return mSampleCount == 1 ? (_byte*)mColorBufferMS.Data() : (_byte*)mColorBuffer.Data();
 			}
 
-			void Clear(const bool clearColor = true, const bool clearDepth = true);
+			void Clear(const WorkContext& workers, const bool clearColor = true, const bool clearDepth = true);
+
+			// First sample's depth of every pixel, row by row in the raster coordinates the depth test uses
+			void ReadDepth(float* pDepths) const;
 		};
 	}
 }
\ No newline at end of file
@@ -0,0 +1,303 @@
+#include "MipGenerator.h"
+#include "SIMD/SSE.h"
+
+#include <atomic>
+#include <stdio.h>
+#include <ppl.h>
+
+namespace EDX
+{
+	namespace RasterRenderer
+	{
+		namespace
+		{
+			__forceinline __m128 LoadTexel(const Color4b& texel)
+			{
+				const __m128i zero = _mm_setzero_si128();
+				const __m128i packed = _mm_cvtsi32_si128(*(const int*)&texel);
+				return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(packed, zero), zero));
+			}
+
+			__forceinline void StoreTexel(const __m128 value, Color4b& texel)
+			{
+				// Rounds to nearest, the saturating packs clamp the ringing of the filter
+				const __m128i rounded = _mm_cvtps_epi32(value);
+				const __m128i packed = _mm_packus_epi16(_mm_packs_epi32(rounded, rounded), rounded);
+				*(int*)&texel = _mm_cvtsi128_si32(packed);
+			}
+
+			// Zeroth order modified Bessel function of the first kind
+			float BesselI0(const float x)
+			{
+				float sum = 1.0f, term = 1.0f;
+				for (auto k = 1; k < 32; k++)
+				{
+					const float half = 0.5f * x / float(k);
+					term *= half * half;
+					sum += term;
+				}
+				return sum;
+			}
+
+			struct MipCacheHeader
+			{
+				uint Magic;
+				uint Version;
+				uint Kind;
+				uint Format;
+				uint LevelCount;
+			};
+
+			struct MipCacheLevelHeader
+			{
+				int Width, Height;
+				uint64 Size;
+			};
+
+			std::atomic<uint> gNextTempFileId(0);
+		}
+
+		void MipGenerator::Downsample(const Color4b* pSrc, const int srcWidth, const int srcHeight, Array<Color4b>& dst, const MipFilter filter)
+		{
+			const int dstWidth = Math::Max(srcWidth >> 1, 1);
+			const int dstHeight = Math::Max(srcHeight >> 1, 1);
+			dst.Resize(dstWidth * dstHeight);
+
+			auto filterRows = [&](const int firstRow, const int endRow)
+			{
+				if (filter == MipFilter::Kaiser)
+					DownsampleKaiserRows(pSrc, srcWidth, srcHeight, dst.Data(), dstWidth, firstRow, endRow);
+				else
+					DownsampleBoxRows(pSrc, srcWidth, srcHeight, dst.Data(), dstWidth, firstRow, endRow);
+			};
+
+			const int taskCount = (dstHeight + ROWS_PER_TASK - 1) / ROWS_PER_TASK;
+			if (taskCount == 1)
+			{
+				filterRows(0, dstHeight);
+				return;
+			}
+
+			concurrency::parallel_for(0, taskCount, [&](int taskId)
+			{
+				filterRows(taskId * ROWS_PER_TASK, Math::Min((taskId + 1) * ROWS_PER_TASK, dstHeight));
+			});
+		}
+
+		void MipGenerator::DownsampleBoxRows(const Color4b* pSrc, const int srcWidth, const int srcHeight, Color4b* pDst, const int dstWidth, const int firstRow, const int endRow)
+		{
+			const __m128i zero = _mm_setzero_si128();
+			const __m128i round = _mm_set1_epi16(2);
+
+			for (auto y = firstRow; y < endRow; y++)
+			{
+				const Color4b* pRow0 = pSrc + Math::Min(2 * y, srcHeight - 1) * srcWidth;
+				const Color4b* pRow1 = pSrc + Math::Min(2 * y + 1, srcHeight - 1) * srcWidth;
+				Color4b* pOut = pDst + y * dstWidth;
+
+				// Two output texels from 4x2 source texels per iteration, channels are summed in 16 bits
+				auto x = 0;
+				for (; x + 2 <= dstWidth; x += 2)
+				{
+					const __m128i row0 = _mm_loadu_si128((const __m128i*)(pRow0 + 2 * x));
+					const __m128i row1 = _mm_loadu_si128((const __m128i*)(pRow1 + 2 * x));
+					const __m128i left = _mm_add_epi16(_mm_unpacklo_epi8(row0, zero), _mm_unpacklo_epi8(row1, zero));
+					const __m128i right = _mm_add_epi16(_mm_unpackhi_epi8(row0, zero), _mm_unpackhi_epi8(row1, zero));
+					const __m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(left, right), _mm_unpackhi_epi64(left, right));
+					const __m128i average = _mm_srli_epi16(_mm_add_epi16(sum, round), 2);
+					_mm_storel_epi64((__m128i*)(pOut + x), _mm_packus_epi16(average, average));
+				}
+
+				// Odd widths and 1 texel wide sources clamp at the edge
+				for (; x < dstWidth; x++)
+				{
+					const int x0 = Math::Min(2 * x, srcWidth - 1);
+					const int x1 = Math::Min(2 * x + 1, srcWidth - 1);
+
+					const Color4b& c00 = pRow0[x0];
+					const Color4b& c01 = pRow0[x1];
+					const Color4b& c10 = pRow1[x0];
+					const Color4b& c11 = pRow1[x1];
+
+					pOut[x].r = (c00.r + c01.r + c10.r + c11.r + 2) >> 2;
+					pOut[x].g = (c00.g + c01.g + c10.g + c11.g + 2) >> 2;
+					pOut[x].b = (c00.b + c01.b + c10.b + c11.b + 2) >> 2;
+					pOut[x].a = (c00.a + c01.a + c10.a + c11.a + 2) >> 2;
+				}
+			}
+		}
+
+		void MipGenerator::DownsampleKaiserRows(const Color4b* pSrc, const int srcWidth, const int srcHeight, Color4b* pDst, const int dstWidth, const int firstRow, const int endRow)
+		{
+			const float* pWeights = KaiserWeights();
+			const int tapOffset = KAISER_TAP_COUNT / 2 - 1;
+
+			// Separable, source rows under the output rows are filtered horizontally first
+			const int firstSrcRow = 2 * firstRow - tapOffset;
+			const int srcRowCount = 2 * (endRow - firstRow) + KAISER_TAP_COUNT - 2;
+
+			Array<float> horizontal;
+			horizontal.Resize(srcRowCount * dstWidth * 4);
+			for (auto row = 0; row < srcRowCount; row++)
+			{
+				const Color4b* pRow = pSrc + Math::Clamp(firstSrcRow + row, 0, srcHeight - 1) * srcWidth;
+				float* pOut = &horizontal[row * dstWidth * 4];
+				for (auto x = 0; x < dstWidth; x++)
+				{
+					__m128 sum = _mm_setzero_ps();
+					for (auto k = 0; k < KAISER_TAP_COUNT; k++)
+					{
+						const int srcX = Math::Clamp(2 * x - tapOffset + k, 0, srcWidth - 1);
+						sum = _mm_add_ps(sum, _mm_mul_ps(LoadTexel(pRow[srcX]), _mm_set1_ps(pWeights[k])));
+					}
+					_mm_storeu_ps(pOut + 4 * x, sum);
+				}
+			}
+
+			for (auto y = firstRow; y < endRow; y++)
+			{
+				const float* pRows = &horizontal[(2 * (y - firstRow)) * dstWidth * 4];
+				Color4b* pOut = pDst + y * dstWidth;
+				for (auto x = 0; x < dstWidth; x++)
+				{
+					__m128 sum = _mm_setzero_ps();
+					for (auto k = 0; k < KAISER_TAP_COUNT; k++)
+						sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(pRows + (k * dstWidth + x) * 4), _mm_set1_ps(pWeights[k])));
+
+					StoreTexel(sum, pOut[x]);
+				}
+			}
+		}
+
+		const float* MipGenerator::KaiserWeights()
+		{
+			struct Weights
+			{
+				float Values[KAISER_TAP_COUNT];
+
+				Weights()
+				{
+					// Sinc at half the source rate, windowed over 2 output texels on each side
+					const float alpha = 4.0f;
+					const float width = 0.25f * KAISER_TAP_COUNT;
+
+					float sum = 0.0f;
+					for (auto k = 0; k < KAISER_TAP_COUNT; k++)
+					{
+						const float t = 0.5f * (k - 0.5f * (KAISER_TAP_COUNT - 1));
+						const float sinc = Math::EDX_PI * t;
+						const float ratio = t / width;
+						Values[k] = sinf(sinc) / sinc * BesselI0(alpha * Math::Sqrt(1.0f - ratio * ratio)) / BesselI0(alpha);
+						sum += Values[k];
+					}
+					for (auto k = 0; k < KAISER_TAP_COUNT; k++)
+						Values[k] /= sum;
+				}
+			};
+
+			static const Weights weights;
+			return weights.Values;
+		}
+
+		bool MipCache::Read(const char* path, MipChain& chain)
+		{
+			return ReadLevels(path, 0, MAX_LEVEL_COUNT, chain);
+		}
+
+		bool MipCache::ReadLevels(const char* path, const int firstLevel, const int endLevel, MipChain& chain)
+		{
+			FILE* pFile = nullptr;
+			if (fopen_s(&pFile, path, "rb") != 0 || !pFile)
+				return false;
+
+			MipCacheHeader header;
+			if (fread(&header, sizeof(header), 1, pFile) != 1 || header.Magic != MAGIC || header.Version != VERSION ||
+				header.LevelCount == 0 || header.LevelCount > MAX_LEVEL_COUNT)
+			{
+				fclose(pFile);
+				return false;
+			}
+
+			chain.Kind = MipChainKind(header.Kind);
+			chain.Format = header.Format;
+			chain.Levels.Resize(header.LevelCount);
+			for (auto i = 0; i < chain.Levels.Size(); i++)
+			{
+				// Sizes are checked before allocating, no level holds more than its texels padded to whole 4x4 tiles
+				MipCacheLevelHeader levelHeader;
+				if (fread(&levelHeader, sizeof(levelHeader), 1, pFile) != 1 ||
+					levelHeader.Width <= 0 || levelHeader.Width > 65536 || levelHeader.Height <= 0 || levelHeader.Height > 65536 ||
+					levelHeader.Size > uint64(levelHeader.Width + 3) * uint64(levelHeader.Height + 3) * sizeof(Color4b))
+				{
+					fclose(pFile);
+					return false;
+				}
+
+				MipChainLevel& level = chain.Levels[i];
+				level.Width = levelHeader.Width;
+				level.Height = levelHeader.Height;
+				level.Data.Clear();
+				if (i < firstLevel || i >= endLevel)
+				{
+					// Headers of the following levels are still read for their sizes
+					if (i + 1 < chain.Levels.Size() && _fseeki64(pFile, __int64(levelHeader.Size), SEEK_CUR) != 0)
+					{
+						fclose(pFile);
+						return false;
+					}
+					continue;
+				}
+
+				level.Data.Resize(size_t(levelHeader.Size));
+				if (fread(level.Data.Data(), 1, level.Data.Size(), pFile) != level.Data.Size())
+				{
+					fclose(pFile);
+					return false;
+				}
+			}
+			fclose(pFile);
+
+			return true;
+		}
+
+		bool MipCache::Write(const char* path, const MipChain& chain)
+		{
+			char tempPath[MAX_PATH];
+			sprintf_s(tempPath, MAX_PATH, "%s.%u.tmp", path, gNextTempFileId++);
+
+			FILE* pFile = nullptr;
+			if (fopen_s(&pFile, tempPath, "wb") != 0 || !pFile)
+				return false;
+
+			MipCacheHeader header;
+			header.Magic = MAGIC;
+			header.Version = VERSION;
+			header.Kind = uint(chain.Kind);
+			header.Format = chain.Format;
+			header.LevelCount = chain.Levels.Size();
+
+			bool succeeded = fwrite(&header, sizeof(header), 1, pFile) == 1;
+			for (auto i = 0; i < chain.Levels.Size() && succeeded; i++)
+			{
+				const MipChainLevel& level = chain.Levels[i];
+
+				MipCacheLevelHeader levelHeader;
+				levelHeader.Width = level.Width;
+				levelHeader.Height = level.Height;
+				levelHeader.Size = level.Data.Size();
+				succeeded = fwrite(&levelHeader, sizeof(levelHeader), 1, pFile) == 1 &&
+					fwrite(level.Data.Data(), 1, level.Data.Size(), pFile) == level.Data.Size();
+			}
+			succeeded = fclose(pFile) == 0 && succeeded;
+
+			// Another writer may have finished the same chain first
+			if (!succeeded || rename(tempPath, path) != 0)
+			{
+				remove(tempPath);
+				return false;
+			}
+
+			return true;
+		}
+	}
+}
\ No newline at end of file
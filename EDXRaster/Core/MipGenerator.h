@@ -0,0 +1,71 @@
+#pragma once
+
+#include "EDXPrerequisites.h"
+#include "Graphics/Color.h"
+
+namespace EDX
+{
+	namespace RasterRenderer
+	{
+		enum class MipFilter
+		{
+			Box, // 2x2 average
+			Kaiser // 8 tap Kaiser windowed sinc, sharper but may ring slightly
+		};
+
+		// SSE downsampling of RGBA8 images to the next mip level, rows of large levels are filtered in parallel
+		class MipGenerator
+		{
+		private:
+			static const int ROWS_PER_TASK = 32;
+			static const int KAISER_TAP_COUNT = 8;
+
+		public:
+			static void Downsample(const Color4b* pSrc, const int srcWidth, const int srcHeight, Array<Color4b>& dst, const MipFilter filter);
+
+		private:
+			static void DownsampleBoxRows(const Color4b* pSrc, const int srcWidth, const int srcHeight, Color4b* pDst, const int dstWidth, const int firstRow, const int endRow);
+			static void DownsampleKaiserRows(const Color4b* pSrc, const int srcWidth, const int srcHeight, Color4b* pDst, const int dstWidth, const int firstRow, const int endRow);
+			static const float* KaiserWeights();
+		};
+
+		enum class MipChainKind
+		{
+			Texels, // Format is the TexelLayout
+			Blocks // Format is the BlockFormat
+		};
+
+		struct MipChainLevel
+		{
+			int Width, Height;
+			Array<_byte> Data;
+		};
+
+		struct MipChain
+		{
+			MipChainKind Kind;
+			uint Format;
+			Array<MipChainLevel> Levels;
+		};
+
+		// Finished mip chains stored on disk. Callers name the files by the source content hash,
+		// so a file never has to be checked against its source image
+		class MipCache
+		{
+		private:
+			static const uint MAGIC = 0x4d584445; // "EDXM"
+			static const uint VERSION = 1;
+			static const int MAX_LEVEL_COUNT = 32;
+
+		public:
+			static bool Read(const char* path, MipChain& chain);
+
+			// Reads the data of levels [firstLevel, endLevel) only, the file is seeked past the others.
+			// Levels outside the range still get their size but no data
+			static bool ReadLevels(const char* path, const int firstLevel, const int endLevel, MipChain& chain);
+
+			// Written to a temporary file first, concurrent writers of the same chain do not corrupt it
+			static bool Write(const char* path, const MipChain& chain);
+		};
+	}
+}
\ No newline at end of file
@@ -0,0 +1,265 @@
+#pragma once
+
+#include "EDXPrerequisites.h"
+#include "Shader.h"
+#include "Sampler.h"
+#include "../Utils/InputBuffer.h"
+#include "Graphics/Color.h"
+#include "SIMD/SSE.h"
+#include "WorkerPool.h"
+
+#include <type_traits>
+
+namespace EDX
+{
+	namespace RasterRenderer
+	{
+		// Render state fixed when a pipeline is created
+		struct PipelineStateDesc
+		{
+			TextureFilter Filter;
+
+			explicit PipelineStateDesc(const TextureFilter filter = TextureFilter::TriLinear)
+				: Filter(filter)
+			{
+			}
+		};
+
+		// Shader stages of a draw, dispatched virtually once per draw instead of once per vertex or quad
+		class PipelineState
+		{
+		protected:
+			// Instances shaded from one decoded batch of vertices
+			static const int INSTANCE_BATCH_SIZE = 16;
+
+			PipelineStateDesc mDesc;
+			SamplerState mSampler;
+
+		public:
+			PipelineState(const PipelineStateDesc& desc)
+				: mDesc(desc)
+				, mSampler(desc.Filter)
+			{
+			}
+			virtual ~PipelineState() {}
+
+			// Shades the vertex buffer once for each instance, instance i filling vertices [i * vertexCount,
+			// (i + 1) * vertexCount) of vertexBuf. Without instances it is shaded once as it is
+			virtual void ProcessVertices(const IVertexBuffer* pVertexBuf,
+				const DrawUniforms& uniforms,
+				const VertexInstance* pInstances,
+				const int instanceCount,
+				const WorkContext& workers,
+				Array<ProjectedVertex>& vertexBuf) const = 0;
+			virtual void ShadeFragments(const Array<Fragment>& fragmentBuf,
+				const Array<ProjectedVertex>* pVertexBufs,
+				const DrawUniforms& uniforms,
+				const WorkContext& workers,
+				Array<Array<IntSSE>>& tiledResultBuf) const = 0;
+
+			// Same shaders with different render state
+			virtual UniquePtr<PipelineState> Recreate(const PipelineStateDesc& desc) const = 0;
+
+			const PipelineStateDesc& GetDesc() const { return mDesc; }
+			const SamplerState& GetSampler() const { return mSampler; }
+
+			template<typename VertexShaderType, typename PixelShaderType>
+			static UniquePtr<PipelineState> Create(const PipelineStateDesc& desc = PipelineStateDesc());
+		};
+
+		// The vertex and fragment loops instantiated for one shader combination, shader calls are
+		// qualified so they bind statically and inline into the loops
+		template<typename VertexShaderType, typename PixelShaderType>
+		class ShaderPipelineState : public PipelineState
+		{
+		private:
+			static const int VERTEX_BATCH_SIZE = 64;
+			static const int QUAD_BATCH_SIZE = 64;
+
+			VertexShaderType mVertexShader;
+			PixelShaderType mPixelShader;
+
+		public:
+			ShaderPipelineState(const PipelineStateDesc& desc)
+				: PipelineState(desc)
+			{
+			}
+
+			void ProcessVertices(const IVertexBuffer* pVertexBuf,
+				const DrawUniforms& uniforms,
+				const VertexInstance* pInstances,
+				const int instanceCount,
+				const WorkContext& workers,
+				Array<ProjectedVertex>& vertexBuf) const
+			{
+				const uint vertexCount = pVertexBuf->GetVertexCount();
+				vertexBuf.Resize(vertexCount * instanceCount);
+
+				// Derived from the uniforms once for the whole draw
+				typename VertexShaderType::DrawSetup setup;
+				VertexShaderType::Prepare(uniforms, &setup);
+
+				// Vertices are fetched in batches so that compressed formats can be decoded in bulk, and each
+				// batch is decoded once for several instances
+				const int batchCount = (vertexCount + VERTEX_BATCH_SIZE - 1) / VERTEX_BATCH_SIZE;
+				const int instanceBatchCount = (instanceCount + INSTANCE_BATCH_SIZE - 1) / INSTANCE_BATCH_SIZE;
+				workers.ParallelFor(0, batchCount * instanceBatchCount, [&](int taskId)
+				{
+					Vector3 positions[VERTEX_BATCH_SIZE];
+					Vector3 normals[VERTEX_BATCH_SIZE];
+					Vector2 texCoords[VERTEX_BATCH_SIZE];
+					Vector3 instancePositions[VERTEX_BATCH_SIZE];
+					Vector3 instanceNormals[VERTEX_BATCH_SIZE];
+
+					const int batchId = taskId % batchCount;
+					const uint startIdx = batchId * VERTEX_BATCH_SIZE;
+					const uint count = Math::Min(uint(VERTEX_BATCH_SIZE), vertexCount - startIdx);
+					pVertexBuf->DecodeVertices(startIdx, count, positions, normals, texCoords);
+
+					if (!pInstances)
+					{
+						ExecuteVertices(uniforms, setup, positions, normals, texCoords, count, &vertexBuf[startIdx]);
+						return;
+					}
+
+					const int firstInstance = taskId / batchCount * INSTANCE_BATCH_SIZE;
+					const int endInstance = Math::Min(firstInstance + INSTANCE_BATCH_SIZE, instanceCount);
+					for (auto instanceId = firstInstance; instanceId < endInstance; instanceId++)
+					{
+						pInstances[instanceId].Apply(positions, normals, count, instancePositions, instanceNormals);
+
+						ExecuteVertices(uniforms, setup, instancePositions, instanceNormals, texCoords, count, &vertexBuf[instanceId * vertexCount + startIdx]);
+					}
+				});
+			}
+
+			void ShadeFragments(const Array<Fragment>& fragmentBuf,
+				const Array<ProjectedVertex>* pVertexBufs,
+				const DrawUniforms& uniforms,
+				const WorkContext& workers,
+				Array<Array<IntSSE>>& tiledResultBuf) const
+			{
+				typename PixelShaderType::DrawSetup setup;
+				PixelShaderType::Prepare(uniforms, &setup);
+
+				// One task per batch of quads rather than per quad
+				const int quadCount = fragmentBuf.Size();
+				const int batchCount = (quadCount + QUAD_BATCH_SIZE - 1) / QUAD_BATCH_SIZE;
+				workers.ParallelFor(0, batchCount, [&](int batchId)
+				{
+					const int endIdx = Math::Min((batchId + 1) * QUAD_BATCH_SIZE, quadCount);
+					for (auto i = batchId * QUAD_BATCH_SIZE; i < endIdx; i++)
+					{
+						const Fragment& frag = fragmentBuf[i];
+
+						const ProjectedVertex& v0 = pVertexBufs[frag.coreId][frag.vId0];
+						const ProjectedVertex& v1 = pVertexBufs[frag.coreId][frag.vId1];
+						const ProjectedVertex& v2 = pVertexBufs[frag.coreId][frag.vId2];
+
+						FloatSSE b0 = frag.lambda0;
+						FloatSSE b1 = frag.lambda1;
+						Vec3f_SSE position;
+						Vec3f_SSE normal;
+						Vec2f_SSE texCoord;
+						frag.Interpolate(v0, v1, v2, b0, b1, position, normal, texCoord);
+
+						Vec3f_SSE shadingResults = ShadeQuad(typename std::is_same<typename PixelShaderType::DrawSetup, PixelShader::DrawSetup>::type(),
+							frag, uniforms, setup, position, normal, texCoord);
+
+						Color4b colorByte[4];
+						colorByte[0].FromFloats(shadingResults.x[0], shadingResults.y[0], shadingResults.z[0]);
+						colorByte[1].FromFloats(shadingResults.x[1], shadingResults.y[1], shadingResults.z[1]);
+						colorByte[2].FromFloats(shadingResults.x[2], shadingResults.y[2], shadingResults.z[2]);
+						colorByte[3].FromFloats(shadingResults.x[3], shadingResults.y[3], shadingResults.z[3]);
+
+						tiledResultBuf[frag.tileId][frag.intraTileIdx] = _mm_loadu_si128((__m128i*)&colorByte);
+					}
+				});
+			}
+
+			UniquePtr<PipelineState> Recreate(const PipelineStateDesc& desc) const
+			{
+				return Create<VertexShaderType, PixelShaderType>(desc);
+			}
+
+		private:
+			void ExecuteVertices(const DrawUniforms& uniforms,
+				const typename VertexShaderType::DrawSetup& setup,
+				const Vector3* pPositions,
+				const Vector3* pNormals,
+				const Vector2* pTexCoords,
+				const int count,
+				ProjectedVertex* pOut) const
+			{
+				ExecuteVertices(std::integral_constant<int, VertexShaderType::BATCH_SIZE>(), uniforms, setup, pPositions, pNormals, pTexCoords, count, pOut);
+			}
+
+			void ExecuteVertices(std::integral_constant<int, 1>,
+				const DrawUniforms& uniforms,
+				const typename VertexShaderType::DrawSetup& setup,
+				const Vector3* pPositions,
+				const Vector3* pNormals,
+				const Vector2* pTexCoords,
+				const int count,
+				ProjectedVertex* pOut) const
+			{
+				for (auto i = 0; i < count; i++)
+					mVertexShader.VertexShaderType::Execute(uniforms, pPositions[i], pNormals[i], pTexCoords[i], &pOut[i]);
+			}
+
+			// Shaders generated from HLSL fill a SIMD lane per vertex. A template so that ExecuteBatch is only
+			// looked up for shaders that batch
+			template<int BatchSize>
+			void ExecuteVertices(std::integral_constant<int, BatchSize>,
+				const DrawUniforms& uniforms,
+				const typename VertexShaderType::DrawSetup& setup,
+				const Vector3* pPositions,
+				const Vector3* pNormals,
+				const Vector2* pTexCoords,
+				const int count,
+				ProjectedVertex* pOut) const
+			{
+				for (auto i = 0; i < count; i += BatchSize)
+				{
+					mVertexShader.VertexShaderType::ExecuteBatch(setup,
+						pPositions + i,
+						pNormals + i,
+						pTexCoords + i,
+						Math::Min(BatchSize, count - i),
+						pOut + i);
+				}
+			}
+
+			// Shaders without a setup of their own
+			Vec3f_SSE ShadeQuad(std::true_type,
+				const Fragment& frag,
+				const DrawUniforms& uniforms,
+				const typename PixelShaderType::DrawSetup& setup,
+				const Vec3f_SSE& position,
+				const Vec3f_SSE& normal,
+				const Vec2f_SSE& texCoord) const
+			{
+				return mPixelShader.PixelShaderType::Shade(frag, uniforms, position, normal, texCoord);
+			}
+
+			// A template for the same reason as ExecuteVertices
+			template<typename DrawSetupType>
+			Vec3f_SSE ShadeQuad(std::false_type,
+				const Fragment& frag,
+				const DrawUniforms& uniforms,
+				const DrawSetupType& setup,
+				const Vec3f_SSE& position,
+				const Vec3f_SSE& normal,
+				const Vec2f_SSE& texCoord) const
+			{
+				return mPixelShader.PixelShaderType::Shade(frag, uniforms, setup, position, normal, texCoord);
+			}
+		};
+
+		template<typename VertexShaderType, typename PixelShaderType>
+		UniquePtr<PipelineState> PipelineState::Create(const PipelineStateDesc& desc)
+		{
+			return MakeUnique<ShaderPipelineState<VertexShaderType, PixelShaderType>>(desc);
+		}
+	}
+}
\ No newline at end of file
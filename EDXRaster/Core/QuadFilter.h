@@ -0,0 +1,262 @@
+#pragma once
+
+#include "EDXPrerequisites.h"
+#include "Sampler.h"
+#include "Math/Vector.h"
+#include "SIMD/SSE.h"
+
+namespace EDX
+{
+	namespace RasterRenderer
+	{
+		// SSE filtering shared by all quad textures. TextureType provides the mip chain through
+		// LevelCount, ResidentLevel, LevelWidth, LevelHeight, and fetches packed RGBA8 texels with
+		// FetchTexels (one tap per lane) and FetchFootprint (the 2x2 bilinear taps of each lane).
+		// The wanted level is reported as sampler feedback before clamping to the resident levels
+		template<typename TextureType>
+		class QuadFilter
+		{
+		private:
+			struct TexelsSSE
+			{
+				__m128 r, g, b;
+
+				__forceinline TexelsSSE()
+				{
+				}
+				__forceinline TexelsSSE(const __m128i packed)
+				{
+					const __m128i mask = _mm_set1_epi32(0xff);
+					r = _mm_cvtepi32_ps(_mm_and_si128(packed, mask));
+					g = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(packed, 8), mask));
+					b = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(packed, 16), mask));
+				}
+
+				__forceinline Vec3f_SSE ToColor() const
+				{
+					const __m128 scale = _mm_set1_ps(1.0f / 255.0f);
+
+					Vec3f_SSE ret;
+					ret.x = _mm_mul_ps(r, scale);
+					ret.y = _mm_mul_ps(g, scale);
+					ret.z = _mm_mul_ps(b, scale);
+					return ret;
+				}
+			};
+
+		public:
+			static Vec3f_SSE Sample(const TextureType& texture,
+				const Vec2f_SSE& texCoord,
+				const Vector2& dUVdx,
+				const Vector2& dUVdy,
+				const SamplerState& sampler)
+			{
+				// The level of detail is computed once for the whole quad
+				switch (sampler.GetFilter())
+				{
+				case SamplerFilter::Nearest:
+					return SampleNearest(texture, RequestLevel(texture, int(ComputeLod(texture, dUVdx, dUVdy) + 0.5f)), texCoord);
+
+				case SamplerFilter::Bilinear:
+					return SampleBilinear(texture, RequestLevel(texture, int(ComputeLod(texture, dUVdx, dUVdy) + 0.5f)), texCoord);
+
+				case SamplerFilter::Trilinear:
+				{
+					const float lod = ComputeLod(texture, dUVdx, dUVdy);
+					RequestLevel(texture, int(lod));
+					return SampleTrilinear(texture, lod, texCoord);
+				}
+
+				default:
+					return SampleAnisotropic(texture, texCoord, dUVdx, dUVdy, sampler.GetMaxAnisotropy());
+				}
+			}
+
+		private:
+			static __forceinline float Log2(const float val)
+			{
+				return logf(val) * 1.44269504f;
+			}
+
+			// SSE2 floor, valid for |x| < 2^31
+			static __forceinline __m128 Floor(const __m128 x)
+			{
+				const __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+				return _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, x), _mm_set1_ps(1.0f)));
+			}
+
+			static __forceinline __m128 Lerp(const __m128 a, const __m128 b, const __m128 t)
+			{
+				return _mm_add_ps(a, _mm_mul_ps(t, _mm_sub_ps(b, a)));
+			}
+
+			static __forceinline TexelsSSE Lerp(const TexelsSSE& a, const TexelsSSE& b, const __m128 t)
+			{
+				TexelsSSE ret;
+				ret.r = Lerp(a.r, b.r, t);
+				ret.g = Lerp(a.g, b.g, t);
+				ret.b = Lerp(a.b, b.b, t);
+				return ret;
+			}
+
+			// Wrapped texel coordinates in [0, size) of the texel left of/below the sample position
+			static __forceinline void WrapCoord(const __m128 coord, const __m128 size, __m128& base, __m128& frac)
+			{
+				const __m128 repeated = _mm_sub_ps(coord, Floor(coord));
+				const __m128 texelPos = _mm_sub_ps(_mm_mul_ps(repeated, size), _mm_set1_ps(0.5f));
+
+				base = Floor(texelPos);
+				frac = _mm_sub_ps(texelPos, base);
+				base = _mm_add_ps(base, _mm_and_ps(_mm_cmplt_ps(base, _mm_setzero_ps()), size));
+			}
+
+			static __forceinline __m128 NextCoord(const __m128 base, const __m128 size)
+			{
+				const __m128 next = _mm_add_ps(base, _mm_set1_ps(1.0f));
+				return _mm_andnot_ps(_mm_cmpge_ps(next, size), next);
+			}
+
+			static int ClampLevel(const TextureType& texture, const int level)
+			{
+				return Math::Clamp(level, texture.ResidentLevel(), texture.LevelCount() - 1);
+			}
+
+			static int RequestLevel(const TextureType& texture, const int level)
+			{
+				texture.RecordFeedback(Math::Max(level, 0));
+				return ClampLevel(texture, level);
+			}
+
+			static float ComputeLod(const TextureType& texture, const Vector2& dUVdx, const Vector2& dUVdy)
+			{
+				const float width = float(texture.LevelWidth(0));
+				const float height = float(texture.LevelHeight(0));
+				const float dxU = dUVdx.x * width, dxV = dUVdx.y * height;
+				const float dyU = dUVdy.x * width, dyV = dUVdy.y * height;
+
+				const float rhoSqr = Math::Max(dxU * dxU + dxV * dxV, dyU * dyU + dyV * dyV);
+				return rhoSqr > 0.0f ? 0.5f * Log2(rhoSqr) : 0.0f;
+			}
+
+			static Vec3f_SSE SampleNearest(const TextureType& texture, const int level, const Vec2f_SSE& texCoord)
+			{
+				const __m128 width = _mm_set1_ps(float(texture.LevelWidth(level)));
+				const __m128 height = _mm_set1_ps(float(texture.LevelHeight(level)));
+
+				__m128 x, y, fracX, fracY;
+				WrapCoord(texCoord.u.m128, width, x, fracX);
+				WrapCoord(texCoord.v.m128, height, y, fracY);
+
+				// Round to the closest texel center
+				x = _mm_add_ps(x, _mm_and_ps(_mm_cmpge_ps(fracX, _mm_set1_ps(0.5f)), _mm_set1_ps(1.0f)));
+				y = _mm_add_ps(y, _mm_and_ps(_mm_cmpge_ps(fracY, _mm_set1_ps(0.5f)), _mm_set1_ps(1.0f)));
+				x = _mm_andnot_ps(_mm_cmpge_ps(x, width), x);
+				y = _mm_andnot_ps(_mm_cmpge_ps(y, height), y);
+
+				const TexelsSSE texels = texture.FetchTexels(level, x, y);
+				return texels.ToColor();
+			}
+
+			static Vec3f_SSE SampleBilinear(const TextureType& texture, const int level, const Vec2f_SSE& texCoord)
+			{
+				const __m128 width = _mm_set1_ps(float(texture.LevelWidth(level)));
+				const __m128 height = _mm_set1_ps(float(texture.LevelHeight(level)));
+
+				__m128 x0, y0, fracX, fracY;
+				WrapCoord(texCoord.u.m128, width, x0, fracX);
+				WrapCoord(texCoord.v.m128, height, y0, fracY);
+				const __m128 x1 = NextCoord(x0, width);
+				const __m128 y1 = NextCoord(y0, height);
+
+				__m128i footprint[4];
+				texture.FetchFootprint(level, x0, x1, y0, y1, footprint);
+
+				const TexelsSSE t00 = footprint[0];
+				const TexelsSSE t01 = footprint[1];
+				const TexelsSSE t10 = footprint[2];
+				const TexelsSSE t11 = footprint[3];
+
+				return Lerp(Lerp(t00, t01, fracX), Lerp(t10, t11, fracX), fracY).ToColor();
+			}
+
+			static Vec3f_SSE SampleTrilinear(const TextureType& texture, const float lod, const Vec2f_SSE& texCoord)
+			{
+				const int minLevel = texture.ResidentLevel();
+				const int maxLevel = texture.LevelCount() - 1;
+				if (lod <= float(minLevel))
+					return SampleBilinear(texture, minLevel, texCoord);
+				if (lod >= float(maxLevel))
+					return SampleBilinear(texture, maxLevel, texCoord);
+
+				const int level = int(lod);
+				const FloatSSE t = FloatSSE(lod - float(level));
+				const Vec3f_SSE c0 = SampleBilinear(texture, level, texCoord);
+				const Vec3f_SSE c1 = SampleBilinear(texture, level + 1, texCoord);
+
+				return c0 + t * (c1 - c0);
+			}
+
+			static Vec3f_SSE SampleAnisotropic(const TextureType& texture,
+				const Vec2f_SSE& texCoord,
+				const Vector2& dUVdx,
+				const Vector2& dUVdy,
+				const int maxAnisotropy)
+			{
+				// Both footprint axes in texels at once, the lengths end up in lanes 0 and 2
+				const float width = float(texture.LevelWidth(0));
+				const float height = float(texture.LevelHeight(0));
+				const __m128 axes = _mm_mul_ps(_mm_setr_ps(dUVdx.x, dUVdx.y, dUVdy.x, dUVdy.y), _mm_setr_ps(width, height, width, height));
+				const __m128 axesSqr = _mm_mul_ps(axes, axes);
+				const __m128 lengths = _mm_sqrt_ps(_mm_add_ps(axesSqr, _mm_shuffle_ps(axesSqr, axesSqr, _MM_SHUFFLE(2, 3, 0, 1))));
+				const float lenX = _mm_cvtss_f32(lengths);
+				const float lenY = _mm_cvtss_f32(_mm_shuffle_ps(lengths, lengths, _MM_SHUFFLE(2, 2, 2, 2)));
+
+				const float major = Math::Max(lenX, lenY);
+				const float minor = Math::Min(lenX, lenY);
+				const Vector2 majorAxis = lenX > lenY ? dUVdx : dUVdy;
+				if (minor <= 0.0f)
+					return SampleBilinear(texture, RequestLevel(texture, 0), texCoord);
+
+				const float ratio = Math::Min(major / minor, float(maxAnisotropy));
+				const float lod = Log2(major / ratio);
+				RequestLevel(texture, int(lod));
+
+				// Only as many probes as the footprint is anisotropic, isotropic footprints are plain trilinear
+				const int probeCount = Math::Max(int(ceilf(ratio - 1e-3f)), 1);
+				if (probeCount == 1)
+					return SampleTrilinear(texture, lod, texCoord);
+
+				// The levels are the same for all probes
+				const int maxLevel = texture.LevelCount() - 1;
+				const float clampedLod = Math::Clamp(lod, float(texture.ResidentLevel()), float(maxLevel));
+				const int level = int(clampedLod);
+				const float t = clampedLod - float(level);
+				const bool blendLevels = t > 0.0f && level < maxLevel;
+
+				// Probes are spread evenly along the major axis of the footprint, the four lanes of each probe are gathered together
+				const float invProbeCount = 1.0f / float(probeCount);
+				const float firstOffset = 0.5f * invProbeCount - 0.5f;
+				const FloatSSE stepU = FloatSSE(invProbeCount * majorAxis.x);
+				const FloatSSE stepV = FloatSSE(invProbeCount * majorAxis.y);
+				Vec2f_SSE probeCoord = Vec2f_SSE(texCoord.u + FloatSSE(firstOffset * majorAxis.x), texCoord.v + FloatSSE(firstOffset * majorAxis.y));
+
+				Vec3f_SSE sum0 = Vec3f_SSE(0.0f, 0.0f, 0.0f);
+				Vec3f_SSE sum1 = Vec3f_SSE(0.0f, 0.0f, 0.0f);
+				for (auto i = 0; i < probeCount; i++)
+				{
+					sum0 += SampleBilinear(texture, level, probeCoord);
+					if (blendLevels)
+						sum1 += SampleBilinear(texture, level + 1, probeCoord);
+
+					probeCoord.u = probeCoord.u + stepU;
+					probeCoord.v = probeCoord.v + stepV;
+				}
+
+				if (!blendLevels)
+					return sum0 * FloatSSE(invProbeCount);
+
+				return (sum0 + FloatSSE(t) * (sum1 - sum0)) * FloatSSE(invProbeCount);
+			}
+		};
+	}
+}
\ No newline at end of file
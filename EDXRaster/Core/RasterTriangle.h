@@ -2,6 +2,7 @@
 
 #include "EDXPrerequisites.h"
 #include "Math/Vector.h"
+#include "Math/Matrix.h"
 #include "SIMD/SSE.h"
 
 namespace EDX
@@ -24,9 +25,8 @@ namespace EDX
 			float lambda0, lambda1; // Barycentric coordinates
 
 
-			bool Setup(Vector3& a, Vector3& b, Vector3& c, const uint* pIdx, const uint cId, const uint texId)
+			bool Setup(Vector3& a, Vector3& b, Vector3& c, const uint* pIdx, const uint cId, const uint texId, const Matrix& rasterMatrix)
 			{
-				const Matrix& rasterMatrix = RenderStates::Instance()->GetRasterMatrix();
 				a = Matrix::TransformPoint(a, rasterMatrix);
 				b = Matrix::TransformPoint(b, rasterMatrix);
 				c = Matrix::TransformPoint(c, rasterMatrix);
@@ -9,18 +9,22 @@ namespace EDX
 {
 	namespace RasterRenderer
 	{
+		// Kernels instantiated with DepthOnly only test and write depth, without building fragments, for Z
+		// prepasses and depth-only targets
 		class Rasterizer
 		{
 		private:
 			FrameBuffer* mpFrameBuffer;
 			Array<ProjectedVertex>* mpDistProjVertexBuf_Ref;
 			const Vec2i_SSE mCenterOffset;
+			DepthFunc mDepthFunc;
 
 		public:
 			Rasterizer(FrameBuffer* pFB, Array<ProjectedVertex>* vb)
 				: mpFrameBuffer(pFB)
 				, mpDistProjVertexBuf_Ref(vb)
 				, mCenterOffset(Vec2i_SSE(IntSSE(8, 24, 8, 24), IntSSE(8, 8, 24, 24)))
+				, mDepthFunc(DepthFunc::LessEqual)
 			{
 			}
 
@@ -28,7 +32,26 @@ namespace EDX
 			{
 			}
 
+			// Depth-only kernels always test LessEqual
+			void SetDepthFunc(const DepthFunc func)
+			{
+				mDepthFunc = func;
+			}
+
+		private:
+			template<bool DepthOnly>
+			__forceinline BoolSSE ZTestQuad(const FloatSSE& d, const int x, const int y, const uint sId, const BoolSSE& mask)
+			{
+				if (!DepthOnly && mDepthFunc == DepthFunc::Equal)
+					return mpFrameBuffer->ZTestQuadEqual(d, x, y, sId);
+
+				return mpFrameBuffer->ZTestQuad(d, x, y, sId, mask);
+			}
+
+		public:
+
 
+			template<bool DepthOnly>
 			void CoarseRasterize(Tile& tile,
 				const Tile::TriangleRef& triRef,
 				const uint blockSize,
@@ -97,19 +120,20 @@ namespace EDX
 					if (trivialAcceptMask[i] != 0)
 					{
 						if (mpFrameBuffer->GetSampleCount() == 1)
-							TrivialAcceptTriangle_SingleSample(tile, Vector2i(minX, minY), Vector2i(maxX, maxY), tri);
+							TrivialAcceptTriangle_SingleSample<DepthOnly>(tile, Vector2i(minX, minY), Vector2i(maxX, maxY), tri);
 						else
-							TrivialAcceptTriangle_MultiSample(tile, Vector2i(minX, minY), Vector2i(maxX, maxY), tri);
+							TrivialAcceptTriangle_MultiSample<DepthOnly>(tile, Vector2i(minX, minY), Vector2i(maxX, maxY), tri);
 						continue;
 					}
 
 					if (mpFrameBuffer->GetSampleCount() == 1)
-						FineRasterize_SingleSample(tile, triRef, Vector2i(minX, minY), Vector2i(maxX, maxY), tri);
+						FineRasterize_SingleSample<DepthOnly>(tile, triRef, Vector2i(minX, minY), Vector2i(maxX, maxY), tri);
 					else
-						FineRasterize_MultiSample(tile, triRef, Vector2i(minX, minY), Vector2i(maxX, maxY), tri);
+						FineRasterize_MultiSample<DepthOnly>(tile, triRef, Vector2i(minX, minY), Vector2i(maxX, maxY), tri);
 				}
 			}
 
+			template<bool DepthOnly>
 			__forceinline void FineRasterize(Tile& tile,
 				const Tile::TriangleRef& triRef,
 				const uint blockSize,
@@ -118,11 +142,12 @@ namespace EDX
 				const RasterTriangle& tri)
 			{
 				if (mpFrameBuffer->GetSampleCount() == 1)
-					FineRasterize_SingleSample(tile, triRef, blockMin, blockMax, tri);
+					FineRasterize_SingleSample<DepthOnly>(tile, triRef, blockMin, blockMax, tri);
 				else
-					FineRasterize_MultiSample(tile, triRef, blockMin, blockMax, tri);
+					FineRasterize_MultiSample<DepthOnly>(tile, triRef, blockMin, blockMax, tri);
 			}
 
+			template<bool DepthOnly>
 			__forceinline void FineRasterize_SingleSample(Tile& tile,
 				const Tile::TriangleRef& triRef,
 				const Vector2i& blockMin,
@@ -169,9 +194,9 @@ namespace EDX
 							const ProjectedVertex& v1 = mpDistProjVertexBuf_Ref[triSSE.coreId][triSSE.vId1];
 							const ProjectedVertex& v2 = mpDistProjVertexBuf_Ref[triSSE.coreId][triSSE.vId2];
 
-							BoolSSE zTest = mpFrameBuffer->ZTestQuad(triSSE.GetDepth(v0, v1, v2), pixelCrd.x, pixelCrd.y, 0, covered);
+							BoolSSE zTest = ZTestQuad<DepthOnly>(triSSE.GetDepth(v0, v1, v2), pixelCrd.x, pixelCrd.y, 0, covered);
 							BoolSSE visible = zTest & covered;
-							if (SSE::Any(visible))
+							if (!DepthOnly && SSE::Any(visible))
 							{
 								tile.fragmentBuf.Add(Fragment(triSSE.lambda0,
 									triSSE.lambda1,
@@ -199,6 +224,7 @@ namespace EDX
 				}
 			}
 
+			template<bool DepthOnly>
 			__forceinline void FineRasterize_MultiSample(Tile& tile,
 				const Tile::TriangleRef& triRef,
 				const Vector2i& blockMin,
@@ -260,9 +286,9 @@ namespace EDX
 								const ProjectedVertex& v1 = mpDistProjVertexBuf_Ref[triSSE.coreId][triSSE.vId1];
 								const ProjectedVertex& v2 = mpDistProjVertexBuf_Ref[triSSE.coreId][triSSE.vId2];
 
-								BoolSSE zTest = mpFrameBuffer->ZTestQuad(triSSE.GetDepth(v0, v1, v2), pixelCrd.x, pixelCrd.y, sampleId, covered);
+								BoolSSE zTest = ZTestQuad<DepthOnly>(triSSE.GetDepth(v0, v1, v2), pixelCrd.x, pixelCrd.y, sampleId, covered);
 								BoolSSE visible = zTest & covered;
-								if (SSE::Any(visible))
+								if (!DepthOnly && SSE::Any(visible))
 								{
 									mask.SetBit(visible, sampleId);
 									genFragment = true;
@@ -270,7 +296,7 @@ namespace EDX
 							}
 						}
 
-						if (genFragment)
+						if (!DepthOnly && genFragment)
 						{
 							triSSE.CalcBarycentricCoord(pixelCenter.x, pixelCenter.y);
 
@@ -299,14 +325,16 @@ namespace EDX
 				}
 			}
 
+			template<bool DepthOnly>
 			__forceinline void TrivialAcceptTriangle(Tile& tile, const Vector2i& blockMin, const Vector2i & blockMax, const RasterTriangle& tri)
 			{
 				if (mpFrameBuffer->GetSampleCount() == 1)
-					TrivialAcceptTriangle_SingleSample(tile, blockMin, blockMax, tri);
+					TrivialAcceptTriangle_SingleSample<DepthOnly>(tile, blockMin, blockMax, tri);
 				else
-					TrivialAcceptTriangle_MultiSample(tile, blockMin, blockMax, tri);
+					TrivialAcceptTriangle_MultiSample<DepthOnly>(tile, blockMin, blockMax, tri);
 			}
 
+			template<bool DepthOnly>
 			__forceinline void TrivialAcceptTriangle_SingleSample(Tile& tile, const Vector2i& blockMin, const Vector2i & blockMax, const RasterTriangle& tri)
 			{
 				int minX = blockMin.x;
@@ -333,8 +361,8 @@ namespace EDX
 						const ProjectedVertex& v1 = mpDistProjVertexBuf_Ref[triSSE.coreId][triSSE.vId1];
 						const ProjectedVertex& v2 = mpDistProjVertexBuf_Ref[triSSE.coreId][triSSE.vId2];
 
-						BoolSSE zTest = mpFrameBuffer->ZTestQuad(triSSE.GetDepth(v0, v1, v2), pixelCrd.x, pixelCrd.y, 0, BoolSSE(Constants::EDX_TRUE));
-						if (SSE::Any(zTest))
+						BoolSSE zTest = ZTestQuad<DepthOnly>(triSSE.GetDepth(v0, v1, v2), pixelCrd.x, pixelCrd.y, 0, BoolSSE(Constants::EDX_TRUE));
+						if (!DepthOnly && SSE::Any(zTest))
 						{
 							tile.fragmentBuf.Add(Fragment(triSSE.lambda0,
 								triSSE.lambda1,
@@ -352,6 +380,7 @@ namespace EDX
 				}
 			}
 
+			template<bool DepthOnly>
 			__forceinline void TrivialAcceptTriangle_MultiSample(Tile& tile, const Vector2i& blockMin, const Vector2i & blockMax, const RasterTriangle& tri)
 			{
 				const uint sampleCount = mpFrameBuffer->GetSampleCount();
@@ -387,15 +416,15 @@ namespace EDX
 							const ProjectedVertex& v1 = mpDistProjVertexBuf_Ref[triSSE.coreId][triSSE.vId1];
 							const ProjectedVertex& v2 = mpDistProjVertexBuf_Ref[triSSE.coreId][triSSE.vId2];
 
-							BoolSSE zTest = mpFrameBuffer->ZTestQuad(triSSE.GetDepth(v0, v1, v2), pixelCrd.x, pixelCrd.y, sampleId, BoolSSE(Constants::EDX_TRUE));
-							if (SSE::Any(zTest))
+							BoolSSE zTest = ZTestQuad<DepthOnly>(triSSE.GetDepth(v0, v1, v2), pixelCrd.x, pixelCrd.y, sampleId, BoolSSE(Constants::EDX_TRUE));
+							if (!DepthOnly && SSE::Any(zTest))
 							{
 								mask.SetBit(zTest, sampleId);
 								genFragment = true;
 							}
 						}
 
-						if (genFragment)
+						if (!DepthOnly && genFragment)
 						{
 							triSSE.CalcBarycentricCoord(pixelCenter.x, pixelCenter.y);
 							tile.fragmentBuf.Add(Fragment(triSSE.lambda0,
@@ -1,71 +1,54 @@
 #pragma once
 
 #include "EDXPrerequisites.h"
-#include "Graphics/Texture.h"
 #include "Math/Matrix.h"
 #include "Core/SmartPointer.h"
+#include "../Utils/TextureCache.h"
 
 namespace EDX
 {
 	namespace RasterRenderer
 	{
+		enum class DepthFunc
+		{
+			LessEqual,	// Keeps the nearest surface and writes its depth
+			Equal		// Only passes the surface a Z prepass left in the depth buffer, without writing
+		};
+
+		// Settings and per frame state of one renderer. Each Renderer owns its own and passes what the stages
+		// need into them, so renderers do not share draw state. They still share the texture cache, whose
+		// TextureCache::UpdateStreaming must run while no renderer in the process is drawing
 		class RenderStates
 		{
 		public:
-			Matrix ModelViewMatrix;
-			Matrix ModelViewInvMatrix;
-			Matrix ProjMatrix;
-			Matrix ModelViewProjMatrix;
 			Matrix RasterMatrix;
 
 			uint MultiSampleLevel;
 			bool BackFaceCull;
-			TextureFilter TexFilter;
 
 			int FrameCount;
 			bool HierarchicalRasterize;
+			DepthFunc DepthTest;
 
-			const Array<UniquePtr<Texture2D<Color>>>* TextureSlots = nullptr;
+			const Array<TextureHandle>* TextureSlots;
 
-		private:
+		public:
 			RenderStates()
 				: FrameCount(0)
+				, TextureSlots(nullptr)
 			{
-			}
-			static RenderStates* mpInstance;
-
-		public:
-			static RenderStates* Instance()
-			{
-				if (!mpInstance)
-					mpInstance = new RenderStates;
-
-				return mpInstance;
-			}
-			static void DeleteInstance()
-			{
-				if (mpInstance)
-				{
-					delete mpInstance;
-					mpInstance = nullptr;
-				}
+				DefaultSettings();
 			}
 
-		public:
 			void DefaultSettings()
 			{
 				MultiSampleLevel = 0;
 				BackFaceCull = true;
 				HierarchicalRasterize = true;
-				TexFilter = TextureFilter::TriLinear;
+				DepthTest = DepthFunc::LessEqual;
 			}
 
-			const Matrix& GetModelViewProjMatrix() const { return ModelViewProjMatrix; }
-			const Matrix& GetModelViewMatrix() const { return ModelViewMatrix; }
-			const Matrix& GetModelViewInvMatrix() const { return ModelViewInvMatrix; }
-			const Matrix& GetProjectMatrix() const { return ProjMatrix; }
 			const Matrix& GetRasterMatrix() const { return RasterMatrix; }
-			const TextureFilter GetTextureFilter() const { return TexFilter; }
 		};
 	}
 }
\ No newline at end of file
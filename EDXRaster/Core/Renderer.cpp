@@ -10,65 +10,74 @@
 #include "Windows/Bitmap.h"
 #include "Windows/Application.h"
 
-#include <ppl.h>
-using namespace concurrency;
-
 namespace EDX
 {
 	namespace RasterRenderer
 	{
-		RenderStates* RenderStates::mpInstance = nullptr;
-
-		void Renderer::Initialize(uint iScreenWidth, uint iScreenHeight)
+		struct Renderer::View
 		{
-			RenderStates::Instance()->DefaultSettings();
-
-			mTileDim.x = (iScreenWidth + Tile::SIZE - 1) >> Tile::SIZE_LOG_2;
-			mTileDim.y = (iScreenHeight + Tile::SIZE - 1) >> Tile::SIZE_LOG_2;
-
-			if (!mpFrameBuffer)
+			UniquePtr<FrameBuffer> pFrameBuffer;
+			UniquePtr<Rasterizer> pRasterizer;
+			Array<ProjectedVertex>* pDistributedProjVertexBuf;
+			Array<RasterTriangle>* pRasterTriangleBuf;
+			Array<Fragment> fragmentBuf;
+			Array<Array<IntSSE>> tiledShadingResultBuf;
+			Array<Tile> tiles;
+			Vector2i tileDim;
+
+			View(const int numCores)
+			{
+				pDistributedProjVertexBuf = new Array<ProjectedVertex>[numCores];
+				pRasterTriangleBuf = new Array<RasterTriangle>[numCores];
+			}
+			~View()
 			{
-				mpFrameBuffer = MakeUnique<FrameBuffer>();
+				Memory::SafeDeleteArray(pDistributedProjVertexBuf);
+				Memory::SafeDeleteArray(pRasterTriangleBuf);
 			}
-			mpFrameBuffer->Init(iScreenWidth, iScreenHeight, mTileDim, RenderStates::Instance()->MultiSampleLevel);
+		};
+
+		void Renderer::Initialize(uint iScreenWidth, uint iScreenHeight, WorkerPool* pWorkerPool)
+		{
+			mRenderStates.DefaultSettings();
 
 			if (!mpScene)
 			{
 				mpScene = MakeUnique<Scene>();
 			}
 
-			mpVertexShader = MakeUnique<DefaultVertexShader>();
-			mpPixelShader = MakeUnique<LambertianAlbedoPixelShader>();
+			mpPipelineState = PipelineState::Create<DefaultVertexShader, LambertianAlbedoPixelShader>();
+			mpTransformConstants = &mTransformConstants;
+			mpLightConstants = &mLightConstants;
 
-			int tId = 0;
-			for (auto i = 0; i < iScreenHeight; i += Tile::SIZE)
-			{
-				for (auto j = 0; j < iScreenWidth; j += Tile::SIZE)
-				{
-					auto maxX = Math::Min(j + Tile::SIZE, iScreenWidth);
-					auto maxY = Math::Min(i + Tile::SIZE, iScreenHeight);
+			// Stages split their work into mNumCores parts, which the pool schedules like any other chunks
+			mpWorkContext = MakeUnique<WorkContext>(pWorkerPool);
+			mNumCores = pWorkerPool ? GetNumberOfCores() : 1;
+			mWriteFrames = false;
 
-					mTiles.Add(Tile(Vector2i(j, i), Vector2i(maxX, maxY), tId++));
-				}
-			}
+			mViews.Clear();
+			mDepthTargets.Clear();
+			mViews.Add(CreateView(iScreenWidth, iScreenHeight, mRenderStates.MultiSampleLevel));
+		}
 
-			mNumCores = GetNumberOfCores();
-			mWriteFrames = false;
+		UniquePtr<Renderer::View> Renderer::CreateView(uint iScreenWidth, uint iScreenHeight, const uint sampleCountLog2)
+		{
+			UniquePtr<View> pView = MakeUnique<View>(mNumCores);
+			InitTiles(*pView, iScreenWidth, iScreenHeight);
 
-			mpDistributedProjVertexBuf = new Array<ProjectedVertex>[mNumCores];
-			mpRasterTriangleBuf = new Array<RasterTriangle>[mNumCores];
+			pView->pFrameBuffer = MakeUnique<FrameBuffer>();
+			pView->pFrameBuffer->Init(iScreenWidth, iScreenHeight, pView->tileDim, sampleCountLog2);
+			pView->pRasterizer = MakeUnique<Rasterizer>(pView->pFrameBuffer.Get(), pView->pDistributedProjVertexBuf);
 
-			mpRasterizer = MakeUnique<Rasterizer>(mpFrameBuffer.Get(), mpDistributedProjVertexBuf);
+			return pView;
 		}
 
-		void Renderer::Resize(uint iScreenWidth, uint iScreenHeight)
+		void Renderer::InitTiles(View& view, uint iScreenWidth, uint iScreenHeight)
 		{
-			mTileDim.x = (iScreenWidth + Tile::SIZE - 1) >> Tile::SIZE_LOG_2;
-			mTileDim.y = (iScreenHeight + Tile::SIZE - 1) >> Tile::SIZE_LOG_2;
-
-			mpFrameBuffer->Resize(iScreenWidth, iScreenHeight, mTileDim, RenderStates::Instance()->MultiSampleLevel);
+			view.tileDim.x = (iScreenWidth + Tile::SIZE - 1) >> Tile::SIZE_LOG_2;
+			view.tileDim.y = (iScreenHeight + Tile::SIZE - 1) >> Tile::SIZE_LOG_2;
 
-			mTiles.Clear();
+			view.tiles.Clear();
 			int tId = 0;
 			for (auto i = 0; i < iScreenHeight; i += Tile::SIZE)
 			{
@@ -77,105 +86,352 @@ namespace EDX
 					auto maxX = Math::Min(j + Tile::SIZE, iScreenWidth);
 					auto maxY = Math::Min(i + Tile::SIZE, iScreenHeight);
 
-					mTiles.Add(Tile(Vector2i(j, i), Vector2i(maxX, maxY), tId++));
+					view.tiles.Add(Tile(Vector2i(j, i), Vector2i(maxX, maxY), tId++));
 				}
 			}
 		}
 
+		void Renderer::Resize(uint iScreenWidth, uint iScreenHeight)
+		{
+			// Depth targets keep their own size
+			for (auto i = 0; i < mViews.Size(); i++)
+			{
+				InitTiles(*mViews[i], iScreenWidth, iScreenHeight);
+				mViews[i]->pFrameBuffer->Resize(iScreenWidth, iScreenHeight, mViews[i]->tileDim, mRenderStates.MultiSampleLevel);
+			}
+		}
+
 		void Renderer::SetTransform(const Matrix& mModelView, const Matrix& mProj, const Matrix& mToRaster)
 		{
-			RenderStates::Instance()->ModelViewMatrix = mModelView;
-			RenderStates::Instance()->ModelViewInvMatrix = Matrix::Inverse(mModelView);
-			RenderStates::Instance()->ProjMatrix = mProj;
-			RenderStates::Instance()->ModelViewProjMatrix = mProj * mModelView;
-			RenderStates::Instance()->RasterMatrix = mToRaster;
+			TransformConstants transform;
+			transform.ModelViewMatrix = mModelView;
+			transform.ProjMatrix = mProj;
+			mTransformConstants.Update(transform);
+			mpTransformConstants = &mTransformConstants;
+
+			mRenderStates.RasterMatrix = mToRaster;
+		}
+
+		void Renderer::SetTransformConstants(const ConstantBuffer<TransformConstants>* pBuffer)
+		{
+			mpTransformConstants = pBuffer ? pBuffer : &mTransformConstants;
+		}
+
+		void Renderer::SetLightConstants(const ConstantBuffer<LightConstants>* pBuffer)
+		{
+			mpLightConstants = pBuffer ? pBuffer : &mLightConstants;
 		}
 
 		void Renderer::SetMSAAMode(const int sampleCountLog2)
 		{
-			RenderStates::Instance()->MultiSampleLevel = sampleCountLog2;
-			Resize(mpFrameBuffer->GetWidth(), mpFrameBuffer->GetHeight());
+			mRenderStates.MultiSampleLevel = sampleCountLog2;
+			Resize(mViews[0]->pFrameBuffer->GetWidth(), mViews[0]->pFrameBuffer->GetHeight());
+		}
+
+		void Renderer::SetTextureFilter(const TextureFilter filter)
+		{
+			// The sampler is part of the pipeline, which is only rebuilt when it changes
+			if (filter != mpPipelineState->GetDesc().Filter)
+				mpPipelineState = mpPipelineState->Recreate(PipelineStateDesc(filter));
 		}
 
 		void Renderer::RenderMesh(const Mesh& mesh)
 		{
+			View& view = *mViews[0];
+
 			// Clear framebuffer
-			mpFrameBuffer->Clear();
+			ClearView(view);
 
-			// Set texture index
-			RenderStates::Instance()->TextureSlots = &mesh.GetTextures();
+			// Nothing to draw until an asynchronous load has committed its geometry
+			if (!mesh.GetVertexBuffer() || !mesh.GetIndexBuffer())
+				return;
+
+			// Derived from the bound constants once here instead of for every quad
+			const DrawUniforms uniforms = GetDrawUniforms(mesh, mpTransformConstants->GetData());
 
-			VertexProcessing(mesh.GetVertexBuffer());
-			Clipping(mesh.GetIndexBuffer(), mesh.GetTextureIds());
-			TiledRasterization();
-			FragmentProcessing();
-			UpdateFrameBuffer();
+			VertexProcessing(mesh.GetVertexBuffer(), uniforms);
+			DrawView(view, mesh, uniforms, mRenderStates.GetRasterMatrix(), nullptr);
+			view.pFrameBuffer->Resolve(*mpWorkContext);
 
 			if (mWriteFrames)
 				WriteFrameToFile();
 
-			RenderStates::Instance()->FrameCount++;
+			mRenderStates.FrameCount++;
 		}
 
-		void Renderer::VertexProcessing(const IVertexBuffer* pVertexBuf)
+		void Renderer::RenderMeshViews(const Mesh& mesh, const ViewDesc* pViews, const int viewCount)
 		{
-			mProjectedVertexBuf.Resize(pVertexBuf->GetVertexCount());
-			parallel_for(0, (int)pVertexBuf->GetVertexCount(), [&](int i)
+			Assert(viewCount > 0);
+
+			while (mViews.Size() < viewCount)
+				mViews.Add(CreateView(mViews[0]->pFrameBuffer->GetWidth(), mViews[0]->pFrameBuffer->GetHeight(), mRenderStates.MultiSampleLevel));
+
+			for (auto i = 0; i < viewCount; i++)
+				ClearView(*mViews[i]);
+
+			if (!mesh.GetVertexBuffer() || !mesh.GetIndexBuffer())
+				return;
+
+			TransformConstants transform;
+			transform.ModelViewMatrix = pViews[0].ModelView;
+			transform.ProjMatrix = pViews[0].Proj;
+			DrawUniforms uniforms = GetDrawUniforms(mesh, transform);
+
+			VertexProcessing(mesh.GetVertexBuffer(), uniforms);
+			DrawView(*mViews[0], mesh, uniforms, pViews[0].ToRaster, nullptr);
+			mViews[0]->pFrameBuffer->Resolve(*mpWorkContext);
+
+			// Vertex shaders end with the model view projection transform, so the first view's clip space
+			// positions map onto any other view through one matrix
+			const Matrix invViewProj = Matrix::Inverse(uniforms.Transform.ModelViewProjMatrix);
+			for (auto i = 1; i < viewCount; i++)
 			{
-				mpVertexShader->Execute(pVertexBuf->GetPosition(i), pVertexBuf->GetNormal(i), pVertexBuf->GetTexCoord(i), &mProjectedVertexBuf[i]);
-			});
+				// Pixel shaders still see each view's own transform, eye position included
+				transform.ModelViewMatrix = pViews[i].ModelView;
+				transform.ProjMatrix = pViews[i].Proj;
+				uniforms.Transform = TransformUniforms(transform);
+
+				const Matrix reprojectMatrix = uniforms.Transform.ModelViewProjMatrix * invViewProj;
+				DrawView(*mViews[i], mesh, uniforms, pViews[i].ToRaster, &reprojectMatrix);
+				mViews[i]->pFrameBuffer->Resolve(*mpWorkContext);
+			}
+
+			// Frames on disk follow the first view like the back buffer does
+			if (mWriteFrames)
+				WriteFrameToFile();
+
+			mRenderStates.FrameCount++;
 		}
 
-		void Renderer::Clipping(IndexBuffer* pIndexBuf, const Array<uint>& texIdBuf)
+		void Renderer::RenderMeshInstanced(const Mesh& mesh, const MeshInstance* pInstances, const int instanceCount)
 		{
-			parallel_for(0, mNumCores, [&](int coreId)
+			View& view = *mViews[0];
+
+			ClearView(view);
+
+			if (!mesh.GetVertexBuffer() || !mesh.GetIndexBuffer())
+				return;
+
+			const DrawUniforms uniforms = GetDrawUniforms(mesh, mpTransformConstants->GetData());
+
+			const BoundingBox bounds = mesh.GetBounds();
+			const uint vertexCount = mesh.GetVertexBuffer()->GetVertexCount();
+			const int groupSize = Math::Max(1, int(INSTANCE_GROUP_VERTEX_COUNT / Math::Max(1u, vertexCount)));
+			const int textureCount = mesh.GetTextures().Size();
+
+			// Groups are drawn one after another into the same frame buffer, the depth test sorts them out
+			mInstanceGroup.Clear();
+			mInstanceGroupTexIds.Clear();
+			for (auto i = 0; i < instanceCount; i++)
 			{
-				mpDistributedProjVertexBuf[coreId].Clear();
-				mpRasterTriangleBuf[coreId].Clear();
+				const MeshInstance& instance = pInstances[i];
+				if (Clipper::IsBoxOutside(bounds, uniforms.Transform.ModelViewProjMatrix * instance.World))
+					continue;
+
+				// Slots past the mesh's textures would be read past the end of its texture array while shading
+				Assert(instance.TextureId < textureCount);
+				mInstanceGroup.Add(VertexInstance(instance.World));
+				mInstanceGroupTexIds.Add(instance.TextureId < textureCount ? instance.TextureId : -1);
+				if (mInstanceGroup.Size() == groupSize)
+					DrawInstanceGroup(view, mesh, uniforms);
+			}
+
+			if (mInstanceGroup.Size() > 0)
+				DrawInstanceGroup(view, mesh, uniforms);
+
+			view.pFrameBuffer->Resolve(*mpWorkContext);
+
+			if (mWriteFrames)
+				WriteFrameToFile();
+
+			mRenderStates.FrameCount++;
+		}
+
+		void Renderer::RenderMeshDepth(const Mesh& mesh)
+		{
+			View& view = *mViews[0];
+			view.pFrameBuffer->Clear(*mpWorkContext, false, true);
+
+			if (!mesh.GetVertexBuffer() || !mesh.GetIndexBuffer())
+				return;
+
+			const DrawUniforms uniforms = GetDrawUniforms(mesh, mpTransformConstants->GetData());
+			DrawDepth(view, mesh, uniforms, mRenderStates.GetRasterMatrix());
+		}
+
+		int Renderer::AddDepthTarget(const uint width, const uint height)
+		{
+			mDepthTargets.Add(CreateView(width, height, 0));
+			return mDepthTargets.Size() - 1;
+		}
+
+		void Renderer::RenderMeshDepth(const Mesh& mesh, const ViewDesc& camera, const int targetId)
+		{
+			View& view = *mDepthTargets[targetId];
+			view.pFrameBuffer->Clear(*mpWorkContext, false, true);
+
+			if (!mesh.GetVertexBuffer() || !mesh.GetIndexBuffer())
+				return;
+
+			TransformConstants transform;
+			transform.ModelViewMatrix = camera.ModelView;
+			transform.ProjMatrix = camera.Proj;
+			const DrawUniforms uniforms = GetDrawUniforms(mesh, transform);
+
+			DrawDepth(view, mesh, uniforms, camera.ToRaster);
+		}
+
+		void Renderer::ReadDepth(const int targetId, float* pDepths) const
+		{
+			mDepthTargets[targetId]->pFrameBuffer->ReadDepth(pDepths);
+		}
+
+		DrawUniforms Renderer::GetDrawUniforms(const Mesh& mesh, const TransformConstants& transform)
+		{
+			// Set texture index
+			mRenderStates.TextureSlots = &mesh.GetTextures();
+
+			DrawUniforms uniforms;
+			uniforms.Transform = TransformUniforms(transform);
+			uniforms.Light = LightUniforms(mpLightConstants->GetData());
+			uniforms.pTextureSlots = mRenderStates.TextureSlots;
+			uniforms.pSampler = &mpPipelineState->GetSampler();
+
+			return uniforms;
+		}
+
+		void Renderer::ClearView(View& view)
+		{
+			// Testing Equal keeps the depth a Z prepass left behind
+			view.pFrameBuffer->Clear(*mpWorkContext, true, GetDepthFunc(view, false) != DepthFunc::Equal);
+		}
+
+		DepthFunc Renderer::GetDepthFunc(const View& view, const bool depthOnly) const
+		{
+			// Depth-only passes write the depth Equal tests against, and a Z prepass only fills the first view
+			if (depthOnly || &view != mViews[0].Get())
+				return DepthFunc::LessEqual;
+
+			return mRenderStates.DepthTest;
+		}
+
+		void Renderer::DrawDepth(View& view, const Mesh& mesh, const DrawUniforms& uniforms, const Matrix& rasterMatrix)
+		{
+			VertexProcessing(mesh.GetVertexBuffer(), uniforms);
+			Clipping(view, mesh.GetIndexBuffer(), mesh.GetTextureIds(), rasterMatrix, nullptr, 1, nullptr);
+			TiledRasterization(view, true);
+		}
+
+		void Renderer::DrawInstanceGroup(View& view, const Mesh& mesh, const DrawUniforms& uniforms)
+		{
+			const int instanceCount = mInstanceGroup.Size();
+			mpPipelineState->ProcessVertices(mesh.GetVertexBuffer(), uniforms, mInstanceGroup.Data(), instanceCount, *mpWorkContext, mProjectedVertexBuf);
+			DrawView(view, mesh, uniforms, mRenderStates.GetRasterMatrix(), nullptr, instanceCount, mInstanceGroupTexIds.Data());
+
+			mInstanceGroup.Clear();
+			mInstanceGroupTexIds.Clear();
+		}
+
+		void Renderer::DrawView(View& view,
+			const Mesh& mesh,
+			const DrawUniforms& uniforms,
+			const Matrix& rasterMatrix,
+			const Matrix* pReprojectMatrix,
+			const int instanceCount,
+			const int* pInstanceTexIds)
+		{
+			Clipping(view, mesh.GetIndexBuffer(), mesh.GetTextureIds(), rasterMatrix, pReprojectMatrix, instanceCount, pInstanceTexIds);
+			TiledRasterization(view, false);
+			FragmentProcessing(view, uniforms);
+			UpdateFrameBuffer(view);
+		}
+
+		void Renderer::VertexProcessing(const IVertexBuffer* pVertexBuf, const DrawUniforms& uniforms)
+		{
+			mpPipelineState->ProcessVertices(pVertexBuf, uniforms, nullptr, 1, *mpWorkContext, mProjectedVertexBuf);
+		}
+
+		void Renderer::Clipping(View& view,
+			IndexBuffer* pIndexBuf,
+			const Array<uint>& texIdBuf,
+			const Matrix& rasterMatrix,
+			const Matrix* pReprojectMatrix,
+			const int instanceCount,
+			const int* pInstanceTexIds)
+		{
+			mpWorkContext->ParallelFor(0, mNumCores, [&](int coreId)
+			{
+				view.pDistributedProjVertexBuf[coreId].Clear();
+				view.pRasterTriangleBuf[coreId].Clear();
 			});
 
-			Clipper::Clip(mProjectedVertexBuf, pIndexBuf, texIdBuf, mpDistributedProjVertexBuf, mpRasterTriangleBuf, mNumCores);
+			Clipper::Clip(mProjectedVertexBuf, pIndexBuf, texIdBuf, view.pDistributedProjVertexBuf, view.pRasterTriangleBuf, rasterMatrix, *mpWorkContext, mNumCores, pReprojectMatrix, instanceCount, pInstanceTexIds);
 
-			parallel_for(0, mNumCores, [&](int coreId)
+			mpWorkContext->ParallelFor(0, mNumCores, [&](int coreId)
 			{
-				for (auto i = 0; i < mpDistributedProjVertexBuf[coreId].Size(); i++)
+				for (auto i = 0; i < view.pDistributedProjVertexBuf[coreId].Size(); i++)
 				{
-					ProjectedVertex& vertex = mpDistributedProjVertexBuf[coreId][i];
+					ProjectedVertex& vertex = view.pDistributedProjVertexBuf[coreId][i];
 					vertex.invW = 1.0f / vertex.projectedPos.w;
 					vertex.projectedPos.z *= vertex.invW;
 				}
 			});
 		}
 
-		void Renderer::TiledRasterization()
+		template<bool DepthOnly>
+		void Renderer::RasterizeTile(View& view, Tile& tile)
+		{
+			for (auto coreId = 0; coreId < mNumCores; coreId++)
+			{
+				for (auto j = 0; j < tile.triangleRefs[coreId].Size(); j++)
+				{
+					const Tile::TriangleRef& triRef = tile.triangleRefs[coreId][j];
+					RasterTriangle& tri = view.pRasterTriangleBuf[coreId][triRef.triId];
+
+					if (triRef.trivialAccept)
+					{
+						view.pRasterizer->TrivialAcceptTriangle<DepthOnly>(tile, tile.minCoord, tile.maxCoord, tri);
+						continue;
+					}
+
+					if (mRenderStates.HierarchicalRasterize && triRef.big)
+						view.pRasterizer->CoarseRasterize<DepthOnly>(tile, triRef, Tile::SIZE, tile.minCoord, tile.maxCoord, tri);
+					else
+						view.pRasterizer->FineRasterize<DepthOnly>(tile, triRef, Tile::SIZE, tile.minCoord, tile.maxCoord, tri);
+				}
+			}
+
+		}
+
+		void Renderer::TiledRasterization(View& view, const bool depthOnly)
 		{
 			// Binning triangles
-			parallel_for(0, (int)mTiles.Size(), [&](int i)
+			mpWorkContext->ParallelFor(0, (int)view.tiles.Size(), [&](int i)
 			{
 				for (auto c = 0; c < mNumCores; c++)
-					mTiles[i].triangleRefs[c].Clear();
+					view.tiles[i].triangleRefs[c].Clear();
 
-				mTiles[i].fragmentBuf.Clear();
+				view.tiles[i].fragmentBuf.Clear();
 			});
 
 			const int Shift = Tile::SIZE_LOG_2 + 4;
-			parallel_for(0, mNumCores, [&](int coreId)
+			mpWorkContext->ParallelFor(0, mNumCores, [&](int coreId)
 			{
-				for (auto i = 0; i < mpRasterTriangleBuf[coreId].Size(); i++)
+				for (auto i = 0; i < view.pRasterTriangleBuf[coreId].Size(); i++)
 				{
-					const RasterTriangle& tri = mpRasterTriangleBuf[coreId][i];
+					const RasterTriangle& tri = view.pRasterTriangleBuf[coreId][i];
 
 					int minX = Math::Max(0, Math::Min(tri.v0.x, Math::Min(tri.v1.x, tri.v2.x)) >> Shift);
-					int maxX = Math::Min(mTileDim.x - 1, Math::Max(tri.v0.x, Math::Max(tri.v1.x, tri.v2.x)) >> Shift);
+					int maxX = Math::Min(view.tileDim.x - 1, Math::Max(tri.v0.x, Math::Max(tri.v1.x, tri.v2.x)) >> Shift);
 					int minY = Math::Max(0, Math::Min(tri.v0.y, Math::Min(tri.v1.y, tri.v2.y)) >> Shift);
-					int maxY = Math::Min(mTileDim.y - 1, Math::Max(tri.v0.y, Math::Max(tri.v1.y, tri.v2.y)) >> Shift);
+					int maxY = Math::Min(view.tileDim.y - 1, Math::Max(tri.v0.y, Math::Max(tri.v1.y, tri.v2.y)) >> Shift);
 
 					if (maxX - minX < 2 && maxY - minY < 2)
 					{
 						for (auto y = minY; y <= maxY; y++)
 						{
 							for (auto x = minX; x <= maxX; x++)
-								mTiles[y * mTileDim.x + x].triangleRefs[coreId].Add(Tile::TriangleRef(i));
+								view.tiles[y * view.tileDim.x + x].triangleRefs[coreId].Add(Tile::TriangleRef(i));
 						}
 					}
 					else
@@ -217,7 +473,7 @@ namespace EDX
 									(pixelBase.x + acptCornerOffset2.x) << Shift,
 									(pixelBase.y + acptCornerOffset2.y) << Shift);
 
-								mTiles[y * mTileDim.x + x].triangleRefs[coreId].Add(Tile::TriangleRef(i,
+								view.tiles[y * view.tileDim.x + x].triangleRefs[coreId].Add(Tile::TriangleRef(i,
 									tri.EdgeFunc0(acptCorner0) >= 0,
 									tri.EdgeFunc1(acptCorner1) >= 0,
 									tri.EdgeFunc2(acptCorner2) >= 0,
@@ -229,115 +485,75 @@ namespace EDX
 			});
 
 
-			//for (auto i = 0; i < mTiles.Size(); i++)
-			parallel_for(0, (int)mTiles.Size(), [&](int i)
-			{
-				RasterizeTile(mTiles[i]);
-			});
+			view.pRasterizer->SetDepthFunc(GetDepthFunc(view, depthOnly));
 
-			mFragmentBuf.Clear();
-			mTiledShadingResultBuf.Resize(mTiles.Size());
-			for (auto i = 0; i < mTiles.Size(); i++)
+			// Depth-only passes leave no fragments to gather
+			if (depthOnly)
 			{
-				mTiledShadingResultBuf[i].Resize(mTiles[i].fragmentBuf.Size());
-				if (mTiles[i].fragmentBuf.Size() > 0)
-					mFragmentBuf.Insert(mTiles[i].fragmentBuf.Data(), mTiles[i].fragmentBuf.Size(), mFragmentBuf.Size());
+				mpWorkContext->ParallelFor(0, (int)view.tiles.Size(), [&](int i)
+				{
+					RasterizeTile<true>(view, view.tiles[i]);
+				});
+				return;
 			}
-		}
 
-		void Renderer::RasterizeTile(Tile& tile)
-		{
-			for (auto coreId = 0; coreId < mNumCores; coreId++)
+			//for (auto i = 0; i < view.tiles.Size(); i++)
+			mpWorkContext->ParallelFor(0, (int)view.tiles.Size(), [&](int i)
 			{
-				for (auto j = 0; j < tile.triangleRefs[coreId].Size(); j++)
-				{
-					const Tile::TriangleRef& triRef = tile.triangleRefs[coreId][j];
-					RasterTriangle& tri = mpRasterTriangleBuf[coreId][triRef.triId];
-
-					if (triRef.trivialAccept)
-					{
-						mpRasterizer->TrivialAcceptTriangle(tile, tile.minCoord, tile.maxCoord, tri);
-						continue;
-					}
+				RasterizeTile<false>(view, view.tiles[i]);
+			});
 
-					if (RenderStates::Instance()->HierarchicalRasterize && triRef.big)
-						mpRasterizer->CoarseRasterize(tile, triRef, Tile::SIZE, tile.minCoord, tile.maxCoord, tri);
-					else
-						mpRasterizer->FineRasterize(tile, triRef, Tile::SIZE, tile.minCoord, tile.maxCoord, tri);
-				}
+			view.fragmentBuf.Clear();
+			view.tiledShadingResultBuf.Resize(view.tiles.Size());
+			for (auto i = 0; i < view.tiles.Size(); i++)
+			{
+				view.tiledShadingResultBuf[i].Resize(view.tiles[i].fragmentBuf.Size());
+				if (view.tiles[i].fragmentBuf.Size() > 0)
+					view.fragmentBuf.Insert(view.tiles[i].fragmentBuf.Data(), view.tiles[i].fragmentBuf.Size(), view.fragmentBuf.Size());
 			}
-
 		}
 
-		void Renderer::FragmentProcessing()
+		void Renderer::FragmentProcessing(View& view, const DrawUniforms& uniforms)
 		{
-			//for (auto i = 0; i < mFragmentBuf.Size(); i++)
-			parallel_for(0, (int)mFragmentBuf.Size(), [&](int i)
-			{
-				Fragment& frag = mFragmentBuf[i];
-
-				const ProjectedVertex& v0 = mpDistributedProjVertexBuf[frag.coreId][frag.vId0];
-				const ProjectedVertex& v1 = mpDistributedProjVertexBuf[frag.coreId][frag.vId1];
-				const ProjectedVertex& v2 = mpDistributedProjVertexBuf[frag.coreId][frag.vId2];
-
-				Vec3f_SSE position;
-				Vec3f_SSE normal;
-				Vec2f_SSE texCoord;
-				frag.Interpolate(v0, v1, v2, frag.lambda0, frag.lambda1, position, normal, texCoord);
-
-				Vec3f_SSE shadingResults = mpPixelShader->Shade(frag,
-					Matrix::TransformPoint(Vector3::ZERO, RenderStates::Instance()->GetModelViewInvMatrix()),
-					Vector3(1, 1, -1),
-					position,
-					normal,
-					texCoord);
-
-				Color4b colorByte[4];
-				colorByte[0].FromFloats(shadingResults.x[0], shadingResults.y[0], shadingResults.z[0]);
-				colorByte[1].FromFloats(shadingResults.x[1], shadingResults.y[1], shadingResults.z[1]);
-				colorByte[2].FromFloats(shadingResults.x[2], shadingResults.y[2], shadingResults.z[2]);
-				colorByte[3].FromFloats(shadingResults.x[3], shadingResults.y[3], shadingResults.z[3]);
-
-				mTiledShadingResultBuf[frag.tileId][frag.intraTileIdx] = _mm_loadu_si128((__m128i*)&colorByte);
-			});
+			mpPipelineState->ShadeFragments(view.fragmentBuf, view.pDistributedProjVertexBuf, uniforms, *mpWorkContext, view.tiledShadingResultBuf);
 		}
 
-		void Renderer::UpdateFrameBuffer()
+		void Renderer::UpdateFrameBuffer(View& view)
 		{
-			parallel_for(0, (int)mTiledShadingResultBuf.Size(), [&](int i)
+			mpWorkContext->ParallelFor(0, (int)view.tiledShadingResultBuf.Size(), [&](int i)
 			{
-				for (auto j = 0; j < mTiles[i].fragmentBuf.Size(); j++)
+				for (auto j = 0; j < view.tiles[i].fragmentBuf.Size(); j++)
 				{
-					const Fragment& frag = mTiles[i].fragmentBuf[j];
-					for (auto sId = 0; sId < mpFrameBuffer->GetSampleCount(); sId++)
+					const Fragment& frag = view.tiles[i].fragmentBuf[j];
+					for (auto sId = 0; sId < view.pFrameBuffer->GetSampleCount(); sId++)
 					{
 						int maskShift = sId << 2;
 
-						const IntSSE& quadResults = mTiledShadingResultBuf[i][j];
+						const IntSSE& quadResults = view.tiledShadingResultBuf[i][j];
 						if (frag.coverageMask.GetBit(maskShift) != 0)
 						{
-							mpFrameBuffer->SetPixel(Color4b(quadResults.m128.m128i_u8[0],
+							view.pFrameBuffer->SetPixel(Color4b(quadResults.m128.m128i_u8[0],
 								quadResults.m128.m128i_u8[1],
 								quadResults.m128.m128i_u8[2]),
 								frag.x, frag.y, sId);
 						}
 						if (frag.coverageMask.GetBit(maskShift + 1) != 0)
 						{
-							mpFrameBuffer->SetPixel(Color4b(quadResults.m128.m128i_u8[4],
+							view.pFrameBuffer->SetPixel(Color4b(quadResults.m128.m128i_u8[4],
 								quadResults.m128.m128i_u8[5],
 								quadResults.m128.m128i_u8[6]),
 								frag.x + 1, frag.y, sId);
 						}
 						if (frag.coverageMask.GetBit(maskShift + 2) != 0)
 						{
-							mpFrameBuffer->SetPixel(Color4b(quadResults.m128.m128i_u8[8],
+							view.pFrameBuffer->SetPixel(Color4b(quadResults.m128.m128i_u8[8],
 								quadResults.m128.m128i_u8[9],
 								quadResults.m128.m128i_u8[10]),
 								frag.x, frag.y + 1, sId);
 						}
 						if (frag.coverageMask.GetBit(maskShift + 3) != 0)
 						{
-							mpFrameBuffer->SetPixel(Color4b(quadResults.m128.m128i_u8[12],
+							view.pFrameBuffer->SetPixel(Color4b(quadResults.m128.m128i_u8[12],
 								quadResults.m128.m128i_u8[13],
 								quadResults.m128.m128i_u8[14]),
 								frag.x + 1, frag.y + 1, sId);
@@ -345,29 +561,30 @@ namespace EDX
 					}
 				}
 			});
-
-			mpFrameBuffer->Resolve();
 		}
 
 		void Renderer::WriteFrameToFile() const
 		{
 			char fileName[MAX_PATH];
-			sprintf_s(fileName, MAX_PATH, "%s/Frames/Frame%05i.bmp", Application::GetBaseDirectory(), RenderStates::Instance()->FrameCount);
+			sprintf_s(fileName, MAX_PATH, "%s/Frames/Frame%05i.bmp", Application::GetBaseDirectory(), mRenderStates.FrameCount);
 
-			Bitmap::SaveBitmapFile(fileName, GetBackBuffer(), mpFrameBuffer->GetWidth(), mpFrameBuffer->GetHeight());
+			Bitmap::SaveBitmapFile(fileName, GetBackBuffer(), mViews[0]->pFrameBuffer->GetWidth(), mViews[0]->pFrameBuffer->GetHeight());
 		}
 
-		const _byte* Renderer::GetBackBuffer() const
+		const _byte* Renderer::GetBackBuffer(const int viewId) const
 		{
-			return mpFrameBuffer->GetColorBuffer();
+			return mViews[viewId]->pFrameBuffer->GetColorBuffer();
 		}
 
-		Renderer::~Renderer()
+		// Out of line so View is complete wherever the views are built or destroyed
+		Renderer::Renderer()
+			: mNumCores(1)
+			, mWriteFrames(false)
 		{
-			Memory::SafeDeleteArray(mpDistributedProjVertexBuf);
-			Memory::SafeDeleteArray(mpRasterTriangleBuf);
+		}
 
-			RenderStates::DeleteInstance();
+		Renderer::~Renderer()
+		{
 		}
 	}
 }
\ No newline at end of file
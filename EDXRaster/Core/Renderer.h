@@ -3,8 +3,12 @@
 #include "EDXPrerequisites.h"
 #include "RenderStates.h"
 #include "Shader.h"
+#include "ConstantBuffer.h"
+#include "PipelineState.h"
+#include "ScriptShader.h"
 #include "RasterTriangle.h"
 #include "Tile.h"
+#include "WorkerPool.h"
 #include "../Utils/InputBuffer.h"
 #include "Windows/Threading.h"
 
@@ -12,50 +16,157 @@ namespace EDX
 {
 	namespace RasterRenderer
 	{
+		// A camera of a multi-view draw
+		struct ViewDesc
+		{
+			Matrix ModelView;
+			Matrix Proj;
+			Matrix ToRaster;
+		};
+
+		// One copy of an instanced draw
+		struct MeshInstance
+		{
+			Matrix World;	// Applied on top of the placement the mesh was loaded with
+
+			// Texture slot of the mesh used for every triangle, negative to keep the mesh's own. Slots past the
+			// mesh's textures assert and also keep its own
+			int TextureId;
+
+			MeshInstance(const Matrix& world = Matrix::IDENTITY, const int textureId = -1)
+				: World(world)
+				, TextureId(textureId)
+			{
+			}
+		};
+
+		// Renderers can draw on different threads at once. Textures come from the process wide TextureCache, so
+		// its per frame UpdateStreaming has to be called between the frames of all renderers, never while any
+		// of them is drawing, since it commits and evicts mip levels in place
 		class Renderer
 		{
 		private:
-			UniquePtr<class FrameBuffer> mpFrameBuffer;
-			UniquePtr<class Rasterizer> mpRasterizer;
-			UniquePtr<class VertexShader> mpVertexShader;
-			UniquePtr<class PixelShader> mpPixelShader;
+			// Vertices shaded at once by an instanced draw, instances are drawn in groups of about this many
+			// vertices so memory does not grow with the instance count
+			static const uint INSTANCE_GROUP_VERTEX_COUNT = 1 << 16;
+
+			// Everything a camera clips, bins and shades into, defined in Renderer.cpp
+			struct View;
+
+			UniquePtr<PipelineState> mpPipelineState;
+			RenderStates mRenderStates;
+
+			// Bound constant buffers, the renderer's own ones unless the application binds others
+			ConstantBuffer<TransformConstants> mTransformConstants;
+			ConstantBuffer<LightConstants> mLightConstants;
+			const ConstantBuffer<TransformConstants>* mpTransformConstants;
+			const ConstantBuffer<LightConstants>* mpLightConstants;
 			UniquePtr<class Scene> mpScene;
+			UniquePtr<WorkContext> mpWorkContext;
 
+			// Vertex shader results, shared by every view of a draw
 			Array<ProjectedVertex> mProjectedVertexBuf;
-			Array<ProjectedVertex>* mpDistributedProjVertexBuf;
-			Array<RasterTriangle>* mpRasterTriangleBuf;
-			Array<Fragment> mFragmentBuf;
-			Array<Array<IntSSE>> mTiledShadingResultBuf;
 
-			Array<Tile> mTiles;
-			Vector2i mTileDim;
+			// The instanced draw's current group
+			Array<VertexInstance> mInstanceGroup;
+			Array<int> mInstanceGroupTexIds;
+
+			// RenderMesh draws into the first view, RenderMeshViews into as many as it has cameras
+			Array<UniquePtr<View>> mViews;
+			Array<UniquePtr<View>> mDepthTargets;
 
 			int mNumCores;
 			bool mWriteFrames;
 
 		public:
+			Renderer();
 			~Renderer();
 
 		public:
-			void Initialize(uint iScreenWidth, uint iScreenHeight);
+			// Renderers given the same pool share its workers, without a pool every stage runs on the thread
+			// calling RenderMesh
+			void Initialize(uint iScreenWidth, uint iScreenHeight, WorkerPool* pWorkerPool = WorkerPool::Instance());
 			void Resize(uint iScreenWidth, uint iScreenHeight);
 			void SetTransform(const class Matrix& mModelView, const Matrix& mProj, const Matrix& mToRaster);
+			void SetTransformConstants(const ConstantBuffer<TransformConstants>* pBuffer);
+			void SetLightConstants(const ConstantBuffer<LightConstants>* pBuffer);
 			void RenderMesh(const class Mesh& mesh);
 
+			// Draws the mesh from every camera in one pass. The vertex shader runs once per vertex with the first
+			// camera's transform and its positions are reprojected into the other views, which are clipped, binned
+			// and shaded into frame buffers of their own. The transform set with SetTransform is not used
+			void RenderMeshViews(const class Mesh& mesh, const ViewDesc* pViews, const int viewCount);
+
+			// Draws the mesh once for every instance with the bound transform. Instances whose moved bounds are
+			// outside the view are skipped, the rest share one decode of each vertex batch
+			void RenderMeshInstanced(const class Mesh& mesh, const MeshInstance* pInstances, const int instanceCount);
+
+			// Z prepass, writes the mesh's depth into the first view without building or shading fragments. A
+			// following draw with DepthFunc::Equal keeps that depth and shades every pixel once. RenderMeshViews
+			// tests its other views with LessEqual, the prepass never reaches them
+			void RenderMeshDepth(const class Mesh& mesh);
+
+			// Single sampled depth-only targets of any size, such as shadow maps and occlusion buffers
+			int AddDepthTarget(const uint width, const uint height);
+			void RenderMeshDepth(const class Mesh& mesh, const ViewDesc& camera, const int targetId);
+			void ReadDepth(const int targetId, float* pDepths) const;
+
 			void WriteFrameToFile() const;
-			const _byte* GetBackBuffer() const;
+			const _byte* GetBackBuffer(const int viewId = 0) const;
 			void SetMSAAMode(const int msaaCountLog2);
-			void SetTextureFilter(const TextureFilter filter) { RenderStates::Instance()->TexFilter = filter; }
-			void SetHierarchicalRasterize(const bool hRas) { RenderStates::Instance()->HierarchicalRasterize = hRas; }
+			void SetTextureFilter(const TextureFilter filter);
+			void SetHierarchicalRasterize(const bool hRas) { mRenderStates.HierarchicalRasterize = hRas; }
+			void SetDepthFunc(const DepthFunc func) { mRenderStates.DepthTest = func; }
 			void SetWriteFrames(const bool wf) { mWriteFrames = wf; }
+			void SetWorkContextDesc(const WorkContextDesc& desc) { mpWorkContext->SetDesc(desc); }
+			const RenderStates& GetRenderStates() const { return mRenderStates; }
+
+			template<typename VertexShaderType, typename PixelShaderType>
+			void SetShaders()
+			{
+				mpPipelineState = PipelineState::Create<VertexShaderType, PixelShaderType>(mpPipelineState->GetDesc());
+			}
+
+			// Shaders compiled from HLSL at runtime, executed by the interpreter. A null program, as left by a failed
+			// compile, keeps the current shaders and returns false
+			bool SetShaderPrograms(const std::shared_ptr<const ShaderProgram>& pVertexProgram, const std::shared_ptr<const ShaderProgram>& pPixelProgram)
+			{
+				if (!pVertexProgram || !pPixelProgram)
+					return false;
+
+				mpPipelineState = MakeUnique<ScriptPipelineState>(pVertexProgram, pPixelProgram, mpPipelineState->GetDesc());
+				return true;
+			}
 
 		private:
-			void VertexProcessing(const IVertexBuffer* pVertexBuf);
-			void Clipping(IndexBuffer* pIndexBuf, const Array<uint>& texIdBuf);
-			void TiledRasterization();
-			void RasterizeTile(Tile& tile);
-			void FragmentProcessing();
-			void UpdateFrameBuffer();
+			UniquePtr<View> CreateView(uint iScreenWidth, uint iScreenHeight, const uint sampleCountLog2);
+			void InitTiles(View& view, uint iScreenWidth, uint iScreenHeight);
+			void ClearView(View& view);
+			DepthFunc GetDepthFunc(const View& view, const bool depthOnly) const;
+			DrawUniforms GetDrawUniforms(const class Mesh& mesh, const TransformConstants& transform);
+
+			void VertexProcessing(const IVertexBuffer* pVertexBuf, const DrawUniforms& uniforms);
+			void DrawInstanceGroup(View& view, const class Mesh& mesh, const DrawUniforms& uniforms);
+			void DrawDepth(View& view, const class Mesh& mesh, const DrawUniforms& uniforms, const Matrix& rasterMatrix);
+			void DrawView(View& view,
+				const class Mesh& mesh,
+				const DrawUniforms& uniforms,
+				const Matrix& rasterMatrix,
+				const Matrix* pReprojectMatrix,
+				const int instanceCount = 1,
+				const int* pInstanceTexIds = nullptr);
+			void Clipping(View& view,
+				IndexBuffer* pIndexBuf,
+				const Array<uint>& texIdBuf,
+				const Matrix& rasterMatrix,
+				const Matrix* pReprojectMatrix,
+				const int instanceCount,
+				const int* pInstanceTexIds);
+			void TiledRasterization(View& view, const bool depthOnly);
+			template<bool DepthOnly>
+			void RasterizeTile(View& view, Tile& tile);
+			void FragmentProcessing(View& view, const DrawUniforms& uniforms);
+			void UpdateFrameBuffer(View& view);
 		};
 
 	}
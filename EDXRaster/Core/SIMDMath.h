@@ -0,0 +1,389 @@
+#pragma once
+
+#include "EDXPrerequisites.h"
+#include "SIMD/SSE.h"
+
+#include <immintrin.h>
+
+namespace EDX
+{
+	namespace RasterRenderer
+	{
+		// Register level operations the math functions are written against, one specialization per register width
+		template<typename Float>
+		struct SIMDOps;
+
+		template<>
+		struct SIMDOps<__m128>
+		{
+			typedef __m128i Int;
+
+			static __forceinline __m128 Set(const float val) { return _mm_set1_ps(val); }
+			static __forceinline Int SetInt(const int val) { return _mm_set1_epi32(val); }
+
+			static __forceinline __m128 Add(const __m128 a, const __m128 b) { return _mm_add_ps(a, b); }
+			static __forceinline __m128 Sub(const __m128 a, const __m128 b) { return _mm_sub_ps(a, b); }
+			static __forceinline __m128 Mul(const __m128 a, const __m128 b) { return _mm_mul_ps(a, b); }
+			static __forceinline __m128 MulAdd(const __m128 a, const __m128 b, const __m128 c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+			static __forceinline __m128 Min(const __m128 a, const __m128 b) { return _mm_min_ps(a, b); }
+			static __forceinline __m128 Max(const __m128 a, const __m128 b) { return _mm_max_ps(a, b); }
+
+			static __forceinline __m128 And(const __m128 a, const __m128 b) { return _mm_and_ps(a, b); }
+			static __forceinline __m128 Or(const __m128 a, const __m128 b) { return _mm_or_ps(a, b); }
+			static __forceinline __m128 Xor(const __m128 a, const __m128 b) { return _mm_xor_ps(a, b); }
+			static __forceinline __m128 Select(const __m128 mask, const __m128 a, const __m128 b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+
+			static __forceinline __m128 CmpLt(const __m128 a, const __m128 b) { return _mm_cmplt_ps(a, b); }
+			static __forceinline __m128 CmpGe(const __m128 a, const __m128 b) { return _mm_cmpge_ps(a, b); }
+			static __forceinline __m128 CmpEq(const __m128 a, const __m128 b) { return _mm_cmpeq_ps(a, b); }
+
+			static __forceinline Int Round(const __m128 a) { return _mm_cvtps_epi32(a); }
+			static __forceinline Int Truncate(const __m128 a) { return _mm_cvttps_epi32(a); }
+			static __forceinline __m128 ToFloat(const Int a) { return _mm_cvtepi32_ps(a); }
+			static __forceinline Int AsInt(const __m128 a) { return _mm_castps_si128(a); }
+			static __forceinline __m128 AsFloat(const Int a) { return _mm_castsi128_ps(a); }
+
+			static __forceinline Int AddInt(const Int a, const Int b) { return _mm_add_epi32(a, b); }
+			static __forceinline Int SubInt(const Int a, const Int b) { return _mm_sub_epi32(a, b); }
+			static __forceinline Int AndInt(const Int a, const Int b) { return _mm_and_si128(a, b); }
+			static __forceinline Int OrInt(const Int a, const Int b) { return _mm_or_si128(a, b); }
+			static __forceinline Int CmpEqInt(const Int a, const Int b) { return _mm_cmpeq_epi32(a, b); }
+			template<int Count> static __forceinline Int ShiftLeft(const Int a) { return _mm_slli_epi32(a, Count); }
+			template<int Count> static __forceinline Int ShiftRight(const Int a) { return _mm_srli_epi32(a, Count); }
+			template<int Count> static __forceinline Int ShiftRightArith(const Int a) { return _mm_srai_epi32(a, Count); }
+
+			static __forceinline __m128 Rcp(const __m128 a) { return _mm_rcp_ps(a); }
+			static __forceinline __m128 Rsqrt(const __m128 a) { return _mm_rsqrt_ps(a); }
+		};
+
+#if defined(__AVX2__)
+		template<>
+		struct SIMDOps<__m256>
+		{
+			typedef __m256i Int;
+
+			static __forceinline __m256 Set(const float val) { return _mm256_set1_ps(val); }
+			static __forceinline Int SetInt(const int val) { return _mm256_set1_epi32(val); }
+
+			static __forceinline __m256 Add(const __m256 a, const __m256 b) { return _mm256_add_ps(a, b); }
+			static __forceinline __m256 Sub(const __m256 a, const __m256 b) { return _mm256_sub_ps(a, b); }
+			static __forceinline __m256 Mul(const __m256 a, const __m256 b) { return _mm256_mul_ps(a, b); }
+			static __forceinline __m256 MulAdd(const __m256 a, const __m256 b, const __m256 c) { return _mm256_fmadd_ps(a, b, c); }
+			static __forceinline __m256 Min(const __m256 a, const __m256 b) { return _mm256_min_ps(a, b); }
+			static __forceinline __m256 Max(const __m256 a, const __m256 b) { return _mm256_max_ps(a, b); }
+
+			static __forceinline __m256 And(const __m256 a, const __m256 b) { return _mm256_and_ps(a, b); }
+			static __forceinline __m256 Or(const __m256 a, const __m256 b) { return _mm256_or_ps(a, b); }
+			static __forceinline __m256 Xor(const __m256 a, const __m256 b) { return _mm256_xor_ps(a, b); }
+			static __forceinline __m256 Select(const __m256 mask, const __m256 a, const __m256 b) { return _mm256_blendv_ps(b, a, mask); }
+
+			static __forceinline __m256 CmpLt(const __m256 a, const __m256 b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+			static __forceinline __m256 CmpGe(const __m256 a, const __m256 b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+			static __forceinline __m256 CmpEq(const __m256 a, const __m256 b) { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+
+			static __forceinline Int Round(const __m256 a) { return _mm256_cvtps_epi32(a); }
+			static __forceinline Int Truncate(const __m256 a) { return _mm256_cvttps_epi32(a); }
+			static __forceinline __m256 ToFloat(const Int a) { return _mm256_cvtepi32_ps(a); }
+			static __forceinline Int AsInt(const __m256 a) { return _mm256_castps_si256(a); }
+			static __forceinline __m256 AsFloat(const Int a) { return _mm256_castsi256_ps(a); }
+
+			static __forceinline Int AddInt(const Int a, const Int b) { return _mm256_add_epi32(a, b); }
+			static __forceinline Int SubInt(const Int a, const Int b) { return _mm256_sub_epi32(a, b); }
+			static __forceinline Int AndInt(const Int a, const Int b) { return _mm256_and_si256(a, b); }
+			static __forceinline Int OrInt(const Int a, const Int b) { return _mm256_or_si256(a, b); }
+			static __forceinline Int CmpEqInt(const Int a, const Int b) { return _mm256_cmpeq_epi32(a, b); }
+			template<int Count> static __forceinline Int ShiftLeft(const Int a) { return _mm256_slli_epi32(a, Count); }
+			template<int Count> static __forceinline Int ShiftRight(const Int a) { return _mm256_srli_epi32(a, Count); }
+			template<int Count> static __forceinline Int ShiftRightArith(const Int a) { return _mm256_srai_epi32(a, Count); }
+
+			static __forceinline __m256 Rcp(const __m256 a) { return _mm256_rcp_ps(a); }
+			static __forceinline __m256 Rsqrt(const __m256 a) { return _mm256_rsqrt_ps(a); }
+		};
+#endif
+
+		// Single precision transcendentals over whole registers, branch free. Errors were measured against double
+		// precision and are given in ULP of the result, on the domain stated for each function. The Fast variants
+		// drop special case handling and use shorter polynomials, they are meant for shading where 8 bit output
+		// hides their error
+		template<typename Float>
+		class SIMDMath
+		{
+		private:
+			typedef SIMDOps<Float> Ops;
+			typedef typename Ops::Int Int;
+
+		public:
+			// 1.2 ULP for x in [-126, 128), 0 below -126 (no denormals), +inf from 128
+			static __forceinline Float Exp2(const Float x)
+			{
+				const Float clamped = Ops::Min(Ops::Max(x, Ops::Set(-126.0f)), Ops::Set(128.0f));
+				const Int n = Ops::Round(clamped);
+				const Float f = Ops::Sub(clamped, Ops::ToFloat(n));
+
+				Float p = Ops::Set(1.535336188319500e-4f);
+				p = Ops::MulAdd(p, f, Ops::Set(1.339887440266574e-3f));
+				p = Ops::MulAdd(p, f, Ops::Set(9.618437357674640e-3f));
+				p = Ops::MulAdd(p, f, Ops::Set(5.550332471162809e-2f));
+				p = Ops::MulAdd(p, f, Ops::Set(2.402264791363012e-1f));
+				p = Ops::MulAdd(p, f, Ops::Set(6.931472028550421e-1f));
+				p = Ops::MulAdd(p, f, Ops::Set(1.0f));
+
+				// 2^n in two factors since 2^128 has no exponent, the product overflows to +inf as it should
+				const Int halfN = Ops::template ShiftRightArith<1>(n);
+				p = ScaleByPow2(ScaleByPow2(p, halfN), Ops::SubInt(n, halfN));
+				return Ops::Select(Ops::CmpLt(x, Ops::Set(-126.0f)), Ops::Set(0.0f), p);
+			}
+
+			// Relative error below 7.5e-5 (about 13.7 bits) for x in [-126, 127]
+			static __forceinline Float FastExp2(const Float x)
+			{
+				const Float clamped = Ops::Min(Ops::Max(x, Ops::Set(-126.0f)), Ops::Set(127.0f));
+				const Int n = Ops::Round(clamped);
+				const Float f = Ops::Sub(clamped, Ops::ToFloat(n));
+
+				Float p = Ops::Set(0.05517167f);
+				p = Ops::MulAdd(p, f, Ops::Set(0.24261114f));
+				p = Ops::MulAdd(p, f, Ops::Set(0.69326099f));
+				p = Ops::MulAdd(p, f, Ops::Set(0.99992807f));
+				return ScaleByPow2(p, n);
+			}
+
+			// 1.4 ULP for positive normal x. Zero and denormals give -inf, negative x and NaN give NaN, +inf gives +inf
+			static __forceinline Float Log2(const Float x)
+			{
+				Float e, z;
+				SplitMantissa(x, e, z);
+
+				const Float z2 = Ops::Mul(z, z);
+				Float p = Ops::Set(7.0376836292e-2f);
+				p = Ops::MulAdd(p, z, Ops::Set(-1.1514610310e-1f));
+				p = Ops::MulAdd(p, z, Ops::Set(1.1676998740e-1f));
+				p = Ops::MulAdd(p, z, Ops::Set(-1.2420140846e-1f));
+				p = Ops::MulAdd(p, z, Ops::Set(1.4249322787e-1f));
+				p = Ops::MulAdd(p, z, Ops::Set(-1.6668057665e-1f));
+				p = Ops::MulAdd(p, z, Ops::Set(2.0000714765e-1f));
+				p = Ops::MulAdd(p, z, Ops::Set(-2.4999993993e-1f));
+				p = Ops::MulAdd(p, z, Ops::Set(3.3333331174e-1f));
+
+				// ln(1 + z) = z + y, scaled by log2(e) split in two so that z keeps its precision
+				const Float y = Ops::Sub(Ops::Mul(Ops::Mul(z, z2), p), Ops::Mul(Ops::Set(0.5f), z2));
+				const Float log2eLow = Ops::Set(0.44269504088896340736f);
+				Float ret = Ops::MulAdd(y, log2eLow, Ops::Mul(z, log2eLow));
+				ret = Ops::Add(Ops::Add(ret, y), Ops::Add(z, e));
+
+				const Float infinity = Ops::AsFloat(Ops::SetInt(0x7f800000));
+				ret = Ops::Select(Ops::CmpLt(x, Ops::Set(1.17549435e-38f)), Ops::Xor(infinity, Ops::Set(-0.0f)), ret);
+				ret = Ops::Select(Ops::CmpEq(x, infinity), infinity, ret);
+				return Ops::Select(Ops::CmpGe(x, Ops::Set(0.0f)), ret, Ops::AsFloat(Ops::SetInt(0x7fc00000)));
+			}
+
+			// Absolute error below 2e-5 for positive normal x, no special cases
+			static __forceinline Float FastLog2(const Float x)
+			{
+				Float e, z;
+				SplitMantissa(x, e, z);
+
+				Float p = Ops::Set(0.25266021f);
+				p = Ops::MulAdd(p, z, Ops::Set(-0.39457551f));
+				p = Ops::MulAdd(p, z, Ops::Set(0.4866862f));
+				p = Ops::MulAdd(p, z, Ops::Set(-0.72024179f));
+				p = Ops::MulAdd(p, z, Ops::Set(1.44257801f));
+				return Ops::MulAdd(p, z, e);
+			}
+
+			// The argument scaling adds about 0.7 ULP per unit of |x|, 64 ULP close to the overflow limit
+			static __forceinline Float Exp(const Float x)
+			{
+				return Exp2(Ops::Mul(x, Ops::Set(1.44269504088896340736f)));
+			}
+
+			// 2 ULP for positive normal x
+			static __forceinline Float Log(const Float x)
+			{
+				return Ops::Mul(Log2(x), Ops::Set(0.69314718055994530942f));
+			}
+
+			// x^y for x >= 0 as Exp2(y * Log2(x)), 0^y is 0 and x^0 is 1. The error grows with |y * log2(x)|:
+			// 1.8 ULP below 1, then about 2.2 ULP per unit (pow(x, 200) of a specular lobe stays within 160 ULP)
+			static __forceinline Float Pow(const Float x, const Float y)
+			{
+				const Float ret = Exp2(Ops::Mul(y, Log2(x)));
+				return Ops::Select(Ops::CmpEq(y, Ops::Set(0.0f)), Ops::Set(1.0f), ret);
+			}
+
+			// Relative error below 8e-5 + 2.2e-5 * |y * log2(x)| for positive normal x
+			static __forceinline Float FastPow(const Float x, const Float y)
+			{
+				return FastExp2(Ops::Mul(y, FastLog2(x)));
+			}
+
+			// 1.5 ULP for |x| <= pi, absolute error below 8e-8 for |x| <= 8192
+			static __forceinline void SinCos(const Float x, Float& sin, Float& cos)
+			{
+				Float reduced;
+				Int octant;
+				ReduceToOctant<true>(x, reduced, octant);
+
+				const Float z = Ops::Mul(reduced, reduced);
+				Float s = Ops::Set(-1.9515295891e-4f);
+				s = Ops::MulAdd(s, z, Ops::Set(8.3321608736e-3f));
+				s = Ops::MulAdd(s, z, Ops::Set(-1.6666654611e-1f));
+				s = Ops::MulAdd(Ops::Mul(s, z), reduced, reduced);
+
+				Float c = Ops::Set(2.443315711809948e-5f);
+				c = Ops::MulAdd(c, z, Ops::Set(-1.388731625493765e-3f));
+				c = Ops::MulAdd(c, z, Ops::Set(4.166664568298827e-2f));
+				c = Ops::Add(Ops::Sub(Ops::Mul(Ops::Mul(c, z), z), Ops::Mul(Ops::Set(0.5f), z)), Ops::Set(1.0f));
+
+				ApplyOctant(x, s, c, octant, sin, cos);
+			}
+
+			// Absolute error below 1.5e-5 for |x| <= 8192
+			static __forceinline void FastSinCos(const Float x, Float& sin, Float& cos)
+			{
+				Float reduced;
+				Int octant;
+				ReduceToOctant<false>(x, reduced, octant);
+
+				const Float z = Ops::Mul(reduced, reduced);
+				Float s = Ops::MulAdd(Ops::Set(0.00815006f), z, Ops::Set(-0.16662382f));
+				s = Ops::MulAdd(Ops::Mul(s, z), reduced, Ops::Mul(Ops::Set(0.99999849f), reduced));
+
+				Float c = Ops::MulAdd(Ops::Set(0.04036229f), z, Ops::Set(-0.49968548f));
+				c = Ops::MulAdd(c, z, Ops::Set(0.99998822f));
+
+				ApplyOctant(x, s, c, octant, sin, cos);
+			}
+
+			static __forceinline Float Sin(const Float x)
+			{
+				Float sin, cos;
+				SinCos(x, sin, cos);
+				return sin;
+			}
+			static __forceinline Float Cos(const Float x)
+			{
+				Float sin, cos;
+				SinCos(x, sin, cos);
+				return cos;
+			}
+			static __forceinline Float FastSin(const Float x)
+			{
+				Float sin, cos;
+				FastSinCos(x, sin, cos);
+				return sin;
+			}
+			static __forceinline Float FastCos(const Float x)
+			{
+				Float sin, cos;
+				FastSinCos(x, sin, cos);
+				return cos;
+			}
+
+			// Hardware estimate refined by one Newton-Raphson step, 3 ULP (2 with FMA). x must be finite and nonzero
+			static __forceinline Float Rcp(const Float x)
+			{
+				const Float r = Ops::Rcp(x);
+				return Ops::MulAdd(r, Ops::Sub(Ops::Set(1.0f), Ops::Mul(x, r)), r);
+			}
+
+			// Hardware estimate only, relative error below 1.5 * 2^-12
+			static __forceinline Float FastRcp(const Float x)
+			{
+				return Ops::Rcp(x);
+			}
+
+			// Hardware estimate refined by one Newton-Raphson step, 4 ULP. x must be finite and positive
+			static __forceinline Float Rsqrt(const Float x)
+			{
+				const Float r = Ops::Rsqrt(x);
+				const Float halfXr = Ops::Mul(Ops::Mul(Ops::Set(0.5f), x), r);
+				return Ops::Mul(r, Ops::Sub(Ops::Set(1.5f), Ops::Mul(halfXr, r)));
+			}
+
+			// Hardware estimate only, relative error below 1.5 * 2^-12
+			static __forceinline Float FastRsqrt(const Float x)
+			{
+				return Ops::Rsqrt(x);
+			}
+
+		private:
+			// p * 2^n for n in [-126, 127], built directly in the exponent bits
+			static __forceinline Float ScaleByPow2(const Float p, const Int n)
+			{
+				return Ops::Mul(p, Ops::AsFloat(Ops::template ShiftLeft<23>(Ops::AddInt(n, Ops::SetInt(127)))));
+			}
+
+			// x = 2^e * (1 + z) with 1 + z in [sqrt(1/2), sqrt(2))
+			static __forceinline void SplitMantissa(const Float x, Float& e, Float& z)
+			{
+				const Int bits = Ops::AsInt(x);
+				const Float mantissa = Ops::AsFloat(Ops::OrInt(Ops::AndInt(bits, Ops::SetInt(0x007fffff)), Ops::SetInt(0x3f800000)));
+				const Float exponent = Ops::ToFloat(Ops::AddInt(Ops::template ShiftRight<23>(Ops::AndInt(bits, Ops::SetInt(0x7f800000))), Ops::SetInt(-127)));
+
+				const Float upper = Ops::CmpGe(mantissa, Ops::Set(1.41421356f));
+				e = Ops::Add(exponent, Ops::And(upper, Ops::Set(1.0f)));
+				z = Ops::Sub(Ops::Select(upper, Ops::Mul(mantissa, Ops::Set(0.5f)), mantissa), Ops::Set(1.0f));
+			}
+
+			// |x| reduced to [-pi/4, pi/4] around the nearest even multiple of pi/4. pi/4 is subtracted in parts
+			// so that large arguments keep their precision, three for the accurate version and two for the fast one
+			template<bool Accurate>
+			static __forceinline void ReduceToOctant(const Float x, Float& reduced, Int& octant)
+			{
+				const Float absX = Ops::And(x, Ops::AsFloat(Ops::SetInt(0x7fffffff)));
+				octant = Ops::Truncate(Ops::Mul(absX, Ops::Set(1.27323954473516f)));
+				octant = Ops::AndInt(Ops::AddInt(octant, Ops::SetInt(1)), Ops::SetInt(~1));
+				const Float y = Ops::ToFloat(octant);
+
+				if (Accurate)
+				{
+					reduced = Ops::Sub(absX, Ops::Mul(y, Ops::Set(0.78515625f)));
+					reduced = Ops::Sub(reduced, Ops::Mul(y, Ops::Set(2.4187564849853515625e-4f)));
+					reduced = Ops::Sub(reduced, Ops::Mul(y, Ops::Set(3.77489497744594108e-8f)));
+				}
+				else
+				{
+					reduced = Ops::Sub(absX, Ops::Mul(y, Ops::Set(0.78515625f)));
+					reduced = Ops::Sub(reduced, Ops::Mul(y, Ops::Set(2.4191339e-4f)));
+				}
+			}
+
+			// Octants 2 and 6 swap the polynomials, the sign follows the octant and for sin also the sign of x
+			static __forceinline void ApplyOctant(const Float x, const Float s, const Float c, const Int octant, Float& sin, Float& cos)
+			{
+				const Float signBit = Ops::Set(-0.0f);
+				const Float swap = Ops::AsFloat(Ops::CmpEqInt(Ops::AndInt(octant, Ops::SetInt(2)), Ops::SetInt(2)));
+				const Float sinSign = Ops::Xor(Ops::AsFloat(Ops::template ShiftLeft<29>(Ops::AndInt(octant, Ops::SetInt(4)))), Ops::And(x, signBit));
+				const Float cosSign = Ops::AsFloat(Ops::template ShiftLeft<29>(Ops::AndInt(Ops::AddInt(octant, Ops::SetInt(2)), Ops::SetInt(4))));
+
+				sin = Ops::Xor(Ops::Select(swap, c, s), sinSign);
+				cos = Ops::Xor(Ops::Select(swap, s, c), cosSign);
+			}
+		};
+
+		// FloatSSE front end used by the shaders
+		namespace VectorMath
+		{
+			typedef SIMDMath<__m128> MathSSE;
+
+			__forceinline FloatSSE Exp2(const FloatSSE& x) { return MathSSE::Exp2(x.m128); }
+			__forceinline FloatSSE FastExp2(const FloatSSE& x) { return MathSSE::FastExp2(x.m128); }
+			__forceinline FloatSSE Log2(const FloatSSE& x) { return MathSSE::Log2(x.m128); }
+			__forceinline FloatSSE FastLog2(const FloatSSE& x) { return MathSSE::FastLog2(x.m128); }
+			__forceinline FloatSSE Exp(const FloatSSE& x) { return MathSSE::Exp(x.m128); }
+			__forceinline FloatSSE Log(const FloatSSE& x) { return MathSSE::Log(x.m128); }
+			__forceinline FloatSSE Pow(const FloatSSE& x, const FloatSSE& y) { return MathSSE::Pow(x.m128, y.m128); }
+			__forceinline FloatSSE FastPow(const FloatSSE& x, const FloatSSE& y) { return MathSSE::FastPow(x.m128, y.m128); }
+			__forceinline FloatSSE Sin(const FloatSSE& x) { return MathSSE::Sin(x.m128); }
+			__forceinline FloatSSE Cos(const FloatSSE& x) { return MathSSE::Cos(x.m128); }
+			__forceinline FloatSSE FastSin(const FloatSSE& x) { return MathSSE::FastSin(x.m128); }
+			__forceinline FloatSSE FastCos(const FloatSSE& x) { return MathSSE::FastCos(x.m128); }
+			__forceinline FloatSSE Rcp(const FloatSSE& x) { return MathSSE::Rcp(x.m128); }
+			__forceinline FloatSSE FastRcp(const FloatSSE& x) { return MathSSE::FastRcp(x.m128); }
+			__forceinline FloatSSE Rsqrt(const FloatSSE& x) { return MathSSE::Rsqrt(x.m128); }
+			__forceinline FloatSSE FastRsqrt(const FloatSSE& x) { return MathSSE::FastRsqrt(x.m128); }
+			__forceinline void SinCos(const FloatSSE& x, FloatSSE& sin, FloatSSE& cos) { MathSSE::SinCos(x.m128, sin.m128, cos.m128); }
+		}
+	}
+}
\ No newline at end of file
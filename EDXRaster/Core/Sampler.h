@@ -0,0 +1,45 @@
+#pragma once
+
+#include "EDXPrerequisites.h"
+#include "Graphics/Texture.h"
+#include "Math/EDXMath.h"
+
+namespace EDX
+{
+	namespace RasterRenderer
+	{
+		enum class SamplerFilter
+		{
+			Nearest,
+			Bilinear,
+			Trilinear,
+			Anisotropic
+		};
+
+		// Immutable filter state, bound per draw instead of being written into shared textures
+		class SamplerState
+		{
+		private:
+			SamplerFilter mFilter;
+			int mMaxAnisotropy;
+
+		public:
+			explicit SamplerState(const TextureFilter filter = TextureFilter::TriLinear)
+			{
+				// TextureFilter is ordered nearest, linear, trilinear, then 4x, 8x and 16x anisotropic
+				const int filterId = int(filter);
+				mFilter = SamplerFilter(Math::Min(filterId, int(SamplerFilter::Anisotropic)));
+				mMaxAnisotropy = mFilter == SamplerFilter::Anisotropic ? 4 << (filterId - int(SamplerFilter::Anisotropic)) : 1;
+			}
+
+			SamplerFilter GetFilter() const
+			{
+				return mFilter;
+			}
+			int GetMaxAnisotropy() const
+			{
+				return mMaxAnisotropy;
+			}
+		};
+	}
+}
\ No newline at end of file
@@ -0,0 +1,612 @@
+#include "ScriptShader.h"
+#include "../ShaderCompiler/ShaderCompiler.h"
+
+namespace EDX
+{
+	namespace RasterRenderer
+	{
+		using namespace ShaderCompiler;
+
+		namespace
+		{
+			// Fetches from the texture of the fragment's material, every quad of a batch may use a different one
+			class FragmentTextureSource : public IRTextureSource
+			{
+			private:
+				const DrawUniforms& mUniforms;
+				const uint* mpTextureIds;
+
+			public:
+				FragmentTextureSource(const DrawUniforms& uniforms, const uint* pTextureIds)
+					: mUniforms(uniforms)
+					, mpTextureIds(pTextureIds)
+				{
+				}
+
+				void SampleQuad(const int slot,
+					const int quad,
+					const __m128 u,
+					const __m128 v,
+					const float dUVdx[2],
+					const float dUVdy[2],
+					__m128 result[4]) const
+				{
+					const QuadTexture* pTexture = (*mUniforms.pTextureSlots)[mpTextureIds[quad]].get();
+					const Vec3f_SSE color = pTexture->SampleQuad(Vec2f_SSE(FloatSSE(u), FloatSSE(v)),
+						Vector2(dUVdx[0], dUVdx[1]),
+						Vector2(dUVdy[0], dUVdy[1]),
+						*mUniforms.pSampler);
+
+					result[0] = color.x.m128;
+					result[1] = color.y.m128;
+					result[2] = color.z.m128;
+					result[3] = _mm_set1_ps(1.0f);
+				}
+			};
+
+			bool FindAttribute(const string& semantic, ShaderProgram::Attribute& attrib)
+			{
+				if (semantic == "SV_POSITION")
+					attrib = ShaderProgram::Attribute::ScreenPosition;
+				else if (semantic == "POSITION")
+					attrib = ShaderProgram::Attribute::Position;
+				else if (semantic == "NORMAL")
+					attrib = ShaderProgram::Attribute::Normal;
+				else if (semantic == "TEXCOORD")
+					attrib = ShaderProgram::Attribute::TexCoord;
+				else if (semantic == "SV_TARGET" || semantic == "COLOR")
+					attrib = ShaderProgram::Attribute::Target;
+				else
+					return false;
+
+				return true;
+			}
+
+			// Components beyond what the vertex holds read as 0, except w of positions
+			float VertexComponent(const ShaderProgram::Attribute attrib, const int comp, const Vector3& position, const Vector3& normal, const Vector2& texCoord)
+			{
+				switch (attrib)
+				{
+				case ShaderProgram::Attribute::Position:
+					return comp < 3 ? (&position.x)[comp] : 1.0f;
+				case ShaderProgram::Attribute::Normal:
+					return comp < 3 ? (&normal.x)[comp] : 0.0f;
+				default:
+					return comp < 2 ? (&texCoord.x)[comp] : 0.0f;
+				}
+			}
+
+			__m128 FragmentComponent(const ShaderProgram::Attribute attrib, const int comp, const Fragment& frag, const Vec3f_SSE& position, const Vec3f_SSE& normal, const Vec2f_SSE& texCoord)
+			{
+				switch (attrib)
+				{
+				case ShaderProgram::Attribute::ScreenPosition:
+					// Pixel centers, depth is not available to the shader
+					if (comp == 0)
+						return _mm_add_ps(_mm_set1_ps(float(frag.x)), _mm_setr_ps(0.5f, 1.5f, 0.5f, 1.5f));
+					if (comp == 1)
+						return _mm_add_ps(_mm_set1_ps(float(frag.y)), _mm_setr_ps(0.5f, 0.5f, 1.5f, 1.5f));
+					return _mm_set1_ps(comp == 3 ? 1.0f : 0.0f);
+				case ShaderProgram::Attribute::Position:
+					return comp == 0 ? position.x.m128 : comp == 1 ? position.y.m128 : comp == 2 ? position.z.m128 : _mm_set1_ps(1.0f);
+				case ShaderProgram::Attribute::Normal:
+					return comp == 0 ? normal.x.m128 : comp == 1 ? normal.y.m128 : comp == 2 ? normal.z.m128 : _mm_setzero_ps();
+				default:
+					return comp == 0 ? texCoord.u.m128 : comp == 1 ? texCoord.v.m128 : _mm_setzero_ps();
+				}
+			}
+
+			// Registers of the single item entry points, kept between calls on the same thread. The weak
+			// reference keeps the program's control block alive, so a new program can never compare equal to
+			// a released one
+			struct SingleItemRegisters
+			{
+				std::weak_ptr<const ShaderProgram> pProgram;
+				Array<uint> UniformValues;	// What the setup code last ran on
+				Array<uint> Values;
+				IRRegisterFile<1> Registers;
+			};
+
+			thread_local SingleItemRegisters tVertexRegisters;
+			thread_local SingleItemRegisters tPixelRegisters;
+
+			// Gathering the uniforms is a few copies, the setup code only runs when they or the program change
+			IRRegisterFile<1>& GetSingleItemRegisters(SingleItemRegisters& cache, const std::shared_ptr<const ShaderProgram>& pProgram, const DrawUniforms& uniforms)
+			{
+				pProgram->GetUniformValues(uniforms, cache.Values);
+
+				const bool sameProgram = !cache.pProgram.owner_before(pProgram) && !pProgram.owner_before(cache.pProgram) && !cache.pProgram.expired();
+				if (sameProgram && memcmp(cache.Values.Data(), cache.UniformValues.Data(), cache.Values.Size() * sizeof(uint)) == 0)
+					return cache.Registers;
+
+				cache.pProgram = pProgram;
+				cache.UniformValues = cache.Values;
+				ExecuteSetup(pProgram->GetProgram(), cache.Values);
+				cache.Registers.Init(pProgram->GetProgram(), cache.Values);
+
+				return cache.Registers;
+			}
+		}
+
+		std::shared_ptr<ShaderProgram> ShaderProgram::Compile(const char* fileName,
+			const string& source,
+			const string& entryPoint,
+			const ShaderStage stage,
+			Array<CompileError>& errors)
+		{
+			auto pProgram = std::make_shared<ShaderProgram>();
+			if (!CompileShader(fileName, source, entryPoint, stage, pProgram->mProgram, errors, &pProgram->mOptimizeStats) || !pProgram->Bind(fileName, errors))
+				return nullptr;
+
+			for (auto i = 0; i < 3; i++)
+				pProgram->mpKernels[i] = ShaderKernelCache::Instance()->GetKernel(pProgram->mProgram, 1 << i);
+
+			return pProgram;
+		}
+
+		std::shared_ptr<ShaderProgram> ShaderProgram::CompileFromFile(const char* path,
+			const string& entryPoint,
+			const ShaderStage stage,
+			Array<CompileError>& errors)
+		{
+			FILE* pFile = nullptr;
+			if (fopen_s(&pFile, path, "rb") != 0 || !pFile)
+			{
+				errors.Add(CompileError("cannot open file", SourceInfo(path, 0, 0)));
+				return nullptr;
+			}
+
+			string source;
+			char buffer[4096];
+			size_t readSize;
+			while ((readSize = fread(buffer, 1, sizeof(buffer), pFile)) > 0)
+				source.append(buffer, readSize);
+			fclose(pFile);
+
+			return Compile(path, source, entryPoint, stage, errors);
+		}
+
+		std::shared_ptr<const ShaderProgram> ShaderProgram::LinkVertexProgram(const std::shared_ptr<const ShaderProgram>& pVertexProgram,
+			const ShaderProgram& pixelProgram)
+		{
+			auto pLinked = std::make_shared<ShaderProgram>(*pVertexProgram);
+			IRProgram& program = pLinked->mProgram;
+
+			// Clip space positions feed the rasterizer, everything else is only interpolated for the pixel program
+			Array<IRBinding> outputs;
+			for (auto i = 0; i < program.Outputs.Size(); i++)
+			{
+				Attribute attrib;
+				FindAttribute(program.Outputs[i].Name, attrib);
+
+				bool read = attrib == Attribute::ScreenPosition;
+				for (auto j = 0; j < pixelProgram.mInputs.Size(); j++)
+					read = read || pixelProgram.mInputs[j].Attrib == attrib;
+
+				if (read)
+					outputs.Add(program.Outputs[i]);
+			}
+
+			if (outputs.Size() == program.Outputs.Size())
+				return pVertexProgram;
+
+			program.Outputs = outputs;
+
+			IROptimizer optimizer;
+			optimizer.Optimize(program, &pLinked->mOptimizeStats);
+			pLinked->mOptimizeStats.InstructionCountBefore = pVertexProgram->mOptimizeStats.InstructionCountBefore;
+			pLinked->mOptimizeStats.SampleCountBefore = pVertexProgram->mOptimizeStats.SampleCountBefore;
+
+			// Registers moved, the interface was accepted before and binds again
+			pLinked->mUniforms.Clear();
+			pLinked->mInputs.Clear();
+			pLinked->mOutputs.Clear();
+
+			Array<CompileError> errors;
+			pLinked->Bind("", errors);
+			Assert(errors.Size() == 0);
+
+			for (auto i = 0; i < 3; i++)
+				pLinked->mpKernels[i] = ShaderKernelCache::Instance()->GetKernel(program, 1 << i);
+
+			return pLinked;
+		}
+
+		bool ShaderProgram::Bind(const char* fileName, Array<CompileError>& errors)
+		{
+			const int errorCount = errors.Size();
+			const SourceInfo srcInfo(fileName, 0, 0);
+			const bool vertexStage = mProgram.Stage == ShaderStage::Vertex;
+
+			struct UniformInfo
+			{
+				const char* Name;
+				Uniform Source;
+				HLSLType Type;
+			};
+			static const UniformInfo uniformTable[] =
+			{
+				{ "ModelViewProjMatrix", Uniform::ModelViewProjMatrix, HLSLType::MatrixOf(HLSLBaseType::Float, 4, 4) },
+				{ "ModelViewInvMatrix", Uniform::ModelViewInvMatrix, HLSLType::MatrixOf(HLSLBaseType::Float, 4, 4) },
+				{ "EyePos", Uniform::EyePos, HLSLType::Vector(HLSLBaseType::Float, 3) },
+				{ "LightDirection", Uniform::LightDirection, HLSLType::Vector(HLSLBaseType::Float, 3) },
+				{ "LightAmbient", Uniform::LightAmbient, HLSLType::Scalar(HLSLBaseType::Float) },
+				{ "LightIntensity", Uniform::LightIntensity, HLSLType::Scalar(HLSLBaseType::Float) },
+			};
+
+			for (auto i = 0; i < mProgram.Uniforms.Size(); i++)
+			{
+				const IRBinding& binding = mProgram.Uniforms[i];
+
+				const UniformInfo* pInfo = nullptr;
+				for (const auto& info : uniformTable)
+				{
+					if (binding.Name == info.Name)
+						pInfo = &info;
+				}
+
+				if (!pInfo)
+					errors.Add(CompileError("uniform '" + binding.Name + "' is not provided by the renderer", srcInfo));
+				else if (!binding.Type.SameAs(pInfo->Type))
+					errors.Add(CompileError("uniform '" + binding.Name + "' must be declared as '" + pInfo->Type.ToString() + "'", srcInfo));
+				else
+				{
+					UniformBinding uniform = { pInfo->Source, binding.Register };
+					mUniforms.Add(uniform);
+				}
+			}
+
+			for (auto i = 0; i < mProgram.Inputs.Size(); i++)
+			{
+				const IRBinding& binding = mProgram.Inputs[i];
+
+				Attribute attrib;
+				if (!FindAttribute(binding.Name, attrib) || attrib == Attribute::Target || (vertexStage && attrib == Attribute::ScreenPosition))
+					errors.Add(CompileError(string("input semantic '") + binding.Name + "' is not provided to " + (vertexStage ? "vertex" : "pixel") + " shaders", srcInfo));
+				else if (!binding.Type.IsFloatingPoint() || binding.ComponentCount > 4)
+					errors.Add(CompileError("input '" + binding.Name + "' must be a float scalar or vector", srcInfo));
+				else
+				{
+					AttributeBinding input = { attrib, binding.Register, binding.ComponentCount };
+					mInputs.Add(input);
+				}
+			}
+
+			bool hasRequiredOutput = false;
+			for (auto i = 0; i < mProgram.Outputs.Size(); i++)
+			{
+				const IRBinding& binding = mProgram.Outputs[i];
+
+				Attribute attrib;
+				if (!FindAttribute(binding.Name, attrib) || (attrib == Attribute::Target) == vertexStage)
+					errors.Add(CompileError(string("output semantic '") + binding.Name + "' is not consumed from " + (vertexStage ? "vertex" : "pixel") + " shaders", srcInfo));
+				else if (!binding.Type.IsFloatingPoint() || binding.ComponentCount > 4)
+					errors.Add(CompileError("output '" + binding.Name + "' must be a float scalar or vector", srcInfo));
+				else
+				{
+					AttributeBinding output = { attrib, binding.Register, binding.ComponentCount };
+					mOutputs.Add(output);
+					hasRequiredOutput = hasRequiredOutput || attrib == (vertexStage ? Attribute::ScreenPosition : Attribute::Target);
+				}
+			}
+
+			if (!hasRequiredOutput)
+				errors.Add(CompileError(vertexStage ? "vertex shaders must write SV_Position" : "pixel shaders must write SV_Target", srcInfo));
+
+			if (mProgram.Textures.Size() > 1)
+				errors.Add(CompileError("only one texture can be sampled, it is bound to the material of the mesh", srcInfo));
+
+			return errors.Size() == errorCount;
+		}
+
+		void ShaderProgram::GetSharedValues(const DrawUniforms& uniforms, Array<uint>& values) const
+		{
+			GetUniformValues(uniforms, values);
+			ExecuteSetup(mProgram, values);
+		}
+
+		void ShaderProgram::GetUniformValues(const DrawUniforms& uniforms, Array<uint>& values) const
+		{
+			values = mProgram.SharedValues;
+
+			for (auto i = 0; i < mUniforms.Size(); i++)
+			{
+				float data[16];
+				int count = 0;
+				switch (mUniforms[i].Source)
+				{
+				case Uniform::ModelViewProjMatrix:
+				case Uniform::ModelViewInvMatrix:
+				{
+					// Row major in both, mul(M, v) transforms like Matrix::TransformPoint
+					const Matrix& mat = mUniforms[i].Source == Uniform::ModelViewProjMatrix ? uniforms.Transform.ModelViewProjMatrix : uniforms.Transform.ModelViewInvMatrix;
+					for (auto r = 0; r < 4; r++)
+					{
+						for (auto c = 0; c < 4; c++)
+							data[count++] = mat.m[r][c];
+					}
+					break;
+				}
+				case Uniform::EyePos:
+				case Uniform::LightDirection:
+				{
+					const Vec3f_SSE& vec = mUniforms[i].Source == Uniform::EyePos ? uniforms.Transform.EyePos : uniforms.Light.Direction;
+					data[count++] = vec.x[0];
+					data[count++] = vec.y[0];
+					data[count++] = vec.z[0];
+					break;
+				}
+				case Uniform::LightAmbient:
+					data[count++] = uniforms.Light.Ambient[0];
+					break;
+				case Uniform::LightIntensity:
+					data[count++] = uniforms.Light.Intensity[0];
+					break;
+				}
+
+				memcpy(&values[mUniforms[i].Register], data, count * sizeof(float));
+			}
+		}
+
+		void ScriptVertexShader::Execute(const DrawUniforms& uniforms,
+			const Vector3& vPosIn,
+			const Vector3& vNormalIn,
+			const Vector2& vTexIn,
+			ProjectedVertex* pOut) const
+		{
+			ExecuteBatch(GetSingleItemRegisters(tVertexRegisters, mpProgram, uniforms), &vPosIn, &vNormalIn, &vTexIn, 1, pOut);
+		}
+
+		template<int QuadCount>
+		void ScriptVertexShader::ExecuteBatch(IRRegisterFile<QuadCount>& registers,
+			const Vector3* pPositions,
+			const Vector3* pNormals,
+			const Vector2* pTexCoords,
+			const int count,
+			ProjectedVertex* pOut) const
+		{
+			const int LANE_COUNT = 4 * QuadCount;
+			const Array<ShaderProgram::AttributeBinding>& inputs = mpProgram->GetInputs();
+			const Array<ShaderProgram::AttributeBinding>& outputs = mpProgram->GetOutputs();
+
+			// Lanes past the end repeat the last vertex so every lane computes on valid data
+			for (auto i = 0; i < inputs.Size(); i++)
+			{
+				for (auto comp = 0; comp < inputs[i].ComponentCount; comp++)
+				{
+					float lanes[LANE_COUNT];
+					for (auto j = 0; j < LANE_COUNT; j++)
+					{
+						const int idx = j < count ? j : count - 1;
+						lanes[j] = VertexComponent(inputs[i].Attrib, comp, pPositions[idx], pNormals[idx], pTexCoords[idx]);
+					}
+
+					for (auto q = 0; q < QuadCount; q++)
+						registers.Get(inputs[i].Register + comp, q) = _mm_loadu_ps(lanes + 4 * q);
+				}
+			}
+
+			mpProgram->Execute<QuadCount>(registers.Data(), nullptr);
+
+			// Attributes the program does not write are 0, clip space w is 1
+			for (auto j = 0; j < count; j++)
+			{
+				pOut[j].projectedPos = Vector4(0.0f, 0.0f, 0.0f, 1.0f);
+				pOut[j].position = Vector3::ZERO;
+				pOut[j].normal = Vector3::ZERO;
+				pOut[j].texCoord = Vector2::ZERO;
+			}
+
+			for (auto i = 0; i < outputs.Size(); i++)
+			{
+				for (auto comp = 0; comp < outputs[i].ComponentCount; comp++)
+				{
+					float lanes[LANE_COUNT];
+					for (auto q = 0; q < QuadCount; q++)
+						_mm_storeu_ps(lanes + 4 * q, registers.Get(outputs[i].Register + comp, q));
+
+					for (auto j = 0; j < count; j++)
+					{
+						switch (outputs[i].Attrib)
+						{
+						case ShaderProgram::Attribute::ScreenPosition:
+							(&pOut[j].projectedPos.x)[comp] = lanes[j];
+							break;
+						case ShaderProgram::Attribute::Position:
+							if (comp < 3)
+								(&pOut[j].position.x)[comp] = lanes[j];
+							break;
+						case ShaderProgram::Attribute::Normal:
+							if (comp < 3)
+								(&pOut[j].normal.x)[comp] = lanes[j];
+							break;
+						default:
+							if (comp < 2)
+								(&pOut[j].texCoord.x)[comp] = lanes[j];
+							break;
+						}
+					}
+				}
+			}
+		}
+
+		Vec3f_SSE ScriptPixelShader::Shade(const Fragment& fragIn,
+			const DrawUniforms& uniforms,
+			const Vec3f_SSE& position,
+			const Vec3f_SSE& normal,
+			const Vec2f_SSE& texCoord) const
+		{
+			const Fragment* pFrag = &fragIn;
+			Vec3f_SSE result;
+			ShadeBatch(GetSingleItemRegisters(tPixelRegisters, mpProgram, uniforms), uniforms, &pFrag, &position, &normal, &texCoord, 1, &result);
+
+			return result;
+		}
+
+		template<int QuadCount>
+		void ScriptPixelShader::ShadeBatch(IRRegisterFile<QuadCount>& registers,
+			const DrawUniforms& uniforms,
+			const Fragment* const* ppFragments,
+			const Vec3f_SSE* pPositions,
+			const Vec3f_SSE* pNormals,
+			const Vec2f_SSE* pTexCoords,
+			const int count,
+			Vec3f_SSE* pResults) const
+		{
+			const Array<ShaderProgram::AttributeBinding>& inputs = mpProgram->GetInputs();
+			const Array<ShaderProgram::AttributeBinding>& outputs = mpProgram->GetOutputs();
+
+			// Quads past the end repeat the last one
+			uint textureIds[QuadCount];
+			for (auto q = 0; q < QuadCount; q++)
+			{
+				const int idx = q < count ? q : count - 1;
+				textureIds[q] = ppFragments[idx]->textureId;
+
+				for (auto i = 0; i < inputs.Size(); i++)
+				{
+					for (auto comp = 0; comp < inputs[i].ComponentCount; comp++)
+						registers.Get(inputs[i].Register + comp, q) = FragmentComponent(inputs[i].Attrib, comp, *ppFragments[idx], pPositions[idx], pNormals[idx], pTexCoords[idx]);
+				}
+			}
+
+			FragmentTextureSource textures(uniforms, textureIds);
+			mpProgram->Execute<QuadCount>(registers.Data(), &textures);
+
+			const ShaderProgram::AttributeBinding& target = outputs[0];
+			for (auto q = 0; q < count; q++)
+			{
+				const __m128 zero = _mm_setzero_ps();
+				pResults[q] = Vec3f_SSE(FloatSSE(registers.Get(target.Register, q)),
+					FloatSSE(target.ComponentCount > 1 ? registers.Get(target.Register + 1, q) : zero),
+					FloatSSE(target.ComponentCount > 2 ? registers.Get(target.Register + 2, q) : zero));
+			}
+		}
+
+		void ScriptPipelineState::ProcessVertices(const IVertexBuffer* pVertexBuf,
+			const DrawUniforms& uniforms,
+			const VertexInstance* pInstances,
+			const int instanceCount,
+			const WorkContext& workers,
+			Array<ProjectedVertex>& vertexBuf) const
+		{
+			static const int LANE_COUNT = 4 * ScriptVertexShader::QUAD_COUNT;
+
+			const uint vertexCount = pVertexBuf->GetVertexCount();
+			vertexBuf.Resize(vertexCount * instanceCount);
+
+			// Uniforms are resolved once per draw, each batch only copies them into its registers
+			Array<uint> sharedValues;
+			mpVertexProgram->GetSharedValues(uniforms, sharedValues);
+
+			const int batchCount = (vertexCount + VERTEX_BATCH_SIZE - 1) / VERTEX_BATCH_SIZE;
+			const int instanceBatchCount = (instanceCount + INSTANCE_BATCH_SIZE - 1) / INSTANCE_BATCH_SIZE;
+			workers.ParallelFor(0, batchCount * instanceBatchCount, [&](int taskId)
+			{
+				Vector3 positions[VERTEX_BATCH_SIZE];
+				Vector3 normals[VERTEX_BATCH_SIZE];
+				Vector2 texCoords[VERTEX_BATCH_SIZE];
+				Vector3 instancePositions[VERTEX_BATCH_SIZE];
+				Vector3 instanceNormals[VERTEX_BATCH_SIZE];
+
+				const int batchId = taskId % batchCount;
+				const uint startIdx = batchId * VERTEX_BATCH_SIZE;
+				const int count = Math::Min(uint(VERTEX_BATCH_SIZE), vertexCount - startIdx);
+				pVertexBuf->DecodeVertices(startIdx, count, positions, normals, texCoords);
+
+				IRRegisterFile<ScriptVertexShader::QUAD_COUNT> registers;
+				registers.Init(mpVertexProgram->GetProgram(), sharedValues);
+
+				const int firstInstance = pInstances ? taskId / batchCount * INSTANCE_BATCH_SIZE : 0;
+				const int endInstance = pInstances ? Math::Min(firstInstance + INSTANCE_BATCH_SIZE, instanceCount) : 1;
+				for (auto instanceId = firstInstance; instanceId < endInstance; instanceId++)
+				{
+					const Vector3* pPositions = positions;
+					const Vector3* pNormals = normals;
+					if (pInstances)
+					{
+						pInstances[instanceId].Apply(positions, normals, count, instancePositions, instanceNormals);
+						pPositions = instancePositions;
+						pNormals = instanceNormals;
+					}
+
+					ProjectedVertex* pOut = &vertexBuf[instanceId * vertexCount + startIdx];
+					for (auto i = 0; i < count; i += LANE_COUNT)
+					{
+						mVertexShader.ExecuteBatch(registers,
+							pPositions + i,
+							pNormals + i,
+							texCoords + i,
+							Math::Min(LANE_COUNT, count - i),
+							pOut + i);
+					}
+				}
+			});
+		}
+
+		void ScriptPipelineState::ShadeFragments(const Array<Fragment>& fragmentBuf,
+			const Array<ProjectedVertex>* pVertexBufs,
+			const DrawUniforms& uniforms,
+			const WorkContext& workers,
+			Array<Array<IntSSE>>& tiledResultBuf) const
+		{
+			static const int QUAD_COUNT = ScriptPixelShader::QUAD_COUNT;
+
+			Array<uint> sharedValues;
+			mpPixelProgram->GetSharedValues(uniforms, sharedValues);
+
+			const int quadCount = fragmentBuf.Size();
+			const int batchCount = (quadCount + QUAD_BATCH_SIZE - 1) / QUAD_BATCH_SIZE;
+			workers.ParallelFor(0, batchCount, [&](int batchId)
+			{
+				IRRegisterFile<QUAD_COUNT> registers;
+				registers.Init(mpPixelProgram->GetProgram(), sharedValues);
+
+				const int endIdx = Math::Min((batchId + 1) * QUAD_BATCH_SIZE, quadCount);
+				for (auto i = batchId * QUAD_BATCH_SIZE; i < endIdx; i += QUAD_COUNT)
+				{
+					const int count = Math::Min(QUAD_COUNT, endIdx - i);
+
+					const Fragment* pFrags[QUAD_COUNT];
+					Vec3f_SSE positions[QUAD_COUNT];
+					Vec3f_SSE normals[QUAD_COUNT];
+					Vec2f_SSE texCoords[QUAD_COUNT];
+					for (auto j = 0; j < count; j++)
+					{
+						const Fragment& frag = fragmentBuf[i + j];
+						pFrags[j] = &frag;
+
+						const ProjectedVertex& v0 = pVertexBufs[frag.coreId][frag.vId0];
+						const ProjectedVertex& v1 = pVertexBufs[frag.coreId][frag.vId1];
+						const ProjectedVertex& v2 = pVertexBufs[frag.coreId][frag.vId2];
+
+						FloatSSE b0 = frag.lambda0;
+						FloatSSE b1 = frag.lambda1;
+						frag.Interpolate(v0, v1, v2, b0, b1, positions[j], normals[j], texCoords[j]);
+					}
+
+					Vec3f_SSE shadingResults[QUAD_COUNT];
+					mPixelShader.ShadeBatch(registers, uniforms, pFrags, positions, normals, texCoords, count, shadingResults);
+
+					for (auto j = 0; j < count; j++)
+					{
+						const Fragment& frag = *pFrags[j];
+
+						Color4b colorByte[4];
+						colorByte[0].FromFloats(shadingResults[j].x[0], shadingResults[j].y[0], shadingResults[j].z[0]);
+						colorByte[1].FromFloats(shadingResults[j].x[1], shadingResults[j].y[1], shadingResults[j].z[1]);
+						colorByte[2].FromFloats(shadingResults[j].x[2], shadingResults[j].y[2], shadingResults[j].z[2]);
+						colorByte[3].FromFloats(shadingResults[j].x[3], shadingResults[j].y[3], shadingResults[j].z[3]);
+
+						tiledResultBuf[frag.tileId][frag.intraTileIdx] = _mm_loadu_si128((__m128i*)&colorByte);
+					}
+				}
+			});
+		}
+
+		template void ScriptVertexShader::ExecuteBatch<1>(IRRegisterFile<1>&, const Vector3*, const Vector3*, const Vector2*, const int, ProjectedVertex*) const;
+		template void ScriptVertexShader::ExecuteBatch<4>(IRRegisterFile<4>&, const Vector3*, const Vector3*, const Vector2*, const int, ProjectedVertex*) const;
+		template void ScriptPixelShader::ShadeBatch<1>(IRRegisterFile<1>&, const DrawUniforms&, const Fragment* const*, const Vec3f_SSE*, const Vec3f_SSE*, const Vec2f_SSE*, const int, Vec3f_SSE*) const;
+		template void ScriptPixelShader::ShadeBatch<4>(IRRegisterFile<4>&, const DrawUniforms&, const Fragment* const*, const Vec3f_SSE*, const Vec3f_SSE*, const Vec2f_SSE*, const int, Vec3f_SSE*) const;
+	}
+}
\ No newline at end of file
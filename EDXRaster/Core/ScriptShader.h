@@ -0,0 +1,230 @@
+#pragma once
+
+#include "EDXPrerequisites.h"
+#include "Shader.h"
+#include "PipelineState.h"
+#include "../ShaderCompiler/CompilerCommon.h"
+#include "../ShaderCompiler/ShaderIR.h"
+#include "../ShaderCompiler/IROptimizer.h"
+#include "../ShaderCompiler/ShaderInterpreter.h"
+#include "../ShaderCompiler/ShaderJIT.h"
+
+#include <memory>
+
+namespace EDX
+{
+	namespace RasterRenderer
+	{
+		// An HLSL entry point compiled to native kernels, or for the interpreter where those are unavailable,
+		// with its interface resolved against what the renderer provides. Uniforms are matched by name:
+		//   float4x4 ModelViewProjMatrix, ModelViewInvMatrix
+		//   float3 EyePos, LightDirection
+		//   float LightAmbient, LightIntensity
+		// Vertex shaders read POSITION, NORMAL and TEXCOORD and write SV_Position and any of those three.
+		// Pixel shaders read SV_Position, POSITION, NORMAL and TEXCOORD and write SV_Target. A single texture
+		// can be declared, it is bound to the texture of the mesh material being drawn. Programs are optimized
+		// when compiled, the work that only depends on uniforms runs once per draw in GetSharedValues
+		class ShaderProgram
+		{
+		public:
+			enum class Uniform
+			{
+				ModelViewProjMatrix,
+				ModelViewInvMatrix,
+				EyePos,
+				LightDirection,
+				LightAmbient,
+				LightIntensity,
+			};
+
+			enum class Attribute
+			{
+				ScreenPosition,
+				Position,
+				Normal,
+				TexCoord,
+				Target,
+			};
+
+			struct UniformBinding
+			{
+				Uniform Source;
+				int Register;
+			};
+
+			struct AttributeBinding
+			{
+				Attribute Attrib;
+				int Register;
+				int ComponentCount;
+			};
+
+		private:
+			ShaderCompiler::IRProgram mProgram;
+			Array<UniformBinding> mUniforms;
+			Array<AttributeBinding> mInputs;
+			Array<AttributeBinding> mOutputs;
+			ShaderCompiler::IROptimizeStats mOptimizeStats;
+
+			// Kernels for 1, 2 and 4 quads per run, null where the interpreter runs the program
+			std::shared_ptr<const ShaderCompiler::ShaderKernel> mpKernels[3];
+
+		public:
+			// Null with the errors filled in when the source does not compile or uses an interface the
+			// renderer cannot feed
+			static std::shared_ptr<ShaderProgram> Compile(const char* fileName,
+				const string& source,
+				const string& entryPoint,
+				const ShaderCompiler::ShaderStage stage,
+				Array<ShaderCompiler::CompileError>& errors);
+			static std::shared_ptr<ShaderProgram> CompileFromFile(const char* path,
+				const string& entryPoint,
+				const ShaderCompiler::ShaderStage stage,
+				Array<ShaderCompiler::CompileError>& errors);
+
+			// The vertex program without the outputs the pixel program does not read and the work only those
+			// depended on. The same program when every output is read
+			static std::shared_ptr<const ShaderProgram> LinkVertexProgram(const std::shared_ptr<const ShaderProgram>& pVertexProgram,
+				const ShaderProgram& pixelProgram);
+
+			// Constants and setup results with the uniforms of a draw filled in, ready for IRRegisterFile::Init
+			void GetSharedValues(const DrawUniforms& uniforms, Array<uint>& values) const;
+			// The same before the setup code has run, only constants and uniforms
+			void GetUniformValues(const DrawUniforms& uniforms, Array<uint>& values) const;
+
+			// Runs the program over an initialized register file
+			template<int QuadCount>
+			__forceinline void Execute(__m128* pRegisters, const ShaderCompiler::IRTextureSource* pTextures) const
+			{
+				const ShaderCompiler::ShaderKernel* pKernel = mpKernels[QuadCount == 1 ? 0 : QuadCount == 2 ? 1 : 2].get();
+				if (pKernel)
+					pKernel->Execute(pRegisters, pTextures);
+				else
+					ShaderCompiler::ShaderInterpreter<QuadCount>::Execute(mProgram, pRegisters, pTextures);
+			}
+
+			const ShaderCompiler::IRProgram& GetProgram() const { return mProgram; }
+			const Array<UniformBinding>& GetUniforms() const { return mUniforms; }
+			const Array<AttributeBinding>& GetInputs() const { return mInputs; }
+			const Array<AttributeBinding>& GetOutputs() const { return mOutputs; }
+			const ShaderCompiler::IROptimizeStats& GetOptimizeStats() const { return mOptimizeStats; }
+
+		private:
+			bool Bind(const char* fileName, Array<ShaderCompiler::CompileError>& errors);
+		};
+
+		// Vertex shader running a compiled program, 16 vertices per run in the batched path
+		class ScriptVertexShader : public VertexShader
+		{
+		public:
+			static const int QUAD_COUNT = 4;
+
+		private:
+			std::shared_ptr<const ShaderProgram> mpProgram;
+
+		public:
+			explicit ScriptVertexShader(const std::shared_ptr<const ShaderProgram>& pProgram)
+				: mpProgram(pProgram)
+			{
+			}
+
+			// A single vertex. The setup code only runs again when the uniforms it reads change, so a draw
+			// pays for it once per thread
+			void Execute(const DrawUniforms& uniforms,
+				const Vector3& vPosIn,
+				const Vector3& vNormalIn,
+				const Vector2& vTexIn,
+				ProjectedVertex* pOut) const;
+
+			// Up to 4 * QuadCount vertices, registers must have been initialized with the draw's shared values
+			template<int QuadCount>
+			void ExecuteBatch(ShaderCompiler::IRRegisterFile<QuadCount>& registers,
+				const Vector3* pPositions,
+				const Vector3* pNormals,
+				const Vector2* pTexCoords,
+				const int count,
+				ProjectedVertex* pOut) const;
+
+			const ShaderProgram& GetProgram() const { return *mpProgram; }
+		};
+
+		// Pixel shader running a compiled program, 4 quads per run in the batched path
+		class ScriptPixelShader : public PixelShader
+		{
+		public:
+			static const int QUAD_COUNT = 4;
+
+		private:
+			std::shared_ptr<const ShaderProgram> mpProgram;
+
+		public:
+			explicit ScriptPixelShader(const std::shared_ptr<const ShaderProgram>& pProgram)
+				: mpProgram(pProgram)
+			{
+			}
+
+			// A single quad, the setup code is reused like in ScriptVertexShader::Execute
+			Vec3f_SSE Shade(const Fragment& fragIn,
+				const DrawUniforms& uniforms,
+				const Vec3f_SSE& position,
+				const Vec3f_SSE& normal,
+				const Vec2f_SSE& texCoord) const;
+
+			// Up to QuadCount quads, registers must have been initialized with the draw's shared values
+			template<int QuadCount>
+			void ShadeBatch(ShaderCompiler::IRRegisterFile<QuadCount>& registers,
+				const DrawUniforms& uniforms,
+				const Fragment* const* ppFragments,
+				const Vec3f_SSE* pPositions,
+				const Vec3f_SSE* pNormals,
+				const Vec2f_SSE* pTexCoords,
+				const int count,
+				Vec3f_SSE* pResults) const;
+
+			const ShaderProgram& GetProgram() const { return *mpProgram; }
+		};
+
+		// Pipeline for compiled programs, the same vertex and fragment loops as ShaderPipelineState with the
+		// program running several items per call. The vertex program is linked against the pixel program
+		class ScriptPipelineState : public PipelineState
+		{
+		private:
+			static const int VERTEX_BATCH_SIZE = 64;
+			static const int QUAD_BATCH_SIZE = 64;
+
+			std::shared_ptr<const ShaderProgram> mpVertexProgram;
+			std::shared_ptr<const ShaderProgram> mpPixelProgram;
+			ScriptVertexShader mVertexShader;
+			ScriptPixelShader mPixelShader;
+
+		public:
+			ScriptPipelineState(const std::shared_ptr<const ShaderProgram>& pVertexProgram,
+				const std::shared_ptr<const ShaderProgram>& pPixelProgram,
+				const PipelineStateDesc& desc = PipelineStateDesc())
+				: PipelineState(desc)
+				, mpVertexProgram(ShaderProgram::LinkVertexProgram(pVertexProgram, *pPixelProgram))
+				, mpPixelProgram(pPixelProgram)
+				, mVertexShader(mpVertexProgram)
+				, mPixelShader(mpPixelProgram)
+			{
+			}
+
+			void ProcessVertices(const IVertexBuffer* pVertexBuf,
+				const DrawUniforms& uniforms,
+				const VertexInstance* pInstances,
+				const int instanceCount,
+				const WorkContext& workers,
+				Array<ProjectedVertex>& vertexBuf) const;
+			void ShadeFragments(const Array<Fragment>& fragmentBuf,
+				const Array<ProjectedVertex>* pVertexBufs,
+				const DrawUniforms& uniforms,
+				const WorkContext& workers,
+				Array<Array<IntSSE>>& tiledResultBuf) const;
+
+			UniquePtr<PipelineState> Recreate(const PipelineStateDesc& desc) const
+			{
+				return MakeUnique<ScriptPipelineState>(mpVertexProgram, mpPixelProgram, desc);
+			}
+		};
+	}
+}
\ No newline at end of file
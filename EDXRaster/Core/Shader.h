@@ -1,8 +1,10 @@
 #pragma once
 
 #include "RenderStates.h"
+#include "ConstantBuffer.h"
 #include "Math/Vector.h"
-#include "Graphics/Texture.h"
+#include "Texture.h"
+#include "SIMDMath.h"
 #include "Graphics/Color.h"
 #include "SIMD/SSE.h"
 
@@ -24,25 +26,70 @@ namespace EDX
 			}
 		};
 
+		// World transform of one copy of an instanced draw. It moves the decoded attributes before the vertex
+		// shader runs, so shaders see each instance as ordinary geometry
+		struct VertexInstance
+		{
+			Matrix World;
+			Matrix NormalMatrix; // Transpose of the inverse, rows used as columns in Apply
+
+			VertexInstance() {}
+			explicit VertexInstance(const Matrix& world)
+				: World(world)
+				, NormalMatrix(Matrix::Inverse(world))
+			{
+			}
+
+			void Apply(const Vector3* pPosIn, const Vector3* pNormalIn, const int count, Vector3* pPosOut, Vector3* pNormalOut) const
+			{
+				const float(*w)[4] = World.m;
+				const float(*n)[4] = NormalMatrix.m;
+				for (auto i = 0; i < count; i++)
+				{
+					const Vector3& p = pPosIn[i];
+					pPosOut[i] = Vector3(w[0][0] * p.x + w[0][1] * p.y + w[0][2] * p.z + w[0][3],
+						w[1][0] * p.x + w[1][1] * p.y + w[1][2] * p.z + w[1][3],
+						w[2][0] * p.x + w[2][1] * p.y + w[2][2] * p.z + w[2][3]);
+
+					// Left unnormalized, pixel shaders normalize after interpolation
+					const Vector3& nIn = pNormalIn[i];
+					pNormalOut[i] = Vector3(n[0][0] * nIn.x + n[1][0] * nIn.y + n[2][0] * nIn.z,
+						n[0][1] * nIn.x + n[1][1] * nIn.y + n[2][1] * nIn.z,
+						n[0][2] * nIn.x + n[1][2] * nIn.y + n[2][2] * nIn.z);
+				}
+			}
+		};
+
 		class VertexShader
 		{
 		public:
+			// Shaders that hide this with a larger size also provide ExecuteBatch for up to that many vertices,
+			// which ShaderPipelineState calls instead of Execute
+			static const int BATCH_SIZE = 1;
+
+			// What the shader derives from the uniforms, ShaderPipelineState prepares it once per draw. Shaders
+			// that hide this also hide Prepare and take the setup in ExecuteBatch
+			struct DrawSetup {};
+			static void Prepare(const DrawUniforms& uniforms, DrawSetup* pSetup) {}
+
 			virtual ~VertexShader() {}
-			virtual void Execute(const Vector3& vPosIn,
+			virtual void Execute(const DrawUniforms& uniforms,
+				const Vector3& vPosIn,
 				const Vector3& vNormalIn,
 				const Vector2& vTexIn,
-				ProjectedVertex* pOut) = 0;
+				ProjectedVertex* pOut) const = 0;
 		};
 
 		class DefaultVertexShader : public VertexShader
 		{
 		public:
-			virtual void Execute(const Vector3& vPosIn,
+			void Execute(const DrawUniforms& uniforms,
+				const Vector3& vPosIn,
 				const Vector3& vNormalIn,
 				const Vector2& vTexIn,
-				ProjectedVertex* pOut)
+				ProjectedVertex* pOut) const
 			{
-				pOut->projectedPos = Matrix::TransformPoint(Vector4(vPosIn.x, vPosIn.y, vPosIn.z, 1.0f), RenderStates::Instance()->GetModelViewProjMatrix());
+				pOut->projectedPos = Matrix::TransformPoint(Vector4(vPosIn.x, vPosIn.y, vPosIn.z, 1.0f), uniforms.Transform.ModelViewProjMatrix);
 				pOut->position = vPosIn;
 				pOut->normal = vNormalIn;
 				pOut->texCoord = vTexIn;
@@ -146,7 +193,7 @@ namespace EDX
 				FloatSSE& b1,
 				Vec3f_SSE& position,
 				Vec3f_SSE& normal,
-				Vec2f_SSE& texCoord)
+				Vec2f_SSE& texCoord) const
 			{
 				const auto One = FloatSSE(Math::EDX_ONE);
 				FloatSSE b2 = One - b0 - b1;
@@ -173,10 +220,13 @@ namespace EDX
 		class PixelShader
 		{
 		public:
+			// As for vertex shaders, shaders that hide this take the setup in an overload of Shade
+			struct DrawSetup {};
+			static void Prepare(const DrawUniforms& uniforms, DrawSetup* pSetup) {}
+
 			virtual ~PixelShader() {}
-			virtual Vec3f_SSE Shade(Fragment& fragIn,
-				const Vector3& eyePos,
-				const Vector3& lightDir,
+			virtual Vec3f_SSE Shade(const Fragment& fragIn,
+				const DrawUniforms& uniforms,
 				const Vec3f_SSE& position,
 				const Vec3f_SSE& normal,
 				const Vec2f_SSE& texCoord) const = 0;
@@ -185,22 +235,19 @@ namespace EDX
 		class LambertianPixelShader : public PixelShader
 		{
 		public:
-			Vec3f_SSE Shade(Fragment& fragIn,
-				const Vector3& eyePos,
-				const Vector3& lightDir,
+			Vec3f_SSE Shade(const Fragment& fragIn,
+				const DrawUniforms& uniforms,
 				const Vec3f_SSE& position,
 				const Vec3f_SSE& normal,
-				const Vec2f_SSE& texCoord,
-				RenderStates& state) const
+				const Vec2f_SSE& texCoord) const
 			{
-				FloatSSE w = SSE::Rsqrt(Math::Dot(normal, normal));
+				FloatSSE w = VectorMath::Rsqrt(Math::Dot(normal, normal));
 				Vec3f_SSE _normal = normal * w;
-				Vec3f_SSE vecLightDir = Vec3f_SSE(Math::Normalize(lightDir));
 
-				FloatSSE diffuseAmount = Math::Dot(vecLightDir, _normal);
+				FloatSSE diffuseAmount = Math::Dot(uniforms.Light.Direction, _normal);
 				BoolSSE mask = diffuseAmount < FloatSSE(Math::EDX_ZERO);
 				diffuseAmount = SSE::Select(mask, FloatSSE(Math::EDX_ZERO), diffuseAmount);
-				FloatSSE diffuse = (diffuseAmount + 0.2f) * 3 * Math::EDX_INV_PI;
+				FloatSSE diffuse = (diffuseAmount + uniforms.Light.Ambient) * uniforms.Light.Intensity * Math::EDX_INV_PI;
 
 				return diffuse;
 			}
@@ -209,35 +256,26 @@ namespace EDX
 		class LambertianAlbedoPixelShader : public PixelShader
 		{
 		public:
-			Vec3f_SSE Shade(Fragment& fragIn,
-				const Vector3& eyePos,
-				const Vector3& lightDir,
+			Vec3f_SSE Shade(const Fragment& fragIn,
+				const DrawUniforms& uniforms,
 				const Vec3f_SSE& position,
 				const Vec3f_SSE& normal,
 				const Vec2f_SSE& texCoord) const
 			{
-				FloatSSE w = SSE::Rsqrt(Math::Dot(normal, normal));
+				FloatSSE w = VectorMath::Rsqrt(Math::Dot(normal, normal));
 				Vec3f_SSE _normal = normal * w;
-				Vec3f_SSE vecLightDir = Vec3f_SSE(Math::Normalize(lightDir));
 
-				FloatSSE diffuseAmount = Math::Dot(vecLightDir, _normal);
+				FloatSSE diffuseAmount = Math::Dot(uniforms.Light.Direction, _normal);
 				BoolSSE mask = diffuseAmount < FloatSSE(Math::EDX_ZERO);
 				diffuseAmount = SSE::Select(mask, FloatSSE(Math::EDX_ZERO), diffuseAmount);
 
-				// Sample texture
-				const Vector2 differentials[2] = { Vector2(texCoord.u[1] - texCoord.u[0], texCoord.v[1] - texCoord.v[0]),
-					Vector2(texCoord.u[2] - texCoord.u[0], texCoord.v[2] - texCoord.v[0]) };
+				// Sample texture, the quad shares one set of differentials
+				const Vector2 dUVdx = Vector2(texCoord.u[1] - texCoord.u[0], texCoord.v[1] - texCoord.v[0]);
+				const Vector2 dUVdy = Vector2(texCoord.u[2] - texCoord.u[0], texCoord.v[2] - texCoord.v[0]);
 
-				(*RenderStates::Instance()->TextureSlots)[fragIn.textureId]->SetFilter(RenderStates::Instance()->GetTextureFilter());
-				Vec3f_SSE Albedo;
-				for (auto i = 0; i < 4; i++)
-				{
-					Color color = (*RenderStates::Instance()->TextureSlots)[fragIn.textureId]->Sample(Vector2(texCoord.u[i], texCoord.v[i]), differentials);
-					Albedo.x[i] = color.r;
-					Albedo.y[i] = color.g;
-					Albedo.z[i] = color.b;
-				}
-				FloatSSE diffuse = (diffuseAmount + 0.2f) * 3 * Math::EDX_INV_PI;
+				const QuadTexture* pTexture = (*uniforms.pTextureSlots)[fragIn.textureId].get();
+				Vec3f_SSE Albedo = pTexture->SampleQuad(texCoord, dUVdx, dUVdy, *uniforms.pSampler);
+				FloatSSE diffuse = (diffuseAmount + uniforms.Light.Ambient) * uniforms.Light.Intensity * Math::EDX_INV_PI;
 
 				return diffuse * Albedo;
 			}
@@ -246,36 +284,34 @@ namespace EDX
 		class BlinnPhongPixelShader : public PixelShader
 		{
 		public:
-			Vec3f_SSE Shade(Fragment& fragIn,
-				const Vector3& eyePos,
-				const Vector3& lightDir,
+			Vec3f_SSE Shade(const Fragment& fragIn,
+				const DrawUniforms& uniforms,
 				const Vec3f_SSE& position,
 				const Vec3f_SSE& normal,
 				const Vec2f_SSE& texCoord) const
 			{
-				FloatSSE w = SSE::Rsqrt(Math::Dot(normal, normal));
+				FloatSSE w = VectorMath::Rsqrt(Math::Dot(normal, normal));
 				Vec3f_SSE _normal = normal * w;
-				Vec3f_SSE vecLightDir = Vec3f_SSE(Math::Normalize(lightDir));
 
-				FloatSSE diffuseAmount = Math::Dot(vecLightDir, _normal);
+				FloatSSE diffuseAmount = Math::Dot(uniforms.Light.Direction, _normal);
 				BoolSSE mask = diffuseAmount < FloatSSE(Math::EDX_ZERO);
 				diffuseAmount = SSE::Select(mask, FloatSSE(Math::EDX_ZERO), diffuseAmount);
 
-				FloatSSE diffuse = (diffuseAmount + 0.2f) * 3 * Math::EDX_INV_PI;
+				FloatSSE diffuse = (diffuseAmount + uniforms.Light.Ambient) * uniforms.Light.Intensity * Math::EDX_INV_PI;
 
-				Vec3f_SSE eyeDir = Vec3f_SSE(eyePos) - position;
-				w = SSE::Rsqrt(Math::Dot(eyeDir, eyeDir));
+				Vec3f_SSE eyeDir = uniforms.Transform.EyePos - position;
+				w = VectorMath::Rsqrt(Math::Dot(eyeDir, eyeDir));
 				eyeDir *= w;
 
-				Vec3f_SSE halfVec = vecLightDir + eyeDir;
-				w = SSE::Rsqrt(Math::Dot(halfVec, halfVec));
+				Vec3f_SSE halfVec = uniforms.Light.Direction + eyeDir;
+				w = VectorMath::Rsqrt(Math::Dot(halfVec, halfVec));
 				halfVec *= w;
 
+				// Facing away from the half vector gives no highlight, the error of the fast pow is far below 8 bit output
 				FloatSSE specularAmount = Math::Dot(_normal, halfVec);
-				specularAmount = FloatSSE(Math::Pow(specularAmount[0], 200.0f),
-					Math::Pow(specularAmount[1], 200.0f),
-					Math::Pow(specularAmount[2], 200.0f),
-					Math::Pow(specularAmount[3], 200.0f)) * 3.0f;
+				mask = specularAmount < FloatSSE(Math::EDX_ZERO);
+				specularAmount = SSE::Select(mask, FloatSSE(Math::EDX_ZERO), specularAmount);
+				specularAmount = VectorMath::FastPow(specularAmount, FloatSSE(200.0f)) * 3.0f;
 
 				return diffuse + specularAmount;
 			}
@@ -0,0 +1,738 @@
+#include "ShaderCodeGenerator.h"
+
+namespace EDX
+{
+	namespace RasterRenderer
+	{
+		using namespace ShaderCompiler;
+
+		namespace
+		{
+			string Name(const char* pPrefix, const int pc)
+			{
+				return pPrefix + std::to_string(pc);
+			}
+		}
+
+		string ShaderCodeGenerator::Generate(const ShaderProgram& program, const string& className, const string& sourceName)
+		{
+			mpProgram = &program;
+			mSource.clear();
+			mIndent = 0;
+			mConstructs.Clear();
+			mLoop = mFrame = -1;
+
+			const bool vertexStage = program.GetProgram().Stage == ShaderStage::Vertex;
+
+			Line("// Generated by ShaderCodeGen from " + sourceName + ", regenerate instead of editing");
+			Line("");
+			Line("#pragma once");
+			Line("");
+			Line("#include \"Core/Shader.h\"");
+			Line("#include \"ShaderCompiler/ShaderOps.h\"");
+			Line("");
+			Line("namespace EDX");
+			Open();
+			Line("namespace RasterRenderer");
+			Open();
+			Line("class " + className + " : public " + (vertexStage ? "VertexShader" : "PixelShader"));
+			Open();
+			Line("public:");
+			Line("static const int INPUT_COUNT = " + std::to_string(GetInputCount()) + ";");
+			Line("static const int OUTPUT_COUNT = " + std::to_string(GetOutputCount()) + ";");
+			Line("");
+
+			WriteSetup();
+			Line("");
+			WriteRun();
+			Line("");
+			if (vertexStage)
+				WriteVertexShader();
+			else
+				WritePixelShader();
+
+			Close(";");
+			Close();
+			Close();
+
+			mpProgram = nullptr;
+
+			// No trailing newline
+			mSource.pop_back();
+			return mSource;
+		}
+
+		void ShaderCodeGenerator::WriteSetup()
+		{
+			const IRProgram& program = mpProgram->GetProgram();
+			const Array<ShaderProgram::UniformBinding>& uniforms = mpProgram->GetUniforms();
+
+			// Uniform registers and the setup instructions over them get a slot each, in the order they are written
+			int slotCount = 0;
+			mSetupSlots.Resize(program.SharedRegisterCount);
+			for (auto i = 0; i < mSetupSlots.Size(); i++)
+				mSetupSlots[i] = -1;
+			for (auto i = 0; i < uniforms.Size(); i++)
+			{
+				for (auto c = 0; c < GetUniformComponentCount(uniforms[i].Source); c++)
+					mSetupSlots[uniforms[i].Register + c] = slotCount++;
+			}
+			for (auto i = 0; i < program.SetupInstructions.Size(); i++)
+				mSetupSlots[program.SetupInstructions[i].Dst] = slotCount++;
+
+			Line("// Uniform registers and the setup instructions over them, as in ShaderProgram::GetSharedValues");
+			Line("struct DrawSetup");
+			Open();
+			Line("uint Registers[" + std::to_string(slotCount > 0 ? slotCount : 1) + "];");
+			Close(";");
+			Line("");
+
+			Line("static void Prepare(const DrawUniforms& uniforms, DrawSetup* pSetup)");
+			Open();
+			if (slotCount > 0)
+			{
+				Line("typedef ShaderCompiler::ShaderOps<__m128> Ops;");
+				Line("");
+			}
+
+			for (auto i = 0; i < uniforms.Size(); i++)
+			{
+				for (auto c = 0; c < GetUniformComponentCount(uniforms[i].Source); c++)
+					Line("const __m128 " + Reg(uniforms[i].Register + c) + " = Ops::SetFloat(" + UniformComponent(uniforms[i].Source, c) + ");");
+			}
+
+			// Only the constants the setup instructions read
+			Array<bool> isRead;
+			isRead.Resize(program.SharedRegisterCount);
+			for (auto i = 0; i < isRead.Size(); i++)
+				isRead[i] = false;
+			for (auto i = 0; i < program.SetupInstructions.Size(); i++)
+			{
+				const IRInstruction& inst = program.SetupInstructions[i];
+				for (auto j = 0; j < 3 && inst.Src[j] >= 0; j++)
+					isRead[inst.Src[j]] = true;
+			}
+			for (auto i = 0; i < program.SharedRegisterCount; i++)
+			{
+				if (isRead[i] && mSetupSlots[i] < 0)
+					Line("const __m128 " + Constant(i));
+			}
+
+			for (auto i = 0; i < program.SetupInstructions.Size(); i++)
+			{
+				const IRInstruction& inst = program.SetupInstructions[i];
+				string call = string("Ops::") + GetOpsName(inst.Op) + "(";
+				for (auto j = 0; j < 3 && inst.Src[j] >= 0; j++)
+					call += (j > 0 ? ", " : "") + Reg(inst.Src[j]);
+				Line("const __m128 " + Reg(inst.Dst) + " = " + call + ");");
+			}
+			if (slotCount > 0)
+				Line("");
+
+			for (auto i = 0; i < program.SharedRegisterCount; i++)
+			{
+				if (mSetupSlots[i] >= 0)
+					Line("pSetup->Registers[" + std::to_string(mSetupSlots[i]) + "] = uint(_mm_cvtsi128_si32(Ops::AsInt(" + Reg(i) + ")));");
+			}
+			Close();
+		}
+
+		void ShaderCodeGenerator::WriteRun()
+		{
+			const IRProgram& program = mpProgram->GetProgram();
+
+			Line("// Ops::QUAD_COUNT quads per call, inputs and outputs take one register per component in the order of");
+			Line("// the bindings. fetch is called like IRTextureSource::SampleQuad");
+			Line("template<typename Float, typename Fetch>");
+			Line("static __forceinline void Run(const DrawSetup& setup, const Float* pInputs, Float* pOutputs, const Fetch& fetch)");
+			Open();
+			Line("typedef ShaderCompiler::ShaderOps<Float> Ops;");
+			Line("");
+
+			// Shared registers, constants fold into the code and the rest is broadcast from the setup of the draw
+			for (auto i = 0; i < program.SharedRegisterCount; i++)
+			{
+				if (mSetupSlots[i] >= 0)
+					Line("const Float " + Reg(i) + " = Ops::Set(setup.Registers[" + std::to_string(mSetupSlots[i]) + "]);");
+				else
+					Line("const Float " + Constant(i));
+			}
+			Line("");
+
+			// Every lane register and control state is declared up front so the jumps cross no initialization
+			int inputOffset = 0;
+			const Array<ShaderProgram::AttributeBinding>& inputs = mpProgram->GetInputs();
+			Array<int> inputIndices;
+			inputIndices.Resize(program.RegisterCount);
+			for (auto i = 0; i < inputIndices.Size(); i++)
+				inputIndices[i] = -1;
+			for (auto i = 0; i < inputs.Size(); i++)
+			{
+				for (auto c = 0; c < inputs[i].ComponentCount; c++)
+					inputIndices[inputs[i].Register + c] = inputOffset++;
+			}
+
+			for (auto i = program.SharedRegisterCount; i < program.RegisterCount; i++)
+			{
+				if (inputIndices[i] >= 0)
+					Line("Float " + Reg(i) + " = pInputs[" + std::to_string(inputIndices[i]) + "];");
+				else
+					Line("Float " + Reg(i) + " = Ops::Zero();");
+			}
+
+			Line("Float exec = Ops::AllSet();");
+			for (auto pc = 0; pc < program.Instructions.Size(); pc++)
+			{
+				switch (program.Instructions[pc].Op)
+				{
+				case IROpcode::If:
+					Line("Float " + Name("saved", pc) + " = Ops::Zero(), " + Name("taken", pc) + " = Ops::Zero();");
+					break;
+				case IROpcode::Loop:
+					Line("Float " + Name("saved", pc) + " = Ops::Zero(), " + Name("broken", pc) + " = Ops::Zero(), " + Name("continued", pc) + " = Ops::Zero();");
+					break;
+				case IROpcode::Begin:
+					Line("Float " + Name("saved", pc) + " = Ops::Zero(), " + Name("returned", pc) + " = Ops::Zero();");
+					break;
+				default:
+					break;
+				}
+			}
+			Line("");
+
+			Array<bool> isTarget;
+			isTarget.Resize(program.Instructions.Size() + 1);
+			for (auto i = 0; i < isTarget.Size(); i++)
+				isTarget[i] = false;
+			for (auto pc = 0; pc < program.Instructions.Size(); pc++)
+			{
+				const IRInstruction& inst = program.Instructions[pc];
+				if (inst.Op >= IROpcode::If && inst.Op != IROpcode::EndIf && inst.Op != IROpcode::Loop && inst.Op != IROpcode::LoopContinue &&
+					inst.Op != IROpcode::Begin && inst.Op != IROpcode::End)
+					isTarget[inst.Imm] = true;
+			}
+
+			for (auto pc = 0; pc < program.Instructions.Size(); pc++)
+			{
+				if (isTarget[pc])
+					Line(Name("L", pc) + ":");
+
+				if (program.Instructions[pc].Op >= IROpcode::If)
+					WriteControl(pc);
+				else
+					WriteInstruction(program.Instructions[pc]);
+			}
+			if (isTarget[program.Instructions.Size()])
+				Line(Name("L", program.Instructions.Size()) + ":");
+			Line("");
+
+			int outputOffset = 0;
+			const Array<ShaderProgram::AttributeBinding>& outputs = mpProgram->GetOutputs();
+			for (auto i = 0; i < outputs.Size(); i++)
+			{
+				for (auto c = 0; c < outputs[i].ComponentCount; c++)
+					Line("pOutputs[" + std::to_string(outputOffset++) + "] = " + Reg(outputs[i].Register + c) + ";");
+			}
+			Close();
+		}
+
+		void ShaderCodeGenerator::WriteControl(const int pc)
+		{
+			// The same masks as ShaderInterpreter::Execute, with the construct stack resolved while writing
+			const IRInstruction& inst = mpProgram->GetProgram().Instructions[pc];
+			const string cond = inst.Src[0] >= 0 ? Reg(inst.Src[0]) : "";
+			const string target = Name("L", inst.Imm);
+
+			// Lanes that left the enclosing loop or function and must stay off when a construct closes
+			auto leftLanes = [&]()
+			{
+				string ret;
+				if (mLoop >= 0)
+					ret = "Ops::Or(" + Name("broken", mLoop) + ", " + Name("continued", mLoop) + ")";
+				if (mFrame >= 0)
+					ret = ret.empty() ? Name("returned", mFrame) : "Ops::Or(" + ret + ", " + Name("returned", mFrame) + ")";
+				return ret;
+			};
+
+			switch (inst.Op)
+			{
+			case IROpcode::If:
+			{
+				Construct construct = { inst.Op, pc, mLoop, mFrame };
+				mConstructs.Add(construct);
+				Line(Name("saved", pc) + " = exec;");
+				Line("exec = Ops::And(exec, " + cond + ");");
+				Line(Name("taken", pc) + " = exec;");
+				Line("if (!Ops::Any(exec)) goto " + target + ";");
+				break;
+			}
+			case IROpcode::Else:
+			{
+				const int open = mConstructs[mConstructs.Size() - 1].Pc;
+				Line("exec = Ops::AndNot(" + Name("taken", open) + ", " + Name("saved", open) + ");");
+				Line("if (!Ops::Any(exec)) goto " + target + ";");
+				break;
+			}
+			case IROpcode::EndIf:
+			{
+				const int open = mConstructs[mConstructs.Size() - 1].Pc;
+				mConstructs.Resize(mConstructs.Size() - 1);
+				const string left = leftLanes();
+				Line("exec = " + (left.empty() ? Name("saved", open) : "Ops::AndNot(" + left + ", " + Name("saved", open) + ")") + ";");
+				break;
+			}
+
+			case IROpcode::Loop:
+			{
+				Construct construct = { inst.Op, pc, mLoop, mFrame };
+				mConstructs.Add(construct);
+				mLoop = pc;
+				Line(Name("saved", pc) + " = exec;");
+				Line(Name("broken", pc) + " = " + Name("continued", pc) + " = Ops::Zero();");
+				break;
+			}
+			case IROpcode::BreakUnless:
+				Line(Name("broken", mLoop) + " = Ops::Or(" + Name("broken", mLoop) + ", Ops::AndNot(" + cond + ", exec));");
+				Line("exec = Ops::And(exec, " + cond + ");");
+				Line("if (!Ops::Any(exec)) goto " + target + ";");
+				break;
+			case IROpcode::Break:
+			case IROpcode::Continue:
+			{
+				const string mask = Name(inst.Op == IROpcode::Break ? "broken" : "continued", mLoop);
+				Line(mask + " = Ops::Or(" + mask + ", exec);");
+				Line("exec = Ops::Zero();");
+				Line("goto " + target + ";");
+				break;
+			}
+			case IROpcode::LoopContinue:
+				Line("exec = Ops::Or(exec, " + Name("continued", mLoop) + ");");
+				Line(Name("continued", mLoop) + " = Ops::Zero();");
+				break;
+			case IROpcode::EndLoop:
+			{
+				const Construct construct = mConstructs[mConstructs.Size() - 1];
+				mConstructs.Resize(mConstructs.Size() - 1);
+				mLoop = construct.OuterLoop;
+				Line("if (Ops::Any(exec)) goto " + target + ";");
+				Line("exec = " + (mFrame >= 0 ? "Ops::AndNot(" + Name("returned", mFrame) + ", " + Name("saved", construct.Pc) + ")" : Name("saved", construct.Pc)) + ";");
+				break;
+			}
+
+			case IROpcode::Begin:
+			{
+				Construct construct = { inst.Op, pc, mLoop, mFrame };
+				mConstructs.Add(construct);
+				mFrame = pc;
+				mLoop = -1;
+				Line(Name("saved", pc) + " = exec;");
+				Line(Name("returned", pc) + " = Ops::Zero();");
+				break;
+			}
+			case IROpcode::Return:
+				Line(Name("returned", mFrame) + " = Ops::Or(" + Name("returned", mFrame) + ", exec);");
+				Line("exec = Ops::Zero();");
+				Line("goto " + target + ";");
+				break;
+			case IROpcode::End:
+			{
+				const Construct construct = mConstructs[mConstructs.Size() - 1];
+				mConstructs.Resize(mConstructs.Size() - 1);
+				mLoop = construct.OuterLoop;
+				mFrame = construct.OuterFrame;
+				Line("exec = " + Name("saved", construct.Pc) + ";");
+				break;
+			}
+
+			default:
+				break;
+			}
+		}
+
+		void ShaderCodeGenerator::WriteInstruction(const IRInstruction& inst)
+		{
+			const string dst = Reg(inst.Dst);
+			switch (inst.Op)
+			{
+			case IROpcode::Mov:
+				Line(dst + " = " + Reg(inst.Src[0]) + ";");
+				break;
+			case IROpcode::Store:
+				Line(dst + " = Ops::Store(exec, " + Reg(inst.Src[0]) + ", " + dst + ");");
+				break;
+			case IROpcode::StoreIf:
+				Line(dst + " = Ops::StoreIf(exec, " + Reg(inst.Src[0]) + ", " + Reg(inst.Src[1]) + ", " + dst + ");");
+				break;
+
+			case IROpcode::Sample:
+			case IROpcode::SampleBias:
+			case IROpcode::SampleGrad:
+			{
+				Open();
+				string extra = "nullptr";
+				if (inst.Op != IROpcode::Sample)
+				{
+					string values;
+					for (auto k = 0; k < (inst.Op == IROpcode::SampleGrad ? 4 : 1); k++)
+						values += (k > 0 ? ", " : "") + Reg(inst.Src[1] + k);
+					Line("const Float extra[] = { " + values + " };");
+					extra = "extra";
+				}
+
+				Line("Float result[4];");
+				Line(string("Ops::Sample(ShaderCompiler::IROpcode::") + GetOpsName(inst.Op) + ", " + std::to_string(inst.Imm) + ", 0, exec, " +
+					Reg(inst.Src[0]) + ", " + Reg(inst.Src[0] + 1) + ", " + extra + ", fetch, result);");
+				for (auto k = 0; k < 4; k++)
+					Line(Reg(inst.Dst + k) + " = result[" + std::to_string(k) + "];");
+				Close();
+				break;
+			}
+
+			default:
+			{
+				string call = string("Ops::") + GetOpsName(inst.Op) + "(";
+				for (auto j = 0; j < 3 && inst.Src[j] >= 0; j++)
+					call += (j > 0 ? ", " : "") + Reg(inst.Src[j]);
+				Line(dst + " = " + call + ");");
+				break;
+			}
+			}
+		}
+
+		void ShaderCodeGenerator::WriteVertexShader()
+		{
+			const Array<ShaderProgram::AttributeBinding>& inputs = mpProgram->GetInputs();
+			const Array<ShaderProgram::AttributeBinding>& outputs = mpProgram->GetOutputs();
+
+			Line("#if defined(__AVX2__)");
+			Line("typedef __m256 BatchFloat;");
+			Line("#else");
+			Line("typedef __m128 BatchFloat;");
+			Line("#endif");
+			Line("static const int BATCH_SIZE = 4 * ShaderCompiler::ShaderOps<BatchFloat>::QUAD_COUNT;");
+			Line("");
+
+			Line("// Prepares the setup for every vertex, ShaderPipelineState prepares it once per draw and calls ExecuteBatch");
+			Line("void Execute(const DrawUniforms& uniforms,");
+			Line("\tconst Vector3& vPosIn,");
+			Line("\tconst Vector3& vNormalIn,");
+			Line("\tconst Vector2& vTexIn,");
+			Line("\tProjectedVertex* pOut) const");
+			Open();
+			Line("DrawSetup setup;");
+			Line("Prepare(uniforms, &setup);");
+			Line("ExecuteBatch(setup, &vPosIn, &vNormalIn, &vTexIn, 1, pOut);");
+			Close();
+			Line("");
+
+			Line("// Up to BATCH_SIZE vertices, one per lane");
+			Line("void ExecuteBatch(const DrawSetup& setup,");
+			Line("\tconst Vector3* pPosIn,");
+			Line("\tconst Vector3* pNormalIn,");
+			Line("\tconst Vector2* pTexIn,");
+			Line("\tconst int count,");
+			Line("\tProjectedVertex* pOut) const");
+			Open();
+			Line("typedef ShaderCompiler::ShaderOps<BatchFloat> Ops;");
+			Line("");
+
+			// Components the vertex does not hold are the same constant in every lane
+			Array<string> constants;
+			Array<string> components;
+			for (auto i = 0; i < inputs.Size(); i++)
+			{
+				for (auto c = 0; c < inputs[i].ComponentCount; c++)
+				{
+					const string value = VertexComponent(inputs[i].Attrib, c, "lane");
+					const bool isConstant = value == VertexComponent(inputs[i].Attrib, c, "0");
+					constants.Add(isConstant ? value : "");
+					components.Add(isConstant ? "" : value);
+				}
+			}
+
+			bool anyVarying = false;
+			for (auto i = 0; i < components.Size(); i++)
+				anyVarying = anyVarying || !components[i].empty();
+			if (anyVarying)
+			{
+				// Lanes past the end repeat the last vertex so every lane computes on valid data
+				Line("float values[INPUT_COUNT][BATCH_SIZE];");
+				Line("for (auto i = 0; i < BATCH_SIZE; i++)");
+				Open();
+				Line("const int lane = Math::Min(i, count - 1);");
+				for (auto i = 0; i < components.Size(); i++)
+				{
+					if (!components[i].empty())
+						Line("values[" + std::to_string(i) + "][i] = " + components[i] + ";");
+				}
+				Close();
+				Line("");
+			}
+
+			Line("BatchFloat inputs[INPUT_COUNT > 0 ? INPUT_COUNT : 1];");
+			for (auto i = 0; i < components.Size(); i++)
+			{
+				if (components[i].empty())
+					Line("inputs[" + std::to_string(i) + "] = Ops::SetFloat(" + constants[i] + ");");
+				else
+					Line("inputs[" + std::to_string(i) + "] = Ops::LoadLanes(values[" + std::to_string(i) + "]);");
+			}
+			Line("");
+
+			Line("BatchFloat outputs[OUTPUT_COUNT];");
+			Line("Run<BatchFloat>(setup, inputs, outputs, [](const int, const int, const __m128, const __m128, const float*, const float*, __m128 result[4])");
+			Open();
+			Line("result[0] = result[1] = result[2] = result[3] = _mm_setzero_ps();");
+			Close(");");
+			Line("");
+
+			Line("float results[OUTPUT_COUNT][BATCH_SIZE];");
+			Line("for (auto i = 0; i < OUTPUT_COUNT; i++)");
+			Line("\tOps::StoreLanes(results[i], outputs[i]);");
+			Line("");
+
+			Line("for (auto i = 0; i < count; i++)");
+			Open();
+
+			// Attributes the program does not write are 0, clip space w is 1
+			Line("pOut[i].projectedPos = Vector4(0.0f, 0.0f, 0.0f, 1.0f);");
+			Line("pOut[i].position = Vector3::ZERO;");
+			Line("pOut[i].normal = Vector3::ZERO;");
+			Line("pOut[i].texCoord = Vector2::ZERO;");
+
+			static const char* names[] = { "x", "y", "z", "w" };
+			int offset = 0;
+			for (auto i = 0; i < outputs.Size(); i++)
+			{
+				for (auto c = 0; c < outputs[i].ComponentCount; c++, offset++)
+				{
+					const string value = "results[" + std::to_string(offset) + "][i];";
+					switch (outputs[i].Attrib)
+					{
+					case ShaderProgram::Attribute::ScreenPosition:
+						Line(string("pOut[i].projectedPos.") + names[c] + " = " + value);
+						break;
+					case ShaderProgram::Attribute::Position:
+						if (c < 3)
+							Line(string("pOut[i].position.") + names[c] + " = " + value);
+						break;
+					case ShaderProgram::Attribute::Normal:
+						if (c < 3)
+							Line(string("pOut[i].normal.") + names[c] + " = " + value);
+						break;
+					default:
+						if (c < 2)
+							Line(string("pOut[i].texCoord.") + names[c] + " = " + value);
+						break;
+					}
+				}
+			}
+			Close();
+			Close();
+		}
+
+		void ShaderCodeGenerator::WritePixelShader()
+		{
+			const IRProgram& program = mpProgram->GetProgram();
+			const Array<ShaderProgram::AttributeBinding>& inputs = mpProgram->GetInputs();
+			const Array<ShaderProgram::AttributeBinding>& outputs = mpProgram->GetOutputs();
+
+			Line("// Prepares the setup for every quad, ShaderPipelineState prepares it once per draw and calls the overload");
+			Line("// taking it");
+			Line("Vec3f_SSE Shade(const Fragment& fragIn,");
+			Line("\tconst DrawUniforms& uniforms,");
+			Line("\tconst Vec3f_SSE& position,");
+			Line("\tconst Vec3f_SSE& normal,");
+			Line("\tconst Vec2f_SSE& texCoord) const");
+			Open();
+			Line("DrawSetup setup;");
+			Line("Prepare(uniforms, &setup);");
+			Line("return Shade(fragIn, uniforms, setup, position, normal, texCoord);");
+			Close();
+			Line("");
+
+			Line("Vec3f_SSE Shade(const Fragment& fragIn,");
+			Line("\tconst DrawUniforms& uniforms,");
+			Line("\tconst DrawSetup& setup,");
+			Line("\tconst Vec3f_SSE& position,");
+			Line("\tconst Vec3f_SSE& normal,");
+			Line("\tconst Vec2f_SSE& texCoord) const");
+			Open();
+
+			Line("__m128 inputs[INPUT_COUNT > 0 ? INPUT_COUNT : 1];");
+			int offset = 0;
+			for (auto i = 0; i < inputs.Size(); i++)
+			{
+				for (auto c = 0; c < inputs[i].ComponentCount; c++)
+					Line("inputs[" + std::to_string(offset++) + "] = " + FragmentComponent(inputs[i].Attrib, c) + ";");
+			}
+			Line("");
+
+			Line("__m128 outputs[OUTPUT_COUNT];");
+			if (program.Textures.Size() > 0)
+			{
+				// The texture of the fragment's material, as in ScriptPixelShader
+				Line("const QuadTexture* pTexture = (*uniforms.pTextureSlots)[fragIn.textureId].get();");
+				Line("Run<__m128>(setup, inputs, outputs, [&](const int slot, const int quad, const __m128 u, const __m128 v, const float dUVdx[2], const float dUVdy[2], __m128 result[4])");
+				Open();
+				Line("const Vec3f_SSE color = pTexture->SampleQuad(Vec2f_SSE(FloatSSE(u), FloatSSE(v)),");
+				Line("\tVector2(dUVdx[0], dUVdx[1]),");
+				Line("\tVector2(dUVdy[0], dUVdy[1]),");
+				Line("\t*uniforms.pSampler);");
+				Line("");
+				Line("result[0] = color.x.m128;");
+				Line("result[1] = color.y.m128;");
+				Line("result[2] = color.z.m128;");
+				Line("result[3] = _mm_set1_ps(1.0f);");
+				Close(");");
+			}
+			else
+			{
+				Line("Run<__m128>(setup, inputs, outputs, [](const int, const int, const __m128, const __m128, const float*, const float*, __m128 result[4])");
+				Open();
+				Line("result[0] = result[1] = result[2] = result[3] = _mm_setzero_ps();");
+				Close(");");
+			}
+			Line("");
+
+			// The first output is the target, Bind rejects everything else
+			const int targetCount = outputs[0].ComponentCount;
+			Line(string("return Vec3f_SSE(FloatSSE(outputs[0]),"));
+			Line(string("\tFloatSSE(") + (targetCount > 1 ? "outputs[1]" : "_mm_setzero_ps()") + "),");
+			Line(string("\tFloatSSE(") + (targetCount > 2 ? "outputs[2]" : "_mm_setzero_ps()") + "));");
+			Close();
+		}
+
+		void ShaderCodeGenerator::Line(const string& text)
+		{
+			// Labels and access specifiers sit one level out and preprocessor lines in the first column, like
+			// in hand written code
+			const bool isLabel = !text.empty() && text.back() == ':' && text.find(' ') == string::npos;
+			if (!text.empty() && text[0] != '#')
+				mSource.append(isLabel ? mIndent - 1 : mIndent, '\t');
+			mSource += text;
+			mSource += '\n';
+		}
+
+		int ShaderCodeGenerator::GetInputCount() const
+		{
+			int count = 0;
+			for (auto i = 0; i < mpProgram->GetInputs().Size(); i++)
+				count += mpProgram->GetInputs()[i].ComponentCount;
+			return count;
+		}
+
+		int ShaderCodeGenerator::GetOutputCount() const
+		{
+			int count = 0;
+			for (auto i = 0; i < mpProgram->GetOutputs().Size(); i++)
+				count += mpProgram->GetOutputs()[i].ComponentCount;
+			return count;
+		}
+
+		// Declaration of a constant shared register without its type, the value is kept bit exact
+		string ShaderCodeGenerator::Constant(const int reg) const
+		{
+			const uint bits = mpProgram->GetProgram().SharedValues[reg];
+
+			char line[128];
+			float value;
+			memcpy(&value, &bits, sizeof(float));
+			sprintf_s(line, 128, "r%i = Ops::Set(0x%08xu);\t// %g", reg, bits, value);
+			return line;
+		}
+
+		const char* ShaderCodeGenerator::GetOpsName(const IROpcode op)
+		{
+			static const char* names[] =
+			{
+				"Mov", "Store", "StoreIf", "Select",
+				"FAdd", "FSub", "FMul", "FDiv", "FMad", "FMin", "FMax", "FMod", "FNeg", "FAbs", "FSqrt", "FRsqrt", "FRcp",
+				"FFloor", "FCeil", "FFrac", "FRound", "FTrunc", "FSaturate", "FExp", "FExp2", "FLog", "FLog2", "FPow",
+				"FSin", "FCos", "FTan", "FAsin", "FAcos", "FAtan", "FAtan2", "FLt", "FLe", "FEq", "FNe",
+				"IAdd", "ISub", "IMul", "IDiv", "IMod", "UDiv", "UMod", "INeg", "IAbs", "IMin", "IMax", "UMin", "UMax",
+				"And", "Or", "Xor", "Not", "Shl", "Shr", "UShr", "ILt", "ILe", "IEq", "INe", "ULt", "ULe",
+				"IToF", "UToF", "FToI", "FToU",
+				"Ddx", "Ddy",
+				"Sample", "SampleBias", "SampleGrad",
+				"If", "Else", "EndIf", "Loop", "BreakUnless", "Break", "Continue", "LoopContinue", "EndLoop",
+				"Begin", "Return", "End",
+			};
+			static_assert(sizeof(names) / sizeof(names[0]) == int(IROpcode::Count), "Opcode names out of sync");
+
+			return names[int(op)];
+		}
+
+		int ShaderCodeGenerator::GetUniformComponentCount(const ShaderProgram::Uniform source)
+		{
+			switch (source)
+			{
+			case ShaderProgram::Uniform::ModelViewProjMatrix:
+			case ShaderProgram::Uniform::ModelViewInvMatrix:
+				return 16;
+			case ShaderProgram::Uniform::EyePos:
+			case ShaderProgram::Uniform::LightDirection:
+				return 3;
+			default:
+				return 1;
+			}
+		}
+
+		// Sources of the values ShaderProgram::GetSharedValues fills in
+		string ShaderCodeGenerator::UniformComponent(const ShaderProgram::Uniform source, const int comp)
+		{
+			static const char* components[] = { "x", "y", "z" };
+			switch (source)
+			{
+			case ShaderProgram::Uniform::ModelViewProjMatrix:
+				return "uniforms.Transform.ModelViewProjMatrix.m[" + std::to_string(comp / 4) + "][" + std::to_string(comp % 4) + "]";
+			case ShaderProgram::Uniform::ModelViewInvMatrix:
+				return "uniforms.Transform.ModelViewInvMatrix.m[" + std::to_string(comp / 4) + "][" + std::to_string(comp % 4) + "]";
+			case ShaderProgram::Uniform::EyePos:
+				return string("uniforms.Transform.EyePos.") + components[comp] + "[0]";
+			case ShaderProgram::Uniform::LightDirection:
+				return string("uniforms.Light.Direction.") + components[comp] + "[0]";
+			case ShaderProgram::Uniform::LightAmbient:
+				return "uniforms.Light.Ambient[0]";
+			default:
+				return "uniforms.Light.Intensity[0]";
+			}
+		}
+
+		// Components beyond what the vertex holds read as 0, except w of positions
+		string ShaderCodeGenerator::VertexComponent(const ShaderProgram::Attribute attrib, const int comp, const string& index)
+		{
+			static const char* components[] = { "x", "y", "z" };
+			switch (attrib)
+			{
+			case ShaderProgram::Attribute::Position:
+				return comp < 3 ? "pPosIn[" + index + "]." + components[comp] : "1.0f";
+			case ShaderProgram::Attribute::Normal:
+				return comp < 3 ? "pNormalIn[" + index + "]." + components[comp] : "0.0f";
+			default:
+				return comp < 2 ? "pTexIn[" + index + "]." + components[comp] : "0.0f";
+			}
+		}
+
+		string ShaderCodeGenerator::FragmentComponent(const ShaderProgram::Attribute attrib, const int comp)
+		{
+			static const char* components[] = { "x", "y", "z" };
+			switch (attrib)
+			{
+			case ShaderProgram::Attribute::ScreenPosition:
+				// Pixel centers, depth is not available to the shader
+				if (comp == 0)
+					return "_mm_add_ps(_mm_set1_ps(float(fragIn.x)), _mm_setr_ps(0.5f, 1.5f, 0.5f, 1.5f))";
+				if (comp == 1)
+					return "_mm_add_ps(_mm_set1_ps(float(fragIn.y)), _mm_setr_ps(0.5f, 0.5f, 1.5f, 1.5f))";
+				return comp == 3 ? "_mm_set1_ps(1.0f)" : "_mm_setzero_ps()";
+			case ShaderProgram::Attribute::Position:
+				return comp < 3 ? string("position.") + components[comp] + ".m128" : "_mm_set1_ps(1.0f)";
+			case ShaderProgram::Attribute::Normal:
+				return comp < 3 ? string("normal.") + components[comp] + ".m128" : "_mm_setzero_ps()";
+			default:
+				return comp == 0 ? "texCoord.u.m128" : comp == 1 ? "texCoord.v.m128" : "_mm_setzero_ps()";
+			}
+		}
+	}
+}
\ No newline at end of file
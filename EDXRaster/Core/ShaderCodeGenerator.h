@@ -0,0 +1,74 @@
+#pragma once
+
+#include "EDXPrerequisites.h"
+#include "ScriptShader.h"
+
+namespace EDX
+{
+	namespace RasterRenderer
+	{
+		// Writes a compiled program out as a C++ header, for builds that ship their shaders without the compiler.
+		// The generated class derives from VertexShader or PixelShader and goes into PipelineState::Create like
+		// the shaders in Shader.h. Its program is a function template over the register type written against
+		// ShaderCompiler::ShaderOps, with the same results as running the program through ShaderInterpreter.
+		// Uniforms and setup instructions are evaluated once per draw into a DrawSetup. Vertex shaders run a
+		// vertex in each lane, four per call or eight with AVX2, pixel shaders one quad per call
+		class ShaderCodeGenerator
+		{
+		private:
+			// Open construct while writing, its control state lives in locals named after the instruction
+			// that opened it
+			struct Construct
+			{
+				ShaderCompiler::IROpcode Op;
+				int Pc;
+				int OuterLoop;
+				int OuterFrame;
+			};
+
+			const ShaderProgram* mpProgram;
+			string mSource;
+			int mIndent;
+
+			Array<int> mSetupSlots; // Slot in DrawSetup of each shared register, -1 for constants
+			Array<Construct> mConstructs;
+			int mLoop;		// Instruction of the innermost loop or function, -1 if none
+			int mFrame;
+
+		public:
+			ShaderCodeGenerator()
+				: mpProgram(nullptr)
+				, mIndent(0)
+				, mLoop(-1)
+				, mFrame(-1)
+			{
+			}
+
+			// sourceName is only quoted in the header comment
+			string Generate(const ShaderProgram& program, const string& className, const string& sourceName);
+
+		private:
+			void WriteSetup();
+			void WriteRun();
+			void WriteControl(const int pc);
+			void WriteInstruction(const ShaderCompiler::IRInstruction& inst);
+			void WriteVertexShader();
+			void WritePixelShader();
+
+			void Line(const string& text);
+			void Open() { Line("{"); mIndent++; }
+			void Close(const char* pTail = "") { mIndent--; Line(string("}") + pTail); }
+
+			int GetInputCount() const;
+			int GetOutputCount() const;
+			string Constant(const int reg) const;
+
+			static string Reg(const int reg) { return "r" + std::to_string(reg); }
+			static const char* GetOpsName(const ShaderCompiler::IROpcode op);
+			static int GetUniformComponentCount(const ShaderProgram::Uniform source);
+			static string UniformComponent(const ShaderProgram::Uniform source, const int comp);
+			static string VertexComponent(const ShaderProgram::Attribute attrib, const int comp, const string& index);
+			static string FragmentComponent(const ShaderProgram::Attribute attrib, const int comp);
+		};
+	}
+}
\ No newline at end of file
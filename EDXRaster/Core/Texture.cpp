@@ -0,0 +1,331 @@
+#include "Texture.h"
+#include "Windows/Bitmap.h"
+#include "Core/Memory.h"
+
+namespace EDX
+{
+	namespace RasterRenderer
+	{
+		namespace
+		{
+			// Fetches one texel per lane, texels are packed RGBA8
+			__forceinline __m128i Gather(const Color4b* pTexels, const __m128i idx)
+			{
+#if defined(__AVX2__)
+				return _mm_i32gather_epi32((const int*)pTexels, idx, 4);
+#else
+				const int* pData = (const int*)pTexels;
+				return _mm_setr_epi32(pData[_mm_cvtsi128_si32(idx)],
+					pData[_mm_cvtsi128_si32(_mm_shuffle_epi32(idx, _MM_SHUFFLE(1, 1, 1, 1)))],
+					pData[_mm_cvtsi128_si32(_mm_shuffle_epi32(idx, _MM_SHUFFLE(2, 2, 2, 2)))],
+					pData[_mm_cvtsi128_si32(_mm_shuffle_epi32(idx, _MM_SHUFFLE(3, 3, 3, 3)))]);
+#endif
+			}
+
+			// Interleaves the low 2 bits of x and y
+			__forceinline int Morton4x4(const int x, const int y)
+			{
+				return (x & 1) | ((y & 1) << 1) | ((x & 2) << 1) | ((y & 2) << 2);
+			}
+		}
+
+		ImageQuadTexture::ImageQuadTexture(const char* path,
+			const TexelLayout layout,
+			const MipFilter mipFilter,
+			const char* mipCachePath)
+			: mLayout(layout)
+			, mMipFilter(mipFilter)
+			, mResidentLevel(0)
+			, mPath(path)
+			, mMipCachePath(mipCachePath ? mipCachePath : "")
+		{
+			if (!mMipCachePath.empty() && ReadMipCache())
+				return;
+
+			int width, height, channel;
+			Color4b* pTexels = Bitmap::ReadFromFile<Color4b>(path, &width, &height, &channel);
+			const bool loaded = pTexels != nullptr;
+
+			MipLevel level0;
+			if (loaded)
+			{
+				level0.Width = width;
+				level0.Height = height;
+				level0.Pitch = width;
+				level0.Texels.Resize(width * height);
+				memcpy(level0.Texels.Data(), pTexels, width * height * sizeof(Color4b));
+				Memory::SafeDeleteArray(pTexels);
+			}
+			else
+			{
+				level0.Width = 1;
+				level0.Height = 1;
+				level0.Pitch = 1;
+				level0.Texels.Resize(1);
+				level0.Texels[0] = Color4b(255, 255, 255);
+			}
+			mLevels.Add(level0);
+
+			GenerateMips();
+
+			// Mips are filtered in linear order and rearranged once at load time
+			for (auto i = 0; i < mLevels.Size(); i++)
+				ApplyLayout(mLevels[i]);
+
+			// Images that failed to load are not cached, the file may become readable later
+			if (!mMipCachePath.empty() && loaded)
+				WriteMipCache();
+		}
+
+		void ImageQuadTexture::GenerateMips()
+		{
+			while (mLevels[mLevels.Size() - 1].Width > 1 || mLevels[mLevels.Size() - 1].Height > 1)
+			{
+				const MipLevel& src = mLevels[mLevels.Size() - 1];
+
+				MipLevel dst;
+				dst.Width = Math::Max(src.Width >> 1, 1);
+				dst.Height = Math::Max(src.Height >> 1, 1);
+				dst.Pitch = dst.Width;
+				MipGenerator::Downsample(src.Texels.Data(), src.Width, src.Height, dst.Texels, mMipFilter);
+
+				mLevels.Add(dst);
+			}
+		}
+
+		void ImageQuadTexture::ApplyLayout(MipLevel& level) const
+		{
+			if (mLayout == TexelLayout::Linear)
+				return;
+
+			// Padded to whole tiles, edge texels are replicated into the padding
+			const int tileCountX = (level.Width + 3) >> 2;
+			const int tileCountY = (level.Height + 3) >> 2;
+
+			Array<Color4b> tiled;
+			tiled.Resize(tileCountX * tileCountY * 16);
+			for (auto y = 0; y < tileCountY * 4; y++)
+			{
+				const int srcY = Math::Min(y, level.Height - 1);
+				for (auto x = 0; x < tileCountX * 4; x++)
+				{
+					const int srcX = Math::Min(x, level.Width - 1);
+					const int idx = (y >> 2) * tileCountX * 16 + (x >> 2) * 16 + Morton4x4(x, y);
+					tiled[idx] = level.Texels[srcY * level.Width + srcX];
+				}
+			}
+
+			level.Pitch = tileCountX * 16;
+			level.Texels = tiled;
+		}
+
+		bool ImageQuadTexture::ReadMipCache()
+		{
+			MipChain chain;
+			if (!MipCache::Read(mMipCachePath.c_str(), chain) || chain.Kind != MipChainKind::Texels || chain.Format != uint(mLayout))
+				return false;
+
+			for (auto i = 0; i < chain.Levels.Size(); i++)
+			{
+				MipLevel level;
+				level.Width = chain.Levels[i].Width;
+				level.Height = chain.Levels[i].Height;
+				level.Pitch = mLayout == TexelLayout::Linear ? level.Width : ((level.Width + 3) >> 2) * 16;
+				mLevels.Add(level);
+
+				if (chain.Levels[i].Data.Size() != GetLevelMemorySize(i))
+				{
+					mLevels.Clear();
+					return false;
+				}
+
+				MipLevel& mip = mLevels[i];
+				mip.Texels.Resize(chain.Levels[i].Data.Size() / sizeof(Color4b));
+				memcpy(mip.Texels.Data(), chain.Levels[i].Data.Data(), chain.Levels[i].Data.Size());
+			}
+
+			return true;
+		}
+
+		void ImageQuadTexture::WriteMipCache() const
+		{
+			MipChain chain;
+			chain.Kind = MipChainKind::Texels;
+			chain.Format = uint(mLayout);
+			chain.Levels.Resize(mLevels.Size());
+			for (auto i = 0; i < mLevels.Size(); i++)
+			{
+				MipChainLevel& level = chain.Levels[i];
+				level.Width = mLevels[i].Width;
+				level.Height = mLevels[i].Height;
+				level.Data.Resize(mLevels[i].Texels.Size() * sizeof(Color4b));
+				memcpy(level.Data.Data(), mLevels[i].Texels.Data(), level.Data.Size());
+			}
+
+			MipCache::Write(mMipCachePath.c_str(), chain);
+		}
+
+		__m128i ImageQuadTexture::TexelOffsetX(const MipLevel& level, const __m128 x) const
+		{
+			const __m128i xi = _mm_cvttps_epi32(x);
+			if (mLayout == TexelLayout::Linear)
+				return xi;
+
+			// Tile in the row plus the x bits of the Morton offset
+			const __m128i tileOffset = _mm_slli_epi32(_mm_andnot_si128(_mm_set1_epi32(3), xi), 2);
+			const __m128i morton = _mm_or_si128(_mm_and_si128(xi, _mm_set1_epi32(1)), _mm_slli_epi32(_mm_and_si128(xi, _mm_set1_epi32(2)), 1));
+			return _mm_or_si128(tileOffset, morton);
+		}
+
+		__m128i ImageQuadTexture::TexelOffsetY(const MipLevel& level, const __m128 y) const
+		{
+			const __m128 pitch = _mm_set1_ps(float(level.Pitch));
+			if (mLayout == TexelLayout::Linear)
+				return _mm_cvttps_epi32(_mm_mul_ps(y, pitch));
+
+			// Row of tiles plus the y bits of the Morton offset
+			const __m128i yi = _mm_cvttps_epi32(y);
+			const __m128 tileRowY = _mm_cvtepi32_ps(_mm_andnot_si128(_mm_set1_epi32(3), yi));
+			const __m128i rowOffset = _mm_cvttps_epi32(_mm_mul_ps(tileRowY, _mm_mul_ps(pitch, _mm_set1_ps(0.25f))));
+			const __m128i morton = _mm_or_si128(_mm_slli_epi32(_mm_and_si128(yi, _mm_set1_epi32(1)), 1), _mm_slli_epi32(_mm_and_si128(yi, _mm_set1_epi32(2)), 2));
+			return _mm_or_si128(rowOffset, morton);
+		}
+
+		size_t ImageQuadTexture::GetMemorySize() const
+		{
+			size_t size = 0;
+			for (auto i = 0; i < mLevels.Size(); i++)
+				size += mLevels[i].Texels.Size() * sizeof(Color4b);
+
+			return size;
+		}
+
+		size_t ImageQuadTexture::GetLevelMemorySize(const int level) const
+		{
+			const MipLevel& mip = mLevels[level];
+			if (mLayout == TexelLayout::Linear)
+				return mip.Width * mip.Height * sizeof(Color4b);
+
+			return ((mip.Width + 3) >> 2) * ((mip.Height + 3) >> 2) * 16 * sizeof(Color4b);
+		}
+
+		bool ImageQuadTexture::LoadLevels(const int firstLevel, const int endLevel, MipChain& levels) const
+		{
+			if (!mMipCachePath.empty() && MipCache::ReadLevels(mMipCachePath.c_str(), firstLevel, endLevel, levels))
+				return levels.Kind == MipChainKind::Texels && levels.Format == uint(mLayout);
+
+			// Without a cached chain the image is decoded again, but filtering stops at the last level asked for
+			int width, height, channel;
+			Color4b* pTexels = Bitmap::ReadFromFile<Color4b>(mPath.c_str(), &width, &height, &channel);
+			if (!pTexels)
+				return false;
+
+			MipLevel level;
+			level.Width = width;
+			level.Height = height;
+			level.Pitch = width;
+			level.Texels.Resize(width * height);
+			memcpy(level.Texels.Data(), pTexels, width * height * sizeof(Color4b));
+			Memory::SafeDeleteArray(pTexels);
+
+			levels.Kind = MipChainKind::Texels;
+			levels.Format = uint(mLayout);
+			levels.Levels.Clear();
+			for (auto i = 0; ; i++)
+			{
+				MipChainLevel chainLevel;
+				chainLevel.Width = level.Width;
+				chainLevel.Height = level.Height;
+				levels.Levels.Add(chainLevel);
+
+				if (i >= firstLevel && i < endLevel)
+				{
+					MipLevel stored = level;
+					ApplyLayout(stored);
+
+					Array<_byte>& data = levels.Levels[i].Data;
+					data.Resize(stored.Texels.Size() * sizeof(Color4b));
+					memcpy(data.Data(), stored.Texels.Data(), data.Size());
+				}
+
+				if (level.Width == 1 && level.Height == 1)
+					break;
+
+				// Levels past the range only need their size
+				MipLevel next;
+				next.Width = Math::Max(level.Width >> 1, 1);
+				next.Height = Math::Max(level.Height >> 1, 1);
+				next.Pitch = next.Width;
+				if (i + 1 < endLevel)
+					MipGenerator::Downsample(level.Texels.Data(), level.Width, level.Height, next.Texels, mMipFilter);
+				level = next;
+			}
+
+			return true;
+		}
+
+		bool ImageQuadTexture::CommitLevels(MipChain& levels, const int firstLevel)
+		{
+			// The file may have changed since the texture was created
+			if (levels.Kind != MipChainKind::Texels || levels.Format != uint(mLayout) || levels.Levels.Size() != mLevels.Size())
+				return false;
+
+			for (auto i = firstLevel; i < mResidentLevel; i++)
+			{
+				const MipChainLevel& level = levels.Levels[i];
+				if (level.Width != mLevels[i].Width || level.Height != mLevels[i].Height || level.Data.Size() != GetLevelMemorySize(i))
+					return false;
+			}
+
+			for (auto i = firstLevel; i < mResidentLevel; i++)
+			{
+				mLevels[i].Texels.Resize(levels.Levels[i].Data.Size() / sizeof(Color4b));
+				memcpy(mLevels[i].Texels.Data(), levels.Levels[i].Data.Data(), levels.Levels[i].Data.Size());
+				levels.Levels[i].Data.Clear();
+			}
+			mResidentLevel = Math::Min(mResidentLevel, firstLevel);
+
+			return true;
+		}
+
+		void ImageQuadTexture::EvictLevels(const int firstLevel)
+		{
+			// The coarsest level always stays resident
+			const int newResidentLevel = Math::Min(firstLevel, int(mLevels.Size()) - 1);
+			for (auto i = mResidentLevel; i < newResidentLevel; i++)
+				mLevels[i].Texels.Clear();
+			mResidentLevel = Math::Max(mResidentLevel, newResidentLevel);
+		}
+
+		Vec3f_SSE ImageQuadTexture::SampleQuad(const Vec2f_SSE& texCoord,
+			const Vector2& dUVdx,
+			const Vector2& dUVdy,
+			const SamplerState& sampler) const
+		{
+			return QuadFilter<ImageQuadTexture>::Sample(*this, texCoord, dUVdx, dUVdy, sampler);
+		}
+
+		__m128i ImageQuadTexture::FetchTexels(const int level, const __m128 x, const __m128 y) const
+		{
+			const MipLevel& mip = mLevels[level];
+			return Gather(mip.Texels.Data(), _mm_add_epi32(TexelOffsetY(mip, y), TexelOffsetX(mip, x)));
+		}
+
+		void ImageQuadTexture::FetchFootprint(const int level, const __m128 x0, const __m128 x1, const __m128 y0, const __m128 y1, __m128i texels[4]) const
+		{
+			const MipLevel& mip = mLevels[level];
+
+			// Texel offsets are separable in x and y for both layouts
+			const __m128i offsetX0 = TexelOffsetX(mip, x0);
+			const __m128i offsetX1 = TexelOffsetX(mip, x1);
+			const __m128i offsetY0 = TexelOffsetY(mip, y0);
+			const __m128i offsetY1 = TexelOffsetY(mip, y1);
+
+			const Color4b* pTexels = mip.Texels.Data();
+			texels[0] = Gather(pTexels, _mm_add_epi32(offsetY0, offsetX0));
+			texels[1] = Gather(pTexels, _mm_add_epi32(offsetY0, offsetX1));
+			texels[2] = Gather(pTexels, _mm_add_epi32(offsetY1, offsetX0));
+			texels[3] = Gather(pTexels, _mm_add_epi32(offsetY1, offsetX1));
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,183 @@
+#pragma once
+
+#include "EDXPrerequisites.h"
+#include "Sampler.h"
+#include "QuadFilter.h"
+#include "MipGenerator.h"
+#include "Math/Vector.h"
+#include "Graphics/Color.h"
+#include "SIMD/SSE.h"
+
+#include <atomic>
+#include <memory>
+
+namespace EDX
+{
+	namespace RasterRenderer
+	{
+		// Textures are sampled a whole 2x2 quad at a time, the derivatives are shared by the quad
+		class QuadTexture
+		{
+		public:
+			static const int NO_FEEDBACK = 0x7fffffff;
+
+		protected:
+			mutable std::atomic<int> mRequestedLevel;
+
+		public:
+			QuadTexture()
+				: mRequestedLevel(NO_FEEDBACK)
+			{
+			}
+			virtual ~QuadTexture() {}
+			virtual Vec3f_SSE SampleQuad(const Vec2f_SSE& texCoord,
+				const Vector2& dUVdx,
+				const Vector2& dUVdy,
+				const SamplerState& sampler) const = 0;
+			virtual size_t GetMemorySize() const = 0;
+
+			// Mip streaming, levels finer than the resident level are not in memory. LoadLevels reads only the
+			// missing levels off the render thread, CommitLevels then moves them in, it fails when the file no
+			// longer matches the texture
+			virtual int GetLevelCount() const { return 1; }
+			virtual int GetResidentLevel() const { return 0; }
+			virtual size_t GetLevelMemorySize(const int level) const { return GetMemorySize(); }
+			virtual bool LoadLevels(const int firstLevel, const int endLevel, MipChain& levels) const { return false; }
+			virtual bool CommitLevels(MipChain& levels, const int firstLevel) { return false; }
+			virtual void EvictLevels(const int firstLevel) {}
+
+			// Sampler feedback, only finer requests write so a texture already at its level costs a single load
+			void RecordFeedback(const int level) const
+			{
+				int current = mRequestedLevel.load(std::memory_order_relaxed);
+				while (level < current && !mRequestedLevel.compare_exchange_weak(current, level, std::memory_order_relaxed));
+			}
+
+			// Finest level requested since the last call, or NO_FEEDBACK
+			int ConsumeFeedback()
+			{
+				return mRequestedLevel.exchange(NO_FEEDBACK);
+			}
+		};
+
+		class ConstantQuadTexture : public QuadTexture
+		{
+		private:
+			Color mColor;
+
+		public:
+			ConstantQuadTexture(const Color& color)
+				: mColor(color)
+			{
+			}
+
+			Vec3f_SSE SampleQuad(const Vec2f_SSE& texCoord,
+				const Vector2& dUVdx,
+				const Vector2& dUVdy,
+				const SamplerState& sampler) const
+			{
+				return Vec3f_SSE(mColor.r, mColor.g, mColor.b);
+			}
+			size_t GetMemorySize() const
+			{
+				return sizeof(Color);
+			}
+		};
+
+		// Linear stays the default, the tiled layout has not yet been measured faster with mip levels larger
+		// than the cache
+		enum class TexelLayout
+		{
+			Linear,
+			Tiled // 4x4 texel tiles in Morton order, one cache line per tile
+		};
+
+		class ImageQuadTexture : public QuadTexture
+		{
+		private:
+			struct MipLevel
+			{
+				int Width, Height;
+				int Pitch; // Texels per row, or per row of tiles
+				Array<Color4b> Texels;
+			};
+
+			Array<MipLevel> mLevels;
+			TexelLayout mLayout;
+			MipFilter mMipFilter;
+			int mResidentLevel;
+			string mPath;
+			string mMipCachePath; // Empty when the chain is not cached on disk
+
+			friend class QuadFilter<ImageQuadTexture>;
+
+		public:
+			// A finished chain in the mip cache file is loaded instead of decoding and filtering the image,
+			// otherwise the file is written once the chain is built
+			ImageQuadTexture(const char* path,
+				const TexelLayout layout = TexelLayout::Linear,
+				const MipFilter mipFilter = MipFilter::Box,
+				const char* mipCachePath = nullptr);
+
+			Vec3f_SSE SampleQuad(const Vec2f_SSE& texCoord,
+				const Vector2& dUVdx,
+				const Vector2& dUVdy,
+				const SamplerState& sampler) const;
+			size_t GetMemorySize() const;
+
+			int Width() const
+			{
+				return mLevels[0].Width;
+			}
+			int Height() const
+			{
+				return mLevels[0].Height;
+			}
+			TexelLayout GetLayout() const
+			{
+				return mLayout;
+			}
+
+			int GetLevelCount() const
+			{
+				return mLevels.Size();
+			}
+			int GetResidentLevel() const
+			{
+				return mResidentLevel;
+			}
+			size_t GetLevelMemorySize(const int level) const;
+			bool LoadLevels(const int firstLevel, const int endLevel, MipChain& levels) const;
+			bool CommitLevels(MipChain& levels, const int firstLevel);
+			void EvictLevels(const int firstLevel);
+
+		private:
+			void GenerateMips();
+			void ApplyLayout(MipLevel& level) const;
+			bool ReadMipCache();
+			void WriteMipCache() const;
+
+			int LevelCount() const
+			{
+				return mLevels.Size();
+			}
+			int ResidentLevel() const
+			{
+				return mResidentLevel;
+			}
+			int LevelWidth(const int level) const
+			{
+				return mLevels[level].Width;
+			}
+			int LevelHeight(const int level) const
+			{
+				return mLevels[level].Height;
+			}
+			__m128i FetchTexels(const int level, const __m128 x, const __m128 y) const;
+			void FetchFootprint(const int level, const __m128 x0, const __m128 x1, const __m128 y0, const __m128 y1, __m128i texels[4]) const;
+
+			__m128i TexelOffsetX(const MipLevel& level, const __m128 x) const;
+			__m128i TexelOffsetY(const MipLevel& level, const __m128 y) const;
+		};
+	}
+}
\ No newline at end of file
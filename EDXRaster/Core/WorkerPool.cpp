@@ -0,0 +1,208 @@
+#include "WorkerPool.h"
+
+#include <chrono>
+
+namespace EDX
+{
+	namespace RasterRenderer
+	{
+		WorkerPool* WorkerPool::mpInstance = nullptr;
+		std::mutex WorkerPool::mInstanceLock;
+
+		WorkerPool::WorkerPool(const int threadCount)
+			: mShutdown(false)
+		{
+			for (auto i = 0; i < threadCount; i++)
+				mThreads.push_back(std::thread([this]() { WorkerMain(); }));
+		}
+
+		WorkerPool::~WorkerPool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mLock);
+				mShutdown = true;
+			}
+			mWorkAvailable.notify_all();
+
+			for (auto& thread : mThreads)
+				thread.join();
+
+			Assert(mContexts.Size() == 0);
+		}
+
+		WorkerPool::Context* WorkerPool::AddContext(const WorkContextDesc& desc)
+		{
+			std::lock_guard<std::mutex> lock(mLock);
+
+			Context* pContext = new Context;
+			pContext->Desc = desc;
+			pContext->Running = 0;
+			pContext->VirtualTime = 0.0;
+			mContexts.Add(pContext);
+
+			return pContext;
+		}
+
+		void WorkerPool::RemoveContext(Context* pContext)
+		{
+			std::lock_guard<std::mutex> lock(mLock);
+
+			for (auto i = 0; i < mContexts.Size(); i++)
+			{
+				if (mContexts[i] == pContext)
+				{
+					mContexts[i] = mContexts[mContexts.Size() - 1];
+					mContexts.Resize(mContexts.Size() - 1);
+					break;
+				}
+			}
+
+			delete pContext;
+		}
+
+		void WorkerPool::SetDesc(Context* pContext, const WorkContextDesc& desc)
+		{
+			std::lock_guard<std::mutex> lock(mLock);
+			pContext->Desc = desc;
+
+			// A raised quota can let waiting workers in
+			mWorkAvailable.notify_all();
+		}
+
+		void WorkerPool::Run(Context* pContext, Job& job)
+		{
+			std::unique_lock<std::mutex> lock(mLock);
+
+			// A context coming back from idle starts level with the busy ones instead of catching up on the
+			// time it did not use
+			if (pContext->Jobs.Size() == 0 && pContext->Running == 0)
+			{
+				for (auto i = 0; i < mContexts.Size(); i++)
+				{
+					const Context* pOther = mContexts[i];
+					if (pOther != pContext && (pOther->Jobs.Size() > 0 || pOther->Running > 0))
+						pContext->VirtualTime = Math::Max(pContext->VirtualTime, pOther->VirtualTime);
+				}
+			}
+
+			pContext->Jobs.Add(&job);
+			mWorkAvailable.notify_all();
+
+			while (job.Pending > 0)
+			{
+				if (job.Next < job.End)
+					RunChunk(pContext, &job, false, lock);
+				else
+					mJobDone.wait(lock);
+			}
+
+			if (job.Exception)
+				std::rethrow_exception(job.Exception);
+		}
+
+		void WorkerPool::WorkerMain()
+		{
+			std::unique_lock<std::mutex> lock(mLock);
+			while (!mShutdown)
+			{
+				Context* pContext = PickContext();
+				if (!pContext)
+				{
+					mWorkAvailable.wait(lock);
+					continue;
+				}
+
+				RunChunk(pContext, pContext->Jobs[0], true, lock);
+			}
+		}
+
+		WorkerPool::Context* WorkerPool::PickContext() const
+		{
+			Context* pPicked = nullptr;
+			for (auto i = 0; i < mContexts.Size(); i++)
+			{
+				Context* pContext = mContexts[i];
+				if (pContext->Jobs.Size() == 0)
+					continue;
+				if (pContext->Desc.CoreQuota > 0 && pContext->Running >= pContext->Desc.CoreQuota)
+					continue;
+
+				if (!pPicked || pContext->VirtualTime < pPicked->VirtualTime)
+					pPicked = pContext;
+			}
+
+			return pPicked;
+		}
+
+		void WorkerPool::RunChunk(Context* pContext, Job* pJob, const bool isWorker, std::unique_lock<std::mutex>& lock)
+		{
+			const int begin = pJob->Next;
+			const int end = Math::Min(begin + pJob->Grain, pJob->End);
+			pJob->Next = end;
+
+			// Fully handed out jobs leave the queue, keeping the order of the others
+			if (end == pJob->End)
+			{
+				Array<Job*>& jobs = pContext->Jobs;
+				auto idx = 0;
+				while (jobs[idx] != pJob)
+					idx++;
+				for (; idx < jobs.Size() - 1; idx++)
+					jobs[idx] = jobs[idx + 1];
+				jobs.Resize(jobs.Size() - 1);
+			}
+
+			if (isWorker)
+				pContext->Running++;
+
+			lock.unlock();
+			const auto startTime = std::chrono::steady_clock::now();
+
+			// Caught so the job still completes, an exception escaping a worker thread would end the process
+			std::exception_ptr exception;
+			try
+			{
+				pJob->pInvoke(pJob->pFunc, begin, end);
+			}
+			catch (...)
+			{
+				exception = std::current_exception();
+			}
+
+			const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - startTime;
+			lock.lock();
+
+			if (exception && !pJob->Exception)
+				pJob->Exception = exception;
+
+			pContext->VirtualTime += elapsed.count() / Math::Max(1, pContext->Desc.Priority);
+			if (isWorker)
+				pContext->Running--;
+
+			// The job may be gone as soon as its owner sees it finished
+			pJob->Pending -= end - begin;
+			if (pJob->Pending == 0)
+				mJobDone.notify_all();
+		}
+
+		WorkContext::WorkContext(WorkerPool* pPool, const WorkContextDesc& desc)
+			: mpPool(pPool)
+			, mpContext(pPool ? pPool->AddContext(desc) : nullptr)
+			, mDesc(desc)
+		{
+		}
+
+		WorkContext::~WorkContext()
+		{
+			if (mpPool)
+				mpPool->RemoveContext(mpContext);
+		}
+
+		void WorkContext::SetDesc(const WorkContextDesc& desc)
+		{
+			mDesc = desc;
+			if (mpPool)
+				mpPool->SetDesc(mpContext, desc);
+		}
+	}
+}
\ No newline at end of file
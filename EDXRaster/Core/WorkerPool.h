@@ -0,0 +1,164 @@
+#pragma once
+
+#include "EDXPrerequisites.h"
+#include "Math/EDXMath.h"
+#include "Windows/Threading.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <exception>
+
+namespace EDX
+{
+	namespace RasterRenderer
+	{
+		struct WorkContextDesc
+		{
+			int Priority;	// Share of worker time relative to the other contexts with work pending
+			int CoreQuota;	// Most pool workers on the context's loops at once, 0 for no limit
+
+			explicit WorkContextDesc(const int priority = 1, const int coreQuota = 0)
+				: Priority(priority)
+				, CoreQuota(coreQuota)
+			{
+			}
+		};
+
+		// Worker threads shared by every renderer of the process. Loops are handed out in chunks, and each
+		// free worker takes its next chunk from the context that has received the least worker time for its
+		// priority, so the frames of concurrent renderers interleave instead of each renderer assuming it
+		// owns every core
+		class WorkerPool
+		{
+			friend class WorkContext;
+
+		private:
+			// A parallel loop, its indices are handed out in chunks of Grain
+			struct Job
+			{
+				void (*pInvoke)(const void* pFunc, const int begin, const int end);
+				const void* pFunc;
+				int Next;
+				int End;
+				int Grain;
+				int Pending;	// Indices not finished yet
+				std::exception_ptr Exception;	// First one a chunk threw, rethrown to the caller of the loop
+			};
+
+			struct Context
+			{
+				WorkContextDesc Desc;
+				Array<Job*> Jobs;		// Jobs with chunks left to hand out, in submission order
+				int Running;			// Pool workers on the context's chunks
+				double VirtualTime;		// Seconds of work received divided by priority
+			};
+
+			std::vector<std::thread> mThreads;
+			Array<Context*> mContexts;
+			std::mutex mLock;
+			std::condition_variable mWorkAvailable;
+			std::condition_variable mJobDone;
+			bool mShutdown;
+
+			static WorkerPool* mpInstance;
+			static std::mutex mInstanceLock;
+
+		public:
+			explicit WorkerPool(const int threadCount = GetNumberOfCores());
+			~WorkerPool();
+
+			// The pool renderers use unless given another one. Locked, renderers built on different threads can
+			// ask for it the first time at once
+			static WorkerPool* Instance()
+			{
+				std::lock_guard<std::mutex> lock(mInstanceLock);
+				if (!mpInstance)
+					mpInstance = new WorkerPool;
+
+				return mpInstance;
+			}
+			static void DeleteInstance()
+			{
+				std::lock_guard<std::mutex> lock(mInstanceLock);
+				if (mpInstance)
+				{
+					delete mpInstance;
+					mpInstance = nullptr;
+				}
+			}
+
+			int GetThreadCount() const { return int(mThreads.size()); }
+
+		private:
+			Context* AddContext(const WorkContextDesc& desc);
+			void RemoveContext(Context* pContext);
+			void SetDesc(Context* pContext, const WorkContextDesc& desc);
+
+			// Runs a loop to completion, the calling thread works on it too. An exception thrown by the loop body
+			// is rethrown once every chunk has finished
+			void Run(Context* pContext, Job& job);
+			void WorkerMain();
+
+			// With the lock held, unlocks while the chunk runs
+			Context* PickContext() const;
+			void RunChunk(Context* pContext, Job* pJob, const bool isWorker, std::unique_lock<std::mutex>& lock);
+		};
+
+		// A renderer's share of a worker pool. Loops submitted through the same context are scheduled
+		// against each other in order, loops of different contexts by priority and quota. Without a pool the
+		// loops run on the calling thread
+		class WorkContext
+		{
+		private:
+			WorkerPool* mpPool;
+			WorkerPool::Context* mpContext;
+			WorkContextDesc mDesc;
+
+		public:
+			explicit WorkContext(WorkerPool* pPool = WorkerPool::Instance(), const WorkContextDesc& desc = WorkContextDesc());
+			~WorkContext();
+
+			// Applies to chunks handed out from now on
+			void SetDesc(const WorkContextDesc& desc);
+			const WorkContextDesc& GetDesc() const { return mDesc; }
+
+			// func(i) for every i in [begin, end), returns once all have finished. The calling thread always
+			// works on its own loop, the quota only limits the pool workers joining it. If func throws, the first
+			// exception is rethrown here after the other chunks are done
+			template<typename Func>
+			void ParallelFor(const int begin, const int end, const Func& func) const
+			{
+				if (begin >= end)
+					return;
+
+				if (!mpPool)
+				{
+					for (auto i = begin; i < end; i++)
+						func(i);
+					return;
+				}
+
+				// Chunks small enough for other contexts to get in between
+				const int count = end - begin;
+				const int grain = Math::Max(1, count / (4 * (mpPool->GetThreadCount() + 1)));
+
+				WorkerPool::Job job;
+				job.pInvoke = [](const void* pFunc, const int chunkBegin, const int chunkEnd)
+				{
+					const Func& loopFunc = *(const Func*)pFunc;
+					for (auto i = chunkBegin; i < chunkEnd; i++)
+						loopFunc(i);
+				};
+				job.pFunc = &func;
+				job.Next = begin;
+				job.End = end;
+				job.Grain = grain;
+				job.Pending = count;
+
+				mpPool->Run(mpContext, job);
+			}
+		};
+	}
+}
\ No newline at end of file
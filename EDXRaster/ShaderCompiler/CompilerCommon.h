@@ -10,6 +10,7 @@ namespace EDX
 		{
 			// Control
 			Invalid,
+			EndOfStream,
 
 			// Math
 			Plus,
@@ -66,6 +67,7 @@ namespace EDX
 			Default,
 			Continue,
 			Goto,
+			Discard,
 
 			// Unary
 			PlusPlus,
@@ -225,6 +227,7 @@ namespace EDX
 			Out,
 			InOut,
 			Static,
+			Uniform,
 
 			// Misc
 			LeftSquareBracket,
@@ -250,6 +253,19 @@ namespace EDX
 		{
 			string FileName;
 			int Line, Column;
+
+			SourceInfo()
+				: Line(0)
+				, Column(0)
+			{
+			}
+
+			SourceInfo(const string& fileName, const int line, const int column)
+				: FileName(fileName)
+				, Line(line)
+				, Column(column)
+			{
+			}
 		};
 
 		struct HLSLToken
@@ -258,6 +274,11 @@ namespace EDX
 			string Literal;
 			SourceInfo SrcInfo;
 
+			HLSLToken()
+				: Type(HLSLTokenType::Invalid)
+			{
+			}
+
 			HLSLToken(const HLSLTokenType type,
 				const string& str,
 				const SourceInfo& srcInfo) :
@@ -279,6 +300,14 @@ namespace EDX
 				SrcInfo(srcInfo)
 			{
 			}
+
+			// Formatted like compiler output so IDEs can jump to the location
+			string ToString() const
+			{
+				char location[64];
+				sprintf_s(location, 64, "(%i,%i): error: ", SrcInfo.Line, SrcInfo.Column);
+				return SrcInfo.FileName + location + ErrorMsg;
+			}
 		};
 	}
 }
\ No newline at end of file
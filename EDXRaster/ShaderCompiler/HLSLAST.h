@@ -0,0 +1,697 @@
+#pragma once
+
+#include "EDXPrerequisites.h"
+#include "CompilerCommon.h"
+#include "Core/Memory.h"
+
+namespace EDX
+{
+	namespace ShaderCompiler
+	{
+		enum class HLSLBaseType
+		{
+			Void,
+			Bool,
+			Int,
+			Uint,
+			Half,
+			Float,
+			Struct,
+			Texture2D,
+			TextureCube,
+			SamplerState,
+		};
+
+		struct HLSLStructDecl;
+
+		struct HLSLType
+		{
+			HLSLBaseType Base;
+			int Rows;		// Only matrices have more than one
+			int Columns;	// Vector size for vectors
+			bool Matrix;
+			int ArraySize;	// Zero when not an array
+			bool Const;
+			const HLSLStructDecl* pStruct;
+
+			HLSLType(const HLSLBaseType base = HLSLBaseType::Void, const int columns = 1, const int rows = 1, const bool matrix = false)
+				: Base(base)
+				, Rows(rows)
+				, Columns(columns)
+				, Matrix(matrix)
+				, ArraySize(0)
+				, Const(false)
+				, pStruct(nullptr)
+			{
+			}
+
+			static HLSLType Scalar(const HLSLBaseType base) { return HLSLType(base); }
+			static HLSLType Vector(const HLSLBaseType base, const int size) { return HLSLType(base, size); }
+			static HLSLType MatrixOf(const HLSLBaseType base, const int rows, const int columns) { return HLSLType(base, columns, rows, true); }
+
+			bool IsVoid() const { return Base == HLSLBaseType::Void; }
+			bool IsNumeric() const { return Base >= HLSLBaseType::Bool && Base <= HLSLBaseType::Float && ArraySize == 0; }
+			bool IsFloatingPoint() const { return Base == HLSLBaseType::Half || Base == HLSLBaseType::Float; }
+			bool IsInteger() const { return Base == HLSLBaseType::Int || Base == HLSLBaseType::Uint; }
+			bool IsScalar() const { return IsNumeric() && !Matrix && Columns == 1; }
+			bool IsVector() const { return IsNumeric() && !Matrix && Columns > 1; }
+			bool IsMatrix() const { return IsNumeric() && Matrix; }
+			bool IsStruct() const { return Base == HLSLBaseType::Struct && ArraySize == 0; }
+			bool IsTexture() const { return (Base == HLSLBaseType::Texture2D || Base == HLSLBaseType::TextureCube) && ArraySize == 0; }
+			bool IsSampler() const { return Base == HLSLBaseType::SamplerState && ArraySize == 0; }
+			bool IsArray() const { return ArraySize > 0; }
+			int ComponentCount() const { return Rows * Columns; }
+
+			// Same shape and base, ignoring constness
+			bool SameAs(const HLSLType& rhs) const
+			{
+				return Base == rhs.Base && Rows == rhs.Rows && Columns == rhs.Columns && Matrix == rhs.Matrix && ArraySize == rhs.ArraySize && pStruct == rhs.pStruct;
+			}
+
+			HLSLType ElementType() const
+			{
+				HLSLType ret = *this;
+				ret.ArraySize = 0;
+				return ret;
+			}
+
+			HLSLType WithBase(const HLSLBaseType base) const
+			{
+				HLSLType ret = *this;
+				ret.Base = base;
+				ret.Const = false;
+				return ret;
+			}
+
+			string ToString() const;
+		};
+
+		enum class HLSLNodeKind
+		{
+			// Expressions
+			LiteralExpression,
+			IdentifierExpression,
+			UnaryExpression,
+			BinaryExpression,
+			ConditionalExpression,
+			CastExpression,
+			ConstructorExpression,
+			MemberExpression,
+			IndexExpression,
+			CallExpression,
+			MethodCallExpression,
+
+			// Statements
+			BlockStatement,
+			DeclarationStatement,
+			ExpressionStatement,
+			IfStatement,
+			ForStatement,
+			WhileStatement,
+			DoWhileStatement,
+			ReturnStatement,
+			BreakStatement,
+			ContinueStatement,
+			DiscardStatement,
+
+			// Declarations
+			VariableDecl,
+			StructDecl,
+			CBufferDecl,
+			FunctionDecl,
+		};
+
+		struct HLSLNode
+		{
+			HLSLNodeKind Kind;
+			SourceInfo SrcInfo;
+
+			HLSLNode(const HLSLNodeKind kind)
+				: Kind(kind)
+			{
+			}
+			virtual ~HLSLNode() {}
+		};
+
+		// Expressions, Type is filled in by the type checker
+		struct HLSLExpression : public HLSLNode
+		{
+			HLSLType Type;
+
+			HLSLExpression(const HLSLNodeKind kind)
+				: HLSLNode(kind)
+			{
+			}
+		};
+
+		struct HLSLLiteralExpression : public HLSLExpression
+		{
+			HLSLBaseType LiteralType;
+			float FloatValue;
+			int IntValue; // Also holds uint and bool values
+
+			HLSLLiteralExpression()
+				: HLSLExpression(HLSLNodeKind::LiteralExpression)
+				, LiteralType(HLSLBaseType::Int)
+				, FloatValue(0.0f)
+				, IntValue(0)
+			{
+			}
+		};
+
+		struct HLSLVariableDecl;
+
+		struct HLSLIdentifierExpression : public HLSLExpression
+		{
+			string Name;
+			const HLSLVariableDecl* pDecl;
+
+			HLSLIdentifierExpression()
+				: HLSLExpression(HLSLNodeKind::IdentifierExpression)
+				, pDecl(nullptr)
+			{
+			}
+		};
+
+		enum class HLSLUnaryOp
+		{
+			Negate,
+			Plus,
+			LogicalNot,
+			BitNot,
+			PreIncrement,
+			PreDecrement,
+			PostIncrement,
+			PostDecrement,
+		};
+
+		struct HLSLUnaryExpression : public HLSLExpression
+		{
+			HLSLUnaryOp Op;
+			HLSLExpression* pOperand;
+
+			HLSLUnaryExpression()
+				: HLSLExpression(HLSLNodeKind::UnaryExpression)
+				, Op(HLSLUnaryOp::Negate)
+				, pOperand(nullptr)
+			{
+			}
+		};
+
+		enum class HLSLBinaryOp
+		{
+			Add,
+			Sub,
+			Mul,
+			Div,
+			Mod,
+			Less,
+			LessEqual,
+			Greater,
+			GreaterEqual,
+			Equal,
+			NotEqual,
+			LogicalAnd,
+			LogicalOr,
+			BitAnd,
+			BitOr,
+			BitXor,
+			ShiftLeft,
+			ShiftRight,
+
+			// Assignments, compound ones apply the operator above with the same offset from Assign
+			Assign,
+			AddAssign,
+			SubAssign,
+			MulAssign,
+			DivAssign,
+			ModAssign,
+			BitAndAssign,
+			BitOrAssign,
+			BitXorAssign,
+			ShiftLeftAssign,
+			ShiftRightAssign,
+		};
+
+		__forceinline bool IsAssignment(const HLSLBinaryOp op)
+		{
+			return op >= HLSLBinaryOp::Assign;
+		}
+
+		// The arithmetic operator a compound assignment applies
+		__forceinline HLSLBinaryOp CompoundAssignmentOp(const HLSLBinaryOp op)
+		{
+			switch (op)
+			{
+			case HLSLBinaryOp::AddAssign: return HLSLBinaryOp::Add;
+			case HLSLBinaryOp::SubAssign: return HLSLBinaryOp::Sub;
+			case HLSLBinaryOp::MulAssign: return HLSLBinaryOp::Mul;
+			case HLSLBinaryOp::DivAssign: return HLSLBinaryOp::Div;
+			case HLSLBinaryOp::ModAssign: return HLSLBinaryOp::Mod;
+			case HLSLBinaryOp::BitAndAssign: return HLSLBinaryOp::BitAnd;
+			case HLSLBinaryOp::BitOrAssign: return HLSLBinaryOp::BitOr;
+			case HLSLBinaryOp::BitXorAssign: return HLSLBinaryOp::BitXor;
+			case HLSLBinaryOp::ShiftLeftAssign: return HLSLBinaryOp::ShiftLeft;
+			case HLSLBinaryOp::ShiftRightAssign: return HLSLBinaryOp::ShiftRight;
+			default: return op;
+			}
+		}
+
+		struct HLSLBinaryExpression : public HLSLExpression
+		{
+			HLSLBinaryOp Op;
+			HLSLExpression* pLeft;
+			HLSLExpression* pRight;
+
+			// Type both operands are converted to before the operator applies, differs from the
+			// result type for comparisons and logical operators
+			HLSLType OperandType;
+
+			HLSLBinaryExpression()
+				: HLSLExpression(HLSLNodeKind::BinaryExpression)
+				, Op(HLSLBinaryOp::Add)
+				, pLeft(nullptr)
+				, pRight(nullptr)
+			{
+			}
+		};
+
+		struct HLSLConditionalExpression : public HLSLExpression
+		{
+			HLSLExpression* pCondition;
+			HLSLExpression* pTrue;
+			HLSLExpression* pFalse;
+
+			HLSLConditionalExpression()
+				: HLSLExpression(HLSLNodeKind::ConditionalExpression)
+				, pCondition(nullptr)
+				, pTrue(nullptr)
+				, pFalse(nullptr)
+			{
+			}
+		};
+
+		// Explicit casts, and the conversions the type checker inserts wherever types differ
+		struct HLSLCastExpression : public HLSLExpression
+		{
+			HLSLExpression* pOperand;
+			bool Implicit;
+
+			HLSLCastExpression()
+				: HLSLExpression(HLSLNodeKind::CastExpression)
+				, pOperand(nullptr)
+				, Implicit(false)
+			{
+			}
+		};
+
+		// float3(a, b) style construction from scalars and vectors
+		struct HLSLConstructorExpression : public HLSLExpression
+		{
+			Array<HLSLExpression*> Arguments;
+
+			HLSLConstructorExpression()
+				: HLSLExpression(HLSLNodeKind::ConstructorExpression)
+			{
+			}
+		};
+
+		// Struct field access or a swizzle
+		struct HLSLMemberExpression : public HLSLExpression
+		{
+			HLSLExpression* pObject;
+			string Member;
+			int FieldIndex;		// -1 for swizzles
+			int Swizzle[4];
+			int SwizzleCount;
+
+			HLSLMemberExpression()
+				: HLSLExpression(HLSLNodeKind::MemberExpression)
+				, pObject(nullptr)
+				, FieldIndex(-1)
+				, SwizzleCount(0)
+			{
+				Swizzle[0] = Swizzle[1] = Swizzle[2] = Swizzle[3] = 0;
+			}
+		};
+
+		struct HLSLIndexExpression : public HLSLExpression
+		{
+			HLSLExpression* pObject;
+			HLSLExpression* pIndex;
+
+			HLSLIndexExpression()
+				: HLSLExpression(HLSLNodeKind::IndexExpression)
+				, pObject(nullptr)
+				, pIndex(nullptr)
+			{
+			}
+		};
+
+		enum class HLSLIntrinsic
+		{
+			None,
+
+			// Component wise, one argument
+			Abs,
+			Acos,
+			Asin,
+			Atan,
+			Ceil,
+			Cos,
+			Ddx,
+			Ddy,
+			Exp,
+			Exp2,
+			Floor,
+			Frac,
+			Log,
+			Log2,
+			Rcp,
+			Round,
+			Rsqrt,
+			Saturate,
+			Sin,
+			Sqrt,
+			Tan,
+			Trunc,
+
+			// Component wise, several arguments
+			Atan2,
+			Clamp,
+			Fmod,
+			Lerp,
+			Mad,
+			Max,
+			Min,
+			Pow,
+			Smoothstep,
+			Step,
+
+			// Vector
+			All,
+			Any,
+			Cross,
+			Distance,
+			Dot,
+			Length,
+			Mul,
+			Normalize,
+			Reflect,
+
+			// Texture methods
+			Sample,
+			SampleBias,
+			SampleGrad,
+			SampleLevel,
+		};
+
+		struct HLSLFunctionDecl;
+
+		struct HLSLCallExpression : public HLSLExpression
+		{
+			string Name;
+			Array<HLSLExpression*> Arguments;
+			HLSLIntrinsic Intrinsic;
+			const HLSLFunctionDecl* pFunction;
+
+			HLSLCallExpression()
+				: HLSLExpression(HLSLNodeKind::CallExpression)
+				, Intrinsic(HLSLIntrinsic::None)
+				, pFunction(nullptr)
+			{
+			}
+		};
+
+		// tex.Sample(sampler, uv) style calls on textures
+		struct HLSLMethodCallExpression : public HLSLExpression
+		{
+			HLSLExpression* pObject;
+			string Name;
+			Array<HLSLExpression*> Arguments;
+			HLSLIntrinsic Intrinsic;
+
+			HLSLMethodCallExpression()
+				: HLSLExpression(HLSLNodeKind::MethodCallExpression)
+				, pObject(nullptr)
+				, Intrinsic(HLSLIntrinsic::None)
+			{
+			}
+		};
+
+		// Statements
+		struct HLSLStatement : public HLSLNode
+		{
+			HLSLStatement(const HLSLNodeKind kind)
+				: HLSLNode(kind)
+			{
+			}
+		};
+
+		struct HLSLBlockStatement : public HLSLStatement
+		{
+			Array<HLSLStatement*> Statements;
+
+			HLSLBlockStatement()
+				: HLSLStatement(HLSLNodeKind::BlockStatement)
+			{
+			}
+		};
+
+		struct HLSLDeclarationStatement : public HLSLStatement
+		{
+			Array<HLSLVariableDecl*> Variables;
+
+			HLSLDeclarationStatement()
+				: HLSLStatement(HLSLNodeKind::DeclarationStatement)
+			{
+			}
+		};
+
+		struct HLSLExpressionStatement : public HLSLStatement
+		{
+			HLSLExpression* pExpression;
+
+			HLSLExpressionStatement()
+				: HLSLStatement(HLSLNodeKind::ExpressionStatement)
+				, pExpression(nullptr)
+			{
+			}
+		};
+
+		struct HLSLIfStatement : public HLSLStatement
+		{
+			HLSLExpression* pCondition;
+			HLSLStatement* pThen;
+			HLSLStatement* pElse;
+
+			HLSLIfStatement()
+				: HLSLStatement(HLSLNodeKind::IfStatement)
+				, pCondition(nullptr)
+				, pThen(nullptr)
+				, pElse(nullptr)
+			{
+			}
+		};
+
+		struct HLSLForStatement : public HLSLStatement
+		{
+			HLSLStatement* pInit;			// Declaration or expression, may be null
+			HLSLExpression* pCondition;	// May be null
+			HLSLExpression* pIncrement;	// May be null
+			HLSLStatement* pBody;
+
+			HLSLForStatement()
+				: HLSLStatement(HLSLNodeKind::ForStatement)
+				, pInit(nullptr)
+				, pCondition(nullptr)
+				, pIncrement(nullptr)
+				, pBody(nullptr)
+			{
+			}
+		};
+
+		// Also used for do-while loops
+		struct HLSLWhileStatement : public HLSLStatement
+		{
+			HLSLExpression* pCondition;
+			HLSLStatement* pBody;
+
+			HLSLWhileStatement(const HLSLNodeKind kind = HLSLNodeKind::WhileStatement)
+				: HLSLStatement(kind)
+				, pCondition(nullptr)
+				, pBody(nullptr)
+			{
+			}
+		};
+
+		struct HLSLReturnStatement : public HLSLStatement
+		{
+			HLSLExpression* pValue;
+
+			HLSLReturnStatement()
+				: HLSLStatement(HLSLNodeKind::ReturnStatement)
+				, pValue(nullptr)
+			{
+			}
+		};
+
+		struct HLSLJumpStatement : public HLSLStatement
+		{
+			HLSLJumpStatement(const HLSLNodeKind kind = HLSLNodeKind::BreakStatement)
+				: HLSLStatement(kind)
+			{
+			}
+		};
+
+		// Declarations
+		enum class HLSLStorage
+		{
+			Local,
+			Parameter,
+			Static,		// Static globals
+			Uniform,	// Globals outside of any cbuffer
+			CBuffer,	// cbuffer members
+			Resource,	// Textures and samplers
+		};
+
+		enum class HLSLParameterModifier
+		{
+			In,
+			Out,
+			InOut,
+		};
+
+		struct HLSLCBufferDecl;
+
+		struct HLSLVariableDecl : public HLSLNode
+		{
+			string Name;
+			HLSLType Type;
+			string Semantic;
+			HLSLExpression* pInit;
+			HLSLStorage Storage;
+			HLSLParameterModifier Modifier;
+			bool NoInterpolation;
+			const HLSLCBufferDecl* pCBuffer;
+
+			HLSLVariableDecl()
+				: HLSLNode(HLSLNodeKind::VariableDecl)
+				, pInit(nullptr)
+				, Storage(HLSLStorage::Local)
+				, Modifier(HLSLParameterModifier::In)
+				, NoInterpolation(false)
+				, pCBuffer(nullptr)
+			{
+			}
+		};
+
+		struct HLSLStructDecl : public HLSLNode
+		{
+			string Name;
+			Array<HLSLVariableDecl*> Fields;
+
+			HLSLStructDecl()
+				: HLSLNode(HLSLNodeKind::StructDecl)
+			{
+			}
+
+			int FindField(const string& name) const
+			{
+				for (auto i = 0; i < Fields.Size(); i++)
+				{
+					if (Fields[i]->Name == name)
+						return i;
+				}
+				return -1;
+			}
+		};
+
+		struct HLSLCBufferDecl : public HLSLNode
+		{
+			string Name;
+			string Register;
+			Array<HLSLVariableDecl*> Members;
+
+			HLSLCBufferDecl()
+				: HLSLNode(HLSLNodeKind::CBufferDecl)
+			{
+			}
+		};
+
+		struct HLSLFunctionDecl : public HLSLNode
+		{
+			string Name;
+			HLSLType ReturnType;
+			string Semantic;
+			Array<HLSLVariableDecl*> Parameters;
+			HLSLBlockStatement* pBody;
+
+			HLSLFunctionDecl()
+				: HLSLNode(HLSLNodeKind::FunctionDecl)
+				, pBody(nullptr)
+			{
+			}
+		};
+
+		// Owns every node of a translation unit, nodes refer to each other with plain pointers
+		class HLSLTree
+		{
+		private:
+			Array<HLSLNode*> mNodes;
+
+		public:
+			// Structs, cbuffers, global variables and functions in source order
+			Array<HLSLNode*> Declarations;
+
+		public:
+			HLSLTree() {}
+			~HLSLTree()
+			{
+				for (auto i = 0; i < mNodes.Size(); i++)
+					Memory::SafeDelete(mNodes[i]);
+			}
+
+			template<typename T>
+			T* Create(const SourceInfo& srcInfo)
+			{
+				T* pNode = new T;
+				pNode->SrcInfo = srcInfo;
+				mNodes.Add(pNode);
+				return pNode;
+			}
+
+			const HLSLFunctionDecl* FindFunction(const string& name) const
+			{
+				for (auto i = 0; i < Declarations.Size(); i++)
+				{
+					if (Declarations[i]->Kind == HLSLNodeKind::FunctionDecl && static_cast<const HLSLFunctionDecl*>(Declarations[i])->Name == name)
+						return static_cast<const HLSLFunctionDecl*>(Declarations[i]);
+				}
+				return nullptr;
+			}
+
+		private:
+			HLSLTree(const HLSLTree&);
+			HLSLTree& operator = (const HLSLTree&);
+		};
+
+		inline string HLSLType::ToString() const
+		{
+			static const char* baseNames[] = { "void", "bool", "int", "uint", "half", "float", "struct", "Texture2D", "TextureCube", "SamplerState" };
+
+			string ret = Base == HLSLBaseType::Struct && pStruct ? pStruct->Name : baseNames[int(Base)];
+			if (IsNumeric() || (Base >= HLSLBaseType::Bool && Base <= HLSLBaseType::Float))
+			{
+				if (Matrix)
+					ret = ret + char('0' + Rows) + 'x' + char('0' + Columns);
+				else if (Columns > 1)
+					ret += char('0' + Columns);
+			}
+			if (ArraySize > 0)
+				ret += "[" + std::to_string(ArraySize) + "]";
+
+			return ret;
+		}
+	}
+}
\ No newline at end of file
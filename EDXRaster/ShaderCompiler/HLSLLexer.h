@@ -3,6 +3,8 @@
 #include "EDXPrerequisites.h"
 #include "CompilerCommon.h"
 
+#include <unordered_map>
+
 namespace EDX
 {
 	namespace ShaderCompiler
@@ -16,32 +18,364 @@ namespace EDX
 			const char* mpEnd;
 			const char* mpCurrentLineStart;
 			int mLine;
+			Array<CompileError>* mpErrorList;
 
 		public:
-			void Init(const char* fileName)
+			HLSLLexer()
+				: mpCurrent(nullptr)
+				, mpEnd(nullptr)
+				, mpCurrentLineStart(nullptr)
+				, mLine(1)
+				, mpErrorList(nullptr)
+			{
+			}
+
+			void Init(const char* fileName, const string& str)
 			{
 				mFileName = fileName;
-				// Init mString and other pointers here
+				mString = str;
+				mpCurrent = mString.c_str();
+				mpEnd = mpCurrent + mString.length();
+				mpCurrentLineStart = mpCurrent;
+				mLine = 1;
 			}
 
+			// The returned tokens always end with an EndOfStream token
 			Array<HLSLToken> Tokenize(const char* fileName,
 				const string& str,
 				Array<CompileError>& ErrorList)
 			{
+				Init(fileName, str);
+				mpErrorList = &ErrorList;
+
 				Array<HLSLToken> ret;
 
 				while (HasCharsAvailable())
 				{
 					SkipWhitespaceAndEmptyLines();
+					if (!HasCharsAvailable())
+						break;
 
-
+					HLSLToken token = NextToken();
+					if (token.Type != HLSLTokenType::Invalid)
+						ret.Add(token);
 				}
+
+				ret.Add(HLSLToken(HLSLTokenType::EndOfStream, "", CurrentSourceInfo()));
+				mpErrorList = nullptr;
+
+				return ret;
 			}
 
 		private:
 			HLSLToken NextToken()
 			{
-				
+				const SourceInfo srcInfo = CurrentSourceInfo();
+				const char* pStart = mpCurrent;
+				auto Char = Peek();
+
+				if (IsChar(Char) || Char == '_')
+				{
+					while (HasCharsAvailable() && (IsCharOrDigit(Peek()) || Peek() == '_'))
+						++mpCurrent;
+
+					const string word = string(pStart, mpCurrent);
+					return HLSLToken(FindKeyword(word), word, srcInfo);
+				}
+
+				if (IsDigit(Char) || (Char == '.' && IsDigit(Peek(1))))
+					return NumberToken(srcInfo);
+
+				if (Char == '"')
+				{
+					++mpCurrent;
+					while (HasCharsAvailable() && Peek() != '"' && !IsEOL(Peek()))
+						++mpCurrent;
+
+					if (Peek() != '"')
+					{
+						mpErrorList->Add(CompileError("unterminated string literal", srcInfo));
+						return HLSLToken(HLSLTokenType::Invalid, "", srcInfo);
+					}
+
+					++mpCurrent;
+					return HLSLToken(HLSLTokenType::StringConstant, string(pStart + 1, mpCurrent - 1), srcInfo);
+				}
+
+				if (Char == '#')
+				{
+					mpErrorList->Add(CompileError("preprocessor directives are not supported", srcInfo));
+					SkipToNextLine();
+					return HLSLToken(HLSLTokenType::Invalid, "", srcInfo);
+				}
+
+				// Operators and punctuation, longest match first
+				struct Operator
+				{
+					const char* Text;
+					HLSLTokenType Type;
+				};
+				static const Operator operators[] =
+				{
+					{ "<<=", HLSLTokenType::LowerLowerEqual },
+					{ ">>=", HLSLTokenType::GreaterGreaterEqual },
+					{ "++", HLSLTokenType::PlusPlus },
+					{ "--", HLSLTokenType::MinusMinus },
+					{ "+=", HLSLTokenType::PlusEqual },
+					{ "-=", HLSLTokenType::MinusEqual },
+					{ "*=", HLSLTokenType::TimesEqual },
+					{ "/=", HLSLTokenType::DivEqual },
+					{ "%=", HLSLTokenType::ModEqual },
+					{ "==", HLSLTokenType::EqualEqual },
+					{ "!=", HLSLTokenType::NotEqual },
+					{ "<=", HLSLTokenType::LowerEqual },
+					{ ">=", HLSLTokenType::GreaterEqual },
+					{ "&&", HLSLTokenType::AndAnd },
+					{ "||", HLSLTokenType::OrOr },
+					{ "<<", HLSLTokenType::LowerLower },
+					{ ">>", HLSLTokenType::GreaterGreater },
+					{ "&=", HLSLTokenType::AndEqual },
+					{ "|=", HLSLTokenType::OrEqual },
+					{ "^=", HLSLTokenType::XorEqual },
+					{ "+", HLSLTokenType::Plus },
+					{ "-", HLSLTokenType::Minus },
+					{ "*", HLSLTokenType::Times },
+					{ "/", HLSLTokenType::Div },
+					{ "%", HLSLTokenType::Mod },
+					{ "(", HLSLTokenType::LeftParenthesis },
+					{ ")", HLSLTokenType::RightParenthesis },
+					{ "<", HLSLTokenType::Lower },
+					{ ">", HLSLTokenType::Greater },
+					{ "&", HLSLTokenType::And },
+					{ "|", HLSLTokenType::Or },
+					{ "^", HLSLTokenType::Xor },
+					{ "!", HLSLTokenType::Not },
+					{ "~", HLSLTokenType::Neg },
+					{ "=", HLSLTokenType::Equal },
+					{ "{", HLSLTokenType::LeftBrace },
+					{ "}", HLSLTokenType::RightBrace },
+					{ ";", HLSLTokenType::Semicolon },
+					{ "[", HLSLTokenType::LeftSquareBracket },
+					{ "]", HLSLTokenType::RightSquareBracket },
+					{ "?", HLSLTokenType::Question },
+					{ ":", HLSLTokenType::Colon },
+					{ ",", HLSLTokenType::Comma },
+					{ ".", HLSLTokenType::Dot },
+				};
+
+				for (const auto& op : operators)
+				{
+					const int length = int(strlen(op.Text));
+					if (mpCurrent + length <= mpEnd && strncmp(mpCurrent, op.Text, length) == 0)
+					{
+						mpCurrent += length;
+						return HLSLToken(op.Type, op.Text, srcInfo);
+					}
+				}
+
+				++mpCurrent;
+				mpErrorList->Add(CompileError(string("unexpected character '") + Char + "'", srcInfo));
+				return HLSLToken(HLSLTokenType::Invalid, "", srcInfo);
+			}
+
+			HLSLToken NumberToken(const SourceInfo& srcInfo)
+			{
+				const char* pStart = mpCurrent;
+
+				if (Peek() == '0' && (Peek(1) == 'x' || Peek(1) == 'X'))
+				{
+					mpCurrent += 2;
+					while (HasCharsAvailable() && IsHexDigit(Peek()))
+						++mpCurrent;
+					if (mpCurrent == pStart + 2)
+						mpErrorList->Add(CompileError("hexadecimal literal has no digits", srcInfo));
+
+					const string literal = string(pStart, mpCurrent);
+					SkipIntegerSuffix();
+					return HLSLToken(HLSLTokenType::UnsignedIntegerConstant, literal, srcInfo);
+				}
+
+				bool isFloat = false;
+				while (HasCharsAvailable() && IsDigit(Peek()))
+					++mpCurrent;
+				if (Peek() == '.')
+				{
+					isFloat = true;
+					++mpCurrent;
+					while (HasCharsAvailable() && IsDigit(Peek()))
+						++mpCurrent;
+				}
+				if (Peek() == 'e' || Peek() == 'E')
+				{
+					const char* pExponent = mpCurrent;
+					++mpCurrent;
+					if (Peek() == '+' || Peek() == '-')
+						++mpCurrent;
+
+					if (IsDigit(Peek()))
+					{
+						isFloat = true;
+						while (HasCharsAvailable() && IsDigit(Peek()))
+							++mpCurrent;
+					}
+					else
+						mpCurrent = pExponent;
+				}
+
+				const string literal = string(pStart, mpCurrent);
+				if (Peek() == 'f' || Peek() == 'F' || Peek() == 'h' || Peek() == 'H')
+				{
+					++mpCurrent;
+					isFloat = true;
+				}
+				else if (isFloat && (Peek() == 'l' || Peek() == 'L'))
+					++mpCurrent;
+				else if (!isFloat)
+				{
+					// Unsigned suffixes stay in the literal so the parser can type the constant
+					if (Peek() == 'u' || Peek() == 'U')
+					{
+						++mpCurrent;
+						SkipIntegerSuffix();
+						return HLSLToken(HLSLTokenType::UnsignedIntegerConstant, literal + "u", srcInfo);
+					}
+					SkipIntegerSuffix();
+				}
+
+				if (IsCharOrDigit(Peek()) || Peek() == '_')
+				{
+					mpErrorList->Add(CompileError("invalid suffix on numeric literal '" + literal + "'", CurrentSourceInfo()));
+					while (HasCharsAvailable() && (IsCharOrDigit(Peek()) || Peek() == '_'))
+						++mpCurrent;
+				}
+
+				return HLSLToken(isFloat ? HLSLTokenType::FloatConstant : HLSLTokenType::UnsignedIntegerConstant, literal, srcInfo);
+			}
+
+			void SkipIntegerSuffix()
+			{
+				while (Peek() == 'u' || Peek() == 'U' || Peek() == 'l' || Peek() == 'L')
+					++mpCurrent;
+			}
+
+			static HLSLTokenType FindKeyword(const string& word)
+			{
+				struct KeywordTable
+				{
+					std::unordered_map<string, HLSLTokenType> Keywords;
+
+					KeywordTable()
+					{
+						const struct
+						{
+							const char* Name;
+							HLSLTokenType Type;
+						} fixedKeywords[] =
+						{
+							{ "if", HLSLTokenType::If },
+							{ "else", HLSLTokenType::Else },
+							{ "for", HLSLTokenType::For },
+							{ "while", HLSLTokenType::While },
+							{ "do", HLSLTokenType::Do },
+							{ "return", HLSLTokenType::Return },
+							{ "switch", HLSLTokenType::Switch },
+							{ "case", HLSLTokenType::Case },
+							{ "break", HLSLTokenType::Break },
+							{ "default", HLSLTokenType::Default },
+							{ "continue", HLSLTokenType::Continue },
+							{ "goto", HLSLTokenType::Goto },
+							{ "discard", HLSLTokenType::Discard },
+							{ "void", HLSLTokenType::Void },
+							{ "const", HLSLTokenType::Const },
+							{ "dword", HLSLTokenType::Uint },
+							{ "Texture", HLSLTokenType::Texture },
+							{ "Texture1D", HLSLTokenType::Texture1D },
+							{ "Texture1DArray", HLSLTokenType::Texture1DArray },
+							{ "Texture2D", HLSLTokenType::Texture2D },
+							{ "Texture2DArray", HLSLTokenType::Texture2DArray },
+							{ "Texture2DMS", HLSLTokenType::Texture2DMS },
+							{ "Texture2DMSArray", HLSLTokenType::Texture2DMSArray },
+							{ "Texture3D", HLSLTokenType::Texture3D },
+							{ "TextureCube", HLSLTokenType::TextureCube },
+							{ "TextureCubeArray", HLSLTokenType::TextureCubeArray },
+							{ "sampler", HLSLTokenType::Sampler },
+							{ "sampler1D", HLSLTokenType::Sampler1D },
+							{ "sampler2D", HLSLTokenType::Sampler2D },
+							{ "sampler3D", HLSLTokenType::Sampler3D },
+							{ "samplerCUBE", HLSLTokenType::SamplerCube },
+							{ "SamplerState", HLSLTokenType::SamplerState },
+							{ "SamplerComparisonState", HLSLTokenType::SamplerComparisonState },
+							{ "Buffer", HLSLTokenType::Buffer },
+							{ "AppendStructuredBuffer", HLSLTokenType::AppendStructuredBuffer },
+							{ "ByteAddressBuffer", HLSLTokenType::ByteAddressBuffer },
+							{ "ConsumeStructuredBuffer", HLSLTokenType::ConsumeStructuredBuffer },
+							{ "RWBuffer", HLSLTokenType::RWBuffer },
+							{ "RWByteAddressBuffer", HLSLTokenType::RWByteAddressBuffer },
+							{ "RWStructuredBuffer", HLSLTokenType::RWStructuredBuffer },
+							{ "RWTexture1D", HLSLTokenType::RWTexture1D },
+							{ "RWTexture1DArray", HLSLTokenType::RWTexture1DArray },
+							{ "RWTexture2D", HLSLTokenType::RWTexture2D },
+							{ "RWTexture2DArray", HLSLTokenType::RWTexture2DArray },
+							{ "RWTexture3D", HLSLTokenType::RWTexture3D },
+							{ "StructuredBuffer", HLSLTokenType::StructuredBuffer },
+							{ "InputPatch", HLSLTokenType::InputPatch },
+							{ "OutputPatch", HLSLTokenType::OutputPatch },
+							{ "in", HLSLTokenType::In },
+							{ "out", HLSLTokenType::Out },
+							{ "inout", HLSLTokenType::InOut },
+							{ "static", HLSLTokenType::Static },
+							{ "uniform", HLSLTokenType::Uniform },
+							{ "struct", HLSLTokenType::Struct },
+							{ "cbuffer", HLSLTokenType::CBuffer },
+							{ "groupshared", HLSLTokenType::GroupShared },
+							{ "nointerpolation", HLSLTokenType::NoInterpolation },
+							{ "row_major", HLSLTokenType::RowMajor },
+							{ "true", HLSLTokenType::BoolConstant },
+							{ "false", HLSLTokenType::BoolConstant },
+						};
+						for (const auto& keyword : fixedKeywords)
+							Keywords[keyword.Name] = keyword.Type;
+
+						// Numeric types are laid out as the scalar, vectors of 1 to 4, then matrices with the row count varying fastest
+						const struct
+						{
+							const char* Name;
+							HLSLTokenType Scalar;
+						} numericTypes[] =
+						{
+							{ "bool", HLSLTokenType::Bool },
+							{ "int", HLSLTokenType::Int },
+							{ "uint", HLSLTokenType::Uint },
+							{ "half", HLSLTokenType::Half },
+							{ "float", HLSLTokenType::Float },
+						};
+						for (const auto& numericType : numericTypes)
+						{
+							const string name = numericType.Name;
+							const int scalar = int(numericType.Scalar);
+
+							Keywords[name] = numericType.Scalar;
+							for (auto n = 1; n <= 4; n++)
+								Keywords[name + char('0' + n)] = HLSLTokenType(scalar + n);
+
+							for (auto columns = 1; columns <= 4; columns++)
+							{
+								for (auto rows = 1; rows <= 4; rows++)
+									Keywords[name + char('0' + rows) + 'x' + char('0' + columns)] = HLSLTokenType(scalar + 5 + (columns - 1) * 4 + rows - 1);
+							}
+						}
+					}
+				};
+
+				static const KeywordTable table;
+
+				auto it = table.Keywords.find(word);
+				return it != table.Keywords.end() ? it->second : HLSLTokenType::Identifier;
+			}
+
+			SourceInfo CurrentSourceInfo() const
+			{
+				return SourceInfo(mFileName, mLine, int(mpCurrent - mpCurrentLineStart) + 1);
 			}
 
 			// Utils
@@ -165,6 +499,7 @@ namespace EDX
 						else if (Char == '/' && NextChar == '*')
 						{
 							// C Style comment, eat everything up to * /
+							const SourceInfo commentStart = CurrentSourceInfo();
 							mpCurrent += 2;
 							bool bClosedComment = false;
 							while (HasCharsAvailable())
@@ -189,8 +524,9 @@ namespace EDX
 
 								++mpCurrent;
 							}
-							//@todo-rco: Error if no closing * / found and we got to EOL
-							//check(bClosedComment);
+
+							if (!bClosedComment && mpErrorList)
+								mpErrorList->Add(CompileError("unterminated comment", commentStart));
 						}
 						else
 						{
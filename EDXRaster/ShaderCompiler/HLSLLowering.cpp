@@ -0,0 +1,1744 @@
+#include "HLSLLowering.h"
+
+#include <string.h>
+#include <ctype.h>
+#include <functional>
+
+namespace EDX
+{
+	namespace ShaderCompiler
+	{
+		namespace
+		{
+			bool ContainsReturn(const HLSLStatement* pStatement)
+			{
+				if (!pStatement)
+					return false;
+
+				switch (pStatement->Kind)
+				{
+				case HLSLNodeKind::ReturnStatement:
+					return true;
+
+				case HLSLNodeKind::BlockStatement:
+				{
+					const HLSLBlockStatement* pBlock = static_cast<const HLSLBlockStatement*>(pStatement);
+					for (auto i = 0; i < pBlock->Statements.Size(); i++)
+					{
+						if (ContainsReturn(pBlock->Statements[i]))
+							return true;
+					}
+					return false;
+				}
+
+				case HLSLNodeKind::IfStatement:
+				{
+					const HLSLIfStatement* pIf = static_cast<const HLSLIfStatement*>(pStatement);
+					return ContainsReturn(pIf->pThen) || ContainsReturn(pIf->pElse);
+				}
+
+				case HLSLNodeKind::ForStatement:
+					return ContainsReturn(static_cast<const HLSLForStatement*>(pStatement)->pBody);
+
+				case HLSLNodeKind::WhileStatement:
+				case HLSLNodeKind::DoWhileStatement:
+					return ContainsReturn(static_cast<const HLSLWhileStatement*>(pStatement)->pBody);
+
+				default:
+					return false;
+				}
+			}
+
+			// Variable an assignable expression ends up writing to
+			const HLSLVariableDecl* RootDecl(const HLSLExpression* pExpr)
+			{
+				for (;;)
+				{
+					switch (pExpr->Kind)
+					{
+					case HLSLNodeKind::IdentifierExpression:
+						return static_cast<const HLSLIdentifierExpression*>(pExpr)->pDecl;
+					case HLSLNodeKind::MemberExpression:
+						pExpr = static_cast<const HLSLMemberExpression*>(pExpr)->pObject;
+						break;
+					case HLSLNodeKind::IndexExpression:
+						pExpr = static_cast<const HLSLIndexExpression*>(pExpr)->pObject;
+						break;
+					default:
+						return nullptr;
+					}
+				}
+			}
+
+			float AsFloat(const uint bits)
+			{
+				float value;
+				memcpy(&value, &bits, sizeof(float));
+				return value;
+			}
+		}
+
+		bool HLSLLowering::Lower(const HLSLTree& tree, const string& entryPoint, const ShaderStage stage, IRProgram& program, Array<CompileError>& errors)
+		{
+			const int errorCount = errors.Size();
+
+			mpTree = &tree;
+			mpProgram = &program;
+			mpErrors = &errors;
+			mStage = stage;
+			mCode.Clear();
+			mRegisterClasses.Clear();
+			mConstantValues.Clear();
+			mVariableRegs.Clear();
+			mConstants.clear();
+			mVariables.clear();
+			mTextureSlots.clear();
+			mFrames.Clear();
+			mPendingSkips.Clear();
+			mControlDepth = 0;
+
+			program = IRProgram();
+			program.Stage = stage;
+
+			const HLSLFunctionDecl* pEntry = tree.FindFunction(entryPoint);
+			if (!pEntry)
+			{
+				Error("entry point '" + entryPoint + "' not found", SourceInfo());
+				return false;
+			}
+
+			Frame frame;
+			frame.pFunction = pEntry;
+			frame.EarlyReturn = HasEarlyReturn(pEntry);
+			mFrames.Add(frame);
+
+			// Static globals are initialized before the entry point runs, without an initializer they are zero
+			for (auto i = 0; i < tree.Declarations.Size(); i++)
+			{
+				if (tree.Declarations[i]->Kind != HLSLNodeKind::VariableDecl)
+					continue;
+
+				const HLSLVariableDecl* pVariable = static_cast<const HLSLVariableDecl*>(tree.Declarations[i]);
+				if (pVariable->Storage != HLSLStorage::Static)
+					continue;
+
+				IRValue init = pVariable->pInit ? LowerExpression(pVariable->pInit) : Undefined(pVariable->Type);
+
+				bool constantInit = true;
+				for (auto j = 0; j < init.Regs.Size(); j++)
+					constantInit = constantInit && IsConstant(init.Regs[j]);
+
+				if (pVariable->Type.Const && constantInit)
+				{
+					mVariables[pVariable] = init.Regs;
+					continue;
+				}
+
+				mVariables[pVariable] = InitVariable(init);
+			}
+
+			for (auto i = 0; i < pEntry->Parameters.Size(); i++)
+			{
+				const HLSLVariableDecl* pParam = pEntry->Parameters[i];
+				if (pParam->Type.IsTexture() || pParam->Type.IsSampler())
+				{
+					Error("entry point parameter '" + pParam->Name + "' cannot be a texture or sampler, declare it as a global", pParam->SrcInfo);
+					continue;
+				}
+
+				Array<int> regs = NewVariable(ComponentCount(pParam->Type));
+				mVariables[pParam] = regs;
+				if (regs.Size() == 0)
+					continue;
+
+				if (pParam->Modifier != HLSLParameterModifier::Out)
+					BindEntryValues(pParam->Type, pParam->Semantic, regs[0], pParam->SrcInfo, program.Inputs);
+				if (pParam->Modifier != HLSLParameterModifier::In)
+					BindEntryValues(pParam->Type, pParam->Semantic, regs[0], pParam->SrcInfo, program.Outputs);
+			}
+
+			if (!pEntry->ReturnType.IsVoid())
+			{
+				mFrames[0].ReturnRegs = NewVariable(ComponentCount(pEntry->ReturnType));
+				BindEntryValues(pEntry->ReturnType, pEntry->Semantic, mFrames[0].ReturnRegs[0], pEntry->SrcInfo, program.Outputs);
+			}
+
+			if (mFrames[0].EarlyReturn)
+			{
+				EnterControl(pEntry->SrcInfo);
+				Emit(IROpcode::Begin);
+				OpenConstruct();
+			}
+
+			LowerStatement(pEntry->pBody);
+
+			if (mFrames[0].EarlyReturn)
+			{
+				CloseConstruct(mCode.Size());
+				Emit(IROpcode::End);
+				LeaveControl();
+			}
+
+			Finalize();
+
+			mpTree = nullptr;
+			mpProgram = nullptr;
+			mpErrors = nullptr;
+
+			return errors.Size() == errorCount;
+		}
+
+		void HLSLLowering::BindEntryValues(const HLSLType& type, const string& semantic, const int firstReg, const SourceInfo& srcInfo, Array<IRBinding>& bindings)
+		{
+			if (type.IsStruct())
+			{
+				int reg = firstReg;
+				for (auto i = 0; i < type.pStruct->Fields.Size(); i++)
+				{
+					const HLSLVariableDecl* pField = type.pStruct->Fields[i];
+					BindEntryValues(pField->Type, pField->Semantic, reg, pField->SrcInfo, bindings);
+					reg += ComponentCount(pField->Type);
+				}
+				return;
+			}
+
+			if (!type.IsNumeric())
+			{
+				Error("entry point values must be numeric or structs, found '" + type.ToString() + "'", srcInfo);
+				return;
+			}
+
+			if (semantic.empty())
+			{
+				Error("entry point value of type '" + type.ToString() + "' has no semantic", srcInfo);
+				return;
+			}
+
+			const string name = NormalizeSemantic(semantic);
+			for (auto i = 0; i < bindings.Size(); i++)
+			{
+				if (bindings[i].Name == name)
+				{
+					Error("semantic '" + semantic + "' is used more than once", srcInfo);
+					return;
+				}
+			}
+
+			bindings.Add(IRBinding(name, type, firstReg, ComponentCount(type)));
+		}
+
+		void HLSLLowering::Finalize()
+		{
+			// Constants first, then uniforms, then everything written per lane. Order within each class is
+			// kept so that consecutive registers stay consecutive
+			Array<int> remap;
+			remap.Resize(mRegisterClasses.Size());
+
+			int next = 0;
+			const RegisterClass order[] = { RegisterClass::Constant, RegisterClass::Uniform, RegisterClass::Temp };
+			for (const auto regClass : order)
+			{
+				if (regClass == RegisterClass::Temp)
+					mpProgram->SharedRegisterCount = next;
+
+				for (auto i = 0; i < mRegisterClasses.Size(); i++)
+				{
+					if (mRegisterClasses[i] == regClass)
+						remap[i] = next++;
+				}
+			}
+			mpProgram->RegisterCount = next;
+
+			mpProgram->SharedValues.Resize(mpProgram->SharedRegisterCount);
+			for (auto i = 0; i < mRegisterClasses.Size(); i++)
+			{
+				if (mRegisterClasses[i] == RegisterClass::Constant)
+					mpProgram->SharedValues[remap[i]] = mConstantValues[i];
+				else if (mRegisterClasses[i] == RegisterClass::Uniform)
+					mpProgram->SharedValues[remap[i]] = 0;
+			}
+
+			mpProgram->Instructions.Resize(mCode.Size());
+			for (auto i = 0; i < mCode.Size(); i++)
+			{
+				IRInstruction inst = mCode[i];
+				if (inst.Dst >= 0)
+					inst.Dst = remap[inst.Dst];
+				for (auto j = 0; j < 3; j++)
+				{
+					if (inst.Src[j] >= 0)
+						inst.Src[j] = remap[inst.Src[j]];
+				}
+				mpProgram->Instructions[i] = inst;
+			}
+
+			Array<IRBinding>* bindings[] = { &mpProgram->Uniforms, &mpProgram->Inputs, &mpProgram->Outputs };
+			for (auto pBindings : bindings)
+			{
+				for (auto i = 0; i < pBindings->Size(); i++)
+					(*pBindings)[i].Register = remap[(*pBindings)[i].Register];
+			}
+		}
+
+		void HLSLLowering::LowerStatement(const HLSLStatement* pStatement)
+		{
+			if (!pStatement)
+				return;
+
+			switch (pStatement->Kind)
+			{
+			case HLSLNodeKind::BlockStatement:
+			{
+				const HLSLBlockStatement* pBlock = static_cast<const HLSLBlockStatement*>(pStatement);
+				for (auto i = 0; i < pBlock->Statements.Size(); i++)
+					LowerStatement(pBlock->Statements[i]);
+				break;
+			}
+
+			case HLSLNodeKind::DeclarationStatement:
+			{
+				const HLSLDeclarationStatement* pDeclaration = static_cast<const HLSLDeclarationStatement*>(pStatement);
+				for (auto i = 0; i < pDeclaration->Variables.Size(); i++)
+				{
+					const HLSLVariableDecl* pVariable = pDeclaration->Variables[i];
+					const int count = ComponentCount(pVariable->Type);
+
+					if (!pVariable->pInit)
+					{
+						mVariables[pVariable] = NewVariable(count);
+						continue;
+					}
+
+					IRValue init = LowerExpression(pVariable->pInit);
+
+					bool constantInit = true;
+					for (auto j = 0; j < init.Regs.Size(); j++)
+						constantInit = constantInit && IsConstant(init.Regs[j]);
+
+					if (pVariable->Type.Const && constantInit)
+					{
+						mVariables[pVariable] = init.Regs;
+						continue;
+					}
+
+					mVariables[pVariable] = InitVariable(init);
+				}
+				break;
+			}
+
+			case HLSLNodeKind::ExpressionStatement:
+				LowerExpression(static_cast<const HLSLExpressionStatement*>(pStatement)->pExpression);
+				break;
+
+			case HLSLNodeKind::IfStatement:
+				LowerIf(static_cast<const HLSLIfStatement*>(pStatement));
+				break;
+
+			case HLSLNodeKind::ForStatement:
+			case HLSLNodeKind::WhileStatement:
+			case HLSLNodeKind::DoWhileStatement:
+				LowerLoop(pStatement);
+				break;
+
+			case HLSLNodeKind::ReturnStatement:
+				LowerReturn(static_cast<const HLSLReturnStatement*>(pStatement));
+				break;
+
+			case HLSLNodeKind::BreakStatement:
+				EmitJump(IROpcode::Break);
+				break;
+
+			case HLSLNodeKind::ContinueStatement:
+				EmitJump(IROpcode::Continue);
+				break;
+
+			case HLSLNodeKind::DiscardStatement:
+				Error("'discard' is not supported, depth is resolved before shading", pStatement->SrcInfo);
+				break;
+
+			default:
+				break;
+			}
+		}
+
+		void HLSLLowering::LowerIf(const HLSLIfStatement* pIf)
+		{
+			const IRValue condition = LowerExpression(pIf->pCondition);
+
+			EnterControl(pIf->SrcInfo);
+			mFrames[mFrames.Size() - 1].Depth++;
+
+			const int ifIdx = Emit(IROpcode::If, -1, condition.Regs[0]);
+			OpenConstruct();
+			LowerStatement(pIf->pThen);
+
+			if (pIf->pElse)
+			{
+				const int elseIdx = mCode.Size();
+				CloseConstruct(elseIdx);
+				Emit(IROpcode::Else);
+				mCode[ifIdx].Imm = elseIdx;
+
+				OpenConstruct();
+				LowerStatement(pIf->pElse);
+
+				const int endIdx = mCode.Size();
+				CloseConstruct(endIdx);
+				Emit(IROpcode::EndIf);
+				mCode[elseIdx].Imm = endIdx;
+			}
+			else
+			{
+				const int endIdx = mCode.Size();
+				CloseConstruct(endIdx);
+				Emit(IROpcode::EndIf);
+				mCode[ifIdx].Imm = endIdx;
+			}
+
+			mFrames[mFrames.Size() - 1].Depth--;
+			LeaveControl();
+		}
+
+		void HLSLLowering::LowerLoop(const HLSLStatement* pLoop)
+		{
+			const HLSLExpression* pCondition = nullptr;
+			const HLSLExpression* pIncrement = nullptr;
+			const HLSLStatement* pBody = nullptr;
+			const bool doWhile = pLoop->Kind == HLSLNodeKind::DoWhileStatement;
+
+			if (pLoop->Kind == HLSLNodeKind::ForStatement)
+			{
+				const HLSLForStatement* pFor = static_cast<const HLSLForStatement*>(pLoop);
+				LowerStatement(pFor->pInit);
+				pCondition = pFor->pCondition;
+				pIncrement = pFor->pIncrement;
+				pBody = pFor->pBody;
+			}
+			else
+			{
+				const HLSLWhileStatement* pWhile = static_cast<const HLSLWhileStatement*>(pLoop);
+				pCondition = pWhile->pCondition;
+				pBody = pWhile->pBody;
+			}
+
+			EnterControl(pLoop->SrcInfo);
+			mFrames[mFrames.Size() - 1].Depth++;
+
+			const int loopIdx = Emit(IROpcode::Loop);
+			const int head = mCode.Size();
+
+			int breakIdx = -1;
+			if (pCondition && !doWhile)
+			{
+				const IRValue condition = LowerExpression(pCondition);
+				breakIdx = Emit(IROpcode::BreakUnless, -1, condition.Regs[0]);
+			}
+
+			OpenConstruct();
+			LowerStatement(pBody);
+			const int continueIdx = mCode.Size();
+			CloseConstruct(continueIdx);
+			Emit(IROpcode::LoopContinue);
+
+			if (pIncrement)
+				LowerExpression(pIncrement);
+			if (pCondition && doWhile)
+			{
+				const IRValue condition = LowerExpression(pCondition);
+				breakIdx = Emit(IROpcode::BreakUnless, -1, condition.Regs[0]);
+			}
+
+			const int endIdx = Emit(IROpcode::EndLoop, -1, -1, -1, -1, head);
+			mCode[loopIdx].Imm = endIdx;
+			if (breakIdx >= 0)
+				mCode[breakIdx].Imm = endIdx;
+
+			mFrames[mFrames.Size() - 1].Depth--;
+			LeaveControl();
+		}
+
+		void HLSLLowering::LowerReturn(const HLSLReturnStatement* pReturn)
+		{
+			IRValue value;
+			if (pReturn->pValue)
+				value = LowerExpression(pReturn->pValue);
+
+			// Lowering the value may inline calls and grow the frame stack
+			Frame& frame = mFrames[mFrames.Size() - 1];
+			if (frame.EarlyReturn)
+			{
+				for (auto i = 0; i < frame.ReturnRegs.Size(); i++)
+					Emit(IROpcode::Store, frame.ReturnRegs[i], value.Regs[i]);
+				EmitJump(IROpcode::Return);
+			}
+			else if (mFrames.Size() == 1)
+			{
+				for (auto i = 0; i < frame.ReturnRegs.Size(); i++)
+					Emit(IROpcode::Mov, frame.ReturnRegs[i], value.Regs[i]);
+			}
+			else
+			{
+				// The only return is at the end, the caller reads the value where it was computed
+				frame.ReturnRegs = value.Regs;
+			}
+		}
+
+		void HLSLLowering::EmitJump(const IROpcode op)
+		{
+			const int idx = Emit(op);
+			if (mPendingSkips.Size() > 0)
+				mPendingSkips[mPendingSkips.Size() - 1].Add(idx);
+		}
+
+		void HLSLLowering::OpenConstruct()
+		{
+			mPendingSkips.Resize(mPendingSkips.Size() + 1);
+			mPendingSkips[mPendingSkips.Size() - 1].Clear();
+		}
+
+		void HLSLLowering::CloseConstruct(const int target)
+		{
+			const Array<int>& pending = mPendingSkips[mPendingSkips.Size() - 1];
+			for (auto i = 0; i < pending.Size(); i++)
+				mCode[pending[i]].Imm = target;
+
+			mPendingSkips.Resize(mPendingSkips.Size() - 1);
+		}
+
+		bool HLSLLowering::EnterControl(const SourceInfo& srcInfo)
+		{
+			if (++mControlDepth == IRProgram::MAX_CONTROL_DEPTH + 1)
+			{
+				Error("control flow is nested more than " + std::to_string(IRProgram::MAX_CONTROL_DEPTH) + " levels deep", srcInfo);
+				return false;
+			}
+			return true;
+		}
+
+		HLSLLowering::IRValue HLSLLowering::LowerExpression(const HLSLExpression* pExpr)
+		{
+			IRValue ret;
+			ret.Type = pExpr->Type;
+
+			switch (pExpr->Kind)
+			{
+			case HLSLNodeKind::LiteralExpression:
+			{
+				const HLSLLiteralExpression* pLiteral = static_cast<const HLSLLiteralExpression*>(pExpr);
+				if (pLiteral->LiteralType == HLSLBaseType::Float)
+					ret.Regs.Add(FloatConstant(pLiteral->FloatValue));
+				else if (pLiteral->LiteralType == HLSLBaseType::Bool)
+					ret.Regs.Add(IntConstant(pLiteral->IntValue ? -1 : 0));
+				else
+					ret.Regs.Add(IntConstant(pLiteral->IntValue));
+				return ret;
+			}
+
+			case HLSLNodeKind::IdentifierExpression:
+			case HLSLNodeKind::MemberExpression:
+			case HLSLNodeKind::IndexExpression:
+				return ReadPlace(LowerPlace(pExpr));
+
+			case HLSLNodeKind::UnaryExpression:
+				return LowerUnary(static_cast<const HLSLUnaryExpression*>(pExpr));
+
+			case HLSLNodeKind::BinaryExpression:
+				return LowerBinary(static_cast<const HLSLBinaryExpression*>(pExpr));
+
+			case HLSLNodeKind::ConditionalExpression:
+			{
+				// Both sides are evaluated, HLSL selects per component
+				const HLSLConditionalExpression* pConditional = static_cast<const HLSLConditionalExpression*>(pExpr);
+				const IRValue condition = LowerExpression(pConditional->pCondition);
+				const IRValue trueValue = LowerExpression(pConditional->pTrue);
+				const IRValue falseValue = LowerExpression(pConditional->pFalse);
+
+				for (auto i = 0; i < trueValue.Regs.Size(); i++)
+				{
+					const int mask = condition.Regs[condition.Regs.Size() == 1 ? 0 : i];
+					ret.Regs.Add(EmitValue(IROpcode::Select, mask, trueValue.Regs[i], falseValue.Regs[i]));
+				}
+				return ret;
+			}
+
+			case HLSLNodeKind::CastExpression:
+				return Convert(LowerExpression(static_cast<const HLSLCastExpression*>(pExpr)->pOperand), pExpr->Type);
+
+			case HLSLNodeKind::ConstructorExpression:
+			{
+				// The type checker converted the arguments to the constructed base type
+				const HLSLConstructorExpression* pConstructor = static_cast<const HLSLConstructorExpression*>(pExpr);
+				for (auto i = 0; i < pConstructor->Arguments.Size(); i++)
+				{
+					const IRValue arg = LowerExpression(pConstructor->Arguments[i]);
+					for (auto j = 0; j < arg.Regs.Size(); j++)
+						ret.Regs.Add(arg.Regs[j]);
+				}
+
+				const int count = ComponentCount(pExpr->Type);
+				while (ret.Regs.Size() < count)
+					ret.Regs.Add(ret.Regs[0]);
+				return ret;
+			}
+
+			case HLSLNodeKind::CallExpression:
+				return LowerCall(static_cast<const HLSLCallExpression*>(pExpr));
+
+			case HLSLNodeKind::MethodCallExpression:
+				return LowerSample(static_cast<const HLSLMethodCallExpression*>(pExpr));
+
+			default:
+				Error("unexpected expression", pExpr->SrcInfo);
+				return Undefined(pExpr->Type);
+			}
+		}
+
+		HLSLLowering::IRValue HLSLLowering::LowerUnary(const HLSLUnaryExpression* pUnary)
+		{
+			IRValue ret;
+			ret.Type = pUnary->Type;
+			const bool isFloat = IsFloat(pUnary->Type.Base);
+
+			switch (pUnary->Op)
+			{
+			case HLSLUnaryOp::Plus:
+				return LowerExpression(pUnary->pOperand);
+
+			case HLSLUnaryOp::Negate:
+			{
+				const IRValue operand = LowerExpression(pUnary->pOperand);
+				for (auto i = 0; i < operand.Regs.Size(); i++)
+					ret.Regs.Add(EmitValue(isFloat ? IROpcode::FNeg : IROpcode::INeg, operand.Regs[i]));
+				return ret;
+			}
+
+			case HLSLUnaryOp::LogicalNot:
+			case HLSLUnaryOp::BitNot:
+			{
+				const IRValue operand = LowerExpression(pUnary->pOperand);
+				for (auto i = 0; i < operand.Regs.Size(); i++)
+					ret.Regs.Add(EmitValue(IROpcode::Not, operand.Regs[i]));
+				return ret;
+			}
+
+			default:
+			{
+				const bool increment = pUnary->Op == HLSLUnaryOp::PreIncrement || pUnary->Op == HLSLUnaryOp::PostIncrement;
+				const bool post = pUnary->Op == HLSLUnaryOp::PostIncrement || pUnary->Op == HLSLUnaryOp::PostDecrement;
+
+				const IRPlace place = LowerPlace(pUnary->pOperand);
+				const IRValue current = ReadPlace(place);
+				const int one = isFloat ? FloatConstant(1.0f) : IntConstant(1);
+				const IROpcode op = isFloat ? (increment ? IROpcode::FAdd : IROpcode::FSub) : (increment ? IROpcode::IAdd : IROpcode::ISub);
+
+				IRValue updated;
+				updated.Type = current.Type;
+				for (auto i = 0; i < current.Regs.Size(); i++)
+				{
+					updated.Regs.Add(EmitValue(op, current.Regs[i], one));
+
+					// The old value has to survive the write
+					if (post)
+						ret.Regs.Add(EmitValue(IROpcode::Mov, current.Regs[i]));
+				}
+
+				WritePlace(place, updated);
+				return post ? ret : updated;
+			}
+			}
+		}
+
+		HLSLLowering::IRValue HLSLLowering::LowerBinary(const HLSLBinaryExpression* pBinary)
+		{
+			if (IsAssignment(pBinary->Op))
+			{
+				const IRPlace place = LowerPlace(pBinary->pLeft);
+				const IRValue rhs = LowerExpression(pBinary->pRight);
+				if (pBinary->Op == HLSLBinaryOp::Assign)
+				{
+					WritePlace(place, rhs);
+					return rhs;
+				}
+
+				const IRValue current = ReadPlace(place);
+				const HLSLBinaryOp op = CompoundAssignmentOp(pBinary->Op);
+
+				IRValue ret;
+				ret.Type = pBinary->Type;
+				for (auto i = 0; i < current.Regs.Size(); i++)
+					ret.Regs.Add(BinaryComponent(op, pBinary->OperandType.Base, current.Regs[i], rhs.Regs[i]));
+
+				WritePlace(place, ret);
+				return ret;
+			}
+
+			const IRValue lhs = LowerExpression(pBinary->pLeft);
+			const IRValue rhs = LowerExpression(pBinary->pRight);
+
+			IRValue ret;
+			ret.Type = pBinary->Type;
+			for (auto i = 0; i < lhs.Regs.Size(); i++)
+				ret.Regs.Add(BinaryComponent(pBinary->Op, pBinary->OperandType.Base, lhs.Regs[i], rhs.Regs[i]));
+
+			return ret;
+		}
+
+		int HLSLLowering::BinaryComponent(const HLSLBinaryOp op, const HLSLBaseType base, const int lhs, const int rhs)
+		{
+			if (IsFloat(base))
+			{
+				switch (op)
+				{
+				case HLSLBinaryOp::Add: return EmitValue(IROpcode::FAdd, lhs, rhs);
+				case HLSLBinaryOp::Sub: return EmitValue(IROpcode::FSub, lhs, rhs);
+				case HLSLBinaryOp::Mul: return EmitValue(IROpcode::FMul, lhs, rhs);
+				case HLSLBinaryOp::Div: return EmitValue(IROpcode::FDiv, lhs, rhs);
+				case HLSLBinaryOp::Mod: return EmitValue(IROpcode::FMod, lhs, rhs);
+				case HLSLBinaryOp::Less: return EmitValue(IROpcode::FLt, lhs, rhs);
+				case HLSLBinaryOp::LessEqual: return EmitValue(IROpcode::FLe, lhs, rhs);
+				case HLSLBinaryOp::Greater: return EmitValue(IROpcode::FLt, rhs, lhs);
+				case HLSLBinaryOp::GreaterEqual: return EmitValue(IROpcode::FLe, rhs, lhs);
+				case HLSLBinaryOp::Equal: return EmitValue(IROpcode::FEq, lhs, rhs);
+				case HLSLBinaryOp::NotEqual: return EmitValue(IROpcode::FNe, lhs, rhs);
+				default: break;
+				}
+			}
+			else
+			{
+				const bool isUnsigned = base == HLSLBaseType::Uint;
+				switch (op)
+				{
+				case HLSLBinaryOp::Add: return EmitValue(IROpcode::IAdd, lhs, rhs);
+				case HLSLBinaryOp::Sub: return EmitValue(IROpcode::ISub, lhs, rhs);
+				case HLSLBinaryOp::Mul: return EmitValue(IROpcode::IMul, lhs, rhs);
+				case HLSLBinaryOp::Div: return EmitValue(isUnsigned ? IROpcode::UDiv : IROpcode::IDiv, lhs, rhs);
+				case HLSLBinaryOp::Mod: return EmitValue(isUnsigned ? IROpcode::UMod : IROpcode::IMod, lhs, rhs);
+				case HLSLBinaryOp::Less: return EmitValue(isUnsigned ? IROpcode::ULt : IROpcode::ILt, lhs, rhs);
+				case HLSLBinaryOp::LessEqual: return EmitValue(isUnsigned ? IROpcode::ULe : IROpcode::ILe, lhs, rhs);
+				case HLSLBinaryOp::Greater: return EmitValue(isUnsigned ? IROpcode::ULt : IROpcode::ILt, rhs, lhs);
+				case HLSLBinaryOp::GreaterEqual: return EmitValue(isUnsigned ? IROpcode::ULe : IROpcode::ILe, rhs, lhs);
+				case HLSLBinaryOp::Equal: return EmitValue(IROpcode::IEq, lhs, rhs);
+				case HLSLBinaryOp::NotEqual: return EmitValue(IROpcode::INe, lhs, rhs);
+				case HLSLBinaryOp::LogicalAnd:
+				case HLSLBinaryOp::BitAnd: return EmitValue(IROpcode::And, lhs, rhs);
+				case HLSLBinaryOp::LogicalOr:
+				case HLSLBinaryOp::BitOr: return EmitValue(IROpcode::Or, lhs, rhs);
+				case HLSLBinaryOp::BitXor: return EmitValue(IROpcode::Xor, lhs, rhs);
+				case HLSLBinaryOp::ShiftLeft: return EmitValue(IROpcode::Shl, lhs, rhs);
+				case HLSLBinaryOp::ShiftRight: return EmitValue(isUnsigned ? IROpcode::UShr : IROpcode::Shr, lhs, rhs);
+				default: break;
+				}
+			}
+
+			return IntConstant(0);
+		}
+
+		HLSLLowering::IRValue HLSLLowering::LowerCall(const HLSLCallExpression* pCall)
+		{
+			if (pCall->Intrinsic != HLSLIntrinsic::None)
+				return LowerIntrinsic(pCall);
+
+			const HLSLFunctionDecl* pFunction = pCall->pFunction;
+
+			// Arguments are evaluated before the body, out arguments are written back after it
+			Array<IRPlace> outPlaces;
+			outPlaces.Resize(pFunction->Parameters.Size());
+			for (auto i = 0; i < pFunction->Parameters.Size(); i++)
+			{
+				const HLSLVariableDecl* pParam = pFunction->Parameters[i];
+				const HLSLExpression* pArg = pCall->Arguments[i];
+
+				if (pParam->Type.IsTexture())
+				{
+					mTextureSlots[pParam] = TextureSlot(pArg);
+					continue;
+				}
+				if (pParam->Type.IsSampler())
+					continue;
+
+				const int count = ComponentCount(pParam->Type);
+				if (pParam->Modifier == HLSLParameterModifier::In)
+				{
+					const IRValue arg = LowerExpression(pArg);
+
+					// Parameters the callee only reads share the argument's registers, unless the callee could
+					// change the argument through a global
+					const HLSLVariableDecl* pRoot = RootDecl(pArg);
+					if (!IsWritten(pParam, pFunction->pBody) && !(pRoot && pRoot->Storage == HLSLStorage::Static))
+					{
+						mVariables[pParam] = arg.Regs;
+						continue;
+					}
+
+					mVariables[pParam] = InitVariable(arg);
+				}
+				else
+				{
+					outPlaces[i] = LowerPlace(pArg);
+
+					Array<int> regs = NewVariable(count);
+					if (pParam->Modifier == HLSLParameterModifier::InOut)
+					{
+						const IRValue arg = ReadPlace(outPlaces[i]);
+						for (auto j = 0; j < count; j++)
+							Emit(IROpcode::Mov, regs[j], arg.Regs[j]);
+					}
+					mVariables[pParam] = regs;
+				}
+			}
+
+			Frame frame;
+			frame.pFunction = pFunction;
+			frame.EarlyReturn = HasEarlyReturn(pFunction);
+			if (frame.EarlyReturn)
+				frame.ReturnRegs = NewVariable(ComponentCount(pFunction->ReturnType));
+			mFrames.Add(frame);
+
+			if (frame.EarlyReturn)
+			{
+				EnterControl(pCall->SrcInfo);
+				Emit(IROpcode::Begin);
+				OpenConstruct();
+			}
+
+			LowerStatement(pFunction->pBody);
+
+			if (frame.EarlyReturn)
+			{
+				CloseConstruct(mCode.Size());
+				Emit(IROpcode::End);
+				LeaveControl();
+			}
+
+			IRValue ret;
+			ret.Type = pFunction->ReturnType;
+			ret.Regs = mFrames[mFrames.Size() - 1].ReturnRegs;
+			mFrames.Resize(mFrames.Size() - 1);
+
+			for (auto i = 0; i < pFunction->Parameters.Size(); i++)
+			{
+				const HLSLVariableDecl* pParam = pFunction->Parameters[i];
+				if (pParam->Modifier == HLSLParameterModifier::In || pParam->Type.IsTexture() || pParam->Type.IsSampler())
+					continue;
+
+				IRValue result;
+				result.Type = pParam->Type;
+				result.Regs = mVariables[pParam];
+				WritePlace(outPlaces[i], result);
+			}
+
+			return ret;
+		}
+
+		HLSLLowering::IRValue HLSLLowering::LowerIntrinsic(const HLSLCallExpression* pCall)
+		{
+			Array<IRValue> args;
+			args.Resize(pCall->Arguments.Size());
+			for (auto i = 0; i < pCall->Arguments.Size(); i++)
+				args[i] = LowerExpression(pCall->Arguments[i]);
+
+			IRValue ret;
+			ret.Type = pCall->Type;
+
+			const HLSLBaseType base = args[0].Type.Base;
+			const bool isFloat = IsFloat(base);
+			const bool isUnsigned = base == HLSLBaseType::Uint;
+			const Array<int>& a = args[0].Regs;
+
+			switch (pCall->Intrinsic)
+			{
+			case HLSLIntrinsic::Abs:
+				for (auto i = 0; i < a.Size(); i++)
+					ret.Regs.Add(isUnsigned ? a[i] : EmitValue(isFloat ? IROpcode::FAbs : IROpcode::IAbs, a[i]));
+				return ret;
+
+			case HLSLIntrinsic::Acos:
+			case HLSLIntrinsic::Asin:
+			case HLSLIntrinsic::Atan:
+			case HLSLIntrinsic::Ceil:
+			case HLSLIntrinsic::Cos:
+			case HLSLIntrinsic::Ddx:
+			case HLSLIntrinsic::Ddy:
+			case HLSLIntrinsic::Exp:
+			case HLSLIntrinsic::Exp2:
+			case HLSLIntrinsic::Floor:
+			case HLSLIntrinsic::Frac:
+			case HLSLIntrinsic::Log:
+			case HLSLIntrinsic::Log2:
+			case HLSLIntrinsic::Rcp:
+			case HLSLIntrinsic::Round:
+			case HLSLIntrinsic::Rsqrt:
+			case HLSLIntrinsic::Saturate:
+			case HLSLIntrinsic::Sin:
+			case HLSLIntrinsic::Sqrt:
+			case HLSLIntrinsic::Tan:
+			case HLSLIntrinsic::Trunc:
+			{
+				IROpcode op;
+				switch (pCall->Intrinsic)
+				{
+				case HLSLIntrinsic::Acos: op = IROpcode::FAcos; break;
+				case HLSLIntrinsic::Asin: op = IROpcode::FAsin; break;
+				case HLSLIntrinsic::Atan: op = IROpcode::FAtan; break;
+				case HLSLIntrinsic::Ceil: op = IROpcode::FCeil; break;
+				case HLSLIntrinsic::Cos: op = IROpcode::FCos; break;
+				case HLSLIntrinsic::Ddx: op = IROpcode::Ddx; break;
+				case HLSLIntrinsic::Ddy: op = IROpcode::Ddy; break;
+				case HLSLIntrinsic::Exp: op = IROpcode::FExp; break;
+				case HLSLIntrinsic::Exp2: op = IROpcode::FExp2; break;
+				case HLSLIntrinsic::Floor: op = IROpcode::FFloor; break;
+				case HLSLIntrinsic::Frac: op = IROpcode::FFrac; break;
+				case HLSLIntrinsic::Log: op = IROpcode::FLog; break;
+				case HLSLIntrinsic::Log2: op = IROpcode::FLog2; break;
+				case HLSLIntrinsic::Rcp: op = IROpcode::FRcp; break;
+				case HLSLIntrinsic::Round: op = IROpcode::FRound; break;
+				case HLSLIntrinsic::Rsqrt: op = IROpcode::FRsqrt; break;
+				case HLSLIntrinsic::Saturate: op = IROpcode::FSaturate; break;
+				case HLSLIntrinsic::Sin: op = IROpcode::FSin; break;
+				case HLSLIntrinsic::Sqrt: op = IROpcode::FSqrt; break;
+				case HLSLIntrinsic::Tan: op = IROpcode::FTan; break;
+				default: op = IROpcode::FTrunc; break;
+				}
+
+				if ((op == IROpcode::Ddx || op == IROpcode::Ddy) && mStage != ShaderStage::Pixel)
+				{
+					Error("'" + pCall->Name + "' is only available in pixel shaders", pCall->SrcInfo);
+					return Undefined(pCall->Type);
+				}
+
+				for (auto i = 0; i < a.Size(); i++)
+					ret.Regs.Add(EmitValue(op, a[i]));
+				return ret;
+			}
+
+			case HLSLIntrinsic::Atan2:
+			case HLSLIntrinsic::Fmod:
+			case HLSLIntrinsic::Pow:
+			{
+				const IROpcode op = pCall->Intrinsic == HLSLIntrinsic::Atan2 ? IROpcode::FAtan2 : pCall->Intrinsic == HLSLIntrinsic::Fmod ? IROpcode::FMod : IROpcode::FPow;
+				for (auto i = 0; i < a.Size(); i++)
+					ret.Regs.Add(EmitValue(op, a[i], args[1].Regs[i]));
+				return ret;
+			}
+
+			case HLSLIntrinsic::Max:
+			case HLSLIntrinsic::Min:
+			case HLSLIntrinsic::Clamp:
+			{
+				const IROpcode maxOp = isFloat ? IROpcode::FMax : isUnsigned ? IROpcode::UMax : IROpcode::IMax;
+				const IROpcode minOp = isFloat ? IROpcode::FMin : isUnsigned ? IROpcode::UMin : IROpcode::IMin;
+				for (auto i = 0; i < a.Size(); i++)
+				{
+					if (pCall->Intrinsic == HLSLIntrinsic::Max)
+						ret.Regs.Add(EmitValue(maxOp, a[i], args[1].Regs[i]));
+					else if (pCall->Intrinsic == HLSLIntrinsic::Min)
+						ret.Regs.Add(EmitValue(minOp, a[i], args[1].Regs[i]));
+					else
+						ret.Regs.Add(EmitValue(minOp, EmitValue(maxOp, a[i], args[1].Regs[i]), args[2].Regs[i]));
+				}
+				return ret;
+			}
+
+			case HLSLIntrinsic::Mad:
+				for (auto i = 0; i < a.Size(); i++)
+				{
+					if (isFloat)
+						ret.Regs.Add(EmitValue(IROpcode::FMad, a[i], args[1].Regs[i], args[2].Regs[i]));
+					else
+						ret.Regs.Add(EmitValue(IROpcode::IAdd, EmitValue(IROpcode::IMul, a[i], args[1].Regs[i]), args[2].Regs[i]));
+				}
+				return ret;
+
+			case HLSLIntrinsic::Lerp:
+				for (auto i = 0; i < a.Size(); i++)
+				{
+					const int delta = EmitValue(IROpcode::FSub, args[1].Regs[i], a[i]);
+					ret.Regs.Add(EmitValue(IROpcode::FMad, delta, args[2].Regs[i], a[i]));
+				}
+				return ret;
+
+			case HLSLIntrinsic::Smoothstep:
+				for (auto i = 0; i < a.Size(); i++)
+				{
+					const int range = EmitValue(IROpcode::FSub, args[1].Regs[i], a[i]);
+					const int t = EmitValue(IROpcode::FSaturate, EmitValue(IROpcode::FDiv, EmitValue(IROpcode::FSub, args[2].Regs[i], a[i]), range));
+					const int weight = EmitValue(IROpcode::FMad, t, FloatConstant(-2.0f), FloatConstant(3.0f));
+					ret.Regs.Add(EmitValue(IROpcode::FMul, EmitValue(IROpcode::FMul, t, t), weight));
+				}
+				return ret;
+
+			case HLSLIntrinsic::Step:
+				for (auto i = 0; i < a.Size(); i++)
+				{
+					const int mask = EmitValue(IROpcode::FLe, a[i], args[1].Regs[i]);
+					ret.Regs.Add(EmitValue(IROpcode::Select, mask, FloatConstant(1.0f), FloatConstant(0.0f)));
+				}
+				return ret;
+
+			case HLSLIntrinsic::All:
+			case HLSLIntrinsic::Any:
+			{
+				int result = a[0];
+				for (auto i = 1; i < a.Size(); i++)
+					result = EmitValue(pCall->Intrinsic == HLSLIntrinsic::All ? IROpcode::And : IROpcode::Or, result, a[i]);
+				ret.Regs.Add(result);
+				return ret;
+			}
+
+			case HLSLIntrinsic::Cross:
+			{
+				const Array<int>& b = args[1].Regs;
+				for (auto i = 0; i < 3; i++)
+				{
+					const int j = (i + 1) % 3, k = (i + 2) % 3;
+					ret.Regs.Add(EmitValue(IROpcode::FSub, EmitValue(IROpcode::FMul, a[j], b[k]), EmitValue(IROpcode::FMul, a[k], b[j])));
+				}
+				return ret;
+			}
+
+			case HLSLIntrinsic::Dot:
+				ret.Regs.Add(Dot(args[0], args[1]));
+				return ret;
+
+			case HLSLIntrinsic::Length:
+				ret.Regs.Add(EmitValue(IROpcode::FSqrt, Dot(args[0], args[0])));
+				return ret;
+
+			case HLSLIntrinsic::Distance:
+			{
+				IRValue delta;
+				delta.Type = args[0].Type;
+				for (auto i = 0; i < a.Size(); i++)
+					delta.Regs.Add(EmitValue(IROpcode::FSub, a[i], args[1].Regs[i]));
+				ret.Regs.Add(EmitValue(IROpcode::FSqrt, Dot(delta, delta)));
+				return ret;
+			}
+
+			case HLSLIntrinsic::Normalize:
+			{
+				const int invLength = EmitValue(IROpcode::FRsqrt, Dot(args[0], args[0]));
+				for (auto i = 0; i < a.Size(); i++)
+					ret.Regs.Add(EmitValue(IROpcode::FMul, a[i], invLength));
+				return ret;
+			}
+
+			case HLSLIntrinsic::Reflect:
+			{
+				// i - 2 * dot(n, i) * n
+				const Array<int>& n = args[1].Regs;
+				const int d = Dot(args[1], args[0]);
+				const int twoD = EmitValue(IROpcode::FAdd, d, d);
+				for (auto i = 0; i < a.Size(); i++)
+					ret.Regs.Add(EmitValue(IROpcode::FSub, a[i], EmitValue(IROpcode::FMul, twoD, n[i])));
+				return ret;
+			}
+
+			case HLSLIntrinsic::Mul:
+				return LowerMul(args[0], args[1], pCall->Type);
+
+			default:
+				Error("intrinsic '" + pCall->Name + "' is not supported", pCall->SrcInfo);
+				return Undefined(pCall->Type);
+			}
+		}
+
+		HLSLLowering::IRValue HLSLLowering::LowerMul(const IRValue& lhs, const IRValue& rhs, const HLSLType& resultType)
+		{
+			const bool isFloat = IsFloat(resultType.Base);
+			const IROpcode mulOp = isFloat ? IROpcode::FMul : IROpcode::IMul;
+
+			// Sum of products over count terms, a and b give the register of term k
+			auto sum = [&](const int count, const std::function<int(int)>& a, const std::function<int(int)>& b)
+			{
+				int acc = EmitValue(mulOp, a(0), b(0));
+				for (auto k = 1; k < count; k++)
+				{
+					if (isFloat)
+						acc = EmitValue(IROpcode::FMad, a(k), b(k), acc);
+					else
+						acc = EmitValue(IROpcode::IAdd, EmitValue(IROpcode::IMul, a(k), b(k)), acc);
+				}
+				return acc;
+			};
+
+			IRValue ret;
+			ret.Type = resultType;
+
+			const HLSLType& a = lhs.Type;
+			const HLSLType& b = rhs.Type;
+			if (a.IsScalar())
+			{
+				for (auto i = 0; i < rhs.Regs.Size(); i++)
+					ret.Regs.Add(EmitValue(mulOp, lhs.Regs[0], rhs.Regs[i]));
+			}
+			else if (b.IsScalar())
+			{
+				for (auto i = 0; i < lhs.Regs.Size(); i++)
+					ret.Regs.Add(EmitValue(mulOp, lhs.Regs[i], rhs.Regs[0]));
+			}
+			else if (!a.Matrix && !b.Matrix)
+				ret.Regs.Add(Dot(lhs, rhs));
+			else if (!a.Matrix)
+			{
+				// Row vector times matrix
+				for (auto j = 0; j < b.Columns; j++)
+					ret.Regs.Add(sum(a.Columns, [&](int k) { return lhs.Regs[k]; }, [&](int k) { return rhs.Regs[k * b.Columns + j]; }));
+			}
+			else if (!b.Matrix)
+			{
+				// Matrix times column vector
+				for (auto i = 0; i < a.Rows; i++)
+					ret.Regs.Add(sum(a.Columns, [&](int k) { return lhs.Regs[i * a.Columns + k]; }, [&](int k) { return rhs.Regs[k]; }));
+			}
+			else
+			{
+				for (auto i = 0; i < a.Rows; i++)
+				{
+					for (auto j = 0; j < b.Columns; j++)
+						ret.Regs.Add(sum(a.Columns, [&](int k) { return lhs.Regs[i * a.Columns + k]; }, [&](int k) { return rhs.Regs[k * b.Columns + j]; }));
+				}
+			}
+
+			return ret;
+		}
+
+		HLSLLowering::IRValue HLSLLowering::LowerSample(const HLSLMethodCallExpression* pCall)
+		{
+			const HLSLType float4Type = HLSLType::Vector(HLSLBaseType::Float, 4);
+
+			if (mStage != ShaderStage::Pixel)
+			{
+				Error("textures can only be sampled in pixel shaders", pCall->SrcInfo);
+				return Undefined(float4Type);
+			}
+			if (pCall->pObject->Type.Base != HLSLBaseType::Texture2D)
+			{
+				Error("only Texture2D can be sampled", pCall->SrcInfo);
+				return Undefined(float4Type);
+			}
+			if (pCall->Intrinsic == HLSLIntrinsic::SampleLevel)
+			{
+				Error("SampleLevel is not supported, textures select their level from the quad derivatives", pCall->SrcInfo);
+				return Undefined(float4Type);
+			}
+
+			const int slot = TextureSlot(pCall->pObject);
+
+			// Coordinates and gradients are read from consecutive registers
+			const IRValue texCoord = LowerExpression(pCall->Arguments[1]);
+			int coordReg = texCoord.Regs[0];
+			if (texCoord.Regs[1] != coordReg + 1 || mRegisterClasses[coordReg] != RegisterClass::Temp || mRegisterClasses[coordReg + 1] != RegisterClass::Temp)
+			{
+				const Array<int> regs = NewRegisters(2);
+				Emit(IROpcode::Mov, regs[0], texCoord.Regs[0]);
+				Emit(IROpcode::Mov, regs[1], texCoord.Regs[1]);
+				coordReg = regs[0];
+			}
+
+			IROpcode op = IROpcode::Sample;
+			int extraReg = -1;
+			if (pCall->Intrinsic == HLSLIntrinsic::SampleBias)
+			{
+				op = IROpcode::SampleBias;
+				extraReg = LowerExpression(pCall->Arguments[2]).Regs[0];
+			}
+			else if (pCall->Intrinsic == HLSLIntrinsic::SampleGrad)
+			{
+				op = IROpcode::SampleGrad;
+				const IRValue gradX = LowerExpression(pCall->Arguments[2]);
+				const IRValue gradY = LowerExpression(pCall->Arguments[3]);
+				const Array<int> regs = NewRegisters(4);
+				Emit(IROpcode::Mov, regs[0], gradX.Regs[0]);
+				Emit(IROpcode::Mov, regs[1], gradX.Regs[1]);
+				Emit(IROpcode::Mov, regs[2], gradY.Regs[0]);
+				Emit(IROpcode::Mov, regs[3], gradY.Regs[1]);
+				extraReg = regs[0];
+			}
+
+			IRValue ret;
+			ret.Type = float4Type;
+			ret.Regs = NewRegisters(4);
+			Emit(op, ret.Regs[0], coordReg, extraReg, -1, slot);
+
+			return ret;
+		}
+
+		HLSLLowering::IRValue HLSLLowering::Convert(const IRValue& value, const HLSLType& to)
+		{
+			const HLSLType& from = value.Type;
+
+			IRValue ret;
+			ret.Type = to;
+			if (!from.IsNumeric() || !to.IsNumeric())
+			{
+				ret.Regs = value.Regs;
+				return ret;
+			}
+
+			const int count = ComponentCount(to);
+			if (from.IsScalar())
+			{
+				const int reg = ConvertComponent(value.Regs[0], from.Base, to.Base);
+				for (auto i = 0; i < count; i++)
+					ret.Regs.Add(reg);
+			}
+			else if (to.IsScalar())
+				ret.Regs.Add(ConvertComponent(value.Regs[0], from.Base, to.Base));
+			else
+			{
+				// Truncation keeps the leading rows and columns
+				for (auto r = 0; r < to.Rows; r++)
+				{
+					for (auto c = 0; c < to.Columns; c++)
+						ret.Regs.Add(ConvertComponent(value.Regs[r * from.Columns + c], from.Base, to.Base));
+				}
+			}
+
+			return ret;
+		}
+
+		int HLSLLowering::ConvertComponent(const int reg, const HLSLBaseType from, const HLSLBaseType to)
+		{
+			const bool fromFloat = IsFloat(from), toFloat = IsFloat(to);
+			const bool fromBool = from == HLSLBaseType::Bool, toBool = to == HLSLBaseType::Bool;
+
+			if (from == to || (fromFloat && toFloat) || (!fromFloat && !toFloat && !fromBool && !toBool))
+				return reg;
+
+			// Literals convert at compile time
+			if (IsConstant(reg))
+			{
+				const uint bits = mConstantValues[reg];
+				const float f = AsFloat(bits);
+				const int i = int(bits);
+
+				if (toBool)
+					return IntConstant((fromFloat ? f != 0.0f : i != 0) ? -1 : 0);
+				if (fromBool)
+					return toFloat ? FloatConstant(i ? 1.0f : 0.0f) : IntConstant(i ? 1 : 0);
+				if (toFloat)
+					return FloatConstant(from == HLSLBaseType::Uint ? float(bits) : float(i));
+				if (to == HLSLBaseType::Uint)
+					return Constant(f > 0.0f ? uint(f) : 0);
+				return IntConstant(int(f));
+			}
+
+			if (toBool)
+				return fromFloat ? EmitValue(IROpcode::FNe, reg, FloatConstant(0.0f)) : EmitValue(IROpcode::INe, reg, IntConstant(0));
+			if (fromBool)
+				return toFloat ? EmitValue(IROpcode::Select, reg, FloatConstant(1.0f), FloatConstant(0.0f)) : EmitValue(IROpcode::And, reg, IntConstant(1));
+			if (toFloat)
+				return EmitValue(from == HLSLBaseType::Uint ? IROpcode::UToF : IROpcode::IToF, reg);
+
+			return EmitValue(to == HLSLBaseType::Uint ? IROpcode::FToU : IROpcode::FToI, reg);
+		}
+
+		int HLSLLowering::Dot(const IRValue& lhs, const IRValue& rhs)
+		{
+			const bool isFloat = IsFloat(lhs.Type.Base);
+
+			int acc = EmitValue(isFloat ? IROpcode::FMul : IROpcode::IMul, lhs.Regs[0], rhs.Regs[0]);
+			for (auto i = 1; i < lhs.Regs.Size(); i++)
+			{
+				if (isFloat)
+					acc = EmitValue(IROpcode::FMad, lhs.Regs[i], rhs.Regs[i], acc);
+				else
+					acc = EmitValue(IROpcode::IAdd, EmitValue(IROpcode::IMul, lhs.Regs[i], rhs.Regs[i]), acc);
+			}
+			return acc;
+		}
+
+		HLSLLowering::IRPlace HLSLLowering::LowerPlace(const HLSLExpression* pExpr)
+		{
+			IRPlace place;
+			place.Type = pExpr->Type;
+
+			switch (pExpr->Kind)
+			{
+			case HLSLNodeKind::IdentifierExpression:
+			{
+				const HLSLVariableDecl* pDecl = static_cast<const HLSLIdentifierExpression*>(pExpr)->pDecl;
+				place.Regs = VariableRegisters(pDecl);
+				place.Local = pDecl->Storage == HLSLStorage::Local || pDecl->Storage == HLSLStorage::Parameter;
+				return place;
+			}
+
+			case HLSLNodeKind::MemberExpression:
+			{
+				const HLSLMemberExpression* pMember = static_cast<const HLSLMemberExpression*>(pExpr);
+				const IRPlace object = LowerPlace(pMember->pObject);
+				const int objectCount = ComponentCount(pMember->pObject->Type);
+
+				Array<int> components;
+				if (pMember->FieldIndex >= 0)
+				{
+					const HLSLStructDecl* pStruct = pMember->pObject->Type.pStruct;
+					int offset = 0;
+					for (auto i = 0; i < pMember->FieldIndex; i++)
+						offset += ComponentCount(pStruct->Fields[i]->Type);
+
+					const int count = ComponentCount(pStruct->Fields[pMember->FieldIndex]->Type);
+					for (auto i = 0; i < count; i++)
+						components.Add(offset + i);
+				}
+				else
+				{
+					for (auto i = 0; i < pMember->SwizzleCount; i++)
+						components.Add(pMember->Swizzle[i]);
+				}
+
+				place.Index = object.Index;
+				place.ElementCount = object.ElementCount;
+				place.Local = object.Local;
+				for (auto k = 0; k < object.ElementCount; k++)
+				{
+					for (auto i = 0; i < components.Size(); i++)
+						place.Regs.Add(object.Regs[k * objectCount + components[i]]);
+				}
+				return place;
+			}
+
+			case HLSLNodeKind::IndexExpression:
+			{
+				const HLSLIndexExpression* pIndex = static_cast<const HLSLIndexExpression*>(pExpr);
+				const IRPlace object = LowerPlace(pIndex->pObject);
+				const IRValue index = LowerExpression(pIndex->pIndex);
+
+				const HLSLType& objectType = pIndex->pObject->Type;
+				const int objectCount = ComponentCount(objectType);
+				int elementCount, stride;
+				if (objectType.IsArray())
+				{
+					elementCount = objectType.ArraySize;
+					stride = ComponentCount(objectType.ElementType());
+				}
+				else if (objectType.Matrix)
+				{
+					elementCount = objectType.Rows;
+					stride = objectType.Columns;
+				}
+				else
+				{
+					elementCount = objectType.Columns;
+					stride = 1;
+				}
+
+				place.Local = object.Local;
+
+				const int indexReg = index.Regs[0];
+				if (IsConstant(indexReg) || object.ElementCount > 1)
+				{
+					int element = 0;
+					if (!IsConstant(indexReg))
+						Error("indexing with more than one non-constant index is not supported", pExpr->SrcInfo);
+					else
+					{
+						element = int(mConstantValues[indexReg]);
+						if (element < 0 || element >= elementCount)
+						{
+							Error("index " + std::to_string(element) + " is out of bounds", pIndex->pIndex->SrcInfo);
+							element = 0;
+						}
+					}
+
+					place.Index = object.Index;
+					place.ElementCount = object.ElementCount;
+					for (auto k = 0; k < object.ElementCount; k++)
+					{
+						for (auto i = 0; i < stride; i++)
+							place.Regs.Add(object.Regs[k * objectCount + element * stride + i]);
+					}
+					return place;
+				}
+
+				place.Index = indexReg;
+				place.ElementCount = elementCount;
+				place.Regs = object.Regs;
+				return place;
+			}
+
+			default:
+			{
+				const IRValue value = LowerExpression(pExpr);
+				place.Regs = value.Regs;
+				return place;
+			}
+			}
+		}
+
+		HLSLLowering::IRValue HLSLLowering::ReadPlace(const IRPlace& place)
+		{
+			IRValue ret;
+			ret.Type = place.Type;
+			if (place.ElementCount == 1)
+			{
+				ret.Regs = place.Regs;
+				return ret;
+			}
+
+			// Select chain over the candidates, out of range indices read the first one
+			const int count = place.Regs.Size() / place.ElementCount;
+			Array<int> masks;
+			for (auto k = 1; k < place.ElementCount; k++)
+				masks.Add(EmitValue(IROpcode::IEq, place.Index, IntConstant(k)));
+
+			for (auto i = 0; i < count; i++)
+			{
+				int reg = place.Regs[i];
+				for (auto k = 1; k < place.ElementCount; k++)
+					reg = EmitValue(IROpcode::Select, masks[k - 1], place.Regs[k * count + i], reg);
+				ret.Regs.Add(reg);
+			}
+
+			return ret;
+		}
+
+		void HLSLLowering::WritePlace(const IRPlace& place, const IRValue& value)
+		{
+			const int count = value.Regs.Size();
+
+			// Sources overwritten before they are read go through temporaries, as in v = v.yx
+			Array<int> sources = value.Regs;
+			bool overlap = false;
+			for (auto i = 0; i < place.Regs.Size() && !overlap; i++)
+			{
+				for (auto j = 0; j < count; j++)
+				{
+					if (sources[j] == place.Regs[i] && (place.ElementCount > 1 || i != j))
+					{
+						overlap = true;
+						break;
+					}
+				}
+			}
+			if (overlap)
+			{
+				for (auto j = 0; j < count; j++)
+					sources[j] = EmitValue(IROpcode::Mov, sources[j]);
+			}
+
+			if (place.ElementCount == 1)
+			{
+				// Lanes outside the mask keep their values, except in locals written outside any branch or loop
+				// of their own function, which no masked lane reads again
+				const IROpcode op = place.Local && mFrames[mFrames.Size() - 1].Depth == 0 ? IROpcode::Mov : IROpcode::Store;
+				for (auto i = 0; i < count; i++)
+				{
+					if (place.Regs[i] != sources[i])
+						Emit(op, place.Regs[i], sources[i]);
+				}
+				return;
+			}
+
+			for (auto k = 0; k < place.ElementCount; k++)
+			{
+				const int mask = EmitValue(IROpcode::IEq, place.Index, IntConstant(k));
+				for (auto i = 0; i < count; i++)
+					Emit(IROpcode::StoreIf, place.Regs[k * count + i], sources[i], mask);
+			}
+		}
+
+		const Array<int>& HLSLLowering::VariableRegisters(const HLSLVariableDecl* pDecl)
+		{
+			auto it = mVariables.find(pDecl);
+			if (it != mVariables.end())
+				return it->second;
+
+			// Uniforms get registers when first read, unused ones need no binding
+			const int count = ComponentCount(pDecl->Type);
+			if (pDecl->Storage == HLSLStorage::Uniform || pDecl->Storage == HLSLStorage::CBuffer)
+			{
+				Array<int>& regs = mVariables[pDecl];
+				regs = NewRegisters(count, RegisterClass::Uniform);
+				if (count > 0)
+					mpProgram->Uniforms.Add(IRBinding(pDecl->Name, pDecl->Type, regs[0], count));
+				return regs;
+			}
+
+			Array<int>& regs = mVariables[pDecl];
+			regs = NewVariable(count);
+			return regs;
+		}
+
+		int HLSLLowering::TextureSlot(const HLSLExpression* pExpr)
+		{
+			if (pExpr->Kind != HLSLNodeKind::IdentifierExpression)
+			{
+				Error("textures must be referred to by name", pExpr->SrcInfo);
+				return 0;
+			}
+
+			const HLSLVariableDecl* pDecl = static_cast<const HLSLIdentifierExpression*>(pExpr)->pDecl;
+			auto it = mTextureSlots.find(pDecl);
+			if (it != mTextureSlots.end())
+				return it->second;
+
+			const int slot = mpProgram->Textures.Size();
+			mpProgram->Textures.Add(pDecl->Name);
+			mTextureSlots[pDecl] = slot;
+			return slot;
+		}
+
+		bool HLSLLowering::IsWritten(const HLSLVariableDecl* pDecl, const HLSLStatement* pStatement) const
+		{
+			if (!pStatement)
+				return false;
+
+			switch (pStatement->Kind)
+			{
+			case HLSLNodeKind::BlockStatement:
+			{
+				const HLSLBlockStatement* pBlock = static_cast<const HLSLBlockStatement*>(pStatement);
+				for (auto i = 0; i < pBlock->Statements.Size(); i++)
+				{
+					if (IsWritten(pDecl, pBlock->Statements[i]))
+						return true;
+				}
+				return false;
+			}
+
+			case HLSLNodeKind::DeclarationStatement:
+			{
+				const HLSLDeclarationStatement* pDeclaration = static_cast<const HLSLDeclarationStatement*>(pStatement);
+				for (auto i = 0; i < pDeclaration->Variables.Size(); i++)
+				{
+					if (pDeclaration->Variables[i]->pInit && IsWritten(pDecl, pDeclaration->Variables[i]->pInit))
+						return true;
+				}
+				return false;
+			}
+
+			case HLSLNodeKind::ExpressionStatement:
+				return IsWritten(pDecl, static_cast<const HLSLExpressionStatement*>(pStatement)->pExpression);
+
+			case HLSLNodeKind::IfStatement:
+			{
+				const HLSLIfStatement* pIf = static_cast<const HLSLIfStatement*>(pStatement);
+				return IsWritten(pDecl, pIf->pCondition) || IsWritten(pDecl, pIf->pThen) || IsWritten(pDecl, pIf->pElse);
+			}
+
+			case HLSLNodeKind::ForStatement:
+			{
+				const HLSLForStatement* pFor = static_cast<const HLSLForStatement*>(pStatement);
+				return IsWritten(pDecl, pFor->pInit) || (pFor->pCondition && IsWritten(pDecl, pFor->pCondition)) ||
+					(pFor->pIncrement && IsWritten(pDecl, pFor->pIncrement)) || IsWritten(pDecl, pFor->pBody);
+			}
+
+			case HLSLNodeKind::WhileStatement:
+			case HLSLNodeKind::DoWhileStatement:
+			{
+				const HLSLWhileStatement* pWhile = static_cast<const HLSLWhileStatement*>(pStatement);
+				return IsWritten(pDecl, pWhile->pCondition) || IsWritten(pDecl, pWhile->pBody);
+			}
+
+			case HLSLNodeKind::ReturnStatement:
+			{
+				const HLSLReturnStatement* pReturn = static_cast<const HLSLReturnStatement*>(pStatement);
+				return pReturn->pValue && IsWritten(pDecl, pReturn->pValue);
+			}
+
+			default:
+				return false;
+			}
+		}
+
+		bool HLSLLowering::IsWritten(const HLSLVariableDecl* pDecl, const HLSLExpression* pExpr) const
+		{
+			switch (pExpr->Kind)
+			{
+			case HLSLNodeKind::UnaryExpression:
+			{
+				const HLSLUnaryExpression* pUnary = static_cast<const HLSLUnaryExpression*>(pExpr);
+				const bool modifies = pUnary->Op >= HLSLUnaryOp::PreIncrement;
+				return (modifies && RootDecl(pUnary->pOperand) == pDecl) || IsWritten(pDecl, pUnary->pOperand);
+			}
+
+			case HLSLNodeKind::BinaryExpression:
+			{
+				const HLSLBinaryExpression* pBinary = static_cast<const HLSLBinaryExpression*>(pExpr);
+				return (IsAssignment(pBinary->Op) && RootDecl(pBinary->pLeft) == pDecl) || IsWritten(pDecl, pBinary->pLeft) || IsWritten(pDecl, pBinary->pRight);
+			}
+
+			case HLSLNodeKind::ConditionalExpression:
+			{
+				const HLSLConditionalExpression* pConditional = static_cast<const HLSLConditionalExpression*>(pExpr);
+				return IsWritten(pDecl, pConditional->pCondition) || IsWritten(pDecl, pConditional->pTrue) || IsWritten(pDecl, pConditional->pFalse);
+			}
+
+			case HLSLNodeKind::CastExpression:
+				return IsWritten(pDecl, static_cast<const HLSLCastExpression*>(pExpr)->pOperand);
+
+			case HLSLNodeKind::MemberExpression:
+				return IsWritten(pDecl, static_cast<const HLSLMemberExpression*>(pExpr)->pObject);
+
+			case HLSLNodeKind::IndexExpression:
+			{
+				const HLSLIndexExpression* pIndex = static_cast<const HLSLIndexExpression*>(pExpr);
+				return IsWritten(pDecl, pIndex->pObject) || IsWritten(pDecl, pIndex->pIndex);
+			}
+
+			case HLSLNodeKind::ConstructorExpression:
+			case HLSLNodeKind::CallExpression:
+			case HLSLNodeKind::MethodCallExpression:
+			{
+				const Array<HLSLExpression*>& arguments = pExpr->Kind == HLSLNodeKind::ConstructorExpression ? static_cast<const HLSLConstructorExpression*>(pExpr)->Arguments :
+					pExpr->Kind == HLSLNodeKind::CallExpression ? static_cast<const HLSLCallExpression*>(pExpr)->Arguments : static_cast<const HLSLMethodCallExpression*>(pExpr)->Arguments;
+
+				const HLSLFunctionDecl* pFunction = pExpr->Kind == HLSLNodeKind::CallExpression ? static_cast<const HLSLCallExpression*>(pExpr)->pFunction : nullptr;
+				for (auto i = 0; i < arguments.Size(); i++)
+				{
+					if (pFunction && pFunction->Parameters[i]->Modifier != HLSLParameterModifier::In && RootDecl(arguments[i]) == pDecl)
+						return true;
+					if (IsWritten(pDecl, arguments[i]))
+						return true;
+				}
+				return false;
+			}
+
+			default:
+				return false;
+			}
+		}
+
+		int HLSLLowering::NewRegister(const RegisterClass regClass)
+		{
+			mRegisterClasses.Add(regClass);
+			mConstantValues.Add(0);
+			mVariableRegs.Add(false);
+			return mRegisterClasses.Size() - 1;
+		}
+
+		Array<int> HLSLLowering::NewRegisters(const int count, const RegisterClass regClass)
+		{
+			Array<int> ret;
+			for (auto i = 0; i < count; i++)
+				ret.Add(NewRegister(regClass));
+			return ret;
+		}
+
+		Array<int> HLSLLowering::NewVariable(const int count)
+		{
+			Array<int> ret = NewRegisters(count);
+			for (auto i = 0; i < count; i++)
+				mVariableRegs[ret[i]] = true;
+			return ret;
+		}
+
+		Array<int> HLSLLowering::InitVariable(const IRValue& value)
+		{
+			// Temporaries nothing else refers to become the variable, anything else is copied. A fresh variable
+			// is written in full, the lanes outside the mask never read it
+			bool fresh = true;
+			for (auto i = 0; i < value.Regs.Size() && fresh; i++)
+			{
+				const int reg = value.Regs[i];
+				fresh = mRegisterClasses[reg] == RegisterClass::Temp && !mVariableRegs[reg];
+				for (auto j = 0; j < i && fresh; j++)
+					fresh = value.Regs[j] != reg;
+			}
+
+			if (fresh)
+			{
+				for (auto i = 0; i < value.Regs.Size(); i++)
+					mVariableRegs[value.Regs[i]] = true;
+				return value.Regs;
+			}
+
+			Array<int> ret = NewVariable(value.Regs.Size());
+			for (auto i = 0; i < value.Regs.Size(); i++)
+				Emit(IROpcode::Mov, ret[i], value.Regs[i]);
+			return ret;
+		}
+
+		int HLSLLowering::Constant(const uint bits)
+		{
+			auto it = mConstants.find(bits);
+			if (it != mConstants.end())
+				return it->second;
+
+			const int reg = NewRegister(RegisterClass::Constant);
+			mConstantValues[reg] = bits;
+			mConstants[bits] = reg;
+			return reg;
+		}
+
+		int HLSLLowering::FloatConstant(const float value)
+		{
+			uint bits;
+			memcpy(&bits, &value, sizeof(uint));
+			return Constant(bits);
+		}
+
+		int HLSLLowering::Emit(const IROpcode op, const int dst, const int src0, const int src1, const int src2, const int imm)
+		{
+			mCode.Add(IRInstruction(op, dst, src0, src1, src2, imm));
+			return mCode.Size() - 1;
+		}
+
+		int HLSLLowering::EmitValue(const IROpcode op, const int src0, const int src1, const int src2)
+		{
+			const int dst = NewRegister();
+			Emit(op, dst, src0, src1, src2);
+			return dst;
+		}
+
+		HLSLLowering::IRValue HLSLLowering::Undefined(const HLSLType& type)
+		{
+			IRValue ret;
+			ret.Type = type;
+
+			const int zero = IntConstant(0);
+			const int count = ComponentCount(type);
+			for (auto i = 0; i < count; i++)
+				ret.Regs.Add(zero);
+			return ret;
+		}
+
+		int HLSLLowering::ComponentCount(const HLSLType& type)
+		{
+			int count = 0;
+			if (type.Base == HLSLBaseType::Struct && type.pStruct)
+			{
+				for (auto i = 0; i < type.pStruct->Fields.Size(); i++)
+					count += ComponentCount(type.pStruct->Fields[i]->Type);
+			}
+			else if (type.Base >= HLSLBaseType::Bool && type.Base <= HLSLBaseType::Float)
+				count = type.Rows * type.Columns;
+
+			return type.IsArray() ? count * type.ArraySize : count;
+		}
+
+		bool HLSLLowering::HasEarlyReturn(const HLSLFunctionDecl* pFunction)
+		{
+			const Array<HLSLStatement*>& statements = pFunction->pBody->Statements;
+			for (auto i = 0; i < statements.Size(); i++)
+			{
+				const bool last = i == statements.Size() - 1;
+				if (last && statements[i]->Kind == HLSLNodeKind::ReturnStatement)
+					return false;
+				if (ContainsReturn(statements[i]))
+					return true;
+			}
+			return false;
+		}
+
+		string HLSLLowering::NormalizeSemantic(const string& semantic)
+		{
+			// Case insensitive, and index 0 is the same as no index
+			string ret = semantic;
+			for (auto& c : ret)
+				c = char(toupper(c));
+
+			const size_t length = ret.length();
+			if (length > 1 && ret[length - 1] == '0' && !isdigit(ret[length - 2]))
+				ret.erase(length - 1);
+
+			return ret;
+		}
+
+		void HLSLLowering::Error(const string& msg, const SourceInfo& srcInfo)
+		{
+			mpErrors->Add(CompileError(msg, srcInfo));
+		}
+	}
+}
\ No newline at end of file
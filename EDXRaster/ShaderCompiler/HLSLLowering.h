@@ -0,0 +1,155 @@
+#pragma once
+
+#include "EDXPrerequisites.h"
+#include "CompilerCommon.h"
+#include "HLSLAST.h"
+#include "ShaderIR.h"
+
+#include <unordered_map>
+
+namespace EDX
+{
+	namespace ShaderCompiler
+	{
+		// Lowers a type checked tree to scalar IR for one entry point. Every call is inlined, values are split
+		// into one register per component and control flow is kept structured for the lane masks
+		class HLSLLowering
+		{
+		private:
+			enum class RegisterClass
+			{
+				Constant,
+				Uniform,
+				Temp,
+			};
+
+			// Component registers of a value, not necessarily consecutive
+			struct IRValue
+			{
+				HLSLType Type;
+				Array<int> Regs;
+			};
+
+			// Storage an expression refers to. With a dynamic index the place has ElementCount candidates,
+			// candidate k owns Regs[k * components, (k + 1) * components) and is selected where Index equals k
+			struct IRPlace
+			{
+				HLSLType Type;
+				Array<int> Regs;
+				int Index;
+				int ElementCount;
+				bool Local;		// Locals and parameters of the function being lowered
+
+				IRPlace()
+					: Index(-1)
+					, ElementCount(1)
+					, Local(false)
+				{
+				}
+			};
+
+			// An inlined function
+			struct Frame
+			{
+				const HLSLFunctionDecl* pFunction;
+				Array<int> ReturnRegs;
+				bool EarlyReturn;	// Returns from anywhere but the end, the lanes that return are masked off
+				int Depth;			// Nesting of ifs and loops within the function
+
+				Frame()
+					: pFunction(nullptr)
+					, EarlyReturn(false)
+					, Depth(0)
+				{
+				}
+			};
+
+			const HLSLTree* mpTree;
+			IRProgram* mpProgram;
+			Array<CompileError>* mpErrors;
+			ShaderStage mStage;
+
+			Array<IRInstruction> mCode;
+			Array<RegisterClass> mRegisterClasses;
+			Array<uint> mConstantValues;	// Indexed by register, only meaningful for constants
+			Array<bool> mVariableRegs;		// Indexed by register, set where a variable lives
+			std::unordered_map<uint, int> mConstants;
+			std::unordered_map<const HLSLVariableDecl*, Array<int>> mVariables;
+			std::unordered_map<const HLSLVariableDecl*, int> mTextureSlots;
+
+			Array<Frame> mFrames;
+			Array<Array<int>> mPendingSkips;	// Jumps to the end of each open construct, patched when it closes
+			int mControlDepth;
+
+		public:
+			HLSLLowering()
+				: mpTree(nullptr)
+				, mpProgram(nullptr)
+				, mpErrors(nullptr)
+				, mStage(ShaderStage::Pixel)
+				, mControlDepth(0)
+			{
+			}
+
+			bool Lower(const HLSLTree& tree, const string& entryPoint, const ShaderStage stage, IRProgram& program, Array<CompileError>& errors);
+
+		private:
+			// Entry point interface
+			void BindEntryValues(const HLSLType& type, const string& semantic, const int firstReg, const SourceInfo& srcInfo, Array<IRBinding>& bindings);
+			void Finalize();
+
+			// Statements
+			void LowerStatement(const HLSLStatement* pStatement);
+			void LowerIf(const HLSLIfStatement* pIf);
+			void LowerLoop(const HLSLStatement* pLoop);
+			void LowerReturn(const HLSLReturnStatement* pReturn);
+			void EmitJump(const IROpcode op);
+			void OpenConstruct();
+			void CloseConstruct(const int target);
+			bool EnterControl(const SourceInfo& srcInfo);
+			void LeaveControl() { mControlDepth--; }
+
+			// Expressions
+			IRValue LowerExpression(const HLSLExpression* pExpr);
+			IRValue LowerUnary(const HLSLUnaryExpression* pUnary);
+			IRValue LowerBinary(const HLSLBinaryExpression* pBinary);
+			IRValue LowerCall(const HLSLCallExpression* pCall);
+			IRValue LowerIntrinsic(const HLSLCallExpression* pCall);
+			IRValue LowerMul(const IRValue& lhs, const IRValue& rhs, const HLSLType& resultType);
+			IRValue LowerSample(const HLSLMethodCallExpression* pCall);
+			IRValue Convert(const IRValue& value, const HLSLType& to);
+			int ConvertComponent(const int reg, const HLSLBaseType from, const HLSLBaseType to);
+			int BinaryComponent(const HLSLBinaryOp op, const HLSLBaseType base, const int lhs, const int rhs);
+			int Dot(const IRValue& lhs, const IRValue& rhs);
+
+			// Places
+			IRPlace LowerPlace(const HLSLExpression* pExpr);
+			IRValue ReadPlace(const IRPlace& place);
+			void WritePlace(const IRPlace& place, const IRValue& value);
+			const Array<int>& VariableRegisters(const HLSLVariableDecl* pDecl);
+			int TextureSlot(const HLSLExpression* pExpr);
+			bool IsWritten(const HLSLVariableDecl* pDecl, const HLSLStatement* pStatement) const;
+			bool IsWritten(const HLSLVariableDecl* pDecl, const HLSLExpression* pExpr) const;
+
+			// Registers and instructions
+			int NewRegister(const RegisterClass regClass = RegisterClass::Temp);
+			Array<int> NewRegisters(const int count, const RegisterClass regClass = RegisterClass::Temp);
+			Array<int> NewVariable(const int count);
+			Array<int> InitVariable(const IRValue& value);
+			int Constant(const uint bits);
+			int FloatConstant(const float value);
+			int IntConstant(const int value) { return Constant(uint(value)); }
+			bool IsConstant(const int reg) const { return mRegisterClasses[reg] == RegisterClass::Constant; }
+			int Emit(const IROpcode op, const int dst = -1, const int src0 = -1, const int src1 = -1, const int src2 = -1, const int imm = 0);
+			int EmitValue(const IROpcode op, const int src0, const int src1 = -1, const int src2 = -1);
+			IRValue Undefined(const HLSLType& type);
+
+			static int ComponentCount(const HLSLType& type);
+			static bool IsFloat(const HLSLBaseType base) { return base == HLSLBaseType::Float || base == HLSLBaseType::Half; }
+			static bool HasEarlyReturn(const HLSLFunctionDecl* pFunction);
+			static string NormalizeSemantic(const string& semantic);
+
+			void Error(const string& msg, const SourceInfo& srcInfo);
+		};
+	}
+}
\ No newline at end of file
@@ -0,0 +1,1149 @@
+#include "HLSLParser.h"
+#include "HLSLLexer.h"
+
+#include <stdlib.h>
+
+namespace EDX
+{
+	namespace ShaderCompiler
+	{
+		namespace
+		{
+			// Numeric type tokens come in groups of scalar, 4 vectors and 16 matrices per base type
+			const int NUMERIC_TYPE_GROUP_SIZE = 21;
+
+			bool IsNumericTypeToken(const HLSLTokenType type)
+			{
+				return type >= HLSLTokenType::Bool && type <= HLSLTokenType::Float4x4;
+			}
+
+			HLSLType NumericTypeFromToken(const HLSLTokenType type)
+			{
+				const int offset = int(type) - int(HLSLTokenType::Bool);
+				const HLSLBaseType base = HLSLBaseType(int(HLSLBaseType::Bool) + offset / NUMERIC_TYPE_GROUP_SIZE);
+				const int index = offset % NUMERIC_TYPE_GROUP_SIZE;
+
+				if (index == 0)
+					return HLSLType::Scalar(base);
+				if (index <= 4)
+					return HLSLType::Vector(base, index);
+
+				const int matrixIndex = index - 5;
+				return HLSLType::MatrixOf(base, matrixIndex % 4 + 1, matrixIndex / 4 + 1);
+			}
+
+			struct BinaryOperator
+			{
+				HLSLTokenType Token;
+				HLSLBinaryOp Op;
+				int Precedence;
+			};
+
+			const BinaryOperator BinaryOperators[] =
+			{
+				{ HLSLTokenType::OrOr, HLSLBinaryOp::LogicalOr, 1 },
+				{ HLSLTokenType::AndAnd, HLSLBinaryOp::LogicalAnd, 2 },
+				{ HLSLTokenType::Or, HLSLBinaryOp::BitOr, 3 },
+				{ HLSLTokenType::Xor, HLSLBinaryOp::BitXor, 4 },
+				{ HLSLTokenType::And, HLSLBinaryOp::BitAnd, 5 },
+				{ HLSLTokenType::EqualEqual, HLSLBinaryOp::Equal, 6 },
+				{ HLSLTokenType::NotEqual, HLSLBinaryOp::NotEqual, 6 },
+				{ HLSLTokenType::Lower, HLSLBinaryOp::Less, 7 },
+				{ HLSLTokenType::LowerEqual, HLSLBinaryOp::LessEqual, 7 },
+				{ HLSLTokenType::Greater, HLSLBinaryOp::Greater, 7 },
+				{ HLSLTokenType::GreaterEqual, HLSLBinaryOp::GreaterEqual, 7 },
+				{ HLSLTokenType::LowerLower, HLSLBinaryOp::ShiftLeft, 8 },
+				{ HLSLTokenType::GreaterGreater, HLSLBinaryOp::ShiftRight, 8 },
+				{ HLSLTokenType::Plus, HLSLBinaryOp::Add, 9 },
+				{ HLSLTokenType::Minus, HLSLBinaryOp::Sub, 9 },
+				{ HLSLTokenType::Times, HLSLBinaryOp::Mul, 10 },
+				{ HLSLTokenType::Div, HLSLBinaryOp::Div, 10 },
+				{ HLSLTokenType::Mod, HLSLBinaryOp::Mod, 10 },
+			};
+
+			const BinaryOperator AssignmentOperators[] =
+			{
+				{ HLSLTokenType::Equal, HLSLBinaryOp::Assign, 0 },
+				{ HLSLTokenType::PlusEqual, HLSLBinaryOp::AddAssign, 0 },
+				{ HLSLTokenType::MinusEqual, HLSLBinaryOp::SubAssign, 0 },
+				{ HLSLTokenType::TimesEqual, HLSLBinaryOp::MulAssign, 0 },
+				{ HLSLTokenType::DivEqual, HLSLBinaryOp::DivAssign, 0 },
+				{ HLSLTokenType::ModEqual, HLSLBinaryOp::ModAssign, 0 },
+				{ HLSLTokenType::AndEqual, HLSLBinaryOp::BitAndAssign, 0 },
+				{ HLSLTokenType::OrEqual, HLSLBinaryOp::BitOrAssign, 0 },
+				{ HLSLTokenType::XorEqual, HLSLBinaryOp::BitXorAssign, 0 },
+				{ HLSLTokenType::LowerLowerEqual, HLSLBinaryOp::ShiftLeftAssign, 0 },
+				{ HLSLTokenType::GreaterGreaterEqual, HLSLBinaryOp::ShiftRightAssign, 0 },
+			};
+		}
+
+		bool HLSLParser::Parse(const char* fileName, const string& source, HLSLTree& tree, Array<CompileError>& errors)
+		{
+			const int errorCount = errors.Size();
+
+			HLSLLexer lexer;
+			mTokens = lexer.Tokenize(fileName, source, errors);
+			mCurrent = 0;
+			mpTree = &tree;
+			mpErrors = &errors;
+			mRecovering = false;
+			mNestingDepth = 0;
+			mNestingOverflow = false;
+			mStructs.Clear();
+
+			while (!Check(HLSLTokenType::EndOfStream) && mpErrors->Size() - errorCount < MAX_ERROR_COUNT)
+			{
+				const int start = mCurrent;
+				ParseTopLevel();
+
+				if (mRecovering || mCurrent == start)
+				{
+					Synchronize();
+					if (mCurrent == start)
+						Advance();
+				}
+			}
+
+			mpTree = nullptr;
+			mpErrors = nullptr;
+
+			return errors.Size() == errorCount;
+		}
+
+		void HLSLParser::ParseTopLevel()
+		{
+			if (Accept(HLSLTokenType::Semicolon))
+				return;
+
+			if (Check(HLSLTokenType::Struct))
+			{
+				HLSLStructDecl* pStruct = ParseStruct();
+				if (pStruct && Expect(HLSLTokenType::Semicolon, ";"))
+					mpTree->Declarations.Add(pStruct);
+				return;
+			}
+
+			if (Check(HLSLTokenType::CBuffer))
+			{
+				HLSLCBufferDecl* pCBuffer = ParseCBuffer();
+				if (pCBuffer)
+				{
+					Accept(HLSLTokenType::Semicolon);
+					mpTree->Declarations.Add(pCBuffer);
+				}
+				return;
+			}
+
+			bool isStatic = false;
+			bool noInterpolation = false;
+			bool isConst = false;
+			for (;;)
+			{
+				if (Accept(HLSLTokenType::Static))
+					isStatic = true;
+				else if (Accept(HLSLTokenType::Const))
+					isConst = true;
+				else if (Accept(HLSLTokenType::NoInterpolation))
+					noInterpolation = true;
+				else if (!Accept(HLSLTokenType::Uniform) && !Accept(HLSLTokenType::RowMajor))
+					break;
+			}
+
+			HLSLType type;
+			if (!ParseType(type))
+				return;
+			type.Const = isConst;
+
+			if (!Check(HLSLTokenType::Identifier))
+			{
+				Error("expected an identifier after '" + type.ToString() + "'");
+				return;
+			}
+
+			if (Peek(1).Type == HLSLTokenType::LeftParenthesis)
+			{
+				const HLSLToken& nameToken = Advance();
+				HLSLFunctionDecl* pFunction = ParseFunction(type, nameToken);
+				if (pFunction)
+					mpTree->Declarations.Add(pFunction);
+				return;
+			}
+
+			HLSLStorage storage = HLSLStorage::Uniform;
+			if (type.IsTexture() || type.IsSampler())
+				storage = HLSLStorage::Resource;
+			else if (isStatic)
+				storage = HLSLStorage::Static;
+
+			Array<HLSLVariableDecl*> variables;
+			if (!ParseVariableDeclarators(type, storage, noInterpolation, variables) || !Expect(HLSLTokenType::Semicolon, ";"))
+				return;
+
+			for (auto i = 0; i < variables.Size(); i++)
+				mpTree->Declarations.Add(variables[i]);
+		}
+
+		HLSLStructDecl* HLSLParser::ParseStruct()
+		{
+			const SourceInfo srcInfo = Advance().SrcInfo;
+			if (!Check(HLSLTokenType::Identifier))
+			{
+				Error("expected a struct name");
+				return nullptr;
+			}
+
+			HLSLStructDecl* pStruct = mpTree->Create<HLSLStructDecl>(srcInfo);
+			pStruct->Name = Advance().Literal;
+			if (FindStruct(pStruct->Name))
+				Error("redefinition of struct '" + pStruct->Name + "'", srcInfo);
+
+			if (!Expect(HLSLTokenType::LeftBrace, "{"))
+				return nullptr;
+
+			while (!Check(HLSLTokenType::RightBrace) && !Check(HLSLTokenType::EndOfStream))
+			{
+				bool noInterpolation = false;
+				for (;;)
+				{
+					if (Accept(HLSLTokenType::NoInterpolation))
+						noInterpolation = true;
+					else if (!Accept(HLSLTokenType::RowMajor) && !Accept(HLSLTokenType::Const))
+						break;
+				}
+
+				HLSLType type;
+				if (!ParseType(type))
+					return nullptr;
+
+				Array<HLSLVariableDecl*> fields;
+				if (!ParseVariableDeclarators(type, HLSLStorage::Local, noInterpolation, fields) || !Expect(HLSLTokenType::Semicolon, ";"))
+					return nullptr;
+
+				for (auto i = 0; i < fields.Size(); i++)
+				{
+					if (fields[i]->pInit)
+						Error("struct fields cannot have initializers", fields[i]->SrcInfo);
+					if (pStruct->FindField(fields[i]->Name) >= 0)
+						Error("duplicate field '" + fields[i]->Name + "'", fields[i]->SrcInfo);
+					pStruct->Fields.Add(fields[i]);
+				}
+			}
+
+			if (!Expect(HLSLTokenType::RightBrace, "}"))
+				return nullptr;
+
+			mStructs.Add(pStruct);
+			return pStruct;
+		}
+
+		HLSLCBufferDecl* HLSLParser::ParseCBuffer()
+		{
+			const SourceInfo srcInfo = Advance().SrcInfo;
+			if (!Check(HLSLTokenType::Identifier))
+			{
+				Error("expected a cbuffer name");
+				return nullptr;
+			}
+
+			HLSLCBufferDecl* pCBuffer = mpTree->Create<HLSLCBufferDecl>(srcInfo);
+			pCBuffer->Name = Advance().Literal;
+
+			string semantic;
+			if (Check(HLSLTokenType::Colon) && !ParseSemantic(semantic, &pCBuffer->Register))
+				return nullptr;
+
+			if (!Expect(HLSLTokenType::LeftBrace, "{"))
+				return nullptr;
+
+			while (!Check(HLSLTokenType::RightBrace) && !Check(HLSLTokenType::EndOfStream))
+			{
+				while (Accept(HLSLTokenType::RowMajor) || Accept(HLSLTokenType::Uniform))
+				{
+				}
+
+				HLSLType type;
+				if (!ParseType(type))
+					return nullptr;
+
+				Array<HLSLVariableDecl*> members;
+				if (!ParseVariableDeclarators(type, HLSLStorage::CBuffer, false, members) || !Expect(HLSLTokenType::Semicolon, ";"))
+					return nullptr;
+
+				for (auto i = 0; i < members.Size(); i++)
+				{
+					if (members[i]->pInit)
+						Error("cbuffer members cannot have initializers", members[i]->SrcInfo);
+					if (!members[i]->Type.IsNumeric() && !(members[i]->Type.IsArray() && members[i]->Type.ElementType().IsNumeric()) && !members[i]->Type.IsStruct())
+						Error("cbuffer members must be numeric or struct types", members[i]->SrcInfo);
+
+					members[i]->pCBuffer = pCBuffer;
+					pCBuffer->Members.Add(members[i]);
+				}
+			}
+
+			if (!Expect(HLSLTokenType::RightBrace, "}"))
+				return nullptr;
+
+			return pCBuffer;
+		}
+
+		HLSLFunctionDecl* HLSLParser::ParseFunction(const HLSLType& returnType, const HLSLToken& nameToken)
+		{
+			HLSLFunctionDecl* pFunction = mpTree->Create<HLSLFunctionDecl>(nameToken.SrcInfo);
+			pFunction->Name = nameToken.Literal;
+			pFunction->ReturnType = returnType;
+
+			Expect(HLSLTokenType::LeftParenthesis, "(");
+			if (Check(HLSLTokenType::Void) && Peek(1).Type == HLSLTokenType::RightParenthesis)
+				Advance();
+
+			if (!Check(HLSLTokenType::RightParenthesis))
+			{
+				do
+				{
+					HLSLParameterModifier modifier = HLSLParameterModifier::In;
+					bool noInterpolation = false;
+					for (;;)
+					{
+						if (Accept(HLSLTokenType::Out))
+							modifier = HLSLParameterModifier::Out;
+						else if (Accept(HLSLTokenType::InOut))
+							modifier = HLSLParameterModifier::InOut;
+						else if (Accept(HLSLTokenType::NoInterpolation))
+							noInterpolation = true;
+						else if (!Accept(HLSLTokenType::In) && !Accept(HLSLTokenType::Const) && !Accept(HLSLTokenType::Uniform))
+							break;
+					}
+
+					HLSLType type;
+					if (!ParseType(type))
+						return nullptr;
+
+					if (!Check(HLSLTokenType::Identifier))
+					{
+						Error("expected a parameter name");
+						return nullptr;
+					}
+
+					HLSLVariableDecl* pParam = mpTree->Create<HLSLVariableDecl>(Peek().SrcInfo);
+					pParam->Name = Advance().Literal;
+					pParam->Storage = HLSLStorage::Parameter;
+					pParam->Modifier = modifier;
+					pParam->NoInterpolation = noInterpolation;
+					if (!ParseArraySize(type))
+						return nullptr;
+					pParam->Type = type;
+
+					if (Check(HLSLTokenType::Colon) && !ParseSemantic(pParam->Semantic))
+						return nullptr;
+
+					if (Check(HLSLTokenType::Equal))
+					{
+						Error("default parameter values are not supported");
+						return nullptr;
+					}
+
+					pFunction->Parameters.Add(pParam);
+				} while (Accept(HLSLTokenType::Comma));
+			}
+
+			if (!Expect(HLSLTokenType::RightParenthesis, ")"))
+				return nullptr;
+
+			if (Check(HLSLTokenType::Colon) && !ParseSemantic(pFunction->Semantic))
+				return nullptr;
+
+			// Prototypes are dropped, the type checker sees every function before checking any body
+			if (Accept(HLSLTokenType::Semicolon))
+				return nullptr;
+
+			pFunction->pBody = ParseBlock();
+			if (!pFunction->pBody)
+				return nullptr;
+
+			return pFunction;
+		}
+
+		bool HLSLParser::ParseVariableDeclarators(const HLSLType& type, const HLSLStorage storage, const bool noInterpolation, Array<HLSLVariableDecl*>& variables)
+		{
+			do
+			{
+				if (!Check(HLSLTokenType::Identifier))
+				{
+					Error("expected a variable name");
+					return false;
+				}
+
+				HLSLVariableDecl* pVariable = mpTree->Create<HLSLVariableDecl>(Peek().SrcInfo);
+				pVariable->Name = Advance().Literal;
+				pVariable->Storage = storage;
+				pVariable->NoInterpolation = noInterpolation;
+
+				HLSLType variableType = type;
+				if (!ParseArraySize(variableType))
+					return false;
+				pVariable->Type = variableType;
+
+				if (Check(HLSLTokenType::Colon) && !ParseSemantic(pVariable->Semantic))
+					return false;
+
+				if (Accept(HLSLTokenType::Equal))
+				{
+					if (Check(HLSLTokenType::LeftBrace))
+					{
+						Error("initializer lists are not supported");
+						return false;
+					}
+
+					pVariable->pInit = ParseExpression();
+					if (!pVariable->pInit)
+						return false;
+				}
+
+				variables.Add(pVariable);
+			} while (Accept(HLSLTokenType::Comma));
+
+			return true;
+		}
+
+		bool HLSLParser::IsTypeStart(const int offset) const
+		{
+			const HLSLTokenType type = Peek(offset).Type;
+			if (IsNumericTypeToken(type) || type == HLSLTokenType::Void)
+				return true;
+			if (type >= HLSLTokenType::Texture && type <= HLSLTokenType::OutputPatch)
+				return true;
+
+			return type == HLSLTokenType::Identifier && FindStruct(Peek(offset).Literal) != nullptr;
+		}
+
+		bool HLSLParser::IsDeclarationStart() const
+		{
+			const HLSLTokenType type = Peek().Type;
+			if (type == HLSLTokenType::Const || type == HLSLTokenType::Static || type == HLSLTokenType::Struct)
+				return true;
+
+			// A type followed by a name, float3(...) on its own is a constructor expression
+			return IsTypeStart() && Peek(1).Type == HLSLTokenType::Identifier;
+		}
+
+		bool HLSLParser::ParseType(HLSLType& type)
+		{
+			const HLSLToken& token = Peek();
+
+			if (IsNumericTypeToken(token.Type))
+			{
+				Advance();
+				type = NumericTypeFromToken(token.Type);
+				return true;
+			}
+
+			switch (token.Type)
+			{
+			case HLSLTokenType::Void:
+				Advance();
+				type = HLSLType(HLSLBaseType::Void);
+				return true;
+
+			case HLSLTokenType::Texture:
+			case HLSLTokenType::Texture2D:
+			case HLSLTokenType::TextureCube:
+				Advance();
+				type = HLSLType(token.Type == HLSLTokenType::TextureCube ? HLSLBaseType::TextureCube : HLSLBaseType::Texture2D);
+
+				// Texture2D<float4>, textures always sample as float4
+				if (Accept(HLSLTokenType::Lower))
+				{
+					HLSLType elementType;
+					if (!ParseType(elementType))
+						return false;
+					if (!elementType.IsNumeric() || elementType.IsMatrix() || !elementType.IsFloatingPoint())
+						Error("texture element type must be a float scalar or vector", token.SrcInfo);
+
+					if (!Expect(HLSLTokenType::Greater, ">"))
+						return false;
+				}
+				return true;
+
+			case HLSLTokenType::Sampler:
+			case HLSLTokenType::Sampler2D:
+			case HLSLTokenType::SamplerState:
+				Advance();
+				type = HLSLType(HLSLBaseType::SamplerState);
+				return true;
+
+			case HLSLTokenType::Identifier:
+			{
+				const HLSLStructDecl* pStruct = FindStruct(token.Literal);
+				if (pStruct)
+				{
+					Advance();
+					type = HLSLType(HLSLBaseType::Struct);
+					type.pStruct = pStruct;
+					return true;
+				}
+
+				Error("unknown type '" + token.Literal + "'");
+				return false;
+			}
+
+			default:
+				break;
+			}
+
+			if (token.Type >= HLSLTokenType::Texture && token.Type <= HLSLTokenType::OutputPatch)
+				Error("type '" + token.Literal + "' is not supported");
+			else
+				Error("expected a type, found '" + token.Literal + "'");
+
+			return false;
+		}
+
+		bool HLSLParser::ParseArraySize(HLSLType& type)
+		{
+			if (!Accept(HLSLTokenType::LeftSquareBracket))
+				return true;
+
+			if (!Check(HLSLTokenType::UnsignedIntegerConstant))
+			{
+				Error("array sizes must be integer literals");
+				return false;
+			}
+
+			const HLSLToken& sizeToken = Advance();
+			const long size = strtol(sizeToken.Literal.c_str(), nullptr, 0);
+			if (size <= 0 || size > 4096)
+				Error("invalid array size '" + sizeToken.Literal + "'", sizeToken.SrcInfo);
+			if (type.IsVoid())
+				Error("arrays of void are not allowed", sizeToken.SrcInfo);
+
+			type.ArraySize = size > 0 ? int(size) : 1;
+
+			if (Check(HLSLTokenType::LeftSquareBracket))
+			{
+				Error("multidimensional arrays are not supported");
+				return false;
+			}
+
+			return Expect(HLSLTokenType::RightSquareBracket, "]");
+		}
+
+		bool HLSLParser::ParseSemantic(string& semantic, string* pRegister)
+		{
+			Expect(HLSLTokenType::Colon, ":");
+
+			if (!Check(HLSLTokenType::Identifier))
+			{
+				Error("expected a semantic");
+				return false;
+			}
+
+			const HLSLToken& token = Advance();
+			if (token.Literal == "register" || token.Literal == "packoffset")
+			{
+				// Binding locations do not matter to the software pipeline beyond the cbuffer register
+				if (!Expect(HLSLTokenType::LeftParenthesis, "("))
+					return false;
+
+				string location;
+				while (!Check(HLSLTokenType::RightParenthesis) && !Check(HLSLTokenType::EndOfStream))
+					location += Advance().Literal;
+
+				if (pRegister && token.Literal == "register")
+					*pRegister = location;
+
+				return Expect(HLSLTokenType::RightParenthesis, ")");
+			}
+
+			semantic = token.Literal;
+			return true;
+		}
+
+		const HLSLStructDecl* HLSLParser::FindStruct(const string& name) const
+		{
+			for (auto i = 0; i < mStructs.Size(); i++)
+			{
+				if (mStructs[i]->Name == name)
+					return mStructs[i];
+			}
+			return nullptr;
+		}
+
+		HLSLBlockStatement* HLSLParser::ParseBlock()
+		{
+			const NestingScope nesting(*this);
+			if (NestingTooDeep())
+				return nullptr;
+
+			const SourceInfo srcInfo = Peek().SrcInfo;
+			if (!Expect(HLSLTokenType::LeftBrace, "{"))
+				return nullptr;
+
+			HLSLBlockStatement* pBlock = mpTree->Create<HLSLBlockStatement>(srcInfo);
+			while (!Check(HLSLTokenType::RightBrace) && !Check(HLSLTokenType::EndOfStream))
+			{
+				const int start = mCurrent;
+				HLSLStatement* pStatement = ParseStatement();
+				if (pStatement)
+					pBlock->Statements.Add(pStatement);
+
+				if (!pStatement || mRecovering)
+				{
+					Synchronize();
+					if (mCurrent == start)
+						Advance();
+				}
+			}
+
+			if (!Expect(HLSLTokenType::RightBrace, "}"))
+				return nullptr;
+
+			return pBlock;
+		}
+
+		HLSLStatement* HLSLParser::ParseStatement()
+		{
+			const NestingScope nesting(*this);
+			if (NestingTooDeep())
+				return nullptr;
+
+			// Attributes like [unroll] or [branch] are hints the software pipeline has no use for
+			while (Check(HLSLTokenType::LeftSquareBracket))
+			{
+				while (!Check(HLSLTokenType::RightSquareBracket) && !Check(HLSLTokenType::EndOfStream))
+					Advance();
+				Expect(HLSLTokenType::RightSquareBracket, "]");
+			}
+
+			const HLSLToken& token = Peek();
+			const SourceInfo srcInfo = token.SrcInfo;
+
+			switch (token.Type)
+			{
+			case HLSLTokenType::LeftBrace:
+				return ParseBlock();
+
+			case HLSLTokenType::Semicolon:
+				Advance();
+				return mpTree->Create<HLSLBlockStatement>(srcInfo);
+
+			case HLSLTokenType::If:
+			{
+				Advance();
+				HLSLIfStatement* pIf = mpTree->Create<HLSLIfStatement>(srcInfo);
+				if (!Expect(HLSLTokenType::LeftParenthesis, "(") || !(pIf->pCondition = ParseExpression()) || !Expect(HLSLTokenType::RightParenthesis, ")"))
+					return nullptr;
+				if (!(pIf->pThen = ParseStatement()))
+					return nullptr;
+				if (Accept(HLSLTokenType::Else) && !(pIf->pElse = ParseStatement()))
+					return nullptr;
+				return pIf;
+			}
+
+			case HLSLTokenType::For:
+			{
+				Advance();
+				HLSLForStatement* pFor = mpTree->Create<HLSLForStatement>(srcInfo);
+				if (!Expect(HLSLTokenType::LeftParenthesis, "("))
+					return nullptr;
+
+				if (!Accept(HLSLTokenType::Semicolon))
+				{
+					if (IsDeclarationStart())
+						pFor->pInit = ParseDeclarationStatement();
+					else
+					{
+						HLSLExpressionStatement* pInit = mpTree->Create<HLSLExpressionStatement>(Peek().SrcInfo);
+						pInit->pExpression = ParseExpression();
+						if (pInit->pExpression && Expect(HLSLTokenType::Semicolon, ";"))
+							pFor->pInit = pInit;
+					}
+					if (!pFor->pInit)
+						return nullptr;
+				}
+
+				if (!Check(HLSLTokenType::Semicolon) && !(pFor->pCondition = ParseExpression()))
+					return nullptr;
+				if (!Expect(HLSLTokenType::Semicolon, ";"))
+					return nullptr;
+
+				if (!Check(HLSLTokenType::RightParenthesis) && !(pFor->pIncrement = ParseExpression()))
+					return nullptr;
+				if (!Expect(HLSLTokenType::RightParenthesis, ")"))
+					return nullptr;
+
+				if (!(pFor->pBody = ParseStatement()))
+					return nullptr;
+				return pFor;
+			}
+
+			case HLSLTokenType::While:
+			{
+				Advance();
+				HLSLWhileStatement* pWhile = mpTree->Create<HLSLWhileStatement>(srcInfo);
+				if (!Expect(HLSLTokenType::LeftParenthesis, "(") || !(pWhile->pCondition = ParseExpression()) || !Expect(HLSLTokenType::RightParenthesis, ")"))
+					return nullptr;
+				if (!(pWhile->pBody = ParseStatement()))
+					return nullptr;
+				return pWhile;
+			}
+
+			case HLSLTokenType::Do:
+			{
+				Advance();
+				HLSLWhileStatement* pDo = mpTree->Create<HLSLWhileStatement>(srcInfo);
+				pDo->Kind = HLSLNodeKind::DoWhileStatement;
+				if (!(pDo->pBody = ParseStatement()))
+					return nullptr;
+				if (!Expect(HLSLTokenType::While, "while") || !Expect(HLSLTokenType::LeftParenthesis, "(") ||
+					!(pDo->pCondition = ParseExpression()) || !Expect(HLSLTokenType::RightParenthesis, ")") || !Expect(HLSLTokenType::Semicolon, ";"))
+					return nullptr;
+				return pDo;
+			}
+
+			case HLSLTokenType::Return:
+			{
+				Advance();
+				HLSLReturnStatement* pReturn = mpTree->Create<HLSLReturnStatement>(srcInfo);
+				if (!Check(HLSLTokenType::Semicolon) && !(pReturn->pValue = ParseExpression()))
+					return nullptr;
+				if (!Expect(HLSLTokenType::Semicolon, ";"))
+					return nullptr;
+				return pReturn;
+			}
+
+			case HLSLTokenType::Break:
+			case HLSLTokenType::Continue:
+			case HLSLTokenType::Discard:
+			{
+				Advance();
+				const HLSLNodeKind kind = token.Type == HLSLTokenType::Break ? HLSLNodeKind::BreakStatement :
+					token.Type == HLSLTokenType::Continue ? HLSLNodeKind::ContinueStatement : HLSLNodeKind::DiscardStatement;
+				HLSLJumpStatement* pJump = mpTree->Create<HLSLJumpStatement>(srcInfo);
+				pJump->Kind = kind;
+				if (!Expect(HLSLTokenType::Semicolon, ";"))
+					return nullptr;
+				return pJump;
+			}
+
+			case HLSLTokenType::Switch:
+			case HLSLTokenType::Goto:
+				Error("'" + token.Literal + "' statements are not supported");
+				return nullptr;
+
+			default:
+				break;
+			}
+
+			if (IsDeclarationStart())
+				return ParseDeclarationStatement();
+
+			HLSLExpressionStatement* pStatement = mpTree->Create<HLSLExpressionStatement>(srcInfo);
+			pStatement->pExpression = ParseExpression();
+			if (!pStatement->pExpression || !Expect(HLSLTokenType::Semicolon, ";"))
+				return nullptr;
+
+			return pStatement;
+		}
+
+		HLSLStatement* HLSLParser::ParseDeclarationStatement()
+		{
+			const SourceInfo srcInfo = Peek().SrcInfo;
+
+			bool isConst = false;
+			for (;;)
+			{
+				if (Accept(HLSLTokenType::Const))
+					isConst = true;
+				else if (Check(HLSLTokenType::Struct))
+				{
+					Error("local struct declarations are not supported");
+					return nullptr;
+				}
+				else if (!Accept(HLSLTokenType::Static))
+					break;
+			}
+
+			HLSLType type;
+			if (!ParseType(type))
+				return nullptr;
+			type.Const = isConst;
+
+			HLSLDeclarationStatement* pDeclaration = mpTree->Create<HLSLDeclarationStatement>(srcInfo);
+			if (!ParseVariableDeclarators(type, HLSLStorage::Local, false, pDeclaration->Variables) || !Expect(HLSLTokenType::Semicolon, ";"))
+				return nullptr;
+
+			return pDeclaration;
+		}
+
+		HLSLExpression* HLSLParser::ParseExpression()
+		{
+			const NestingScope nesting(*this);
+			if (NestingTooDeep())
+				return nullptr;
+
+			HLSLExpression* pLeft = ParseConditional();
+			if (!pLeft)
+				return nullptr;
+
+			// Assignments are right associative
+			for (const auto& op : AssignmentOperators)
+			{
+				if (Check(op.Token))
+				{
+					HLSLBinaryExpression* pAssign = mpTree->Create<HLSLBinaryExpression>(Advance().SrcInfo);
+					pAssign->Op = op.Op;
+					pAssign->pLeft = pLeft;
+					pAssign->pRight = ParseExpression();
+					if (!pAssign->pRight)
+						return nullptr;
+
+					return pAssign;
+				}
+			}
+
+			return pLeft;
+		}
+
+		HLSLExpression* HLSLParser::ParseConditional()
+		{
+			const NestingScope nesting(*this);
+			if (NestingTooDeep())
+				return nullptr;
+
+			HLSLExpression* pCondition = ParseBinary(1);
+			if (!pCondition || !Check(HLSLTokenType::Question))
+				return pCondition;
+
+			HLSLConditionalExpression* pConditional = mpTree->Create<HLSLConditionalExpression>(Advance().SrcInfo);
+			pConditional->pCondition = pCondition;
+			if (!(pConditional->pTrue = ParseExpression()) || !Expect(HLSLTokenType::Colon, ":") || !(pConditional->pFalse = ParseConditional()))
+				return nullptr;
+
+			return pConditional;
+		}
+
+		HLSLExpression* HLSLParser::ParseBinary(const int minPrecedence)
+		{
+			HLSLExpression* pLeft = ParseUnary();
+			if (!pLeft)
+				return nullptr;
+
+			for (;;)
+			{
+				const BinaryOperator* pOperator = nullptr;
+				for (const auto& op : BinaryOperators)
+				{
+					if (Check(op.Token) && op.Precedence >= minPrecedence)
+					{
+						pOperator = &op;
+						break;
+					}
+				}
+
+				if (!pOperator)
+					return pLeft;
+
+				HLSLBinaryExpression* pBinary = mpTree->Create<HLSLBinaryExpression>(Advance().SrcInfo);
+				pBinary->Op = pOperator->Op;
+				pBinary->pLeft = pLeft;
+				pBinary->pRight = ParseBinary(pOperator->Precedence + 1);
+				if (!pBinary->pRight)
+					return nullptr;
+
+				pLeft = pBinary;
+			}
+		}
+
+		HLSLExpression* HLSLParser::ParseUnary()
+		{
+			const NestingScope nesting(*this);
+			if (NestingTooDeep())
+				return nullptr;
+
+			HLSLUnaryOp op;
+			switch (Peek().Type)
+			{
+			case HLSLTokenType::Minus: op = HLSLUnaryOp::Negate; break;
+			case HLSLTokenType::Plus: op = HLSLUnaryOp::Plus; break;
+			case HLSLTokenType::Not: op = HLSLUnaryOp::LogicalNot; break;
+			case HLSLTokenType::Neg: op = HLSLUnaryOp::BitNot; break;
+			case HLSLTokenType::PlusPlus: op = HLSLUnaryOp::PreIncrement; break;
+			case HLSLTokenType::MinusMinus: op = HLSLUnaryOp::PreDecrement; break;
+			default:
+				return ParsePostfix(ParsePrimary());
+			}
+
+			HLSLUnaryExpression* pUnary = mpTree->Create<HLSLUnaryExpression>(Advance().SrcInfo);
+			pUnary->Op = op;
+			pUnary->pOperand = ParseUnary();
+			if (!pUnary->pOperand)
+				return nullptr;
+
+			return pUnary;
+		}
+
+		HLSLExpression* HLSLParser::ParsePostfix(HLSLExpression* pExpr)
+		{
+			while (pExpr)
+			{
+				const SourceInfo srcInfo = Peek().SrcInfo;
+
+				if (Accept(HLSLTokenType::Dot))
+				{
+					if (!Check(HLSLTokenType::Identifier))
+					{
+						Error("expected a member name after '.'");
+						return nullptr;
+					}
+					const string name = Advance().Literal;
+
+					if (Check(HLSLTokenType::LeftParenthesis))
+					{
+						HLSLMethodCallExpression* pCall = mpTree->Create<HLSLMethodCallExpression>(srcInfo);
+						pCall->pObject = pExpr;
+						pCall->Name = name;
+						if (!ParseArguments(pCall->Arguments))
+							return nullptr;
+						pExpr = pCall;
+					}
+					else
+					{
+						HLSLMemberExpression* pMember = mpTree->Create<HLSLMemberExpression>(srcInfo);
+						pMember->pObject = pExpr;
+						pMember->Member = name;
+						pExpr = pMember;
+					}
+				}
+				else if (Accept(HLSLTokenType::LeftSquareBracket))
+				{
+					HLSLIndexExpression* pIndex = mpTree->Create<HLSLIndexExpression>(srcInfo);
+					pIndex->pObject = pExpr;
+					if (!(pIndex->pIndex = ParseExpression()) || !Expect(HLSLTokenType::RightSquareBracket, "]"))
+						return nullptr;
+					pExpr = pIndex;
+				}
+				else if (Check(HLSLTokenType::PlusPlus) || Check(HLSLTokenType::MinusMinus))
+				{
+					HLSLUnaryExpression* pUnary = mpTree->Create<HLSLUnaryExpression>(srcInfo);
+					pUnary->Op = Advance().Type == HLSLTokenType::PlusPlus ? HLSLUnaryOp::PostIncrement : HLSLUnaryOp::PostDecrement;
+					pUnary->pOperand = pExpr;
+					pExpr = pUnary;
+				}
+				else
+					break;
+			}
+
+			return pExpr;
+		}
+
+		HLSLExpression* HLSLParser::ParsePrimary()
+		{
+			const NestingScope nesting(*this);
+			if (NestingTooDeep())
+				return nullptr;
+
+			const HLSLToken& token = Peek();
+			const SourceInfo srcInfo = token.SrcInfo;
+
+			switch (token.Type)
+			{
+			case HLSLTokenType::FloatConstant:
+			case HLSLTokenType::UnsignedIntegerConstant:
+			case HLSLTokenType::BoolConstant:
+				return ParseLiteral();
+
+			case HLSLTokenType::Identifier:
+			{
+				if (FindStruct(token.Literal))
+				{
+					Error("unexpected type name '" + token.Literal + "'");
+					return nullptr;
+				}
+
+				const string name = Advance().Literal;
+				if (Check(HLSLTokenType::LeftParenthesis))
+				{
+					HLSLCallExpression* pCall = mpTree->Create<HLSLCallExpression>(srcInfo);
+					pCall->Name = name;
+					if (!ParseArguments(pCall->Arguments))
+						return nullptr;
+					return pCall;
+				}
+
+				HLSLIdentifierExpression* pIdentifier = mpTree->Create<HLSLIdentifierExpression>(srcInfo);
+				pIdentifier->Name = name;
+				return pIdentifier;
+			}
+
+			case HLSLTokenType::LeftParenthesis:
+			{
+				Advance();
+
+				// (type)expr casts, telling a struct name from a variable needs the declared structs
+				if (IsTypeStart())
+				{
+					HLSLCastExpression* pCast = mpTree->Create<HLSLCastExpression>(srcInfo);
+					if (!ParseType(pCast->Type) || !ParseArraySize(pCast->Type) || !Expect(HLSLTokenType::RightParenthesis, ")"))
+						return nullptr;
+					if (!(pCast->pOperand = ParseUnary()))
+						return nullptr;
+					return pCast;
+				}
+
+				HLSLExpression* pExpr = ParseExpression();
+				if (!pExpr || !Expect(HLSLTokenType::RightParenthesis, ")"))
+					return nullptr;
+				return pExpr;
+			}
+
+			default:
+				break;
+			}
+
+			if (IsNumericTypeToken(token.Type))
+			{
+				HLSLConstructorExpression* pConstructor = mpTree->Create<HLSLConstructorExpression>(srcInfo);
+				ParseType(pConstructor->Type);
+				if (!Check(HLSLTokenType::LeftParenthesis))
+				{
+					Error("expected '(' after '" + pConstructor->Type.ToString() + "'");
+					return nullptr;
+				}
+				if (!ParseArguments(pConstructor->Arguments))
+					return nullptr;
+				return pConstructor;
+			}
+
+			if (token.Type == HLSLTokenType::EndOfStream)
+				Error("unexpected end of file");
+			else
+				Error("expected an expression, found '" + token.Literal + "'");
+
+			return nullptr;
+		}
+
+		HLSLExpression* HLSLParser::ParseLiteral()
+		{
+			const HLSLToken& token = Advance();
+			HLSLLiteralExpression* pLiteral = mpTree->Create<HLSLLiteralExpression>(token.SrcInfo);
+
+			switch (token.Type)
+			{
+			case HLSLTokenType::FloatConstant:
+				pLiteral->LiteralType = HLSLBaseType::Float;
+				pLiteral->FloatValue = float(strtod(token.Literal.c_str(), nullptr));
+				break;
+
+			case HLSLTokenType::UnsignedIntegerConstant:
+			{
+				// Integer literals are int unless they carry a u suffix
+				const unsigned long long value = strtoull(token.Literal.c_str(), nullptr, 0);
+				if (value > 0xffffffffULL)
+					Error("integer literal '" + token.Literal + "' is too large", token.SrcInfo);
+
+				const char suffix = token.Literal[token.Literal.length() - 1];
+				pLiteral->LiteralType = suffix == 'u' ? HLSLBaseType::Uint : HLSLBaseType::Int;
+				pLiteral->IntValue = int(uint(value));
+				break;
+			}
+
+			default:
+				pLiteral->LiteralType = HLSLBaseType::Bool;
+				pLiteral->IntValue = token.Literal == "true" ? 1 : 0;
+				break;
+			}
+
+			return pLiteral;
+		}
+
+		bool HLSLParser::ParseArguments(Array<HLSLExpression*>& arguments)
+		{
+			if (!Expect(HLSLTokenType::LeftParenthesis, "("))
+				return false;
+
+			if (Accept(HLSLTokenType::RightParenthesis))
+				return true;
+
+			do
+			{
+				HLSLExpression* pArgument = ParseExpression();
+				if (!pArgument)
+					return false;
+
+				arguments.Add(pArgument);
+			} while (Accept(HLSLTokenType::Comma));
+
+			return Expect(HLSLTokenType::RightParenthesis, ")");
+		}
+
+		bool HLSLParser::Expect(const HLSLTokenType type, const char* text)
+		{
+			if (Accept(type))
+				return true;
+
+			const HLSLToken& token = Peek();
+			if (token.Type == HLSLTokenType::EndOfStream)
+				Error(string("expected '") + text + "' before end of file");
+			else
+				Error(string("expected '") + text + "', found '" + token.Literal + "'");
+
+			return false;
+		}
+
+		void HLSLParser::Error(const string& msg, const SourceInfo& srcInfo)
+		{
+			// Only the first error of a broken construct is reported, the rest tend to be noise. Past a nesting
+			// overflow the input was skipped, so the blocks it leaves unclosed are not reported either
+			if (mRecovering || mNestingOverflow)
+				return;
+
+			mpErrors->Add(CompileError(msg, srcInfo));
+			mRecovering = true;
+		}
+
+		bool HLSLParser::NestingTooDeep()
+		{
+			if (mNestingDepth <= MAX_NESTING_DEPTH)
+				return false;
+
+			Error("code is nested too deeply");
+			mNestingOverflow = true;
+
+			// Nothing after this can be parsed within the limit, jumping to the end unwinds every level at once
+			mCurrent = mTokens.Size() - 1;
+			return true;
+		}
+
+		void HLSLParser::Synchronize()
+		{
+			int depth = 0;
+			while (!Check(HLSLTokenType::EndOfStream))
+			{
+				const HLSLTokenType type = Peek().Type;
+				if (type == HLSLTokenType::LeftBrace)
+					depth++;
+				else if (type == HLSLTokenType::RightBrace)
+				{
+					// The end of the enclosing block is left for its parser
+					if (depth == 0)
+						break;
+
+					Advance();
+					if (--depth == 0)
+						break;
+					continue;
+				}
+				else if (type == HLSLTokenType::Semicolon && depth == 0)
+				{
+					Advance();
+					break;
+				}
+
+				Advance();
+			}
+
+			mRecovering = false;
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,130 @@
+#pragma once
+
+#include "EDXPrerequisites.h"
+#include "CompilerCommon.h"
+#include "HLSLAST.h"
+
+namespace EDX
+{
+	namespace ShaderCompiler
+	{
+		// Recursive descent parser for the HLSL subset the rasterizer shaders use. Produces an untyped tree,
+		// HLSLTypeChecker resolves names and fills in the types
+		class HLSLParser
+		{
+		private:
+			static const int MAX_ERROR_COUNT = 64;
+			static const int MAX_NESTING_DEPTH = 256;
+
+			Array<HLSLToken> mTokens;
+			int mCurrent;
+			HLSLTree* mpTree;
+			Array<CompileError>* mpErrors;
+			bool mRecovering;
+			int mNestingDepth;
+			bool mNestingOverflow;
+
+			// Struct names declared so far, tell declarations from expressions
+			Array<const HLSLStructDecl*> mStructs;
+
+		public:
+			HLSLParser()
+				: mCurrent(0)
+				, mpTree(nullptr)
+				, mpErrors(nullptr)
+				, mRecovering(false)
+				, mNestingDepth(0)
+				, mNestingOverflow(false)
+			{
+			}
+
+			bool Parse(const char* fileName, const string& source, HLSLTree& tree, Array<CompileError>& errors);
+
+		private:
+			// Top level declarations
+			void ParseTopLevel();
+			HLSLStructDecl* ParseStruct();
+			HLSLCBufferDecl* ParseCBuffer();
+			HLSLFunctionDecl* ParseFunction(const HLSLType& returnType, const HLSLToken& nameToken);
+			bool ParseVariableDeclarators(const HLSLType& type, const HLSLStorage storage, const bool noInterpolation, Array<HLSLVariableDecl*>& variables);
+
+			// Types
+			bool IsTypeStart(const int offset = 0) const;
+			bool IsDeclarationStart() const;
+			bool ParseType(HLSLType& type);
+			bool ParseArraySize(HLSLType& type);
+			bool ParseSemantic(string& semantic, string* pRegister = nullptr);
+			const HLSLStructDecl* FindStruct(const string& name) const;
+
+			// Statements
+			HLSLStatement* ParseStatement();
+			HLSLBlockStatement* ParseBlock();
+			HLSLStatement* ParseDeclarationStatement();
+
+			// Expressions
+			HLSLExpression* ParseExpression();
+			HLSLExpression* ParseConditional();
+			HLSLExpression* ParseBinary(const int minPrecedence);
+			HLSLExpression* ParseUnary();
+			HLSLExpression* ParsePostfix(HLSLExpression* pExpr);
+			HLSLExpression* ParsePrimary();
+			HLSLExpression* ParseLiteral();
+			bool ParseArguments(Array<HLSLExpression*>& arguments);
+
+			// Token helpers
+			const HLSLToken& Peek(const int offset = 0) const
+			{
+				return mTokens[Math::Min(mCurrent + offset, int(mTokens.Size()) - 1)];
+			}
+
+			bool Check(const HLSLTokenType type) const
+			{
+				return Peek().Type == type;
+			}
+
+			const HLSLToken& Advance()
+			{
+				const HLSLToken& token = Peek();
+				if (token.Type != HLSLTokenType::EndOfStream)
+					mCurrent++;
+
+				return token;
+			}
+
+			bool Accept(const HLSLTokenType type)
+			{
+				if (!Check(type))
+					return false;
+
+				Advance();
+				return true;
+			}
+
+			bool Expect(const HLSLTokenType type, const char* text);
+			void Error(const string& msg, const SourceInfo& srcInfo);
+			void Error(const string& msg) { Error(msg, Peek().SrcInfo); }
+
+			// Skips past the end of the broken statement or declaration
+			void Synchronize();
+
+			// Held by every parse function that can recurse, keeps hostile input from overflowing the stack
+			class NestingScope
+			{
+			private:
+				HLSLParser& mParser;
+
+			public:
+				explicit NestingScope(HLSLParser& parser)
+					: mParser(parser)
+				{
+					mParser.mNestingDepth++;
+				}
+				~NestingScope()
+				{
+					mParser.mNestingDepth--;
+				}
+			};
+			bool NestingTooDeep();
+		};
+	}
+}
\ No newline at end of file
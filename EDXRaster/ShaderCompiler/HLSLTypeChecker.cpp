@@ -0,0 +1,1229 @@
+#include "HLSLTypeChecker.h"
+
+#include <limits.h>
+
+namespace EDX
+{
+	namespace ShaderCompiler
+	{
+		namespace
+		{
+			struct IntrinsicInfo
+			{
+				const char* Name;
+				HLSLIntrinsic Intrinsic;
+				int ArgCount;
+			};
+
+			const IntrinsicInfo Intrinsics[] =
+			{
+				{ "abs", HLSLIntrinsic::Abs, 1 },
+				{ "acos", HLSLIntrinsic::Acos, 1 },
+				{ "asin", HLSLIntrinsic::Asin, 1 },
+				{ "atan", HLSLIntrinsic::Atan, 1 },
+				{ "ceil", HLSLIntrinsic::Ceil, 1 },
+				{ "cos", HLSLIntrinsic::Cos, 1 },
+				{ "ddx", HLSLIntrinsic::Ddx, 1 },
+				{ "ddy", HLSLIntrinsic::Ddy, 1 },
+				{ "exp", HLSLIntrinsic::Exp, 1 },
+				{ "exp2", HLSLIntrinsic::Exp2, 1 },
+				{ "floor", HLSLIntrinsic::Floor, 1 },
+				{ "frac", HLSLIntrinsic::Frac, 1 },
+				{ "log", HLSLIntrinsic::Log, 1 },
+				{ "log2", HLSLIntrinsic::Log2, 1 },
+				{ "rcp", HLSLIntrinsic::Rcp, 1 },
+				{ "round", HLSLIntrinsic::Round, 1 },
+				{ "rsqrt", HLSLIntrinsic::Rsqrt, 1 },
+				{ "saturate", HLSLIntrinsic::Saturate, 1 },
+				{ "sin", HLSLIntrinsic::Sin, 1 },
+				{ "sqrt", HLSLIntrinsic::Sqrt, 1 },
+				{ "tan", HLSLIntrinsic::Tan, 1 },
+				{ "trunc", HLSLIntrinsic::Trunc, 1 },
+				{ "atan2", HLSLIntrinsic::Atan2, 2 },
+				{ "clamp", HLSLIntrinsic::Clamp, 3 },
+				{ "fmod", HLSLIntrinsic::Fmod, 2 },
+				{ "lerp", HLSLIntrinsic::Lerp, 3 },
+				{ "mad", HLSLIntrinsic::Mad, 3 },
+				{ "max", HLSLIntrinsic::Max, 2 },
+				{ "min", HLSLIntrinsic::Min, 2 },
+				{ "pow", HLSLIntrinsic::Pow, 2 },
+				{ "smoothstep", HLSLIntrinsic::Smoothstep, 3 },
+				{ "step", HLSLIntrinsic::Step, 2 },
+				{ "all", HLSLIntrinsic::All, 1 },
+				{ "any", HLSLIntrinsic::Any, 1 },
+				{ "cross", HLSLIntrinsic::Cross, 2 },
+				{ "distance", HLSLIntrinsic::Distance, 2 },
+				{ "dot", HLSLIntrinsic::Dot, 2 },
+				{ "length", HLSLIntrinsic::Length, 1 },
+				{ "mul", HLSLIntrinsic::Mul, 2 },
+				{ "normalize", HLSLIntrinsic::Normalize, 1 },
+				{ "reflect", HLSLIntrinsic::Reflect, 2 },
+			};
+
+			const IntrinsicInfo TextureMethods[] =
+			{
+				{ "Sample", HLSLIntrinsic::Sample, 2 },
+				{ "SampleBias", HLSLIntrinsic::SampleBias, 3 },
+				{ "SampleGrad", HLSLIntrinsic::SampleGrad, 4 },
+				{ "SampleLevel", HLSLIntrinsic::SampleLevel, 3 },
+			};
+
+			// Integer and bool operands of float only operations are promoted to float
+			HLSLType FloatType(const HLSLType& type)
+			{
+				return type.IsFloatingPoint() ? type.WithBase(type.Base) : type.WithBase(HLSLBaseType::Float);
+			}
+
+			HLSLType ArithmeticType(const HLSLType& type)
+			{
+				return type.Base == HLSLBaseType::Bool ? type.WithBase(HLSLBaseType::Int) : type.WithBase(type.Base);
+			}
+
+			int SwizzleComponent(const char c, int& set)
+			{
+				static const char* sets[] = { "xyzw", "rgba" };
+				for (auto i = 0; i < 2; i++)
+				{
+					for (auto j = 0; j < 4; j++)
+					{
+						if (sets[i][j] == c && (set < 0 || set == i))
+						{
+							set = i;
+							return j;
+						}
+					}
+				}
+				return -1;
+			}
+		}
+
+		bool HLSLTypeChecker::Check(HLSLTree& tree, Array<CompileError>& errors)
+		{
+			const int errorCount = errors.Size();
+
+			mpTree = &tree;
+			mpErrors = &errors;
+			mSymbols.Clear();
+			mScopes.Clear();
+			mFunctions.Clear();
+			mCallees.Clear();
+			mCurrentFunction = -1;
+			mLoopDepth = 0;
+
+			// Every function is visible from every body, the parser drops prototypes
+			for (auto i = 0; i < tree.Declarations.Size(); i++)
+			{
+				if (tree.Declarations[i]->Kind != HLSLNodeKind::FunctionDecl)
+					continue;
+
+				const HLSLFunctionDecl* pFunction = static_cast<const HLSLFunctionDecl*>(tree.Declarations[i]);
+				for (auto j = 0; j < mFunctions.Size(); j++)
+				{
+					if (mFunctions[j]->Name != pFunction->Name || mFunctions[j]->Parameters.Size() != pFunction->Parameters.Size())
+						continue;
+
+					bool sameSignature = true;
+					for (auto k = 0; k < pFunction->Parameters.Size(); k++)
+						sameSignature = sameSignature && mFunctions[j]->Parameters[k]->Type.SameAs(pFunction->Parameters[k]->Type);
+
+					if (sameSignature)
+						Error("redefinition of function '" + pFunction->Name + "'", pFunction->SrcInfo);
+				}
+
+				mFunctions.Add(pFunction);
+			}
+			mCallees.Resize(mFunctions.Size());
+
+			PushScope();
+			int functionIndex = 0;
+			for (auto i = 0; i < tree.Declarations.Size(); i++)
+			{
+				HLSLNode* pDecl = tree.Declarations[i];
+				switch (pDecl->Kind)
+				{
+				case HLSLNodeKind::VariableDecl:
+					CheckGlobalVariable(static_cast<HLSLVariableDecl*>(pDecl));
+					break;
+
+				case HLSLNodeKind::CBufferDecl:
+				{
+					HLSLCBufferDecl* pCBuffer = static_cast<HLSLCBufferDecl*>(pDecl);
+					for (auto j = 0; j < pCBuffer->Members.Size(); j++)
+						Declare(pCBuffer->Members[j]);
+					break;
+				}
+
+				case HLSLNodeKind::FunctionDecl:
+					CheckFunction(functionIndex++);
+					break;
+
+				default:
+					break;
+				}
+			}
+			PopScope();
+
+			CheckRecursion();
+
+			mpTree = nullptr;
+			mpErrors = nullptr;
+
+			return errors.Size() == errorCount;
+		}
+
+		void HLSLTypeChecker::CheckGlobalVariable(HLSLVariableDecl* pVariable)
+		{
+			if (pVariable->Type.IsVoid())
+				Error("variable '" + pVariable->Name + "' cannot be void", pVariable->SrcInfo);
+
+			if (pVariable->pInit)
+			{
+				if (pVariable->Storage == HLSLStorage::Resource)
+					Error("textures and samplers cannot be initialized", pVariable->SrcInfo);
+				else if (CheckExpression(pVariable->pInit))
+					Coerce(pVariable->pInit, pVariable->Type);
+			}
+			else if (pVariable->Type.Const && pVariable->Storage == HLSLStorage::Static)
+				Error("static const variable '" + pVariable->Name + "' must be initialized", pVariable->SrcInfo);
+
+			Declare(pVariable);
+		}
+
+		void HLSLTypeChecker::CheckFunction(const int index)
+		{
+			const HLSLFunctionDecl* pFunction = mFunctions[index];
+			mCurrentFunction = index;
+
+			if (pFunction->ReturnType.IsArray())
+				Error("functions cannot return arrays", pFunction->SrcInfo);
+
+			PushScope();
+			for (auto i = 0; i < pFunction->Parameters.Size(); i++)
+			{
+				HLSLVariableDecl* pParam = pFunction->Parameters[i];
+				if (pParam->Type.IsVoid())
+					Error("parameter '" + pParam->Name + "' cannot be void", pParam->SrcInfo);
+				if ((pParam->Type.IsTexture() || pParam->Type.IsSampler()) && pParam->Modifier != HLSLParameterModifier::In)
+					Error("textures and samplers can only be input parameters", pParam->SrcInfo);
+
+				Declare(pParam);
+			}
+
+			CheckStatement(pFunction->pBody);
+			PopScope();
+
+			if (!pFunction->ReturnType.IsVoid() && !AlwaysReturns(pFunction->pBody))
+				Error("'" + pFunction->Name + "': not all control paths return a value", pFunction->SrcInfo);
+
+			mCurrentFunction = -1;
+		}
+
+		void HLSLTypeChecker::CheckVariable(HLSLVariableDecl* pVariable)
+		{
+			if (pVariable->Type.IsVoid())
+				Error("variable '" + pVariable->Name + "' cannot be void", pVariable->SrcInfo);
+			if (pVariable->Type.IsTexture() || pVariable->Type.IsSampler())
+				Error("local textures and samplers are not supported", pVariable->SrcInfo);
+
+			if (pVariable->pInit)
+			{
+				if (CheckExpression(pVariable->pInit))
+					Coerce(pVariable->pInit, pVariable->Type);
+			}
+			else if (pVariable->Type.Const)
+				Error("const variable '" + pVariable->Name + "' must be initialized", pVariable->SrcInfo);
+
+			// Declared after the initializer, float x = x; refers to an outer x
+			Declare(pVariable);
+		}
+
+		void HLSLTypeChecker::CheckRecursion()
+		{
+			// Depth first search over the call graph, 1 marks functions on the current path
+			Array<int> state;
+			state.Resize(mFunctions.Size());
+			for (auto i = 0; i < state.Size(); i++)
+				state[i] = 0;
+
+			for (auto root = 0; root < mFunctions.Size(); root++)
+			{
+				if (state[root] != 0)
+					continue;
+
+				Array<int> stack, next;
+				stack.Add(root);
+				next.Add(0);
+				state[root] = 1;
+
+				while (stack.Size() > 0)
+				{
+					const int function = stack[stack.Size() - 1];
+					int& callee = next[next.Size() - 1];
+					if (callee == mCallees[function].Size())
+					{
+						state[function] = 2;
+						stack.Resize(stack.Size() - 1);
+						next.Resize(next.Size() - 1);
+						continue;
+					}
+
+					const int target = mCallees[function][callee++];
+					if (state[target] == 1)
+						Error("recursive call to '" + mFunctions[target]->Name + "' from '" + mFunctions[function]->Name + "'", mFunctions[function]->SrcInfo);
+					else if (state[target] == 0)
+					{
+						state[target] = 1;
+						stack.Add(target);
+						next.Add(0);
+					}
+				}
+			}
+		}
+
+		void HLSLTypeChecker::CheckStatement(HLSLStatement* pStatement)
+		{
+			if (!pStatement)
+				return;
+
+			switch (pStatement->Kind)
+			{
+			case HLSLNodeKind::BlockStatement:
+			{
+				HLSLBlockStatement* pBlock = static_cast<HLSLBlockStatement*>(pStatement);
+				PushScope();
+				for (auto i = 0; i < pBlock->Statements.Size(); i++)
+					CheckStatement(pBlock->Statements[i]);
+				PopScope();
+				break;
+			}
+
+			case HLSLNodeKind::DeclarationStatement:
+			{
+				HLSLDeclarationStatement* pDeclaration = static_cast<HLSLDeclarationStatement*>(pStatement);
+				for (auto i = 0; i < pDeclaration->Variables.Size(); i++)
+					CheckVariable(pDeclaration->Variables[i]);
+				break;
+			}
+
+			case HLSLNodeKind::ExpressionStatement:
+				CheckExpression(static_cast<HLSLExpressionStatement*>(pStatement)->pExpression);
+				break;
+
+			case HLSLNodeKind::IfStatement:
+			{
+				HLSLIfStatement* pIf = static_cast<HLSLIfStatement*>(pStatement);
+				CheckCondition(pIf->pCondition);
+				CheckStatement(pIf->pThen);
+				CheckStatement(pIf->pElse);
+				break;
+			}
+
+			case HLSLNodeKind::ForStatement:
+			{
+				// The init statement is scoped to the loop
+				HLSLForStatement* pFor = static_cast<HLSLForStatement*>(pStatement);
+				PushScope();
+				CheckStatement(pFor->pInit);
+				if (pFor->pCondition)
+					CheckCondition(pFor->pCondition);
+				if (pFor->pIncrement)
+					CheckExpression(pFor->pIncrement);
+
+				mLoopDepth++;
+				CheckStatement(pFor->pBody);
+				mLoopDepth--;
+				PopScope();
+				break;
+			}
+
+			case HLSLNodeKind::WhileStatement:
+			case HLSLNodeKind::DoWhileStatement:
+			{
+				HLSLWhileStatement* pWhile = static_cast<HLSLWhileStatement*>(pStatement);
+				CheckCondition(pWhile->pCondition);
+
+				mLoopDepth++;
+				CheckStatement(pWhile->pBody);
+				mLoopDepth--;
+				break;
+			}
+
+			case HLSLNodeKind::ReturnStatement:
+			{
+				HLSLReturnStatement* pReturn = static_cast<HLSLReturnStatement*>(pStatement);
+				const HLSLType& returnType = mFunctions[mCurrentFunction]->ReturnType;
+				if (!pReturn->pValue)
+				{
+					if (!returnType.IsVoid())
+						Error("function must return a value", pReturn->SrcInfo);
+				}
+				else if (returnType.IsVoid())
+					Error("void function cannot return a value", pReturn->SrcInfo);
+				else if (CheckExpression(pReturn->pValue))
+					Coerce(pReturn->pValue, returnType);
+				break;
+			}
+
+			case HLSLNodeKind::BreakStatement:
+			case HLSLNodeKind::ContinueStatement:
+				if (mLoopDepth == 0)
+					Error(string(pStatement->Kind == HLSLNodeKind::BreakStatement ? "'break'" : "'continue'") + " outside of a loop", pStatement->SrcInfo);
+				break;
+
+			default:
+				break;
+			}
+		}
+
+		void HLSLTypeChecker::CheckCondition(HLSLExpression*& pCondition)
+		{
+			if (!CheckExpression(pCondition))
+				return;
+
+			if (!pCondition->Type.IsScalar())
+			{
+				Error("condition must be a scalar, found '" + pCondition->Type.ToString() + "'", pCondition->SrcInfo);
+				return;
+			}
+
+			Coerce(pCondition, HLSLType::Scalar(HLSLBaseType::Bool));
+		}
+
+		bool HLSLTypeChecker::AlwaysReturns(const HLSLStatement* pStatement) const
+		{
+			if (!pStatement)
+				return false;
+
+			switch (pStatement->Kind)
+			{
+			case HLSLNodeKind::ReturnStatement:
+			case HLSLNodeKind::DiscardStatement:
+				return true;
+
+			case HLSLNodeKind::BlockStatement:
+			{
+				const HLSLBlockStatement* pBlock = static_cast<const HLSLBlockStatement*>(pStatement);
+				for (auto i = 0; i < pBlock->Statements.Size(); i++)
+				{
+					if (AlwaysReturns(pBlock->Statements[i]))
+						return true;
+				}
+				return false;
+			}
+
+			case HLSLNodeKind::IfStatement:
+			{
+				const HLSLIfStatement* pIf = static_cast<const HLSLIfStatement*>(pStatement);
+				return AlwaysReturns(pIf->pThen) && AlwaysReturns(pIf->pElse);
+			}
+
+			case HLSLNodeKind::DoWhileStatement:
+				return AlwaysReturns(static_cast<const HLSLWhileStatement*>(pStatement)->pBody);
+
+			default:
+				return false;
+			}
+		}
+
+		bool HLSLTypeChecker::CheckExpression(HLSLExpression*& pExpr)
+		{
+			switch (pExpr->Kind)
+			{
+			case HLSLNodeKind::LiteralExpression:
+				pExpr->Type = HLSLType::Scalar(static_cast<HLSLLiteralExpression*>(pExpr)->LiteralType);
+				return true;
+
+			case HLSLNodeKind::IdentifierExpression:
+			{
+				HLSLIdentifierExpression* pIdentifier = static_cast<HLSLIdentifierExpression*>(pExpr);
+				pIdentifier->pDecl = Lookup(pIdentifier->Name);
+				if (!pIdentifier->pDecl)
+				{
+					Error("undeclared identifier '" + pIdentifier->Name + "'", pIdentifier->SrcInfo);
+					return false;
+				}
+
+				pIdentifier->Type = pIdentifier->pDecl->Type;
+				return true;
+			}
+
+			case HLSLNodeKind::UnaryExpression:
+				return CheckUnary(static_cast<HLSLUnaryExpression*>(pExpr));
+
+			case HLSLNodeKind::BinaryExpression:
+				return CheckBinary(static_cast<HLSLBinaryExpression*>(pExpr));
+
+			case HLSLNodeKind::ConditionalExpression:
+				return CheckConditional(static_cast<HLSLConditionalExpression*>(pExpr));
+
+			case HLSLNodeKind::CastExpression:
+			{
+				HLSLCastExpression* pCast = static_cast<HLSLCastExpression*>(pExpr);
+				if (!CheckExpression(pCast->pOperand))
+					return false;
+
+				if (!CanConvert(pCast->pOperand->Type, pCast->Type))
+				{
+					Error("cannot cast from '" + pCast->pOperand->Type.ToString() + "' to '" + pCast->Type.ToString() + "'", pCast->SrcInfo);
+					return false;
+				}
+				return true;
+			}
+
+			case HLSLNodeKind::ConstructorExpression:
+				return CheckConstructor(static_cast<HLSLConstructorExpression*>(pExpr));
+
+			case HLSLNodeKind::MemberExpression:
+				return CheckMember(static_cast<HLSLMemberExpression*>(pExpr));
+
+			case HLSLNodeKind::IndexExpression:
+				return CheckIndex(static_cast<HLSLIndexExpression*>(pExpr));
+
+			case HLSLNodeKind::CallExpression:
+				return CheckCall(static_cast<HLSLCallExpression*>(pExpr));
+
+			case HLSLNodeKind::MethodCallExpression:
+				return CheckMethodCall(static_cast<HLSLMethodCallExpression*>(pExpr));
+
+			default:
+				Error("unexpected node in expression", pExpr->SrcInfo);
+				return false;
+			}
+		}
+
+		bool HLSLTypeChecker::CheckUnary(HLSLUnaryExpression* pUnary)
+		{
+			if (!CheckExpression(pUnary->pOperand))
+				return false;
+
+			const HLSLType& type = pUnary->pOperand->Type;
+			if (!type.IsNumeric())
+			{
+				Error("invalid operand type '" + type.ToString() + "' for unary operator", pUnary->SrcInfo);
+				return false;
+			}
+
+			switch (pUnary->Op)
+			{
+			case HLSLUnaryOp::Negate:
+			case HLSLUnaryOp::Plus:
+				pUnary->Type = ArithmeticType(type);
+				return Coerce(pUnary->pOperand, pUnary->Type);
+
+			case HLSLUnaryOp::LogicalNot:
+				pUnary->Type = type.WithBase(HLSLBaseType::Bool);
+				return Coerce(pUnary->pOperand, pUnary->Type);
+
+			case HLSLUnaryOp::BitNot:
+				pUnary->Type = ArithmeticType(type);
+				if (!pUnary->Type.IsInteger())
+				{
+					Error("'~' requires an integer operand, found '" + type.ToString() + "'", pUnary->SrcInfo);
+					return false;
+				}
+				return Coerce(pUnary->pOperand, pUnary->Type);
+
+			default:
+				if (type.Base == HLSLBaseType::Bool)
+				{
+					Error("cannot increment or decrement a bool", pUnary->SrcInfo);
+					return false;
+				}
+				pUnary->Type = type.WithBase(type.Base);
+				return CheckLValue(pUnary->pOperand);
+			}
+		}
+
+		bool HLSLTypeChecker::CheckBinary(HLSLBinaryExpression* pBinary)
+		{
+			if (!CheckExpression(pBinary->pLeft) || !CheckExpression(pBinary->pRight))
+				return false;
+
+			const HLSLType& left = pBinary->pLeft->Type;
+			const HLSLType& right = pBinary->pRight->Type;
+
+			if (pBinary->Op == HLSLBinaryOp::Assign)
+			{
+				if (!CheckLValue(pBinary->pLeft))
+					return false;
+
+				pBinary->Type = left.WithBase(left.Base);
+				pBinary->OperandType = pBinary->Type;
+				return Coerce(pBinary->pRight, pBinary->Type);
+			}
+
+			const HLSLBinaryOp op = CompoundAssignmentOp(pBinary->Op);
+			if (!left.IsNumeric() || !right.IsNumeric())
+			{
+				Error("invalid operand types '" + left.ToString() + "' and '" + right.ToString() + "' for binary operator", pBinary->SrcInfo);
+				return false;
+			}
+
+			HLSLType operandType;
+			if (IsAssignment(pBinary->Op))
+			{
+				// The operation happens in the destination's type
+				if (!CheckLValue(pBinary->pLeft))
+					return false;
+				operandType = left.WithBase(left.Base);
+				if (operandType.Base == HLSLBaseType::Bool)
+				{
+					Error("compound assignment to a bool", pBinary->SrcInfo);
+					return false;
+				}
+			}
+			else if (!CommonType(left, right, operandType))
+			{
+				Error("incompatible operand types '" + left.ToString() + "' and '" + right.ToString() + "'", pBinary->SrcInfo);
+				return false;
+			}
+
+			switch (op)
+			{
+			case HLSLBinaryOp::Less:
+			case HLSLBinaryOp::LessEqual:
+			case HLSLBinaryOp::Greater:
+			case HLSLBinaryOp::GreaterEqual:
+			case HLSLBinaryOp::Equal:
+			case HLSLBinaryOp::NotEqual:
+				pBinary->Type = operandType.WithBase(HLSLBaseType::Bool);
+				break;
+
+			case HLSLBinaryOp::LogicalAnd:
+			case HLSLBinaryOp::LogicalOr:
+				operandType = operandType.WithBase(HLSLBaseType::Bool);
+				pBinary->Type = operandType;
+				break;
+
+			case HLSLBinaryOp::BitAnd:
+			case HLSLBinaryOp::BitOr:
+			case HLSLBinaryOp::BitXor:
+			case HLSLBinaryOp::ShiftLeft:
+			case HLSLBinaryOp::ShiftRight:
+				operandType = ArithmeticType(operandType);
+				if (!operandType.IsInteger())
+				{
+					Error("bitwise operators require integer operands, found '" + operandType.ToString() + "'", pBinary->SrcInfo);
+					return false;
+				}
+				pBinary->Type = operandType;
+				break;
+
+			default:
+				operandType = ArithmeticType(operandType);
+				pBinary->Type = operandType;
+				break;
+			}
+
+			pBinary->OperandType = operandType;
+			if (IsAssignment(pBinary->Op))
+				return Coerce(pBinary->pRight, operandType);
+
+			return Coerce(pBinary->pLeft, operandType) && Coerce(pBinary->pRight, operandType);
+		}
+
+		bool HLSLTypeChecker::CheckConditional(HLSLConditionalExpression* pConditional)
+		{
+			if (!CheckExpression(pConditional->pCondition) || !CheckExpression(pConditional->pTrue) || !CheckExpression(pConditional->pFalse))
+				return false;
+
+			HLSLType resultType;
+			if (pConditional->pTrue->Type.IsNumeric() && pConditional->pFalse->Type.IsNumeric())
+			{
+				if (!CommonType(pConditional->pTrue->Type, pConditional->pFalse->Type, resultType))
+				{
+					Error("incompatible types '" + pConditional->pTrue->Type.ToString() + "' and '" + pConditional->pFalse->Type.ToString() + "' in conditional", pConditional->SrcInfo);
+					return false;
+				}
+			}
+			else if (pConditional->pTrue->Type.SameAs(pConditional->pFalse->Type))
+				resultType = pConditional->pTrue->Type.WithBase(pConditional->pTrue->Type.Base);
+			else
+			{
+				Error("incompatible types '" + pConditional->pTrue->Type.ToString() + "' and '" + pConditional->pFalse->Type.ToString() + "' in conditional", pConditional->SrcInfo);
+				return false;
+			}
+
+			// A vector condition selects per component
+			const HLSLType& conditionType = pConditional->pCondition->Type;
+			if (!conditionType.IsNumeric() || (!conditionType.IsScalar() && !(resultType.IsNumeric() && conditionType.ComponentCount() == resultType.ComponentCount())))
+			{
+				Error("invalid condition type '" + conditionType.ToString() + "'", pConditional->SrcInfo);
+				return false;
+			}
+
+			pConditional->Type = resultType;
+			return Coerce(pConditional->pCondition, conditionType.WithBase(HLSLBaseType::Bool)) &&
+				Coerce(pConditional->pTrue, resultType) &&
+				Coerce(pConditional->pFalse, resultType);
+		}
+
+		bool HLSLTypeChecker::CheckConstructor(HLSLConstructorExpression* pConstructor)
+		{
+			if (!CheckArguments(pConstructor->Arguments))
+				return false;
+
+			const HLSLType& type = pConstructor->Type;
+			int componentCount = 0;
+			for (auto i = 0; i < pConstructor->Arguments.Size(); i++)
+			{
+				HLSLExpression*& pArgument = pConstructor->Arguments[i];
+				if (!pArgument->Type.IsNumeric())
+				{
+					Error("invalid constructor argument of type '" + pArgument->Type.ToString() + "'", pArgument->SrcInfo);
+					return false;
+				}
+
+				componentCount += pArgument->Type.ComponentCount();
+				if (!Coerce(pArgument, pArgument->Type.WithBase(type.Base)))
+					return false;
+			}
+
+			// float3(0) splats like an implicit conversion would
+			const bool splat = pConstructor->Arguments.Size() == 1 && componentCount == 1;
+			if (!splat && componentCount != type.ComponentCount())
+			{
+				Error("'" + type.ToString() + "' constructor expects " + std::to_string(type.ComponentCount()) + " components, found " + std::to_string(componentCount), pConstructor->SrcInfo);
+				return false;
+			}
+
+			return true;
+		}
+
+		bool HLSLTypeChecker::CheckMember(HLSLMemberExpression* pMember)
+		{
+			if (!CheckExpression(pMember->pObject))
+				return false;
+
+			const HLSLType& objectType = pMember->pObject->Type;
+			if (objectType.IsStruct())
+			{
+				pMember->FieldIndex = objectType.pStruct->FindField(pMember->Member);
+				if (pMember->FieldIndex < 0)
+				{
+					Error("'" + pMember->Member + "' is not a member of '" + objectType.ToString() + "'", pMember->SrcInfo);
+					return false;
+				}
+
+				pMember->Type = objectType.pStruct->Fields[pMember->FieldIndex]->Type;
+				return true;
+			}
+
+			if (objectType.IsMatrix())
+			{
+				Error("matrix member access is not supported, index rows with []", pMember->SrcInfo);
+				return false;
+			}
+
+			if (!objectType.IsScalar() && !objectType.IsVector())
+			{
+				Error("'" + objectType.ToString() + "' has no member '" + pMember->Member + "'", pMember->SrcInfo);
+				return false;
+			}
+
+			const string& swizzle = pMember->Member;
+			if (swizzle.length() > 4)
+			{
+				Error("invalid swizzle '" + swizzle + "'", pMember->SrcInfo);
+				return false;
+			}
+
+			int set = -1;
+			for (auto i = 0; i < int(swizzle.length()); i++)
+			{
+				const int component = SwizzleComponent(swizzle[i], set);
+				if (component < 0 || component >= objectType.Columns)
+				{
+					Error("invalid swizzle '" + swizzle + "' on '" + objectType.ToString() + "'", pMember->SrcInfo);
+					return false;
+				}
+				pMember->Swizzle[i] = component;
+			}
+
+			pMember->SwizzleCount = int(swizzle.length());
+			pMember->Type = HLSLType::Vector(objectType.Base, pMember->SwizzleCount);
+			return true;
+		}
+
+		bool HLSLTypeChecker::CheckIndex(HLSLIndexExpression* pIndex)
+		{
+			if (!CheckExpression(pIndex->pObject) || !CheckExpression(pIndex->pIndex))
+				return false;
+
+			const HLSLType& objectType = pIndex->pObject->Type;
+			if (objectType.IsArray())
+				pIndex->Type = objectType.ElementType();
+			else if (objectType.IsMatrix())
+				pIndex->Type = HLSLType::Vector(objectType.Base, objectType.Columns);
+			else if (objectType.IsVector())
+				pIndex->Type = HLSLType::Scalar(objectType.Base);
+			else
+			{
+				Error("'" + objectType.ToString() + "' cannot be indexed", pIndex->SrcInfo);
+				return false;
+			}
+			pIndex->Type.Const = objectType.Const;
+
+			if (!pIndex->pIndex->Type.IsScalar())
+			{
+				Error("index must be a scalar, found '" + pIndex->pIndex->Type.ToString() + "'", pIndex->pIndex->SrcInfo);
+				return false;
+			}
+
+			return Coerce(pIndex->pIndex, HLSLType::Scalar(HLSLBaseType::Int));
+		}
+
+		bool HLSLTypeChecker::CheckCall(HLSLCallExpression* pCall)
+		{
+			if (!CheckArguments(pCall->Arguments))
+				return false;
+
+			// User functions shadow intrinsics, overloads prefer the fewest conversions
+			int best = -1, bestConversions = INT_MAX;
+			bool nameFound = false;
+			for (auto i = 0; i < mFunctions.Size(); i++)
+			{
+				const HLSLFunctionDecl* pFunction = mFunctions[i];
+				if (pFunction->Name != pCall->Name)
+					continue;
+
+				nameFound = true;
+				if (pFunction->Parameters.Size() != pCall->Arguments.Size())
+					continue;
+
+				int conversions = 0;
+				for (auto j = 0; j < pCall->Arguments.Size() && conversions != INT_MAX; j++)
+				{
+					const HLSLType& argType = pCall->Arguments[j]->Type;
+					const HLSLType& paramType = pFunction->Parameters[j]->Type;
+					if (argType.SameAs(paramType))
+						continue;
+
+					// Out parameters are written back, they need an exact match
+					if (pFunction->Parameters[j]->Modifier != HLSLParameterModifier::In || !CanConvert(argType, paramType))
+						conversions = INT_MAX;
+					else
+						conversions++;
+				}
+
+				if (conversions < bestConversions)
+				{
+					best = i;
+					bestConversions = conversions;
+				}
+			}
+
+			if (!nameFound)
+				return CheckIntrinsic(pCall);
+
+			if (best < 0)
+			{
+				Error("no overload of '" + pCall->Name + "' matches the arguments", pCall->SrcInfo);
+				return false;
+			}
+
+			const HLSLFunctionDecl* pFunction = mFunctions[best];
+			pCall->pFunction = pFunction;
+			pCall->Type = pFunction->ReturnType;
+			if (mCurrentFunction >= 0)
+				mCallees[mCurrentFunction].Add(best);
+
+			for (auto i = 0; i < pCall->Arguments.Size(); i++)
+			{
+				if (pFunction->Parameters[i]->Modifier != HLSLParameterModifier::In && !CheckLValue(pCall->Arguments[i]))
+					return false;
+				if (!Coerce(pCall->Arguments[i], pFunction->Parameters[i]->Type))
+					return false;
+			}
+
+			return true;
+		}
+
+		bool HLSLTypeChecker::CheckIntrinsic(HLSLCallExpression* pCall)
+		{
+			const IntrinsicInfo* pInfo = nullptr;
+			for (const auto& info : Intrinsics)
+			{
+				if (pCall->Name == info.Name)
+				{
+					pInfo = &info;
+					break;
+				}
+			}
+
+			if (!pInfo)
+			{
+				Error("undeclared function '" + pCall->Name + "'", pCall->SrcInfo);
+				return false;
+			}
+
+			Array<HLSLExpression*>& args = pCall->Arguments;
+			if (args.Size() != pInfo->ArgCount)
+			{
+				Error("'" + pCall->Name + "' expects " + std::to_string(pInfo->ArgCount) + " arguments, found " + std::to_string(args.Size()), pCall->SrcInfo);
+				return false;
+			}
+
+			for (auto i = 0; i < args.Size(); i++)
+			{
+				if (!args[i]->Type.IsNumeric())
+				{
+					Error("invalid argument of type '" + args[i]->Type.ToString() + "' to '" + pCall->Name + "'", args[i]->SrcInfo);
+					return false;
+				}
+			}
+
+			pCall->Intrinsic = pInfo->Intrinsic;
+
+			// All arguments share one type, the component wise intrinsics return it. mul mixes shapes
+			HLSLType common = args[0]->Type.WithBase(args[0]->Type.Base);
+			for (auto i = 1; i < args.Size(); i++)
+			{
+				if (pInfo->Intrinsic == HLSLIntrinsic::Mul)
+					common.Base = HLSLBaseType(Math::Max(int(common.Base), int(args[i]->Type.Base)));
+				else if (!CommonType(common, args[i]->Type, common))
+				{
+					Error("incompatible argument types to '" + pCall->Name + "'", pCall->SrcInfo);
+					return false;
+				}
+			}
+
+			HLSLType argType;
+			switch (pInfo->Intrinsic)
+			{
+			case HLSLIntrinsic::Abs:
+			case HLSLIntrinsic::Max:
+			case HLSLIntrinsic::Min:
+			case HLSLIntrinsic::Clamp:
+			case HLSLIntrinsic::Mad:
+				argType = ArithmeticType(common);
+				pCall->Type = argType;
+				break;
+
+			case HLSLIntrinsic::All:
+			case HLSLIntrinsic::Any:
+				argType = common.WithBase(HLSLBaseType::Bool);
+				pCall->Type = HLSLType::Scalar(HLSLBaseType::Bool);
+				break;
+
+			case HLSLIntrinsic::Cross:
+				argType = HLSLType::Vector(FloatType(common).Base, 3);
+				pCall->Type = argType;
+				if (!args[0]->Type.IsVector() || args[0]->Type.Columns != 3 || !args[1]->Type.IsVector() || args[1]->Type.Columns != 3)
+				{
+					Error("'cross' expects 3 component vectors", pCall->SrcInfo);
+					return false;
+				}
+				break;
+
+			case HLSLIntrinsic::Dot:
+				argType = ArithmeticType(common);
+				pCall->Type = HLSLType::Scalar(argType.Base);
+				if (argType.IsMatrix())
+				{
+					Error("'dot' expects vectors", pCall->SrcInfo);
+					return false;
+				}
+				break;
+
+			case HLSLIntrinsic::Distance:
+			case HLSLIntrinsic::Length:
+				argType = FloatType(common);
+				pCall->Type = HLSLType::Scalar(argType.Base);
+				if (argType.IsMatrix())
+				{
+					Error("'" + pCall->Name + "' expects vectors", pCall->SrcInfo);
+					return false;
+				}
+				break;
+
+			case HLSLIntrinsic::Mul:
+			{
+				// mul(v, M) treats v as a row vector, mul(M, v) as a column vector
+				const HLSLType& a = args[0]->Type;
+				const HLSLType& b = args[1]->Type;
+				const HLSLBaseType base = ArithmeticType(common).Base;
+
+				HLSLType aType = a.WithBase(base), bType = b.WithBase(base);
+				if (a.IsScalar() || b.IsScalar())
+				{
+					pCall->Type = a.IsScalar() ? bType : aType;
+					if (a.IsScalar())
+						aType = HLSLType::Scalar(base);
+					else
+						bType = HLSLType::Scalar(base);
+				}
+				else if (a.IsVector() && b.IsVector())
+				{
+					if (a.Columns != b.Columns)
+					{
+						Error("'mul' vector sizes differ", pCall->SrcInfo);
+						return false;
+					}
+					pCall->Type = HLSLType::Scalar(base);
+				}
+				else if (a.IsVector() && b.IsMatrix())
+				{
+					if (a.Columns != b.Rows)
+					{
+						Error("'mul' " + a.ToString() + " by " + b.ToString() + " has mismatched dimensions", pCall->SrcInfo);
+						return false;
+					}
+					pCall->Type = HLSLType::Vector(base, b.Columns);
+				}
+				else if (a.IsMatrix() && b.IsVector())
+				{
+					if (a.Columns != b.Columns)
+					{
+						Error("'mul' " + a.ToString() + " by " + b.ToString() + " has mismatched dimensions", pCall->SrcInfo);
+						return false;
+					}
+					pCall->Type = HLSLType::Vector(base, a.Rows);
+				}
+				else
+				{
+					if (a.Columns != b.Rows)
+					{
+						Error("'mul' " + a.ToString() + " by " + b.ToString() + " has mismatched dimensions", pCall->SrcInfo);
+						return false;
+					}
+					pCall->Type = HLSLType::MatrixOf(base, a.Rows, b.Columns);
+				}
+
+				return Coerce(args[0], aType) && Coerce(args[1], bType);
+			}
+
+			default:
+				// Everything else is a component wise float operation
+				argType = FloatType(common);
+				pCall->Type = argType;
+				if ((pInfo->Intrinsic == HLSLIntrinsic::Normalize || pInfo->Intrinsic == HLSLIntrinsic::Reflect) && !argType.IsVector())
+				{
+					Error("'" + pCall->Name + "' expects vectors", pCall->SrcInfo);
+					return false;
+				}
+				break;
+			}
+
+			for (auto i = 0; i < args.Size(); i++)
+			{
+				if (!Coerce(args[i], argType))
+					return false;
+			}
+
+			return true;
+		}
+
+		bool HLSLTypeChecker::CheckMethodCall(HLSLMethodCallExpression* pCall)
+		{
+			if (!CheckExpression(pCall->pObject) || !CheckArguments(pCall->Arguments))
+				return false;
+
+			const HLSLType& objectType = pCall->pObject->Type;
+			if (!objectType.IsTexture())
+			{
+				Error("'" + objectType.ToString() + "' has no methods", pCall->SrcInfo);
+				return false;
+			}
+
+			const IntrinsicInfo* pInfo = nullptr;
+			for (const auto& info : TextureMethods)
+			{
+				if (pCall->Name == info.Name)
+				{
+					pInfo = &info;
+					break;
+				}
+			}
+
+			if (!pInfo)
+			{
+				Error("'" + pCall->Name + "' is not a supported texture method", pCall->SrcInfo);
+				return false;
+			}
+
+			Array<HLSLExpression*>& args = pCall->Arguments;
+			if (args.Size() != pInfo->ArgCount)
+			{
+				Error("'" + pCall->Name + "' expects " + std::to_string(pInfo->ArgCount) + " arguments, found " + std::to_string(args.Size()), pCall->SrcInfo);
+				return false;
+			}
+
+			if (!args[0]->Type.IsSampler())
+			{
+				Error("first argument of '" + pCall->Name + "' must be a sampler", args[0]->SrcInfo);
+				return false;
+			}
+
+			pCall->Intrinsic = pInfo->Intrinsic;
+			pCall->Type = HLSLType::Vector(HLSLBaseType::Float, 4);
+
+			const HLSLType coordType = HLSLType::Vector(HLSLBaseType::Float, objectType.Base == HLSLBaseType::TextureCube ? 3 : 2);
+			if (!Coerce(args[1], coordType))
+				return false;
+
+			switch (pInfo->Intrinsic)
+			{
+			case HLSLIntrinsic::SampleBias:
+			case HLSLIntrinsic::SampleLevel:
+				return Coerce(args[2], HLSLType::Scalar(HLSLBaseType::Float));
+
+			case HLSLIntrinsic::SampleGrad:
+				return Coerce(args[2], coordType) && Coerce(args[3], coordType);
+
+			default:
+				return true;
+			}
+		}
+
+		bool HLSLTypeChecker::CheckArguments(Array<HLSLExpression*>& arguments)
+		{
+			bool valid = true;
+			for (auto i = 0; i < arguments.Size(); i++)
+				valid = CheckExpression(arguments[i]) && valid;
+
+			return valid;
+		}
+
+		bool HLSLTypeChecker::CanConvert(const HLSLType& from, const HLSLType& to)
+		{
+			if (from.SameAs(to))
+				return true;
+			if (!from.IsNumeric() || !to.IsNumeric())
+				return false;
+
+			// Scalars splat, anything truncates to a scalar
+			if (from.IsScalar() || to.IsScalar())
+				return true;
+			if (from.Matrix != to.Matrix)
+				return false;
+
+			// Vectors and matrices only truncate
+			return to.Columns <= from.Columns && to.Rows <= from.Rows;
+		}
+
+		bool HLSLTypeChecker::CommonType(const HLSLType& lhs, const HLSLType& rhs, HLSLType& result)
+		{
+			if (!lhs.IsNumeric() || !rhs.IsNumeric())
+				return false;
+
+			const HLSLBaseType base = HLSLBaseType(Math::Max(int(lhs.Base), int(rhs.Base)));
+			if (lhs.IsScalar())
+				result = rhs.WithBase(base);
+			else if (rhs.IsScalar())
+				result = lhs.WithBase(base);
+			else if (lhs.Matrix != rhs.Matrix)
+				return false;
+			else
+			{
+				// Mismatched vector sizes truncate to the smaller one
+				result = lhs.WithBase(base);
+				result.Columns = Math::Min(lhs.Columns, rhs.Columns);
+				result.Rows = Math::Min(lhs.Rows, rhs.Rows);
+			}
+
+			return true;
+		}
+
+		bool HLSLTypeChecker::Coerce(HLSLExpression*& pExpr, const HLSLType& to)
+		{
+			if (pExpr->Type.SameAs(to))
+				return true;
+
+			if (!CanConvert(pExpr->Type, to))
+			{
+				Error("cannot convert from '" + pExpr->Type.ToString() + "' to '" + to.ToString() + "'", pExpr->SrcInfo);
+				return false;
+			}
+
+			HLSLCastExpression* pCast = mpTree->Create<HLSLCastExpression>(pExpr->SrcInfo);
+			pCast->Type = to.WithBase(to.Base);
+			pCast->pOperand = pExpr;
+			pCast->Implicit = true;
+			pExpr = pCast;
+
+			return true;
+		}
+
+		bool HLSLTypeChecker::IsLValue(const HLSLExpression* pExpr) const
+		{
+			switch (pExpr->Kind)
+			{
+			case HLSLNodeKind::IdentifierExpression:
+			{
+				const HLSLVariableDecl* pDecl = static_cast<const HLSLIdentifierExpression*>(pExpr)->pDecl;
+				if (pDecl->Type.Const)
+					return false;
+
+				// Globals outside static storage are shader inputs, read only for the shader
+				return pDecl->Storage == HLSLStorage::Local || pDecl->Storage == HLSLStorage::Parameter || pDecl->Storage == HLSLStorage::Static;
+			}
+
+			case HLSLNodeKind::MemberExpression:
+			{
+				const HLSLMemberExpression* pMember = static_cast<const HLSLMemberExpression*>(pExpr);
+				for (auto i = 0; i < pMember->SwizzleCount; i++)
+				{
+					for (auto j = 0; j < i; j++)
+					{
+						if (pMember->Swizzle[i] == pMember->Swizzle[j])
+							return false;
+					}
+				}
+				return IsLValue(pMember->pObject);
+			}
+
+			case HLSLNodeKind::IndexExpression:
+				return IsLValue(static_cast<const HLSLIndexExpression*>(pExpr)->pObject);
+
+			default:
+				return false;
+			}
+		}
+
+		bool HLSLTypeChecker::CheckLValue(const HLSLExpression* pExpr)
+		{
+			if (IsLValue(pExpr))
+				return true;
+
+			Error("expression is not assignable", pExpr->SrcInfo);
+			return false;
+		}
+
+		void HLSLTypeChecker::PopScope()
+		{
+			mSymbols.Resize(mScopes[mScopes.Size() - 1]);
+			mScopes.Resize(mScopes.Size() - 1);
+		}
+
+		void HLSLTypeChecker::Declare(const HLSLVariableDecl* pVariable)
+		{
+			const int scopeStart = mScopes[mScopes.Size() - 1];
+			for (auto i = scopeStart; i < mSymbols.Size(); i++)
+			{
+				if (mSymbols[i]->Name == pVariable->Name)
+				{
+					Error("redefinition of '" + pVariable->Name + "'", pVariable->SrcInfo);
+					return;
+				}
+			}
+
+			mSymbols.Add(pVariable);
+		}
+
+		const HLSLVariableDecl* HLSLTypeChecker::Lookup(const string& name) const
+		{
+			for (int i = mSymbols.Size() - 1; i >= 0; i--)
+			{
+				if (mSymbols[i]->Name == name)
+					return mSymbols[i];
+			}
+			return nullptr;
+		}
+
+		void HLSLTypeChecker::Error(const string& msg, const SourceInfo& srcInfo)
+		{
+			mpErrors->Add(CompileError(msg, srcInfo));
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "EDXPrerequisites.h"
+#include "CompilerCommon.h"
+#include "HLSLAST.h"
+
+namespace EDX
+{
+	namespace ShaderCompiler
+	{
+		// Resolves names, fills in expression types and makes every conversion explicit by inserting implicit
+		// HLSLCastExpression nodes, so later stages never have to reason about HLSL promotion rules
+		class HLSLTypeChecker
+		{
+		private:
+			HLSLTree* mpTree;
+			Array<CompileError>* mpErrors;
+
+			// Visible variables, mScopes holds where each nested scope starts in mSymbols
+			Array<const HLSLVariableDecl*> mSymbols;
+			Array<int> mScopes;
+
+			Array<const HLSLFunctionDecl*> mFunctions;
+			Array<Array<int>> mCallees;
+			int mCurrentFunction;
+			int mLoopDepth;
+
+		public:
+			HLSLTypeChecker()
+				: mpTree(nullptr)
+				, mpErrors(nullptr)
+				, mCurrentFunction(-1)
+				, mLoopDepth(0)
+			{
+			}
+
+			bool Check(HLSLTree& tree, Array<CompileError>& errors);
+
+		private:
+			// Declarations
+			void CheckGlobalVariable(HLSLVariableDecl* pVariable);
+			void CheckFunction(const int index);
+			void CheckVariable(HLSLVariableDecl* pVariable);
+			void CheckRecursion();
+
+			// Statements
+			void CheckStatement(HLSLStatement* pStatement);
+			void CheckCondition(HLSLExpression*& pCondition);
+			bool AlwaysReturns(const HLSLStatement* pStatement) const;
+
+			// Expressions, the pointer is updated when a conversion is wrapped around the expression
+			bool CheckExpression(HLSLExpression*& pExpr);
+			bool CheckUnary(HLSLUnaryExpression* pUnary);
+			bool CheckBinary(HLSLBinaryExpression* pBinary);
+			bool CheckConditional(HLSLConditionalExpression* pConditional);
+			bool CheckConstructor(HLSLConstructorExpression* pConstructor);
+			bool CheckMember(HLSLMemberExpression* pMember);
+			bool CheckIndex(HLSLIndexExpression* pIndex);
+			bool CheckCall(HLSLCallExpression* pCall);
+			bool CheckIntrinsic(HLSLCallExpression* pCall);
+			bool CheckMethodCall(HLSLMethodCallExpression* pCall);
+			bool CheckArguments(Array<HLSLExpression*>& arguments);
+
+			// Conversions
+			static bool CanConvert(const HLSLType& from, const HLSLType& to);
+			static bool CommonType(const HLSLType& lhs, const HLSLType& rhs, HLSLType& result);
+			bool Coerce(HLSLExpression*& pExpr, const HLSLType& to);
+			bool IsLValue(const HLSLExpression* pExpr) const;
+			bool CheckLValue(const HLSLExpression* pExpr);
+
+			// Symbols
+			void PushScope() { mScopes.Add(mSymbols.Size()); }
+			void PopScope();
+			void Declare(const HLSLVariableDecl* pVariable);
+			const HLSLVariableDecl* Lookup(const string& name) const;
+
+			void Error(const string& msg, const SourceInfo& srcInfo);
+		};
+	}
+}
\ No newline at end of file
@@ -0,0 +1,770 @@
+#include "IROptimizer.h"
+#include "ShaderInterpreter.h"
+
+namespace EDX
+{
+	namespace ShaderCompiler
+	{
+		namespace
+		{
+			const uint FLOAT_ONE = 0x3f800000;
+			const uint FLOAT_NEG_ZERO = 0x80000000;
+
+			// Rewrites usually settle after two rounds, the limit only guards against rewrites undoing each other
+			const int MAX_ROUNDS = 8;
+
+			// Jump targets are instruction indices and move when instructions before them are removed. Loop
+			// holds the index of its EndLoop
+			bool HasJumpTarget(const IROpcode op)
+			{
+				switch (op)
+				{
+				case IROpcode::If:
+				case IROpcode::Else:
+				case IROpcode::BreakUnless:
+				case IROpcode::Break:
+				case IROpcode::Continue:
+				case IROpcode::Loop:
+				case IROpcode::EndLoop:
+				case IROpcode::Return:
+					return true;
+				default:
+					return false;
+				}
+			}
+
+			// Float operations are left out, with two NaN operands the result depends on their order
+			bool IsCommutative(const IROpcode op)
+			{
+				switch (op)
+				{
+				case IROpcode::IAdd:
+				case IROpcode::IMul:
+				case IROpcode::IMin:
+				case IROpcode::IMax:
+				case IROpcode::UMin:
+				case IROpcode::UMax:
+				case IROpcode::And:
+				case IROpcode::Or:
+				case IROpcode::Xor:
+				case IROpcode::IEq:
+				case IROpcode::INe:
+				case IROpcode::FEq:
+				case IROpcode::FNe:
+					return true;
+				default:
+					return false;
+				}
+			}
+
+			int CountSamples(const Array<IRInstruction>& code)
+			{
+				int count = 0;
+				for (auto i = 0; i < code.Size(); i++)
+				{
+					if (code[i].Op >= IROpcode::Sample && code[i].Op <= IROpcode::SampleGrad)
+						count++;
+				}
+				return count;
+			}
+
+			// Marks an if with a condition the same in every lane together with the part that never runs. Ifs
+			// with control flow inside are left alone, jumps out of them land on the end that would go away
+			bool RemoveStaticBranch(const Array<IRInstruction>& code, const int pc, const bool taken, Array<bool>& removed)
+			{
+				int elsePc = -1, endPc = pc + 1;
+				for (; code[endPc].Op != IROpcode::EndIf; endPc++)
+				{
+					if (code[endPc].Op == IROpcode::Else)
+						elsePc = endPc;
+					else if (code[endPc].Op >= IROpcode::If)
+						return false;
+				}
+
+				const int skipBegin = taken ? elsePc : pc + 1;
+				const int skipEnd = taken ? (elsePc >= 0 ? endPc : -1) : (elsePc >= 0 ? elsePc + 1 : endPc);
+				for (auto i = skipBegin; i >= 0 && i < skipEnd; i++)
+					removed[i] = true;
+				removed[pc] = true;
+				removed[endPc] = true;
+
+				return true;
+			}
+		}
+
+		void IROptimizer::Optimize(IRProgram& program, IROptimizeStats* pStats)
+		{
+			mpProgram = &program;
+
+			const int instCountBefore = program.Instructions.Size();
+			const int sampleCountBefore = CountSamples(program.Instructions);
+
+			Classify();
+			for (auto round = 0; round < MAX_ROUNDS; round++)
+			{
+				CountDefinitions();
+				const bool simplified = Simplify();
+
+				CountDefinitions();
+				const bool eliminated = EliminateDeadCode();
+
+				if (!simplified && !eliminated)
+					break;
+			}
+			EliminateDeadSetup();
+			CompactRegisters();
+
+			if (pStats)
+			{
+				pStats->InstructionCountBefore = instCountBefore;
+				pStats->InstructionCountAfter = program.Instructions.Size();
+				pStats->SetupInstructionCount = program.SetupInstructions.Size();
+				pStats->SampleCountBefore = sampleCountBefore;
+				pStats->SampleCountAfter = CountSamples(program.Instructions);
+			}
+
+			mpProgram = nullptr;
+		}
+
+		void IROptimizer::Classify()
+		{
+			const IRProgram& program = *mpProgram;
+
+			mKinds.Clear();
+			mConstantValues.Clear();
+			mConstants.clear();
+			for (auto i = 0; i < program.RegisterCount; i++)
+			{
+				mKinds.Add(i < program.SharedRegisterCount ? RegisterKind::Constant : RegisterKind::Lane);
+				mConstantValues.Add(i < program.SharedRegisterCount ? program.SharedValues[i] : 0);
+			}
+
+			for (auto i = 0; i < program.Uniforms.Size(); i++)
+			{
+				for (auto c = 0; c < program.Uniforms[i].ComponentCount; c++)
+					mKinds[program.Uniforms[i].Register + c] = RegisterKind::Uniform;
+			}
+			for (auto i = 0; i < program.SetupInstructions.Size(); i++)
+				mKinds[program.SetupInstructions[i].Dst] = RegisterKind::Setup;
+
+			for (auto i = 0; i < program.SharedRegisterCount; i++)
+			{
+				if (mKinds[i] == RegisterKind::Constant && mConstants.find(mConstantValues[i]) == mConstants.end())
+					mConstants[mConstantValues[i]] = i;
+			}
+		}
+
+		void IROptimizer::CountDefinitions()
+		{
+			const int regCount = mKinds.Size();
+			mDefCounts.Resize(regCount);
+			mStored.Resize(regCount);
+			mValues.Resize(regCount);
+			for (auto i = 0; i < regCount; i++)
+			{
+				mDefCounts[i] = 0;
+				mStored[i] = false;
+				mValues[i] = i;
+			}
+
+			const Array<IRInstruction>& code = mpProgram->Instructions;
+			for (auto i = 0; i < code.Size(); i++)
+			{
+				const IRInstruction& inst = code[i];
+				for (auto k = 0; k < GetWriteCount(inst); k++)
+					mDefCounts[inst.Dst + k]++;
+				if (inst.Op == IROpcode::Store || inst.Op == IROpcode::StoreIf)
+					mStored[inst.Dst] = true;
+			}
+		}
+
+		bool IROptimizer::Simplify()
+		{
+			IRProgram& program = *mpProgram;
+			const Array<IRInstruction>& code = program.Instructions;
+
+			Array<IRInstruction> newCode;
+			Array<int> newIndices;
+			newIndices.Resize(code.Size() + 1);
+
+			// Expressions computed before in this region or an enclosing one. A region starts over where lanes
+			// that skipped the code before can join, at else, the end of a construct and the loop continue
+			Array<Expression> available;
+			Array<int> regionStarts;
+
+			Array<Expression> setupExprs;
+			for (auto i = 0; i < program.SetupInstructions.Size(); i++)
+			{
+				const IRInstruction& inst = program.SetupInstructions[i];
+				Expression expr = { inst.Op, { inst.Src[0], inst.Src[1], inst.Src[2], -1, -1, -1 }, inst.Imm, inst.Dst };
+				setupExprs.Add(expr);
+			}
+
+			bool changed = false;
+			Array<bool> removed;
+			removed.Resize(code.Size());
+			for (auto i = 0; i < code.Size(); i++)
+				removed[i] = false;
+			for (auto i = 0; i < code.Size(); i++)
+			{
+				const int cond = code[i].Src[0];
+				if (code[i].Op == IROpcode::If && !removed[i] && mKinds[cond] == RegisterKind::Constant &&
+					(mConstantValues[cond] == 0 || mConstantValues[cond] == 0xffffffff))
+					changed = RemoveStaticBranch(code, i, mConstantValues[cond] != 0, removed) || changed;
+			}
+
+			for (auto pc = 0; pc < code.Size(); pc++)
+			{
+				newIndices[pc] = newCode.Size();
+				if (removed[pc])
+					continue;
+
+				IRInstruction inst = code[pc];
+
+				// Fetch coordinates and gradients name the first of consecutive registers and are kept
+				for (auto j = 0; j < 3; j++)
+				{
+					const bool consecutive = (IsSample(inst.Op) && j == 0) || (inst.Op == IROpcode::SampleGrad && j == 1);
+					if (inst.Src[j] >= 0 && !consecutive)
+						inst.Src[j] = Canonical(inst.Src[j]);
+				}
+
+				if (IsControl(inst.Op))
+				{
+					switch (inst.Op)
+					{
+					case IROpcode::If:
+					case IROpcode::Loop:
+					case IROpcode::Begin:
+						regionStarts.Add(available.Size());
+						break;
+					case IROpcode::Else:
+					case IROpcode::LoopContinue:
+						available.Resize(regionStarts[regionStarts.Size() - 1]);
+						break;
+					case IROpcode::EndIf:
+					case IROpcode::EndLoop:
+					case IROpcode::End:
+						available.Resize(regionStarts[regionStarts.Size() - 1]);
+						regionStarts.Resize(regionStarts.Size() - 1);
+						break;
+					default:
+						break;
+					}
+				}
+				else if (IsArithmetic(inst.Op) && inst.Op != IROpcode::Mov)
+				{
+					bool shared = true, constant = true;
+					for (auto j = 0; j < 3; j++)
+					{
+						if (inst.Src[j] >= 0)
+						{
+							shared = shared && IsShared(inst.Src[j]);
+							constant = constant && mKinds[inst.Src[j]] == RegisterKind::Constant;
+						}
+					}
+
+					uint bits;
+					if (constant && FoldConstant(inst, bits))
+						inst = IRInstruction(IROpcode::Mov, inst.Dst, Constant(bits));
+					else if (shared)
+					{
+						// The same in every lane of the draw, computed once in the setup code
+						Expression expr = { inst.Op, { inst.Src[0], inst.Src[1], inst.Src[2], -1, -1, -1 }, inst.Imm, -1 };
+						int result = FindExpression(setupExprs, expr);
+						if (result < 0)
+						{
+							result = NewRegister(RegisterKind::Setup);
+							program.SetupInstructions.Add(IRInstruction(inst.Op, result, inst.Src[0], inst.Src[1], inst.Src[2], inst.Imm));
+							expr.Result = result;
+							setupExprs.Add(expr);
+						}
+						inst = IRInstruction(IROpcode::Mov, inst.Dst, result);
+					}
+					else
+						SimplifyIdentity(inst);
+				}
+
+				// Expressions over values computed before are copied from the first result
+				if ((IsArithmetic(inst.Op) && inst.Op != IROpcode::Mov) || inst.Op == IROpcode::Ddx || inst.Op == IROpcode::Ddy)
+				{
+					Expression expr = { inst.Op, { inst.Src[0], inst.Src[1], inst.Src[2], -1, -1, -1 }, inst.Imm, inst.Dst };
+					if (IsCommutative(inst.Op) && expr.Operands[0] > expr.Operands[1])
+						Swap(expr.Operands[0], expr.Operands[1]);
+
+					bool values = true;
+					for (auto j = 0; j < 3; j++)
+						values = values && (inst.Src[j] < 0 || IsValue(inst.Src[j]));
+
+					if (values)
+					{
+						const int result = FindExpression(available, expr);
+						if (result >= 0)
+							inst = IRInstruction(IROpcode::Mov, inst.Dst, result);
+						else if (IsValue(inst.Dst))
+							available.Add(expr);
+					}
+				}
+				else if (IsSample(inst.Op))
+				{
+					// A fetch repeated under the same or fewer lanes returns what the first one did
+					Expression expr = { inst.Op, { Canonical(inst.Src[0]), Canonical(inst.Src[0] + 1), -1, -1, -1, -1 }, inst.Imm, inst.Dst };
+					if (inst.Op == IROpcode::SampleBias)
+						expr.Operands[2] = inst.Src[1];
+					else if (inst.Op == IROpcode::SampleGrad)
+					{
+						for (auto k = 0; k < 4; k++)
+							expr.Operands[2 + k] = Canonical(inst.Src[1] + k);
+					}
+
+					bool values = true;
+					for (auto j = 0; j < 6; j++)
+						values = values && (expr.Operands[j] < 0 || IsValue(expr.Operands[j]));
+					for (auto k = 0; k < 4; k++)
+						values = values && IsValue(inst.Dst + k);
+
+					if (values)
+					{
+						const int result = FindExpression(available, expr);
+						if (result >= 0)
+						{
+							for (auto k = 0; k < 4; k++)
+							{
+								newCode.Add(IRInstruction(IROpcode::Mov, inst.Dst + k, result + k));
+								mValues[inst.Dst + k] = result + k;
+							}
+							changed = true;
+							continue;
+						}
+						available.Add(expr);
+					}
+				}
+				else if (inst.Op == IROpcode::StoreIf && mKinds[inst.Src[1]] == RegisterKind::Constant)
+				{
+					// A constant condition is the same in every lane
+					if (mConstantValues[inst.Src[1]] == 0)
+					{
+						changed = true;
+						continue;
+					}
+					if (mConstantValues[inst.Src[1]] == 0xffffffff)
+						inst = IRInstruction(IROpcode::Store, inst.Dst, inst.Src[0]);
+				}
+
+				// Later reads of a copy read the original
+				if (inst.Op == IROpcode::Mov && IsValue(inst.Dst) && IsValue(inst.Src[0]))
+					mValues[inst.Dst] = inst.Src[0];
+
+				changed = changed || memcmp(&inst, &code[pc], sizeof(IRInstruction)) != 0;
+				newCode.Add(inst);
+			}
+			newIndices[code.Size()] = newCode.Size();
+
+			for (auto i = 0; i < newCode.Size(); i++)
+			{
+				if (HasJumpTarget(newCode[i].Op))
+					newCode[i].Imm = newIndices[newCode[i].Imm];
+			}
+			program.Instructions = newCode;
+
+			return changed;
+		}
+
+		bool IROptimizer::EliminateDeadCode()
+		{
+			IRProgram& program = *mpProgram;
+			const Array<IRInstruction>& code = program.Instructions;
+
+			// Registers an output depends on, control flow decides which lanes write and is always kept
+			Array<bool> live;
+			live.Resize(mKinds.Size());
+			for (auto i = 0; i < live.Size(); i++)
+				live[i] = false;
+			for (auto i = 0; i < program.Outputs.Size(); i++)
+			{
+				for (auto c = 0; c < program.Outputs[i].ComponentCount; c++)
+					live[program.Outputs[i].Register + c] = true;
+			}
+
+			Array<bool> needed;
+			needed.Resize(code.Size());
+			for (auto i = 0; i < code.Size(); i++)
+				needed[i] = false;
+
+			Array<int> reads;
+			bool grown = true;
+			while (grown)
+			{
+				grown = false;
+				for (int i = code.Size() - 1; i >= 0; i--)
+				{
+					if (needed[i])
+						continue;
+
+					const IRInstruction& inst = code[i];
+					bool writesLive = false;
+					for (auto k = 0; k < GetWriteCount(inst); k++)
+						writesLive = writesLive || live[inst.Dst + k];
+					if (!IsControl(inst.Op) && !writesLive)
+						continue;
+
+					needed[i] = true;
+					grown = true;
+					GetReads(inst, reads);
+					for (auto j = 0; j < reads.Size(); j++)
+						live[reads[j]] = true;
+				}
+			}
+
+			Array<int> kept;
+			for (auto i = 0; i < code.Size(); i++)
+			{
+				if (needed[i])
+					kept.Add(i);
+			}
+
+			// Constructs left empty go away, a then or else part on its own and empty functions
+			bool emptied = true;
+			while (emptied)
+			{
+				emptied = false;
+				for (auto k = 0; k + 1 < kept.Size() && !emptied; k++)
+				{
+					const IROpcode op = code[kept[k]].Op;
+					const IROpcode next = code[kept[k + 1]].Op;
+
+					int removeCount = 0;
+					if ((op == IROpcode::If && next == IROpcode::EndIf) || (op == IROpcode::Begin && next == IROpcode::End))
+						removeCount = 2;
+					else if (op == IROpcode::Else && next == IROpcode::EndIf)
+						removeCount = 1;
+
+					if (removeCount > 0)
+					{
+						for (auto j = 0; j < removeCount; j++)
+							needed[kept[k + j]] = false;
+
+						Array<int> remaining;
+						for (auto j = 0; j < kept.Size(); j++)
+						{
+							if (needed[kept[j]])
+								remaining.Add(kept[j]);
+						}
+						kept = remaining;
+						emptied = true;
+					}
+				}
+			}
+
+			// Inputs no kept instruction reads are not fed any more
+			Array<IRBinding> inputs;
+			for (auto i = 0; i < program.Inputs.Size(); i++)
+			{
+				bool used = false;
+				for (auto c = 0; c < program.Inputs[i].ComponentCount; c++)
+					used = used || live[program.Inputs[i].Register + c];
+				if (used)
+					inputs.Add(program.Inputs[i]);
+			}
+			program.Inputs = inputs;
+
+			if (kept.Size() == code.Size())
+				return false;
+
+			// Jumps to removed instructions continue at the next kept one
+			Array<int> newIndices;
+			newIndices.Resize(code.Size() + 1);
+			Array<IRInstruction> newCode;
+			for (auto i = 0; i < code.Size(); i++)
+			{
+				newIndices[i] = newCode.Size();
+				if (needed[i])
+					newCode.Add(code[i]);
+			}
+			newIndices[code.Size()] = newCode.Size();
+
+			for (auto i = 0; i < newCode.Size(); i++)
+			{
+				if (HasJumpTarget(newCode[i].Op))
+					newCode[i].Imm = newIndices[newCode[i].Imm];
+			}
+			program.Instructions = newCode;
+
+			return true;
+		}
+
+		void IROptimizer::EliminateDeadSetup()
+		{
+			IRProgram& program = *mpProgram;
+
+			Array<bool> live;
+			live.Resize(mKinds.Size());
+			for (auto i = 0; i < live.Size(); i++)
+				live[i] = false;
+
+			Array<int> reads;
+			for (auto i = 0; i < program.Instructions.Size(); i++)
+			{
+				GetReads(program.Instructions[i], reads);
+				for (auto j = 0; j < reads.Size(); j++)
+					live[reads[j]] = true;
+			}
+
+			Array<bool> needed;
+			needed.Resize(program.SetupInstructions.Size());
+			for (int i = program.SetupInstructions.Size() - 1; i >= 0; i--)
+			{
+				const IRInstruction& inst = program.SetupInstructions[i];
+				needed[i] = live[inst.Dst];
+				if (!needed[i])
+					continue;
+
+				GetReads(inst, reads);
+				for (auto j = 0; j < reads.Size(); j++)
+					live[reads[j]] = true;
+			}
+
+			Array<IRInstruction> setup;
+			for (auto i = 0; i < program.SetupInstructions.Size(); i++)
+			{
+				if (needed[i])
+					setup.Add(program.SetupInstructions[i]);
+			}
+			program.SetupInstructions = setup;
+		}
+
+		void IROptimizer::CompactRegisters()
+		{
+			IRProgram& program = *mpProgram;
+			const int regCount = mKinds.Size();
+
+			Array<bool> used;
+			used.Resize(regCount);
+			for (auto i = 0; i < regCount; i++)
+				used[i] = false;
+
+			Array<int> reads;
+			const Array<IRInstruction>* codes[] = { &program.SetupInstructions, &program.Instructions };
+			for (auto pCode : codes)
+			{
+				for (auto i = 0; i < pCode->Size(); i++)
+				{
+					const IRInstruction& inst = (*pCode)[i];
+					for (auto k = 0; k < GetWriteCount(inst); k++)
+						used[inst.Dst + k] = true;
+
+					GetReads(inst, reads);
+					for (auto j = 0; j < reads.Size(); j++)
+						used[reads[j]] = true;
+				}
+			}
+
+			Array<IRBinding>* bindings[] = { &program.Uniforms, &program.Inputs, &program.Outputs };
+			for (auto pBindings : bindings)
+			{
+				for (auto i = 0; i < pBindings->Size(); i++)
+				{
+					for (auto c = 0; c < (*pBindings)[i].ComponentCount; c++)
+						used[(*pBindings)[i].Register + c] = true;
+				}
+			}
+
+			// The layout of HLSLLowering with setup results after the uniforms. Registers read as consecutive
+			// runs are all used and keep their order, so they stay consecutive
+			Array<int> remap;
+			remap.Resize(regCount);
+
+			int next = 0;
+			const RegisterKind order[] = { RegisterKind::Constant, RegisterKind::Uniform, RegisterKind::Setup, RegisterKind::Lane };
+			for (const auto kind : order)
+			{
+				if (kind == RegisterKind::Lane)
+					program.SharedRegisterCount = next;
+
+				for (auto i = 0; i < regCount; i++)
+				{
+					if (mKinds[i] == kind && used[i])
+						remap[i] = next++;
+				}
+			}
+			program.RegisterCount = next;
+
+			program.SharedValues.Resize(program.SharedRegisterCount);
+			for (auto i = 0; i < regCount; i++)
+			{
+				if (used[i] && IsShared(i))
+					program.SharedValues[remap[i]] = mKinds[i] == RegisterKind::Constant ? mConstantValues[i] : 0;
+			}
+
+			Array<IRInstruction>* rewrites[] = { &program.SetupInstructions, &program.Instructions };
+			for (auto pCode : rewrites)
+			{
+				for (auto i = 0; i < pCode->Size(); i++)
+				{
+					IRInstruction& inst = (*pCode)[i];
+					if (inst.Dst >= 0)
+						inst.Dst = remap[inst.Dst];
+					for (auto j = 0; j < 3; j++)
+					{
+						if (inst.Src[j] >= 0)
+							inst.Src[j] = remap[inst.Src[j]];
+					}
+				}
+			}
+
+			for (auto pBindings : bindings)
+			{
+				for (auto i = 0; i < pBindings->Size(); i++)
+					(*pBindings)[i].Register = remap[(*pBindings)[i].Register];
+			}
+		}
+
+		bool IROptimizer::FoldConstant(const IRInstruction& inst, uint& result) const
+		{
+			// Evaluated by the interpreter so folding gives exactly what running the program would
+			__m128 registers[5];
+			registers[0] = _mm_setzero_ps();
+			for (auto j = 0; j < 3; j++)
+				registers[1 + j] = inst.Src[j] >= 0 ? _mm_castsi128_ps(_mm_set1_epi32(mConstantValues[inst.Src[j]])) : _mm_setzero_ps();
+
+			IRInstruction local = inst;
+			local.Dst = 4;
+			for (auto j = 0; j < 3; j++)
+				local.Src[j] = inst.Src[j] >= 0 ? 1 + j : -1;
+
+			const __m128 exec = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			ShaderInterpreter<1>::ExecuteInstruction(local, 4, registers, &exec, nullptr);
+
+			uint lanes[4];
+			_mm_storeu_ps((float*)lanes, registers[4]);
+			result = lanes[0];
+
+			return lanes[1] == result && lanes[2] == result && lanes[3] == result;
+		}
+
+		bool IROptimizer::SimplifyIdentity(IRInstruction& inst)
+		{
+			const int a = inst.Src[0];
+			const int b = inst.Src[1];
+			const int c = inst.Src[2];
+
+			// Only identities that hold for every input, x + 0 is left alone as -0 + 0 is +0
+			int copy = -1;
+			switch (inst.Op)
+			{
+			case IROpcode::Select:
+				copy = IsConstant(a, 0xffffffff) || b == c ? b : IsConstant(a, 0) ? c : -1;
+				break;
+			case IROpcode::FAdd:
+				copy = IsConstant(b, FLOAT_NEG_ZERO) ? a : IsConstant(a, FLOAT_NEG_ZERO) ? b : -1;
+				break;
+			case IROpcode::FSub:
+				copy = IsConstant(b, 0) ? a : -1;
+				break;
+			case IROpcode::FMul:
+				copy = IsConstant(b, FLOAT_ONE) ? a : IsConstant(a, FLOAT_ONE) ? b : -1;
+				break;
+			case IROpcode::FDiv:
+				copy = IsConstant(b, FLOAT_ONE) ? a : -1;
+				break;
+			case IROpcode::FMad:
+				if (IsConstant(c, FLOAT_NEG_ZERO))
+					inst = IRInstruction(IROpcode::FMul, inst.Dst, a, b);
+				else if (IsConstant(a, FLOAT_ONE))
+					inst = IRInstruction(IROpcode::FAdd, inst.Dst, b, c);
+				else if (IsConstant(b, FLOAT_ONE))
+					inst = IRInstruction(IROpcode::FAdd, inst.Dst, a, c);
+				else
+					return false;
+				return true;
+			case IROpcode::IAdd:
+			case IROpcode::Or:
+			case IROpcode::Xor:
+				copy = IsConstant(b, 0) ? a : IsConstant(a, 0) ? b : -1;
+				break;
+			case IROpcode::ISub:
+			case IROpcode::Shl:
+			case IROpcode::Shr:
+			case IROpcode::UShr:
+				copy = IsConstant(b, 0) ? a : -1;
+				break;
+			case IROpcode::IMul:
+				copy = IsConstant(b, 1) ? a : IsConstant(a, 1) ? b : -1;
+				break;
+			case IROpcode::And:
+				copy = IsConstant(b, 0xffffffff) ? a : IsConstant(a, 0xffffffff) ? b : -1;
+				break;
+			default:
+				break;
+			}
+
+			if (copy < 0)
+				return false;
+
+			inst = IRInstruction(IROpcode::Mov, inst.Dst, copy);
+			return true;
+		}
+
+		int IROptimizer::FindExpression(const Array<Expression>& exprs, const Expression& expr) const
+		{
+			for (int i = exprs.Size() - 1; i >= 0; i--)
+			{
+				const Expression& other = exprs[i];
+				if (other.Op == expr.Op && other.Imm == expr.Imm && memcmp(other.Operands, expr.Operands, sizeof(expr.Operands)) == 0)
+					return other.Result;
+			}
+			return -1;
+		}
+
+		int IROptimizer::Constant(const uint bits)
+		{
+			auto it = mConstants.find(bits);
+			if (it != mConstants.end())
+				return it->second;
+
+			const int reg = NewRegister(RegisterKind::Constant);
+			mConstantValues[reg] = bits;
+			mConstants[bits] = reg;
+			return reg;
+		}
+
+		int IROptimizer::NewRegister(const RegisterKind kind)
+		{
+			const int reg = mKinds.Size();
+			mKinds.Add(kind);
+			mConstantValues.Add(0);
+			mDefCounts.Add(0);
+			mStored.Add(false);
+			mValues.Add(reg);
+			return reg;
+		}
+
+		void IROptimizer::GetReads(const IRInstruction& inst, Array<int>& regs)
+		{
+			regs.Clear();
+			if (IsSample(inst.Op))
+			{
+				regs.Add(inst.Src[0]);
+				regs.Add(inst.Src[0] + 1);
+				if (inst.Op == IROpcode::SampleBias)
+					regs.Add(inst.Src[1]);
+				else if (inst.Op == IROpcode::SampleGrad)
+				{
+					for (auto k = 0; k < 4; k++)
+						regs.Add(inst.Src[1] + k);
+				}
+				return;
+			}
+
+			for (auto j = 0; j < 3; j++)
+			{
+				if (inst.Src[j] >= 0)
+					regs.Add(inst.Src[j]);
+			}
+
+			// Lanes outside the mask keep what the register held
+			if (inst.Op == IROpcode::Store || inst.Op == IROpcode::StoreIf)
+				regs.Add(inst.Dst);
+		}
+	}
+}
\ No newline at end of file
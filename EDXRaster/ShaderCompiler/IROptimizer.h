@@ -0,0 +1,102 @@
+#pragma once
+
+#include "EDXPrerequisites.h"
+#include "ShaderIR.h"
+
+#include <unordered_map>
+
+namespace EDX
+{
+	namespace ShaderCompiler
+	{
+		struct IROptimizeStats
+		{
+			int InstructionCountBefore;	// Per lane instructions
+			int InstructionCountAfter;
+			int SetupInstructionCount;	// Uniform only work moved to draw setup
+			int SampleCountBefore;
+			int SampleCountAfter;
+
+			IROptimizeStats()
+				: InstructionCountBefore(0)
+				, InstructionCountAfter(0)
+				, SetupInstructionCount(0)
+				, SampleCountBefore(0)
+				, SampleCountAfter(0)
+			{
+			}
+		};
+
+		// Rewrites a lowered program into one with the same results in every lane that reads an output.
+		// Expressions of constants are folded, expressions of uniforms move to the setup code that runs once
+		// per draw, repeated expressions and texture fetches are computed once, and code whose results no
+		// output depends on is removed together with the inputs it reads. Outputs removed from the program
+		// before optimizing count as unused
+		class IROptimizer
+		{
+		private:
+			enum class RegisterKind
+			{
+				Constant,
+				Uniform,
+				Setup,
+				Lane,
+			};
+
+			// An instruction already computed in an enclosing region, operands are canonical registers
+			struct Expression
+			{
+				IROpcode Op;
+				int Operands[6];
+				int Imm;
+				int Result;
+			};
+
+			IRProgram* mpProgram;
+
+			Array<RegisterKind> mKinds;
+			Array<uint> mConstantValues;	// Indexed by register, only meaningful for constants
+			std::unordered_map<uint, int> mConstants;
+
+			// Per pass, indexed by register
+			Array<int> mDefCounts;
+			Array<bool> mStored;			// Written through Store or StoreIf
+			Array<int> mValues;				// Register known to hold the same value
+
+		public:
+			IROptimizer()
+				: mpProgram(nullptr)
+			{
+			}
+
+			void Optimize(IRProgram& program, IROptimizeStats* pStats = nullptr);
+
+		private:
+			void Classify();
+			void CountDefinitions();
+			bool Simplify();
+			bool EliminateDeadCode();
+			void EliminateDeadSetup();
+			void CompactRegisters();
+
+			bool FoldConstant(const IRInstruction& inst, uint& result) const;
+			bool SimplifyIdentity(IRInstruction& inst);
+			int FindExpression(const Array<Expression>& exprs, const Expression& expr) const;
+			int Canonical(const int reg) const { return mValues[reg]; }
+			int Constant(const uint bits);
+			int NewRegister(const RegisterKind kind);
+
+			bool IsValue(const int reg) const { return mDefCounts[reg] == 0 || (mDefCounts[reg] == 1 && !mStored[reg]); }
+			bool IsShared(const int reg) const { return mKinds[reg] != RegisterKind::Lane; }
+			bool IsConstant(const int reg, const uint bits) const { return mKinds[reg] == RegisterKind::Constant && mConstantValues[reg] == bits; }
+
+			// Registers an instruction reads, with the consecutive ones behind fetch operands
+			static void GetReads(const IRInstruction& inst, Array<int>& regs);
+			static int GetWriteCount(const IRInstruction& inst) { return IsSample(inst.Op) ? 4 : (inst.Dst >= 0 ? 1 : 0); }
+
+			static bool IsArithmetic(const IROpcode op) { return op <= IROpcode::FToU && op != IROpcode::Store && op != IROpcode::StoreIf; }
+			static bool IsSample(const IROpcode op) { return op >= IROpcode::Sample && op <= IROpcode::SampleGrad; }
+			static bool IsControl(const IROpcode op) { return op >= IROpcode::If; }
+		};
+	}
+}
\ No newline at end of file
@@ -0,0 +1,38 @@
+#include "ShaderCompiler.h"
+#include "HLSLParser.h"
+#include "HLSLTypeChecker.h"
+#include "HLSLLowering.h"
+
+namespace EDX
+{
+	namespace ShaderCompiler
+	{
+		bool CompileShader(const char* fileName,
+			const string& source,
+			const string& entryPoint,
+			const ShaderStage stage,
+			IRProgram& program,
+			Array<CompileError>& errors,
+			IROptimizeStats* pStats)
+		{
+			HLSLTree tree;
+
+			HLSLParser parser;
+			if (!parser.Parse(fileName, source, tree, errors))
+				return false;
+
+			HLSLTypeChecker checker;
+			if (!checker.Check(tree, errors))
+				return false;
+
+			HLSLLowering lowering;
+			if (!lowering.Lower(tree, entryPoint, stage, program, errors))
+				return false;
+
+			IROptimizer optimizer;
+			optimizer.Optimize(program, pStats);
+
+			return true;
+		}
+	}
+}
\ No newline at end of file
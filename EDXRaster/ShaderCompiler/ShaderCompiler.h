@@ -0,0 +1,22 @@
+#pragma once
+
+#include "EDXPrerequisites.h"
+#include "CompilerCommon.h"
+#include "ShaderIR.h"
+#include "IROptimizer.h"
+
+namespace EDX
+{
+	namespace ShaderCompiler
+	{
+		// Parses, type checks, lowers and optimizes one entry point of an HLSL source. Returns false with the
+		// errors filled in when any stage fails
+		bool CompileShader(const char* fileName,
+			const string& source,
+			const string& entryPoint,
+			const ShaderStage stage,
+			IRProgram& program,
+			Array<CompileError>& errors,
+			IROptimizeStats* pStats = nullptr);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,88 @@
+#include "ShaderIR.h"
+
+namespace EDX
+{
+	namespace ShaderCompiler
+	{
+		const char* IRProgram::GetOpcodeName(const IROpcode op)
+		{
+			static const char* names[] =
+			{
+				"mov", "store", "storeif", "select",
+				"fadd", "fsub", "fmul", "fdiv", "fmad", "fmin", "fmax", "fmod", "fneg", "fabs", "fsqrt", "frsqrt", "frcp",
+				"ffloor", "fceil", "ffrac", "fround", "ftrunc", "fsaturate", "fexp", "fexp2", "flog", "flog2", "fpow",
+				"fsin", "fcos", "ftan", "fasin", "facos", "fatan", "fatan2", "flt", "fle", "feq", "fne",
+				"iadd", "isub", "imul", "idiv", "imod", "udiv", "umod", "ineg", "iabs", "imin", "imax", "umin", "umax",
+				"and", "or", "xor", "not", "shl", "shr", "ushr", "ilt", "ile", "ieq", "ine", "ult", "ule",
+				"itof", "utof", "ftoi", "ftou",
+				"ddx", "ddy",
+				"sample", "samplebias", "samplegrad",
+				"if", "else", "endif", "loop", "breakunless", "break", "continue", "loopcontinue", "endloop",
+				"begin", "return", "end",
+			};
+			static_assert(sizeof(names) / sizeof(names[0]) == int(IROpcode::Count), "Opcode names out of sync");
+
+			return names[int(op)];
+		}
+
+		string IRProgram::Disassemble() const
+		{
+			string ret;
+			char line[128];
+
+			for (auto i = 0; i < SharedRegisterCount; i++)
+			{
+				// Uniforms and setup results are listed with their sources
+				bool isConstant = true;
+				for (auto j = 0; j < Uniforms.Size(); j++)
+					isConstant = isConstant && (i < Uniforms[j].Register || i >= Uniforms[j].Register + Uniforms[j].ComponentCount);
+				for (auto j = 0; j < SetupInstructions.Size(); j++)
+					isConstant = isConstant && SetupInstructions[j].Dst != i;
+				if (!isConstant)
+					continue;
+
+				float value;
+				memcpy(&value, &SharedValues[i], sizeof(float));
+				sprintf_s(line, 128, "r%i = 0x%08x (%g)\n", i, SharedValues[i], value);
+				ret += line;
+			}
+
+			for (auto i = 0; i < Uniforms.Size(); i++)
+				ret += "r" + std::to_string(Uniforms[i].Register) + " = uniform " + Uniforms[i].Type.ToString() + " " + Uniforms[i].Name + "\n";
+			for (auto i = 0; i < Inputs.Size(); i++)
+				ret += "r" + std::to_string(Inputs[i].Register) + " = input " + Inputs[i].Type.ToString() + " " + Inputs[i].Name + "\n";
+			for (auto i = 0; i < Outputs.Size(); i++)
+				ret += "r" + std::to_string(Outputs[i].Register) + " = output " + Outputs[i].Type.ToString() + " " + Outputs[i].Name + "\n";
+
+			if (SetupInstructions.Size() > 0)
+			{
+				ret += "setup:\n";
+				for (auto i = 0; i < SetupInstructions.Size(); i++)
+					ret += DisassembleInstruction(SetupInstructions[i], i);
+				ret += "code:\n";
+			}
+
+			for (auto i = 0; i < Instructions.Size(); i++)
+				ret += DisassembleInstruction(Instructions[i], i);
+
+			return ret;
+		}
+
+		string IRProgram::DisassembleInstruction(const IRInstruction& inst, const int index)
+		{
+			char line[128];
+			int length = sprintf_s(line, 128, "%4i: %s", index, GetOpcodeName(inst.Op));
+			if (inst.Dst >= 0)
+				length += sprintf_s(line + length, 128 - length, " r%i", inst.Dst);
+			for (auto j = 0; j < 3; j++)
+			{
+				if (inst.Src[j] >= 0)
+					length += sprintf_s(line + length, 128 - length, "%s r%i", inst.Dst >= 0 || j > 0 ? "," : "", inst.Src[j]);
+			}
+			if (inst.Op >= IROpcode::Sample)
+				length += sprintf_s(line + length, 128 - length, " [%i]", inst.Imm);
+
+			return string(line) + "\n";
+		}
+	}
+}
\ No newline at end of file
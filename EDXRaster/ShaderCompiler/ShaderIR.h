@@ -0,0 +1,218 @@
+#pragma once
+
+#include "EDXPrerequisites.h"
+#include "HLSLAST.h"
+
+namespace EDX
+{
+	namespace ShaderCompiler
+	{
+		enum class ShaderStage
+		{
+			Vertex,
+			Pixel,
+		};
+
+		// Scalar instructions over register lanes. A register holds one component of a value for every lane
+		// of a batch, vectors and matrices take one register per component. Int registers also hold uint and
+		// bool values, bools are all bits set or clear per lane
+		enum class IROpcode
+		{
+			// Moves, Store only writes the lanes of the execution mask and StoreIf those where Src1 is also set
+			Mov,
+			Store,
+			StoreIf,
+			Select,		// Src0 ? Src1 : Src2 per lane
+
+			// Float
+			FAdd,
+			FSub,
+			FMul,
+			FDiv,
+			FMad,
+			FMin,
+			FMax,
+			FMod,
+			FNeg,
+			FAbs,
+			FSqrt,
+			FRsqrt,
+			FRcp,
+			FFloor,
+			FCeil,
+			FFrac,
+			FRound,
+			FTrunc,
+			FSaturate,
+			FExp,
+			FExp2,
+			FLog,
+			FLog2,
+			FPow,
+			FSin,
+			FCos,
+			FTan,
+			FAsin,
+			FAcos,
+			FAtan,
+			FAtan2,
+			FLt,
+			FLe,
+			FEq,
+			FNe,
+
+			// Int, U variants treat the lanes as unsigned
+			IAdd,
+			ISub,
+			IMul,
+			IDiv,
+			IMod,
+			UDiv,
+			UMod,
+			INeg,
+			IAbs,
+			IMin,
+			IMax,
+			UMin,
+			UMax,
+			And,
+			Or,
+			Xor,
+			Not,
+			Shl,
+			Shr,
+			UShr,
+			ILt,
+			ILe,
+			IEq,
+			INe,
+			ULt,
+			ULe,
+
+			// Conversions
+			IToF,
+			UToF,
+			FToI,
+			FToU,
+
+			// Pixel quads, the difference to the horizontal or vertical neighbour of the quad
+			Ddx,
+			Ddy,
+
+			// Fetch float4 into Dst..Dst+3 from texture slot Imm. Coordinates are in Src0, Src0+1, the bias is
+			// in Src1 and the gradients in Src1..Src1+3 as ddx(u), ddx(v), ddy(u), ddy(v)
+			Sample,
+			SampleBias,
+			SampleGrad,
+
+			// Structured control flow. Lanes leave the execution mask instead of branching, a jump is only
+			// taken once no lane of the batch is left active. Imm is the jump target
+			If,				// Jumps to the matching Else or EndIf
+			Else,			// Jumps to the matching EndIf
+			EndIf,
+			Loop,
+			BreakUnless,	// Lanes where Src0 is clear leave the loop, jumps to EndLoop
+			Break,			// Jumps to the end of the innermost construct
+			Continue,
+			LoopContinue,	// Continued lanes rejoin before the loop increment
+			EndLoop,		// Jumps back to the loop head while lanes remain
+			Begin,			// Inlined function with returns before its end
+			Return,
+			End,
+
+			Count,
+		};
+
+		struct IRInstruction
+		{
+			IROpcode Op;
+			int Dst;
+			int Src[3];
+			int Imm;
+
+			IRInstruction(const IROpcode op = IROpcode::Mov, const int dst = -1, const int src0 = -1, const int src1 = -1, const int src2 = -1, const int imm = 0)
+				: Op(op)
+				, Dst(dst)
+				, Imm(imm)
+			{
+				Src[0] = src0;
+				Src[1] = src1;
+				Src[2] = src2;
+			}
+		};
+
+		// A named value exchanged with the renderer, the components live in consecutive registers
+		struct IRBinding
+		{
+			string Name;	// Uniform name, or semantic of inputs and outputs
+			HLSLType Type;
+			int Register;
+			int ComponentCount;
+
+			IRBinding()
+				: Register(-1)
+				, ComponentCount(0)
+			{
+			}
+
+			IRBinding(const string& name, const HLSLType& type, const int reg, const int componentCount)
+				: Name(name)
+				, Type(type)
+				, Register(reg)
+				, ComponentCount(componentCount)
+			{
+			}
+		};
+
+		// A lowered shader entry point. Registers [0, SharedRegisterCount) hold constants, uniforms and values
+		// computed from those only, which are the same for every lane and never written by the program. Values
+		// in registers are raw 32 bit patterns, SharedValues is indexed by register and has the constants
+		// filled in
+		class IRProgram
+		{
+		public:
+			static const int MAX_CONTROL_DEPTH = 32;
+
+			ShaderStage Stage;
+			Array<IRInstruction> Instructions;
+			Array<IRInstruction> SetupInstructions;	// Run once per draw with the uniforms filled in, no control flow
+			int RegisterCount;
+			int SharedRegisterCount;
+			Array<uint> SharedValues;
+
+			Array<IRBinding> Uniforms;
+			Array<IRBinding> Inputs;
+			Array<IRBinding> Outputs;
+			Array<string> Textures; // Texture slots by global name
+
+		public:
+			IRProgram()
+				: Stage(ShaderStage::Pixel)
+				, RegisterCount(0)
+				, SharedRegisterCount(0)
+			{
+			}
+
+			const IRBinding* FindInput(const string& semantic) const { return FindBinding(Inputs, semantic); }
+			const IRBinding* FindOutput(const string& semantic) const { return FindBinding(Outputs, semantic); }
+
+			// Readable listing, one instruction per line
+			string Disassemble() const;
+
+			static const char* GetOpcodeName(const IROpcode op);
+
+		private:
+			static string DisassembleInstruction(const IRInstruction& inst, const int index);
+
+			static const IRBinding* FindBinding(const Array<IRBinding>& bindings, const string& name)
+			{
+				for (auto i = 0; i < bindings.Size(); i++)
+				{
+					if (bindings[i].Name == name)
+						return &bindings[i];
+				}
+				return nullptr;
+			}
+		};
+	}
+}
\ No newline at end of file
@@ -0,0 +1,373 @@
+#include "ShaderInterpreter.h"
+#include "ShaderOps.h"
+
+namespace EDX
+{
+	namespace ShaderCompiler
+	{
+		namespace
+		{
+			typedef ShaderOps<__m128> Ops;
+
+			__forceinline bool AnyActive(const __m128* pMask, const int count)
+			{
+				__m128 any = pMask[0];
+				for (auto q = 1; q < count; q++)
+					any = _mm_or_ps(any, pMask[q]);
+				return _mm_movemask_ps(any) != 0;
+			}
+		}
+
+		template<int QuadCount>
+		void ShaderInterpreter<QuadCount>::ExecuteInstruction(const IRInstruction& inst,
+			const int sharedRegisterCount,
+			__m128* pRegisters,
+			const __m128* pExec,
+			const IRTextureSource* pTextures)
+		{
+			// Unused operands point at register 0 and are never read
+			__m128* d = pRegisters + (inst.Dst > 0 ? inst.Dst : 0) * QuadCount;
+			const __m128* a = pRegisters + (inst.Src[0] > 0 ? inst.Src[0] : 0) * QuadCount;
+			const __m128* b = pRegisters + (inst.Src[1] > 0 ? inst.Src[1] : 0) * QuadCount;
+			const __m128* c = pRegisters + (inst.Src[2] > 0 ? inst.Src[2] : 0) * QuadCount;
+
+#define UNARY(expr) for (auto q = 0; q < QuadCount; q++) { const __m128 x = a[q]; d[q] = (expr); } break
+#define BINARY(expr) for (auto q = 0; q < QuadCount; q++) { const __m128 x = a[q], y = b[q]; d[q] = (expr); } break
+
+			switch (inst.Op)
+			{
+			case IROpcode::Mov: UNARY(x);
+			case IROpcode::Store:
+				for (auto q = 0; q < QuadCount; q++)
+					d[q] = Ops::Store(pExec[q], a[q], d[q]);
+				break;
+			case IROpcode::StoreIf:
+				for (auto q = 0; q < QuadCount; q++)
+					d[q] = Ops::StoreIf(pExec[q], a[q], b[q], d[q]);
+				break;
+			case IROpcode::Select:
+				for (auto q = 0; q < QuadCount; q++)
+					d[q] = Ops::Select(a[q], b[q], c[q]);
+				break;
+
+			case IROpcode::FAdd: BINARY(Ops::FAdd(x, y));
+			case IROpcode::FSub: BINARY(Ops::FSub(x, y));
+			case IROpcode::FMul: BINARY(Ops::FMul(x, y));
+			case IROpcode::FDiv: BINARY(Ops::FDiv(x, y));
+			case IROpcode::FMad:
+				for (auto q = 0; q < QuadCount; q++)
+					d[q] = Ops::FMad(a[q], b[q], c[q]);
+				break;
+			case IROpcode::FMin: BINARY(Ops::FMin(x, y));
+			case IROpcode::FMax: BINARY(Ops::FMax(x, y));
+			case IROpcode::FMod: BINARY(Ops::FMod(x, y));
+			case IROpcode::FNeg: UNARY(Ops::FNeg(x));
+			case IROpcode::FAbs: UNARY(Ops::FAbs(x));
+			case IROpcode::FSqrt: UNARY(Ops::FSqrt(x));
+			case IROpcode::FRsqrt: UNARY(Ops::FRsqrt(x));
+			case IROpcode::FRcp: UNARY(Ops::FRcp(x));
+			case IROpcode::FFloor: UNARY(Ops::FFloor(x));
+			case IROpcode::FCeil: UNARY(Ops::FCeil(x));
+			case IROpcode::FFrac: UNARY(Ops::FFrac(x));
+			case IROpcode::FRound: UNARY(Ops::FRound(x));
+			case IROpcode::FTrunc: UNARY(Ops::FTrunc(x));
+			case IROpcode::FSaturate: UNARY(Ops::FSaturate(x));
+			case IROpcode::FExp: UNARY(Ops::FExp(x));
+			case IROpcode::FExp2: UNARY(Ops::FExp2(x));
+			case IROpcode::FLog: UNARY(Ops::FLog(x));
+			case IROpcode::FLog2: UNARY(Ops::FLog2(x));
+			case IROpcode::FPow: BINARY(Ops::FPow(x, y));
+			case IROpcode::FSin: UNARY(Ops::FSin(x));
+			case IROpcode::FCos: UNARY(Ops::FCos(x));
+			case IROpcode::FTan: UNARY(Ops::FTan(x));
+			case IROpcode::FAsin: UNARY(Ops::FAsin(x));
+			case IROpcode::FAcos: UNARY(Ops::FAcos(x));
+			case IROpcode::FAtan: UNARY(Ops::FAtan(x));
+			case IROpcode::FAtan2: BINARY(Ops::FAtan2(x, y));
+			case IROpcode::FLt: BINARY(Ops::FLt(x, y));
+			case IROpcode::FLe: BINARY(Ops::FLe(x, y));
+			case IROpcode::FEq: BINARY(Ops::FEq(x, y));
+			case IROpcode::FNe: BINARY(Ops::FNe(x, y));
+
+			case IROpcode::IAdd: BINARY(Ops::IAdd(x, y));
+			case IROpcode::ISub: BINARY(Ops::ISub(x, y));
+			case IROpcode::IMul: BINARY(Ops::IMul(x, y));
+			case IROpcode::IDiv: BINARY(Ops::IDiv(x, y));
+			case IROpcode::IMod: BINARY(Ops::IMod(x, y));
+			case IROpcode::UDiv: BINARY(Ops::UDiv(x, y));
+			case IROpcode::UMod: BINARY(Ops::UMod(x, y));
+			case IROpcode::INeg: UNARY(Ops::INeg(x));
+			case IROpcode::IAbs: UNARY(Ops::IAbs(x));
+			case IROpcode::IMin: BINARY(Ops::IMin(x, y));
+			case IROpcode::IMax: BINARY(Ops::IMax(x, y));
+			case IROpcode::UMin: BINARY(Ops::UMin(x, y));
+			case IROpcode::UMax: BINARY(Ops::UMax(x, y));
+			case IROpcode::And: BINARY(Ops::And(x, y));
+			case IROpcode::Or: BINARY(Ops::Or(x, y));
+			case IROpcode::Xor: BINARY(Ops::Xor(x, y));
+			case IROpcode::Not: UNARY(Ops::Not(x));
+
+			case IROpcode::Shl:
+			case IROpcode::Shr:
+			case IROpcode::UShr:
+				if (inst.Src[1] < sharedRegisterCount)
+				{
+					// The same count in every lane, the usual case of shifting by a literal
+					const __m128i count = _mm_cvtsi32_si128(_mm_cvtsi128_si32(Ops::AsInt(b[0])) & 31);
+					for (auto q = 0; q < QuadCount; q++)
+					{
+						const __m128i x = Ops::AsInt(a[q]);
+						d[q] = Ops::AsFloat(inst.Op == IROpcode::Shl ? _mm_sll_epi32(x, count) : inst.Op == IROpcode::Shr ? _mm_sra_epi32(x, count) : _mm_srl_epi32(x, count));
+					}
+				}
+				else
+				{
+					for (auto q = 0; q < QuadCount; q++)
+						d[q] = inst.Op == IROpcode::Shl ? Ops::Shl(a[q], b[q]) : inst.Op == IROpcode::Shr ? Ops::Shr(a[q], b[q]) : Ops::UShr(a[q], b[q]);
+				}
+				break;
+
+			case IROpcode::ILt: BINARY(Ops::ILt(x, y));
+			case IROpcode::ILe: BINARY(Ops::ILe(x, y));
+			case IROpcode::IEq: BINARY(Ops::IEq(x, y));
+			case IROpcode::INe: BINARY(Ops::INe(x, y));
+			case IROpcode::ULt: BINARY(Ops::ULt(x, y));
+			case IROpcode::ULe: BINARY(Ops::ULe(x, y));
+
+			case IROpcode::IToF: UNARY(Ops::IToF(x));
+			case IROpcode::UToF: UNARY(Ops::UToF(x));
+			case IROpcode::FToI: UNARY(Ops::FToI(x));
+			case IROpcode::FToU: UNARY(Ops::FToU(x));
+
+			case IROpcode::Ddx: UNARY(Ops::Ddx(x));
+			case IROpcode::Ddy: UNARY(Ops::Ddy(x));
+
+			case IROpcode::Sample:
+			case IROpcode::SampleBias:
+			case IROpcode::SampleGrad:
+			{
+				auto fetch = [pTextures](const int slot, const int quad, const __m128 u, const __m128 v, const float dUVdx[2], const float dUVdy[2], __m128 result[4])
+				{
+					pTextures->SampleQuad(slot, quad, u, v, dUVdx, dUVdy, result);
+				};
+
+				for (auto q = 0; q < QuadCount; q++)
+				{
+					__m128 extra[4], result[4];
+					for (auto i = 0; i < (inst.Op == IROpcode::SampleGrad ? 4 : 1); i++)
+						extra[i] = b[i * QuadCount + q];
+
+					Ops::Sample(inst.Op, inst.Imm, q, pExec[q], a[q], a[QuadCount + q], extra, fetch, result);
+					for (auto i = 0; i < 4; i++)
+						d[i * QuadCount + q] = result[i];
+				}
+				break;
+			}
+
+			default:
+				break;
+			}
+
+#undef UNARY
+#undef BINARY
+		}
+
+		template<int QuadCount>
+		void ShaderInterpreter<QuadCount>::Execute(const IRProgram& program, __m128* pRegisters, const IRTextureSource* pTextures)
+		{
+			// Open ifs, loops and inlined functions. Masks hold the taken lanes of an if, the broken and
+			// continued lanes of a loop and the returned lanes of a function
+			struct ControlEntry
+			{
+				__m128 Saved[QuadCount];
+				__m128 Masks[2][QuadCount];
+				int OuterLoop;
+				int OuterFrame;
+			};
+
+			ControlEntry stack[IRProgram::MAX_CONTROL_DEPTH];
+			int top = -1, loop = -1, frame = -1;
+
+			__m128 exec[QuadCount];
+			for (auto q = 0; q < QuadCount; q++)
+				exec[q] = Ops::AllSet();
+
+			// Lanes that left the enclosing loop or function and must stay off when a construct closes
+			auto leftLanes = [&](const int q)
+			{
+				__m128 ret = _mm_setzero_ps();
+				if (loop >= 0)
+					ret = _mm_or_ps(stack[loop].Masks[0][q], stack[loop].Masks[1][q]);
+				if (frame >= 0)
+					ret = _mm_or_ps(ret, stack[frame].Masks[0][q]);
+				return ret;
+			};
+
+			const IRInstruction* pCode = program.Instructions.Data();
+			const int instCount = program.Instructions.Size();
+			for (auto pc = 0; pc < instCount; pc++)
+			{
+				const IRInstruction& inst = pCode[pc];
+				const __m128* a = pRegisters + (inst.Src[0] > 0 ? inst.Src[0] : 0) * QuadCount;
+
+				switch (inst.Op)
+				{
+				case IROpcode::If:
+				{
+					ControlEntry& entry = stack[++top];
+					for (auto q = 0; q < QuadCount; q++)
+					{
+						entry.Saved[q] = exec[q];
+						exec[q] = _mm_and_ps(exec[q], a[q]);
+						entry.Masks[0][q] = exec[q];
+					}
+					if (!AnyActive(exec, QuadCount))
+						pc = inst.Imm - 1;
+					break;
+				}
+				case IROpcode::Else:
+				{
+					const ControlEntry& entry = stack[top];
+					for (auto q = 0; q < QuadCount; q++)
+						exec[q] = _mm_andnot_ps(entry.Masks[0][q], entry.Saved[q]);
+					if (!AnyActive(exec, QuadCount))
+						pc = inst.Imm - 1;
+					break;
+				}
+				case IROpcode::EndIf:
+				{
+					const ControlEntry& entry = stack[top--];
+					for (auto q = 0; q < QuadCount; q++)
+						exec[q] = _mm_andnot_ps(leftLanes(q), entry.Saved[q]);
+					break;
+				}
+
+				case IROpcode::Loop:
+				{
+					ControlEntry& entry = stack[++top];
+					for (auto q = 0; q < QuadCount; q++)
+					{
+						entry.Saved[q] = exec[q];
+						entry.Masks[0][q] = entry.Masks[1][q] = _mm_setzero_ps();
+					}
+					entry.OuterLoop = loop;
+					loop = top;
+					break;
+				}
+				case IROpcode::BreakUnless:
+				{
+					ControlEntry& entry = stack[loop];
+					for (auto q = 0; q < QuadCount; q++)
+					{
+						entry.Masks[0][q] = _mm_or_ps(entry.Masks[0][q], _mm_andnot_ps(a[q], exec[q]));
+						exec[q] = _mm_and_ps(exec[q], a[q]);
+					}
+					if (!AnyActive(exec, QuadCount))
+						pc = inst.Imm - 1;
+					break;
+				}
+				case IROpcode::Break:
+				case IROpcode::Continue:
+				{
+					ControlEntry& entry = stack[loop];
+					const int maskIdx = inst.Op == IROpcode::Break ? 0 : 1;
+					for (auto q = 0; q < QuadCount; q++)
+					{
+						entry.Masks[maskIdx][q] = _mm_or_ps(entry.Masks[maskIdx][q], exec[q]);
+						exec[q] = _mm_setzero_ps();
+					}
+					pc = inst.Imm - 1;
+					break;
+				}
+				case IROpcode::LoopContinue:
+				{
+					ControlEntry& entry = stack[loop];
+					for (auto q = 0; q < QuadCount; q++)
+					{
+						exec[q] = _mm_or_ps(exec[q], entry.Masks[1][q]);
+						entry.Masks[1][q] = _mm_setzero_ps();
+					}
+					break;
+				}
+				case IROpcode::EndLoop:
+				{
+					if (AnyActive(exec, QuadCount))
+					{
+						pc = inst.Imm - 1;
+						break;
+					}
+
+					const ControlEntry& entry = stack[top--];
+					loop = entry.OuterLoop;
+					for (auto q = 0; q < QuadCount; q++)
+						exec[q] = frame >= 0 ? _mm_andnot_ps(stack[frame].Masks[0][q], entry.Saved[q]) : entry.Saved[q];
+					break;
+				}
+
+				case IROpcode::Begin:
+				{
+					ControlEntry& entry = stack[++top];
+					for (auto q = 0; q < QuadCount; q++)
+					{
+						entry.Saved[q] = exec[q];
+						entry.Masks[0][q] = _mm_setzero_ps();
+					}
+					entry.OuterLoop = loop;
+					entry.OuterFrame = frame;
+					frame = top;
+					loop = -1;
+					break;
+				}
+				case IROpcode::Return:
+				{
+					ControlEntry& entry = stack[frame];
+					for (auto q = 0; q < QuadCount; q++)
+					{
+						entry.Masks[0][q] = _mm_or_ps(entry.Masks[0][q], exec[q]);
+						exec[q] = _mm_setzero_ps();
+					}
+					pc = inst.Imm - 1;
+					break;
+				}
+				case IROpcode::End:
+				{
+					const ControlEntry& entry = stack[top--];
+					for (auto q = 0; q < QuadCount; q++)
+						exec[q] = entry.Saved[q];
+					loop = entry.OuterLoop;
+					frame = entry.OuterFrame;
+					break;
+				}
+
+				default:
+					ExecuteInstruction(inst, program.SharedRegisterCount, pRegisters, exec, pTextures);
+					break;
+				}
+			}
+		}
+
+		void ExecuteSetup(const IRProgram& program, Array<uint>& sharedValues)
+		{
+			if (program.SetupInstructions.Size() == 0)
+				return;
+
+			// Every lane holds the same value, lane 0 is read back
+			Array<__m128> registers;
+			registers.Resize(program.SharedRegisterCount);
+			for (auto i = 0; i < program.SharedRegisterCount; i++)
+				registers[i] = Ops::Set(sharedValues[i]);
+
+			const __m128 exec = Ops::AllSet();
+			for (auto i = 0; i < program.SetupInstructions.Size(); i++)
+			{
+				const IRInstruction& inst = program.SetupInstructions[i];
+				ShaderInterpreter<1>::ExecuteInstruction(inst, program.SharedRegisterCount, registers.Data(), &exec, nullptr);
+				sharedValues[inst.Dst] = _mm_cvtsi128_si32(Ops::AsInt(registers[inst.Dst]));
+			}
+		}
+
+		template class ShaderInterpreter<1>;
+		template class ShaderInterpreter<2>;
+		template class ShaderInterpreter<4>;
+	}
+}
\ No newline at end of file
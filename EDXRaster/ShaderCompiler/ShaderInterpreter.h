@@ -0,0 +1,72 @@
+#pragma once
+
+#include "EDXPrerequisites.h"
+#include "ShaderIR.h"
+#include "SIMD/SSE.h"
+
+namespace EDX
+{
+	namespace ShaderCompiler
+	{
+		// Texture fetches of a running program. Slots are indexed as in IRProgram::Textures, quad is the
+		// position within the batch so the renderer can pick each fragment's own texture
+		class IRTextureSource
+		{
+		public:
+			virtual ~IRTextureSource() {}
+			virtual void SampleQuad(const int slot,
+				const int quad,
+				const __m128 u,
+				const __m128 v,
+				const float dUVdx[2],
+				const float dUVdy[2],
+				__m128 result[4]) const = 0;
+		};
+
+		// Registers for batches of QuadCount quads, register r of quad q at index r * QuadCount + q so one
+		// instruction walks adjacent memory. Shared registers are written once and stay valid across batches
+		template<int QuadCount>
+		class IRRegisterFile
+		{
+		private:
+			Array<IntSSE> mRegisters;
+
+		public:
+			void Init(const IRProgram& program, const Array<uint>& sharedValues)
+			{
+				mRegisters.Resize(program.RegisterCount * QuadCount);
+				for (auto i = 0; i < program.SharedRegisterCount; i++)
+				{
+					for (auto q = 0; q < QuadCount; q++)
+						mRegisters[i * QuadCount + q] = _mm_set1_epi32(sharedValues[i]);
+				}
+			}
+
+			__forceinline __m128* Data() { return (__m128*)mRegisters.Data(); }
+			__forceinline __m128& Get(const int reg, const int quad) { return Data()[reg * QuadCount + quad]; }
+		};
+
+		// Runs the setup code of a program, sharedValues holds the constants and the uniforms of a draw and
+		// receives the shared registers computed from them
+		void ExecuteSetup(const IRProgram& program, Array<uint>& sharedValues);
+
+		// Runs a program over all lanes of a batch at once. Divergent branches and loops are executed under an
+		// execution mask, writes through Store only land in the active lanes
+		template<int QuadCount>
+		class ShaderInterpreter
+		{
+		public:
+			static const int LANE_COUNT = 4 * QuadCount;
+
+			static void Execute(const IRProgram& program, __m128* pRegisters, const IRTextureSource* pTextures);
+
+			// One instruction other than control flow, under the execution mask pExec. Generated kernels call
+			// back into this for the instructions they have no native code for
+			static void ExecuteInstruction(const IRInstruction& inst,
+				const int sharedRegisterCount,
+				__m128* pRegisters,
+				const __m128* pExec,
+				const IRTextureSource* pTextures);
+		};
+	}
+}
\ No newline at end of file
@@ -0,0 +1,1052 @@
+#include "ShaderJIT.h"
+#include "X64Emitter.h"
+
+#include <Windows.h>
+#include <intrin.h>
+
+namespace EDX
+{
+	namespace ShaderCompiler
+	{
+		namespace
+		{
+			// Instructions without native code, control flow stays in the kernel
+			template<int QuadCount>
+			void __cdecl InterpretInstruction(const IRInstruction* pInst, __m128* pRegisters, const __m128* pExec, const IRTextureSource* pTextures)
+			{
+				// Shifts by shared registers have native code, the rest go lane by lane
+				ShaderInterpreter<QuadCount>::ExecuteInstruction(*pInst, 0, pRegisters, pExec, pTextures);
+			}
+
+			enum class RoundMode
+			{
+				Nearest = 8,	// Roundps immediates with precision exceptions suppressed
+				Floor = 9,
+				Ceil = 10,
+				Truncate = 11,
+			};
+
+			// Cmpps predicates
+			const int CMP_EQ = 0;
+			const int CMP_LT = 1;
+			const int CMP_LE = 2;
+			const int CMP_NEQ = 4;
+
+			// Generates the kernel for one program. Values live in the register file between instructions, each
+			// instruction loads its operands into xmm0-xmm5, which are the only vector registers the Windows
+			// x64 convention lets a function clobber. rbx points at the register file, rsi at the texture
+			// source and rdi at the constant pool behind the code. The execution mask and the masks of open
+			// constructs are on the stack, where control flow finds them at offsets fixed by the nesting
+			class KernelBuilder
+			{
+			private:
+				// Rsp relative, above the home space of calls
+				static const int EXEC_OFFSET = 32;
+
+				struct Construct
+				{
+					int OuterLoop;
+					int OuterFrame;
+				};
+
+				const IRProgram& mProgram;
+				const int mQuadCount;
+				const JITTarget mTarget;
+				const bool mVex;
+				const int mVectorSize;
+				const int mUnitCount;
+				void* mpFallback;
+
+				X64Emitter mCode;
+				Array<int> mLabels;
+				int mPoolLabel;
+				Array<_byte> mPool;
+				Array<uint> mConstants;
+				Array<int> mConstantOffsets;
+				int mFrameSize;
+				int mSlotOffset;
+
+				Array<Construct> mConstructs;
+				int mLoop;
+				int mFrame;
+
+			public:
+				KernelBuilder(const IRProgram& program, const int quadCount, const JITTarget target)
+					: mProgram(program)
+					, mQuadCount(quadCount)
+					, mTarget(target)
+					, mVex(target == JITTarget::AVX2)
+					, mVectorSize(target == JITTarget::AVX2 && quadCount > 1 ? 32 : 16)
+					, mUnitCount(quadCount * 16 / mVectorSize)
+					, mpFallback(quadCount == 1 ? (void*)&InterpretInstruction<1> : quadCount == 2 ? (void*)&InterpretInstruction<2> : (void*)&InterpretInstruction<4>)
+					, mPoolLabel(-1)
+					, mFrameSize(0)
+					, mSlotOffset(0)
+					, mLoop(-1)
+					, mFrame(-1)
+				{
+					mCode.SetVectorMode(mVex, mVectorSize == 32);
+				}
+
+				const Array<_byte>& Build();
+
+			private:
+				void EmitPrologue();
+				void EmitEpilogue();
+				void EmitInstruction(const IRInstruction& inst);
+				void EmitControl(const IRInstruction& inst);
+				void EmitFallback(const IRInstruction& inst);
+
+				// Result in the register returned, the mask in xmm0 and the values in xmm1 and xmm2
+				int EmitSelect();
+				// Into xmm3, clobbers xmm4 and xmm5
+				void EmitRound(const int src, const RoundMode mode);
+				// Jumps once no lane of the mask accumulated in xmm4 is set
+				void EmitAccumulate(const int unit, const int src);
+				void EmitJumpIfNone(const int label);
+
+				bool HasSSE41() const { return mTarget >= JITTarget::SSE41; }
+
+				X64Mem Reg(const int reg, const int unit) const { return X64Mem(X64Reg::RBX, (reg * mQuadCount * 16) + unit * mVectorSize); }
+				X64Mem Exec(const int unit) const { return X64Mem(X64Reg::RSP, EXEC_OFFSET + unit * mVectorSize); }
+				X64Mem Saved(const int slot, const int unit) const { return X64Mem(X64Reg::RSP, mSlotOffset + slot * 3 * mQuadCount * 16 + unit * mVectorSize); }
+				X64Mem Mask(const int slot, const int idx, const int unit) const { return X64Mem(X64Reg::RSP, mSlotOffset + (slot * 3 + 1 + idx) * mQuadCount * 16 + unit * mVectorSize); }
+				X64Mem Constant(const uint bits);
+				X64Mem Constant(const float val) { return Constant(*(const uint*)&val); }
+				int AddPoolData(const void* pData, const int size, const int alignment);
+			};
+
+			const Array<_byte>& KernelBuilder::Build()
+			{
+				const Array<IRInstruction>& code = mProgram.Instructions;
+				for (auto i = 0; i <= code.Size(); i++)
+					mLabels.Add(mCode.NewLabel());
+				mPoolLabel = mCode.NewLabel();
+
+				EmitPrologue();
+				for (auto pc = 0; pc < code.Size(); pc++)
+				{
+					mCode.Bind(mLabels[pc]);
+					EmitInstruction(code[pc]);
+				}
+				mCode.Bind(mLabels[code.Size()]);
+				EmitEpilogue();
+
+				mCode.Align(32, 0xCC);
+				mCode.Bind(mPoolLabel);
+				mCode.EmitData(mPool.Data(), mPool.Size());
+
+				return mCode.Finish();
+			}
+
+			void KernelBuilder::EmitPrologue()
+			{
+				// The deepest nesting decides how many construct slots the frame needs
+				int depth = 0, maxDepth = 0;
+				for (auto i = 0; i < mProgram.Instructions.Size(); i++)
+				{
+					switch (mProgram.Instructions[i].Op)
+					{
+					case IROpcode::If:
+					case IROpcode::Loop:
+					case IROpcode::Begin:
+						maxDepth = Math::Max(maxDepth, ++depth);
+						break;
+					case IROpcode::EndIf:
+					case IROpcode::EndLoop:
+					case IROpcode::End:
+						depth--;
+						break;
+					default:
+						break;
+					}
+				}
+
+				// Three pushes after the return address leave rsp 16 byte aligned
+				mSlotOffset = EXEC_OFFSET + mQuadCount * 16;
+				mFrameSize = mSlotOffset + maxDepth * 3 * mQuadCount * 16;
+
+				mCode.Push(X64Reg::RBX);
+				mCode.Push(X64Reg::RSI);
+				mCode.Push(X64Reg::RDI);
+
+				// Stack pages are committed by touching the guard page below the stack in order
+				for (auto offset = 4096; offset <= mFrameSize; offset += 4096)
+					mCode.Test32(X64Mem(X64Reg::RSP, -offset), X64Reg::RAX);
+
+				mCode.Sub64(X64Reg::RSP, mFrameSize);
+				mCode.Mov(X64Reg::RBX, X64Reg::RCX);
+				mCode.Mov(X64Reg::RSI, X64Reg::RDX);
+				mCode.LeaLabel(X64Reg::RDI, mPoolLabel);
+
+				mCode.Vec(X64VecOp::Pcmpeqd, 0, 0, 0);
+				for (auto u = 0; u < mUnitCount; u++)
+					mCode.Store(Exec(u), 0);
+			}
+
+			void KernelBuilder::EmitEpilogue()
+			{
+				if (mVex)
+					mCode.Vzeroupper();
+				mCode.Add64(X64Reg::RSP, mFrameSize);
+				mCode.Pop(X64Reg::RDI);
+				mCode.Pop(X64Reg::RSI);
+				mCode.Pop(X64Reg::RBX);
+				mCode.Ret();
+			}
+
+			void KernelBuilder::EmitInstruction(const IRInstruction& inst)
+			{
+				X64Emitter& e = mCode;
+				const int d = inst.Dst, a = inst.Src[0], b = inst.Src[1], c = inst.Src[2];
+
+				// The same operation on every unit with the first operand loaded and the second from memory
+				auto binary = [&](const X64VecOp op, const int imm)
+				{
+					for (auto u = 0; u < mUnitCount; u++)
+					{
+						e.Load(0, Reg(a, u));
+						e.Vec(op, 0, 0, Reg(b, u), imm);
+						e.Store(Reg(d, u), 0);
+					}
+				};
+				auto unary = [&](const X64VecOp op)
+				{
+					for (auto u = 0; u < mUnitCount; u++)
+					{
+						e.VecUnary(op, 0, Reg(a, u));
+						e.Store(Reg(d, u), 0);
+					}
+				};
+				auto withConstant = [&](const X64VecOp op, const uint bits)
+				{
+					const X64Mem constant = Constant(bits);
+					for (auto u = 0; u < mUnitCount; u++)
+					{
+						e.Load(0, Reg(a, u));
+						e.Vec(op, 0, 0, constant);
+						e.Store(Reg(d, u), 0);
+					}
+				};
+
+				switch (inst.Op)
+				{
+				case IROpcode::Mov:
+					for (auto u = 0; u < mUnitCount; u++)
+					{
+						e.Load(0, Reg(a, u));
+						e.Store(Reg(d, u), 0);
+					}
+					break;
+				case IROpcode::Store:
+				case IROpcode::StoreIf:
+				case IROpcode::Select:
+					for (auto u = 0; u < mUnitCount; u++)
+					{
+						if (inst.Op == IROpcode::Select)
+						{
+							e.Load(0, Reg(a, u));
+							e.Load(1, Reg(b, u));
+							e.Load(2, Reg(c, u));
+						}
+						else
+						{
+							e.Load(0, Exec(u));
+							if (inst.Op == IROpcode::StoreIf)
+								e.Vec(X64VecOp::Andps, 0, 0, Reg(b, u));
+							e.Load(1, Reg(a, u));
+							e.Load(2, Reg(d, u));
+						}
+						e.Store(Reg(d, u), EmitSelect());
+					}
+					break;
+
+				case IROpcode::FAdd: binary(X64VecOp::Addps, -1); break;
+				case IROpcode::FSub: binary(X64VecOp::Subps, -1); break;
+				case IROpcode::FMul: binary(X64VecOp::Mulps, -1); break;
+				case IROpcode::FDiv: binary(X64VecOp::Divps, -1); break;
+				case IROpcode::FMin: binary(X64VecOp::Minps, -1); break;
+				case IROpcode::FMax: binary(X64VecOp::Maxps, -1); break;
+				case IROpcode::FLt: binary(X64VecOp::Cmpps, CMP_LT); break;
+				case IROpcode::FLe: binary(X64VecOp::Cmpps, CMP_LE); break;
+				case IROpcode::FEq: binary(X64VecOp::Cmpps, CMP_EQ); break;
+				case IROpcode::FNe: binary(X64VecOp::Cmpps, CMP_NEQ); break;
+				case IROpcode::FMad:
+					for (auto u = 0; u < mUnitCount; u++)
+					{
+						e.Load(0, Reg(a, u));
+						e.Vec(X64VecOp::Mulps, 0, 0, Reg(b, u));
+						e.Vec(X64VecOp::Addps, 0, 0, Reg(c, u));
+						e.Store(Reg(d, u), 0);
+					}
+					break;
+				case IROpcode::FMod:
+					for (auto u = 0; u < mUnitCount; u++)
+					{
+						e.Load(0, Reg(a, u));
+						e.Vec(X64VecOp::Divps, 1, 0, Reg(b, u));
+						EmitRound(1, RoundMode::Truncate);
+						e.Vec(X64VecOp::Mulps, 3, 3, Reg(b, u));
+						e.Vec(X64VecOp::Subps, 0, 0, 3);
+						e.Store(Reg(d, u), 0);
+					}
+					break;
+				case IROpcode::FNeg: withConstant(X64VecOp::Xorps, 0x80000000); break;
+				case IROpcode::FAbs: withConstant(X64VecOp::Andps, 0x7fffffff); break;
+				case IROpcode::FSqrt: unary(X64VecOp::Sqrtps); break;
+				case IROpcode::FRsqrt:
+				{
+					// Estimate and one Newton-Raphson step as SIMDMath::Rsqrt
+					const X64Mem half = Constant(0.5f), threeHalves = Constant(1.5f);
+					for (auto u = 0; u < mUnitCount; u++)
+					{
+						e.VecUnary(X64VecOp::Rsqrtps, 1, Reg(a, u));
+						e.Load(0, half);
+						e.Vec(X64VecOp::Mulps, 0, 0, Reg(a, u));
+						e.Vec(X64VecOp::Mulps, 0, 0, 1);
+						e.Vec(X64VecOp::Mulps, 0, 0, 1);
+						e.Load(2, threeHalves);
+						e.Vec(X64VecOp::Subps, 2, 2, 0);
+						e.Vec(X64VecOp::Mulps, 2, 2, 1);
+						e.Store(Reg(d, u), 2);
+					}
+					break;
+				}
+				case IROpcode::FRcp:
+				{
+					// Estimate and one Newton-Raphson step as SIMDMath::Rcp
+					const X64Mem one = Constant(1.0f);
+					for (auto u = 0; u < mUnitCount; u++)
+					{
+						e.VecUnary(X64VecOp::Rcpps, 1, Reg(a, u));
+						e.Load(0, Reg(a, u));
+						e.Vec(X64VecOp::Mulps, 0, 0, 1);
+						e.Load(2, one);
+						e.Vec(X64VecOp::Subps, 2, 2, 0);
+						e.Vec(X64VecOp::Mulps, 2, 2, 1);
+						e.Vec(X64VecOp::Addps, 2, 2, 1);
+						e.Store(Reg(d, u), 2);
+					}
+					break;
+				}
+				case IROpcode::FFloor:
+				case IROpcode::FCeil:
+				case IROpcode::FRound:
+				case IROpcode::FTrunc:
+				case IROpcode::FFrac:
+				{
+					const RoundMode mode = inst.Op == IROpcode::FCeil ? RoundMode::Ceil :
+						inst.Op == IROpcode::FRound ? RoundMode::Nearest :
+						inst.Op == IROpcode::FTrunc ? RoundMode::Truncate : RoundMode::Floor;
+					for (auto u = 0; u < mUnitCount; u++)
+					{
+						e.Load(0, Reg(a, u));
+						EmitRound(0, mode);
+						if (inst.Op == IROpcode::FFrac)
+						{
+							e.Vec(X64VecOp::Subps, 0, 0, 3);
+							e.Store(Reg(d, u), 0);
+						}
+						else
+							e.Store(Reg(d, u), 3);
+					}
+					break;
+				}
+				case IROpcode::FSaturate:
+				{
+					const X64Mem zero = Constant(0u), one = Constant(1.0f);
+					for (auto u = 0; u < mUnitCount; u++)
+					{
+						e.Load(0, Reg(a, u));
+						e.Vec(X64VecOp::Maxps, 0, 0, zero);
+						e.Vec(X64VecOp::Minps, 0, 0, one);
+						e.Store(Reg(d, u), 0);
+					}
+					break;
+				}
+
+				case IROpcode::IAdd: binary(X64VecOp::Paddd, -1); break;
+				case IROpcode::ISub: binary(X64VecOp::Psubd, -1); break;
+				case IROpcode::IMul:
+					if (HasSSE41())
+					{
+						binary(X64VecOp::Pmulld, -1);
+						break;
+					}
+
+					// Low halves of the even and odd 64 bit products
+					for (auto u = 0; u < mUnitCount; u++)
+					{
+						e.Load(0, Reg(a, u));
+						e.Load(1, Reg(b, u));
+						e.VecShift(X64ShiftOp::Psrldq, 2, 0, 4);
+						e.VecShift(X64ShiftOp::Psrldq, 3, 1, 4);
+						e.Vec(X64VecOp::Pmuludq, 0, 0, 1);
+						e.Vec(X64VecOp::Pmuludq, 2, 2, 3);
+						e.VecUnary(X64VecOp::Pshufd, 0, 0, _MM_SHUFFLE(0, 0, 2, 0));
+						e.VecUnary(X64VecOp::Pshufd, 2, 2, _MM_SHUFFLE(0, 0, 2, 0));
+						e.Vec(X64VecOp::Punpckldq, 0, 0, 2);
+						e.Store(Reg(d, u), 0);
+					}
+					break;
+				case IROpcode::INeg:
+					for (auto u = 0; u < mUnitCount; u++)
+					{
+						e.Vec(X64VecOp::Xorps, 0, 0, 0);
+						e.Vec(X64VecOp::Psubd, 0, 0, Reg(a, u));
+						e.Store(Reg(d, u), 0);
+					}
+					break;
+				case IROpcode::IAbs:
+					if (HasSSE41())
+					{
+						unary(X64VecOp::Pabsd);
+						break;
+					}
+
+					for (auto u = 0; u < mUnitCount; u++)
+					{
+						e.Load(0, Reg(a, u));
+						e.VecShift(X64ShiftOp::Psrad, 1, 0, 31);
+						e.Vec(X64VecOp::Xorps, 0, 0, 1);
+						e.Vec(X64VecOp::Psubd, 0, 0, 1);
+						e.Store(Reg(d, u), 0);
+					}
+					break;
+				case IROpcode::IMin:
+				case IROpcode::IMax:
+				case IROpcode::UMin:
+				case IROpcode::UMax:
+				{
+					if (HasSSE41())
+					{
+						binary(inst.Op == IROpcode::IMin ? X64VecOp::Pminsd :
+							inst.Op == IROpcode::IMax ? X64VecOp::Pmaxsd :
+							inst.Op == IROpcode::UMin ? X64VecOp::Pminud : X64VecOp::Pmaxud, -1);
+						break;
+					}
+
+					// Unsigned order is signed order with the sign bits flipped
+					const bool isUnsigned = inst.Op == IROpcode::UMin || inst.Op == IROpcode::UMax;
+					const bool isMin = inst.Op == IROpcode::IMin || inst.Op == IROpcode::UMin;
+					const X64Mem signBit = Constant(0x80000000u);
+					for (auto u = 0; u < mUnitCount; u++)
+					{
+						e.Load(1, Reg(a, u));
+						e.Load(2, Reg(b, u));
+						const int x = isUnsigned ? 3 : 1, y = isUnsigned ? 4 : 2;
+						if (isUnsigned)
+						{
+							e.Vec(X64VecOp::Xorps, 3, 1, signBit);
+							e.Vec(X64VecOp::Xorps, 4, 2, signBit);
+						}
+						if (isMin)
+							e.Vec(X64VecOp::Pcmpgtd, 0, y, x);
+						else
+							e.Vec(X64VecOp::Pcmpgtd, 0, x, y);
+						e.Store(Reg(d, u), EmitSelect());
+					}
+					break;
+				}
+				case IROpcode::And: binary(X64VecOp::Andps, -1); break;
+				case IROpcode::Or: binary(X64VecOp::Orps, -1); break;
+				case IROpcode::Xor: binary(X64VecOp::Xorps, -1); break;
+				case IROpcode::Not: withConstant(X64VecOp::Xorps, 0xffffffff); break;
+
+				case IROpcode::Shl:
+				case IROpcode::Shr:
+				case IROpcode::UShr:
+				{
+					const X64VecOp op = inst.Op == IROpcode::Shl ? X64VecOp::Pslld : inst.Op == IROpcode::Shr ? X64VecOp::Psrad : X64VecOp::Psrld;
+					if (b < mProgram.SharedRegisterCount)
+					{
+						// The same count in every lane, taken from the first one
+						e.Load32(X64Reg::RAX, Reg(b, 0));
+						e.And32(X64Reg::RAX, 31);
+						e.MovdToVec(5, X64Reg::RAX);
+						for (auto u = 0; u < mUnitCount; u++)
+						{
+							e.Load(0, Reg(a, u));
+							e.Vec(op, 0, 0, 5);
+							e.Store(Reg(d, u), 0);
+						}
+					}
+					else if (mTarget == JITTarget::AVX2)
+					{
+						const X64VecOp varOp = inst.Op == IROpcode::Shl ? X64VecOp::Psllvd : inst.Op == IROpcode::Shr ? X64VecOp::Psravd : X64VecOp::Psrlvd;
+						const X64Mem countMask = Constant(31u);
+						for (auto u = 0; u < mUnitCount; u++)
+						{
+							e.Load(1, Reg(b, u));
+							e.Vec(X64VecOp::Andps, 1, 1, countMask);
+							e.Load(0, Reg(a, u));
+							e.Vec(varOp, 0, 0, 1);
+							e.Store(Reg(d, u), 0);
+						}
+					}
+					else
+						EmitFallback(inst);
+					break;
+				}
+
+				case IROpcode::ILt:
+					for (auto u = 0; u < mUnitCount; u++)
+					{
+						e.Load(0, Reg(b, u));
+						e.Vec(X64VecOp::Pcmpgtd, 0, 0, Reg(a, u));
+						e.Store(Reg(d, u), 0);
+					}
+					break;
+				case IROpcode::ILe:
+				case IROpcode::INe:
+				{
+					const X64Mem allSet = Constant(0xffffffffu);
+					for (auto u = 0; u < mUnitCount; u++)
+					{
+						e.Load(0, Reg(a, u));
+						e.Vec(inst.Op == IROpcode::ILe ? X64VecOp::Pcmpgtd : X64VecOp::Pcmpeqd, 0, 0, Reg(b, u));
+						e.Vec(X64VecOp::Xorps, 0, 0, allSet);
+						e.Store(Reg(d, u), 0);
+					}
+					break;
+				}
+				case IROpcode::IEq: binary(X64VecOp::Pcmpeqd, -1); break;
+				case IROpcode::ULt:
+				case IROpcode::ULe:
+				{
+					const X64Mem signBit = Constant(0x80000000u), allSet = Constant(0xffffffffu);
+					for (auto u = 0; u < mUnitCount; u++)
+					{
+						e.Load(5, signBit);
+						e.Vec(X64VecOp::Xorps, 0, 5, Reg(a, u));
+						e.Vec(X64VecOp::Xorps, 1, 5, Reg(b, u));
+						if (inst.Op == IROpcode::ULt)
+						{
+							e.Vec(X64VecOp::Pcmpgtd, 1, 1, 0);
+							e.Store(Reg(d, u), 1);
+						}
+						else
+						{
+							e.Vec(X64VecOp::Pcmpgtd, 0, 0, 1);
+							e.Vec(X64VecOp::Xorps, 0, 0, allSet);
+							e.Store(Reg(d, u), 0);
+						}
+					}
+					break;
+				}
+
+				case IROpcode::IToF: unary(X64VecOp::Cvtdq2ps); break;
+				case IROpcode::FToI: unary(X64VecOp::Cvttps2dq); break;
+				case IROpcode::UToF:
+				{
+					const X64Mem scale = Constant(65536.0f), lowMask = Constant(0xffffu);
+					for (auto u = 0; u < mUnitCount; u++)
+					{
+						e.Load(0, Reg(a, u));
+						e.VecShift(X64ShiftOp::Psrld, 0, 0, 16);
+						e.VecUnary(X64VecOp::Cvtdq2ps, 0, 0);
+						e.Vec(X64VecOp::Mulps, 0, 0, scale);
+						e.Load(1, Reg(a, u));
+						e.Vec(X64VecOp::Andps, 1, 1, lowMask);
+						e.VecUnary(X64VecOp::Cvtdq2ps, 1, 1);
+						e.Vec(X64VecOp::Addps, 0, 0, 1);
+						e.Store(Reg(d, u), 0);
+					}
+					break;
+				}
+				case IROpcode::FToU:
+				{
+					// From 2^31 up the conversion goes through the value less 2^31 with the top bit put back
+					const X64Mem zero = Constant(0u), twoTo31 = Constant(2147483648.0f), signBit = Constant(0x80000000u);
+					for (auto u = 0; u < mUnitCount; u++)
+					{
+						e.Load(3, Reg(a, u));
+						e.Vec(X64VecOp::Maxps, 3, 3, zero);
+						e.VecUnary(X64VecOp::Cvttps2dq, 2, 3);
+						e.Vec(X64VecOp::Subps, 1, 3, twoTo31);
+						e.VecUnary(X64VecOp::Cvttps2dq, 1, 1);
+						e.Vec(X64VecOp::Xorps, 1, 1, signBit);
+						e.Load(0, twoTo31);
+						e.Vec(X64VecOp::Cmpps, 0, 0, 3, CMP_LE);
+						e.Store(Reg(d, u), EmitSelect());
+					}
+					break;
+				}
+
+				// Coarse derivatives, every pixel of a quad gets the same difference
+				case IROpcode::Ddx:
+				case IROpcode::Ddy:
+				{
+					const int neighbour = inst.Op == IROpcode::Ddx ? _MM_SHUFFLE(1, 1, 1, 1) : _MM_SHUFFLE(2, 2, 2, 2);
+					for (auto u = 0; u < mUnitCount; u++)
+					{
+						e.Load(0, Reg(a, u));
+						e.Vec(X64VecOp::Shufps, 1, 0, 0, _MM_SHUFFLE(0, 0, 0, 0));
+						e.Vec(X64VecOp::Shufps, 0, 0, 0, neighbour);
+						e.Vec(X64VecOp::Subps, 0, 0, 1);
+						e.Store(Reg(d, u), 0);
+					}
+					break;
+				}
+
+				case IROpcode::If:
+				case IROpcode::Else:
+				case IROpcode::EndIf:
+				case IROpcode::Loop:
+				case IROpcode::BreakUnless:
+				case IROpcode::Break:
+				case IROpcode::Continue:
+				case IROpcode::LoopContinue:
+				case IROpcode::EndLoop:
+				case IROpcode::Begin:
+				case IROpcode::Return:
+				case IROpcode::End:
+					EmitControl(inst);
+					break;
+
+				// Transcendentals, integer division and texture fetches
+				default:
+					EmitFallback(inst);
+					break;
+				}
+			}
+
+			void KernelBuilder::EmitControl(const IRInstruction& inst)
+			{
+				X64Emitter& e = mCode;
+				const int a = inst.Src[0];
+				const int top = mConstructs.Size() - 1;
+
+				switch (inst.Op)
+				{
+				case IROpcode::If:
+				{
+					const int slot = top + 1;
+					Construct construct = { mLoop, mFrame };
+					mConstructs.Add(construct);
+					for (auto u = 0; u < mUnitCount; u++)
+					{
+						e.Load(0, Exec(u));
+						e.Store(Saved(slot, u), 0);
+						e.Vec(X64VecOp::Andps, 0, 0, Reg(a, u));
+						e.Store(Exec(u), 0);
+						e.Store(Mask(slot, 0, u), 0);
+						EmitAccumulate(u, 0);
+					}
+					EmitJumpIfNone(mLabels[inst.Imm]);
+					break;
+				}
+				case IROpcode::Else:
+					for (auto u = 0; u < mUnitCount; u++)
+					{
+						e.Load(0, Mask(top, 0, u));
+						e.Vec(X64VecOp::Andnps, 0, 0, Saved(top, u));
+						e.Store(Exec(u), 0);
+						EmitAccumulate(u, 0);
+					}
+					EmitJumpIfNone(mLabels[inst.Imm]);
+					break;
+				case IROpcode::EndIf:
+					// Lanes that left the enclosing loop or function stay off
+					for (auto u = 0; u < mUnitCount; u++)
+					{
+						if (mLoop < 0 && mFrame < 0)
+						{
+							e.Load(0, Saved(top, u));
+							e.Store(Exec(u), 0);
+							continue;
+						}
+
+						if (mLoop >= 0)
+						{
+							e.Load(0, Mask(mLoop, 0, u));
+							e.Vec(X64VecOp::Orps, 0, 0, Mask(mLoop, 1, u));
+							if (mFrame >= 0)
+								e.Vec(X64VecOp::Orps, 0, 0, Mask(mFrame, 0, u));
+						}
+						else
+							e.Load(0, Mask(mFrame, 0, u));
+						e.Vec(X64VecOp::Andnps, 0, 0, Saved(top, u));
+						e.Store(Exec(u), 0);
+					}
+					mConstructs.Pop();
+					break;
+
+				case IROpcode::Loop:
+				{
+					const int slot = top + 1;
+					Construct construct = { mLoop, mFrame };
+					mConstructs.Add(construct);
+					mLoop = slot;
+
+					e.Vec(X64VecOp::Xorps, 1, 1, 1);
+					for (auto u = 0; u < mUnitCount; u++)
+					{
+						e.Load(0, Exec(u));
+						e.Store(Saved(slot, u), 0);
+						e.Store(Mask(slot, 0, u), 1);
+						e.Store(Mask(slot, 1, u), 1);
+					}
+					break;
+				}
+				case IROpcode::BreakUnless:
+					for (auto u = 0; u < mUnitCount; u++)
+					{
+						e.Load(0, Exec(u));
+						e.Load(1, Reg(a, u));
+						e.Vec(X64VecOp::Andnps, 2, 1, 0);
+						e.Vec(X64VecOp::Orps, 2, 2, Mask(mLoop, 0, u));
+						e.Store(Mask(mLoop, 0, u), 2);
+						e.Vec(X64VecOp::Andps, 0, 0, 1);
+						e.Store(Exec(u), 0);
+						EmitAccumulate(u, 0);
+					}
+					EmitJumpIfNone(mLabels[inst.Imm]);
+					break;
+				case IROpcode::Break:
+				case IROpcode::Continue:
+				case IROpcode::Return:
+				{
+					// Returns collect their lanes in the function, breaks and continues in the loop
+					const int slot = inst.Op == IROpcode::Return ? mFrame : mLoop;
+					const int maskIdx = inst.Op == IROpcode::Continue ? 1 : 0;
+					e.Vec(X64VecOp::Xorps, 1, 1, 1);
+					for (auto u = 0; u < mUnitCount; u++)
+					{
+						e.Load(0, Exec(u));
+						e.Vec(X64VecOp::Orps, 0, 0, Mask(slot, maskIdx, u));
+						e.Store(Mask(slot, maskIdx, u), 0);
+						e.Store(Exec(u), 1);
+					}
+					e.Jump(mLabels[inst.Imm]);
+					break;
+				}
+				case IROpcode::LoopContinue:
+					e.Vec(X64VecOp::Xorps, 1, 1, 1);
+					for (auto u = 0; u < mUnitCount; u++)
+					{
+						e.Load(0, Exec(u));
+						e.Vec(X64VecOp::Orps, 0, 0, Mask(mLoop, 1, u));
+						e.Store(Exec(u), 0);
+						e.Store(Mask(mLoop, 1, u), 1);
+					}
+					break;
+				case IROpcode::EndLoop:
+				{
+					// Back to the head while lanes remain, the code after runs once they all left
+					for (auto u = 0; u < mUnitCount; u++)
+					{
+						e.Load(0, Exec(u));
+						EmitAccumulate(u, 0);
+					}
+					e.Movmsk(X64Reg::RAX, 4);
+					e.Test32(X64Reg::RAX, X64Reg::RAX);
+					e.Jump(X64Cond::NotZero, mLabels[inst.Imm]);
+
+					mLoop = mConstructs[top].OuterLoop;
+					mConstructs.Pop();
+					for (auto u = 0; u < mUnitCount; u++)
+					{
+						if (mFrame >= 0)
+						{
+							e.Load(0, Mask(mFrame, 0, u));
+							e.Vec(X64VecOp::Andnps, 0, 0, Saved(top, u));
+						}
+						else
+							e.Load(0, Saved(top, u));
+						e.Store(Exec(u), 0);
+					}
+					break;
+				}
+
+				case IROpcode::Begin:
+				{
+					const int slot = top + 1;
+					Construct construct = { mLoop, mFrame };
+					mConstructs.Add(construct);
+					mFrame = slot;
+					mLoop = -1;
+
+					e.Vec(X64VecOp::Xorps, 1, 1, 1);
+					for (auto u = 0; u < mUnitCount; u++)
+					{
+						e.Load(0, Exec(u));
+						e.Store(Saved(slot, u), 0);
+						e.Store(Mask(slot, 0, u), 1);
+					}
+					break;
+				}
+				case IROpcode::End:
+					for (auto u = 0; u < mUnitCount; u++)
+					{
+						e.Load(0, Saved(top, u));
+						e.Store(Exec(u), 0);
+					}
+					mLoop = mConstructs[top].OuterLoop;
+					mFrame = mConstructs[top].OuterFrame;
+					mConstructs.Pop();
+					break;
+
+				default:
+					break;
+				}
+			}
+
+			void KernelBuilder::EmitFallback(const IRInstruction& inst)
+			{
+				// The record is read by the interpreter from the pool, arguments as for InterpretInstruction
+				const int offset = AddPoolData(&inst, sizeof(inst), 8);
+				if (mVex)
+					mCode.Vzeroupper();
+				mCode.Lea(X64Reg::RCX, X64Mem(X64Reg::RDI, offset));
+				mCode.Mov(X64Reg::RDX, X64Reg::RBX);
+				mCode.Lea(X64Reg::R8, X64Mem(X64Reg::RSP, EXEC_OFFSET));
+				mCode.Mov(X64Reg::R9, X64Reg::RSI);
+				mCode.MovImm(X64Reg::RAX, uint64(mpFallback));
+				mCode.Call(X64Reg::RAX);
+			}
+
+			int KernelBuilder::EmitSelect()
+			{
+				if (HasSSE41())
+				{
+					mCode.Blendv(2, 2, 1, 0);
+					return 2;
+				}
+
+				mCode.Vec(X64VecOp::Andps, 1, 1, 0);
+				mCode.Vec(X64VecOp::Andnps, 0, 0, 2);
+				mCode.Vec(X64VecOp::Orps, 0, 0, 1);
+				return 0;
+			}
+
+			void KernelBuilder::EmitRound(const int src, const RoundMode mode)
+			{
+				X64Emitter& e = mCode;
+				if (HasSSE41())
+				{
+					e.VecUnary(X64VecOp::Roundps, 3, src, int(mode));
+					return;
+				}
+
+				// SSE2 rounds by converting to int and back, as the interpreter does. From 2^23 up every float is
+				// an integer already and is passed through
+				e.VecUnary(mode == RoundMode::Nearest ? X64VecOp::Cvtps2dq : X64VecOp::Cvttps2dq, 3, src);
+				e.VecUnary(X64VecOp::Cvtdq2ps, 3, 3);
+				if (mode == RoundMode::Floor || mode == RoundMode::Ceil)
+				{
+					if (mode == RoundMode::Floor)
+						e.Vec(X64VecOp::Cmpps, 4, src, 3, CMP_LT);
+					else
+						e.Vec(X64VecOp::Cmpps, 4, 3, src, CMP_LT);
+					e.Vec(X64VecOp::Andps, 4, 4, Constant(1.0f));
+					e.Vec(mode == RoundMode::Floor ? X64VecOp::Subps : X64VecOp::Addps, 3, 3, 4);
+				}
+
+				e.Vec(X64VecOp::Andps, 4, src, Constant(0x7fffffffu));
+				e.Load(5, Constant(8388608.0f));
+				e.Vec(X64VecOp::Cmpps, 5, 5, 4, CMP_LE);
+				e.Vec(X64VecOp::Andps, 4, 5, src);
+				e.Vec(X64VecOp::Andnps, 5, 5, 3);
+				e.Vec(X64VecOp::Orps, 3, 4, 5);
+			}
+
+			void KernelBuilder::EmitAccumulate(const int unit, const int src)
+			{
+				if (unit == 0)
+					mCode.VecUnary(X64VecOp::Movaps, 4, src);
+				else
+					mCode.Vec(X64VecOp::Orps, 4, 4, src);
+			}
+
+			void KernelBuilder::EmitJumpIfNone(const int label)
+			{
+				mCode.Movmsk(X64Reg::RAX, 4);
+				mCode.Test32(X64Reg::RAX, X64Reg::RAX);
+				mCode.Jump(X64Cond::Zero, label);
+			}
+
+			X64Mem KernelBuilder::Constant(const uint bits)
+			{
+				for (auto i = 0; i < mConstants.Size(); i++)
+				{
+					if (mConstants[i] == bits)
+						return X64Mem(X64Reg::RDI, mConstantOffsets[i]);
+				}
+
+				// Wide enough for 256 bit operands
+				uint values[8];
+				for (auto i = 0; i < 8; i++)
+					values[i] = bits;
+
+				const int offset = AddPoolData(values, sizeof(values), 32);
+				mConstants.Add(bits);
+				mConstantOffsets.Add(offset);
+				return X64Mem(X64Reg::RDI, offset);
+			}
+
+			int KernelBuilder::AddPoolData(const void* pData, const int size, const int alignment)
+			{
+				while (mPool.Size() % alignment != 0)
+					mPool.Add(0);
+
+				const int offset = mPool.Size();
+				const _byte* pBytes = (const _byte*)pData;
+				for (auto i = 0; i < size; i++)
+					mPool.Add(pBytes[i]);
+
+				return offset;
+			}
+		}
+
+		ShaderKernel::~ShaderKernel()
+		{
+			VirtualFree(mpCode, 0, MEM_RELEASE);
+		}
+
+		JITTarget ShaderJIT::DetectTarget()
+		{
+#if defined(_M_X64)
+			int info[4];
+			__cpuid(info, 0);
+			const int maxLeaf = info[0];
+
+			__cpuid(info, 1);
+			const bool sse41 = (info[2] & (1 << 19)) != 0;
+			const bool osxsave = (info[2] & (1 << 27)) != 0;
+			const bool avx = (info[2] & (1 << 28)) != 0;
+
+			// AVX also needs the OS to save the upper halves of the registers
+			bool avx2 = false;
+			if (maxLeaf >= 7 && osxsave && avx && (_xgetbv(0) & 6) == 6)
+			{
+				__cpuidex(info, 7, 0);
+				avx2 = (info[1] & (1 << 5)) != 0;
+			}
+
+			return avx2 ? JITTarget::AVX2 : sse41 ? JITTarget::SSE41 : JITTarget::SSE2;
+#else
+			return JITTarget::None;
+#endif
+		}
+
+		std::shared_ptr<const ShaderKernel> ShaderJIT::Compile(const IRProgram& program, const int quadCount, const JITTarget target)
+		{
+			Assert(quadCount == 1 || quadCount == 2 || quadCount == 4);
+			if (target == JITTarget::None)
+				return nullptr;
+
+			KernelBuilder builder(program, quadCount, target);
+			const Array<_byte>& code = builder.Build();
+
+			// Written before the pages are made executable, they are never writable and executable at once
+			void* pCode = VirtualAlloc(nullptr, code.Size(), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+			if (!pCode)
+				return nullptr;
+
+			memcpy(pCode, code.Data(), code.Size());
+			DWORD oldProtect;
+			if (!VirtualProtect(pCode, code.Size(), PAGE_EXECUTE_READ, &oldProtect))
+			{
+				VirtualFree(pCode, 0, MEM_RELEASE);
+				return nullptr;
+			}
+			FlushInstructionCache(GetCurrentProcess(), pCode, code.Size());
+
+			return std::make_shared<ShaderKernel>(pCode, code.Size(), quadCount, target);
+		}
+
+		ShaderKernelCache* ShaderKernelCache::mpInstance = nullptr;
+		std::mutex ShaderKernelCache::mInstanceLock;
+
+		ShaderKernelCache::ShaderKernelCache()
+			: mDetectedTarget(ShaderJIT::DetectTarget())
+		{
+			mTarget = mDetectedTarget;
+		}
+
+		std::shared_ptr<const ShaderKernel> ShaderKernelCache::GetKernel(const IRProgram& program, const int quadCount)
+		{
+			const JITTarget target = GetTarget();
+			if (target == JITTarget::None)
+				return nullptr;
+
+			const uint64 hash = HashProgram(program, quadCount, target);
+			auto matches = [&](const Entry& entry)
+			{
+				return entry.pKernel->GetQuadCount() == quadCount &&
+					entry.pKernel->GetTarget() == target &&
+					entry.RegisterCount == program.RegisterCount &&
+					entry.SharedRegisterCount == program.SharedRegisterCount &&
+					entry.Instructions.Size() == program.Instructions.Size() &&
+					memcmp(entry.Instructions.Data(), program.Instructions.Data(), program.Instructions.Size() * sizeof(IRInstruction)) == 0;
+			};
+
+			{
+				std::lock_guard<std::mutex> lock(mLock);
+				auto entryIt = mEntries.find(hash);
+				if (entryIt != mEntries.end() && matches(entryIt->second))
+					return entryIt->second.pKernel;
+			}
+
+			// Compiled outside of the lock, a program compiled on two threads at once ends up with one kernel
+			// in the cache
+			std::shared_ptr<const ShaderKernel> pKernel = ShaderJIT::Compile(program, quadCount, target);
+			if (!pKernel)
+				return nullptr;
+
+			std::lock_guard<std::mutex> lock(mLock);
+			auto entryIt = mEntries.find(hash);
+			if (entryIt == mEntries.end())
+			{
+				Entry& entry = mEntries[hash];
+				entry.Instructions = program.Instructions;
+				entry.RegisterCount = program.RegisterCount;
+				entry.SharedRegisterCount = program.SharedRegisterCount;
+				entry.pKernel = pKernel;
+			}
+			else if (matches(entryIt->second))
+				return entryIt->second.pKernel;
+
+			return pKernel;
+		}
+
+		void ShaderKernelCache::SetTargetLimit(const JITTarget target)
+		{
+			std::lock_guard<std::mutex> lock(mLock);
+			mTarget = target < mDetectedTarget ? target : mDetectedTarget;
+		}
+
+		JITTarget ShaderKernelCache::GetTarget() const
+		{
+			std::lock_guard<std::mutex> lock(mLock);
+			return mTarget;
+		}
+
+		void ShaderKernelCache::Clear()
+		{
+			std::lock_guard<std::mutex> lock(mLock);
+			mEntries.clear();
+		}
+
+		uint64 ShaderKernelCache::HashProgram(const IRProgram& program, const int quadCount, const JITTarget target)
+		{
+			// 64 bit FNV-1a over the instructions and the layout
+			uint64 hash = 14695981039346656037ULL;
+			auto hashBytes = [&hash](const void* pData, const size_t size)
+			{
+				const _byte* pBytes = (const _byte*)pData;
+				for (size_t i = 0; i < size; i++)
+					hash = (hash ^ pBytes[i]) * 1099511628211ULL;
+			};
+
+			hashBytes(program.Instructions.Data(), program.Instructions.Size() * sizeof(IRInstruction));
+			hashBytes(&program.RegisterCount, sizeof(program.RegisterCount));
+			hashBytes(&program.SharedRegisterCount, sizeof(program.SharedRegisterCount));
+			hashBytes(&quadCount, sizeof(quadCount));
+			hashBytes(&target, sizeof(target));
+
+			return hash;
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "EDXPrerequisites.h"
+#include "ShaderIR.h"
+#include "ShaderInterpreter.h"
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace EDX
+{
+	namespace ShaderCompiler
+	{
+		// Instruction sets kernels are generated for, each includes the ones before. AVX2 runs two quads per
+		// instruction
+		enum class JITTarget
+		{
+			None,
+			SSE2,
+			SSE41,
+			AVX2,
+		};
+
+		// Native code for a program at one batch width, with the same results as running the program through
+		// ShaderInterpreter at that width. Instructions without native code call back into the interpreter
+		class ShaderKernel
+		{
+		public:
+			typedef void (__cdecl *Function)(__m128* pRegisters, const IRTextureSource* pTextures);
+
+		private:
+			void* mpCode;
+			size_t mCodeSize;
+			int mQuadCount;
+			JITTarget mTarget;
+
+		public:
+			ShaderKernel(void* pCode, const size_t codeSize, const int quadCount, const JITTarget target)
+				: mpCode(pCode)
+				, mCodeSize(codeSize)
+				, mQuadCount(quadCount)
+				, mTarget(target)
+			{
+			}
+			~ShaderKernel();
+
+			// Registers as for ShaderInterpreter::Execute
+			__forceinline void Execute(__m128* pRegisters, const IRTextureSource* pTextures) const
+			{
+				((Function)mpCode)(pRegisters, pTextures);
+			}
+
+			size_t GetCodeSize() const { return mCodeSize; }
+			int GetQuadCount() const { return mQuadCount; }
+			JITTarget GetTarget() const { return mTarget; }
+		};
+
+		class ShaderJIT
+		{
+		public:
+			// Best target of the running CPU and OS, None when the build is not x64
+			static JITTarget DetectTarget();
+
+			// Null when the target is None or no executable memory is left, callers then run the interpreter
+			static std::shared_ptr<const ShaderKernel> Compile(const IRProgram& program, const int quadCount, const JITTarget target);
+		};
+
+		// Kernels shared by every program with the same code. The key covers the instructions and register
+		// layout of the program and the batch width and instruction set of the pipeline running it
+		class ShaderKernelCache
+		{
+		private:
+			struct Entry
+			{
+				Array<IRInstruction> Instructions;
+				int RegisterCount;
+				int SharedRegisterCount;
+				std::shared_ptr<const ShaderKernel> pKernel;
+			};
+
+			mutable std::mutex mLock;
+			std::unordered_map<uint64, Entry> mEntries;
+			JITTarget mTarget;
+			JITTarget mDetectedTarget;
+
+		private:
+			ShaderKernelCache();
+			static ShaderKernelCache* mpInstance;
+			static std::mutex mInstanceLock;
+
+		public:
+			// Locked, concurrent renderers can compile their first programs at once
+			static ShaderKernelCache* Instance()
+			{
+				std::lock_guard<std::mutex> lock(mInstanceLock);
+				if (!mpInstance)
+					mpInstance = new ShaderKernelCache;
+
+				return mpInstance;
+			}
+			static void DeleteInstance()
+			{
+				std::lock_guard<std::mutex> lock(mInstanceLock);
+				if (mpInstance)
+				{
+					delete mpInstance;
+					mpInstance = nullptr;
+				}
+			}
+
+		public:
+			// Thread safe. Null when kernels are disabled or compilation failed
+			std::shared_ptr<const ShaderKernel> GetKernel(const IRProgram& program, const int quadCount);
+
+			// Kernels requested afterwards use at most this instruction set, None runs everything through
+			// the interpreter
+			void SetTargetLimit(const JITTarget target);
+			JITTarget GetTarget() const;
+
+			// Kernels stay alive while programs hold them
+			void Clear();
+
+		private:
+			static uint64 HashProgram(const IRProgram& program, const int quadCount, const JITTarget target);
+		};
+	}
+}
\ No newline at end of file
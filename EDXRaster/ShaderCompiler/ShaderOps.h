@@ -0,0 +1,404 @@
+#pragma once
+
+#include "EDXPrerequisites.h"
+#include "ShaderIR.h"
+#include "../Core/SIMDMath.h"
+
+#include <immintrin.h>
+#include <math.h>
+
+namespace EDX
+{
+	namespace ShaderCompiler
+	{
+		// The IR instructions as functions over whole registers, named after their opcodes. The interpreter runs
+		// on the SSE specialization one quad at a time, generated shaders are templated over the register type
+		// and run QUAD_COUNT quads per call. Every specialization gives the same bits as the SSE one
+		template<typename Float>
+		struct ShaderOps;
+
+		template<>
+		struct ShaderOps<__m128>
+		{
+			static const int QUAD_COUNT = 1;
+
+			typedef RasterRenderer::SIMDMath<__m128> Math;
+
+			static __forceinline __m128i AsInt(const __m128 a) { return _mm_castps_si128(a); }
+			static __forceinline __m128 AsFloat(const __m128i a) { return _mm_castsi128_ps(a); }
+
+			static __forceinline __m128 Set(const uint bits) { return AsFloat(_mm_set1_epi32(bits)); }
+			static __forceinline __m128 SetFloat(const float val) { return _mm_set1_ps(val); }
+			static __forceinline __m128 Zero() { return _mm_setzero_ps(); }
+			static __forceinline __m128 AllSet() { return AsFloat(_mm_set1_epi32(-1)); }
+			static __forceinline __m128 SignMask() { return AsFloat(_mm_set1_epi32(0x80000000)); }
+
+			// One value per lane, in lane order
+			static __forceinline __m128 LoadLanes(const float* pValues) { return _mm_loadu_ps(pValues); }
+			static __forceinline void StoreLanes(float* pValues, const __m128 a) { _mm_storeu_ps(pValues, a); }
+
+			// Execution masks
+			static __forceinline bool Any(const __m128 mask) { return _mm_movemask_ps(mask) != 0; }
+			static __forceinline __m128 And(const __m128 a, const __m128 b) { return _mm_and_ps(a, b); }
+			static __forceinline __m128 AndNot(const __m128 a, const __m128 b) { return _mm_andnot_ps(a, b); }
+			static __forceinline __m128 Or(const __m128 a, const __m128 b) { return _mm_or_ps(a, b); }
+			static __forceinline __m128 Xor(const __m128 a, const __m128 b) { return _mm_xor_ps(a, b); }
+			static __forceinline __m128 Not(const __m128 a) { return _mm_xor_ps(a, AllSet()); }
+
+			static __forceinline __m128 Select(const __m128 mask, const __m128 a, const __m128 b)
+			{
+				return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+			}
+			static __forceinline __m128 Store(const __m128 exec, const __m128 value, const __m128 prev) { return Select(exec, value, prev); }
+			static __forceinline __m128 StoreIf(const __m128 exec, const __m128 value, const __m128 cond, const __m128 prev) { return Select(_mm_and_ps(exec, cond), value, prev); }
+
+			// SSE2 has no rounding instructions, the conversions round trip through int. From 2^23 up every
+			// float is an integer already and is passed through
+			static __forceinline __m128 Truncate(const __m128 x)
+			{
+				const __m128 isInteger = _mm_cmpge_ps(FAbs(x), _mm_set1_ps(8388608.0f));
+				return Select(isInteger, x, _mm_cvtepi32_ps(_mm_cvttps_epi32(x)));
+			}
+
+			static __forceinline __m128 FAdd(const __m128 a, const __m128 b) { return _mm_add_ps(a, b); }
+			static __forceinline __m128 FSub(const __m128 a, const __m128 b) { return _mm_sub_ps(a, b); }
+			static __forceinline __m128 FMul(const __m128 a, const __m128 b) { return _mm_mul_ps(a, b); }
+			static __forceinline __m128 FDiv(const __m128 a, const __m128 b) { return _mm_div_ps(a, b); }
+			static __forceinline __m128 FMad(const __m128 a, const __m128 b, const __m128 c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+			static __forceinline __m128 FMin(const __m128 a, const __m128 b) { return _mm_min_ps(a, b); }
+			static __forceinline __m128 FMax(const __m128 a, const __m128 b) { return _mm_max_ps(a, b); }
+			static __forceinline __m128 FMod(const __m128 a, const __m128 b) { return _mm_sub_ps(a, _mm_mul_ps(b, Truncate(_mm_div_ps(a, b)))); }
+			static __forceinline __m128 FNeg(const __m128 a) { return _mm_xor_ps(a, SignMask()); }
+			static __forceinline __m128 FAbs(const __m128 a) { return _mm_andnot_ps(SignMask(), a); }
+			static __forceinline __m128 FSqrt(const __m128 a) { return _mm_sqrt_ps(a); }
+			static __forceinline __m128 FRsqrt(const __m128 a) { return Math::Rsqrt(a); }
+			static __forceinline __m128 FRcp(const __m128 a) { return Math::Rcp(a); }
+			static __forceinline __m128 FFloor(const __m128 a)
+			{
+				const __m128 t = Truncate(a);
+				return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a), _mm_set1_ps(1.0f)));
+			}
+			static __forceinline __m128 FCeil(const __m128 a)
+			{
+				const __m128 t = Truncate(a);
+				return _mm_add_ps(t, _mm_and_ps(_mm_cmplt_ps(t, a), _mm_set1_ps(1.0f)));
+			}
+			static __forceinline __m128 FFrac(const __m128 a) { return _mm_sub_ps(a, FFloor(a)); }
+			static __forceinline __m128 FRound(const __m128 a)
+			{
+				const __m128 isInteger = _mm_cmpge_ps(FAbs(a), _mm_set1_ps(8388608.0f));
+				return Select(isInteger, a, _mm_cvtepi32_ps(_mm_cvtps_epi32(a)));
+			}
+			static __forceinline __m128 FTrunc(const __m128 a) { return Truncate(a); }
+			static __forceinline __m128 FSaturate(const __m128 a) { return _mm_min_ps(_mm_max_ps(a, _mm_setzero_ps()), _mm_set1_ps(1.0f)); }
+			static __forceinline __m128 FExp(const __m128 a) { return Math::Exp(a); }
+			static __forceinline __m128 FExp2(const __m128 a) { return Math::Exp2(a); }
+			static __forceinline __m128 FLog(const __m128 a) { return Math::Log(a); }
+			static __forceinline __m128 FLog2(const __m128 a) { return Math::Log2(a); }
+			static __forceinline __m128 FPow(const __m128 a, const __m128 b) { return Math::Pow(a, b); }
+			static __forceinline __m128 FSin(const __m128 a) { return Math::Sin(a); }
+			static __forceinline __m128 FCos(const __m128 a) { return Math::Cos(a); }
+			static __forceinline __m128 FTan(const __m128 a)
+			{
+				__m128 sin, cos;
+				Math::SinCos(a, sin, cos);
+				return _mm_div_ps(sin, cos);
+			}
+			static __forceinline __m128 FAsin(const __m128 a) { return FloatLanes(a, a, [](float v, float) { return asinf(v); }); }
+			static __forceinline __m128 FAcos(const __m128 a) { return FloatLanes(a, a, [](float v, float) { return acosf(v); }); }
+			static __forceinline __m128 FAtan(const __m128 a) { return FloatLanes(a, a, [](float v, float) { return atanf(v); }); }
+			static __forceinline __m128 FAtan2(const __m128 a, const __m128 b) { return FloatLanes(a, b, [](float v, float w) { return atan2f(v, w); }); }
+			static __forceinline __m128 FLt(const __m128 a, const __m128 b) { return _mm_cmplt_ps(a, b); }
+			static __forceinline __m128 FLe(const __m128 a, const __m128 b) { return _mm_cmple_ps(a, b); }
+			static __forceinline __m128 FEq(const __m128 a, const __m128 b) { return _mm_cmpeq_ps(a, b); }
+			static __forceinline __m128 FNe(const __m128 a, const __m128 b) { return _mm_cmpneq_ps(a, b); }
+
+			static __forceinline __m128 IAdd(const __m128 a, const __m128 b) { return AsFloat(_mm_add_epi32(AsInt(a), AsInt(b))); }
+			static __forceinline __m128 ISub(const __m128 a, const __m128 b) { return AsFloat(_mm_sub_epi32(AsInt(a), AsInt(b))); }
+			static __forceinline __m128 IMul(const __m128 a, const __m128 b)
+			{
+				// Low 32 bits of the products from the two even/odd 64 bit multiplies
+				const __m128i even = _mm_mul_epu32(AsInt(a), AsInt(b));
+				const __m128i odd = _mm_mul_epu32(_mm_srli_si128(AsInt(a), 4), _mm_srli_si128(AsInt(b), 4));
+				return AsFloat(_mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0))));
+			}
+			static __forceinline __m128 IDiv(const __m128 a, const __m128 b) { return IntLanes(a, b, SignedDiv); }
+			static __forceinline __m128 IMod(const __m128 a, const __m128 b) { return IntLanes(a, b, SignedMod); }
+			static __forceinline __m128 UDiv(const __m128 a, const __m128 b) { return IntLanes(a, b, UnsignedDiv); }
+			static __forceinline __m128 UMod(const __m128 a, const __m128 b) { return IntLanes(a, b, UnsignedMod); }
+			static __forceinline __m128 INeg(const __m128 a) { return AsFloat(_mm_sub_epi32(_mm_setzero_si128(), AsInt(a))); }
+			static __forceinline __m128 IAbs(const __m128 a)
+			{
+				const __m128i sign = _mm_srai_epi32(AsInt(a), 31);
+				return AsFloat(_mm_sub_epi32(_mm_xor_si128(AsInt(a), sign), sign));
+			}
+			static __forceinline __m128 IMin(const __m128 a, const __m128 b) { return Select(AsFloat(_mm_cmplt_epi32(AsInt(a), AsInt(b))), a, b); }
+			static __forceinline __m128 IMax(const __m128 a, const __m128 b) { return Select(AsFloat(_mm_cmpgt_epi32(AsInt(a), AsInt(b))), a, b); }
+			static __forceinline __m128 UMin(const __m128 a, const __m128 b) { return Select(AsFloat(_mm_cmplt_epi32(Unsigned(a), Unsigned(b))), a, b); }
+			static __forceinline __m128 UMax(const __m128 a, const __m128 b) { return Select(AsFloat(_mm_cmpgt_epi32(Unsigned(a), Unsigned(b))), a, b); }
+			static __forceinline __m128 Shl(const __m128 a, const __m128 b) { return IntLanes(a, b, [](int v, int s) { return int(uint(v) << (s & 31)); }); }
+			static __forceinline __m128 Shr(const __m128 a, const __m128 b) { return IntLanes(a, b, [](int v, int s) { return v >> (s & 31); }); }
+			static __forceinline __m128 UShr(const __m128 a, const __m128 b) { return IntLanes(a, b, [](int v, int s) { return int(uint(v) >> (s & 31)); }); }
+			static __forceinline __m128 ILt(const __m128 a, const __m128 b) { return AsFloat(_mm_cmplt_epi32(AsInt(a), AsInt(b))); }
+			static __forceinline __m128 ILe(const __m128 a, const __m128 b) { return AsFloat(_mm_xor_si128(_mm_cmpgt_epi32(AsInt(a), AsInt(b)), _mm_set1_epi32(-1))); }
+			static __forceinline __m128 IEq(const __m128 a, const __m128 b) { return AsFloat(_mm_cmpeq_epi32(AsInt(a), AsInt(b))); }
+			static __forceinline __m128 INe(const __m128 a, const __m128 b) { return AsFloat(_mm_xor_si128(_mm_cmpeq_epi32(AsInt(a), AsInt(b)), _mm_set1_epi32(-1))); }
+			static __forceinline __m128 ULt(const __m128 a, const __m128 b) { return AsFloat(_mm_cmplt_epi32(Unsigned(a), Unsigned(b))); }
+			static __forceinline __m128 ULe(const __m128 a, const __m128 b) { return AsFloat(_mm_xor_si128(_mm_cmpgt_epi32(Unsigned(a), Unsigned(b)), _mm_set1_epi32(-1))); }
+
+			static __forceinline __m128 IToF(const __m128 a) { return _mm_cvtepi32_ps(AsInt(a)); }
+			static __forceinline __m128 UToF(const __m128 a)
+			{
+				const __m128 high = _mm_cvtepi32_ps(_mm_srli_epi32(AsInt(a), 16));
+				const __m128 low = _mm_cvtepi32_ps(_mm_and_si128(AsInt(a), _mm_set1_epi32(0xffff)));
+				return _mm_add_ps(_mm_mul_ps(high, _mm_set1_ps(65536.0f)), low);
+			}
+			static __forceinline __m128 FToI(const __m128 a) { return AsFloat(_mm_cvttps_epi32(a)); }
+			static __forceinline __m128 FToU(const __m128 a)
+			{
+				const __m128 x = _mm_max_ps(a, _mm_setzero_ps());
+				const __m128 twoTo31 = _mm_set1_ps(2147483648.0f);
+				const __m128i low = _mm_cvttps_epi32(x);
+				const __m128i high = _mm_xor_si128(_mm_cvttps_epi32(_mm_sub_ps(x, twoTo31)), _mm_set1_epi32(0x80000000));
+				return Select(_mm_cmpge_ps(x, twoTo31), AsFloat(high), AsFloat(low));
+			}
+
+			// Coarse derivatives, every pixel of a quad gets the same difference
+			static __forceinline __m128 Ddx(const __m128 a) { return _mm_sub_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(1, 1, 1, 1)), _mm_shuffle_ps(a, a, _MM_SHUFFLE(0, 0, 0, 0))); }
+			static __forceinline __m128 Ddy(const __m128 a) { return _mm_sub_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 2, 2, 2)), _mm_shuffle_ps(a, a, _MM_SHUFFLE(0, 0, 0, 0))); }
+
+			// A fetch of one of Sample, SampleBias or SampleGrad. pExtra holds the bias or the four gradients.
+			// fetch(slot, quad, u, v, dUVdx, dUVdy, result) as IRTextureSource::SampleQuad is called for the quad
+			// unless none of its lanes is active
+			template<typename Fetch>
+			static __forceinline void Sample(const IROpcode op,
+				const int slot,
+				const int quad,
+				const __m128 exec,
+				const __m128 u,
+				const __m128 v,
+				const __m128* pExtra,
+				const Fetch& fetch,
+				__m128 result[4])
+			{
+				if (_mm_movemask_ps(exec) == 0)
+				{
+					result[0] = result[1] = result[2] = result[3] = _mm_setzero_ps();
+					return;
+				}
+
+				// Inactive lanes may hold anything, the texture only gets finite coordinates
+				const __m128 infinity = _mm_set1_ps(INFINITY);
+				const __m128 finiteU = _mm_and_ps(u, _mm_cmplt_ps(FAbs(u), infinity));
+				const __m128 finiteV = _mm_and_ps(v, _mm_cmplt_ps(FAbs(v), infinity));
+
+				float dUVdx[2], dUVdy[2];
+				if (op == IROpcode::SampleGrad)
+				{
+					dUVdx[0] = _mm_cvtss_f32(pExtra[0]);
+					dUVdx[1] = _mm_cvtss_f32(pExtra[1]);
+					dUVdy[0] = _mm_cvtss_f32(pExtra[2]);
+					dUVdy[1] = _mm_cvtss_f32(pExtra[3]);
+				}
+				else
+				{
+					float us[4], vs[4];
+					_mm_storeu_ps(us, finiteU);
+					_mm_storeu_ps(vs, finiteV);
+					dUVdx[0] = us[1] - us[0];
+					dUVdx[1] = vs[1] - vs[0];
+					dUVdy[0] = us[2] - us[0];
+					dUVdy[1] = vs[2] - vs[0];
+
+					// A bias scales the footprint, which moves the level by the bias
+					if (op == IROpcode::SampleBias)
+					{
+						const float scale = exp2f(_mm_cvtss_f32(pExtra[0]));
+						dUVdx[0] *= scale;
+						dUVdx[1] *= scale;
+						dUVdy[0] *= scale;
+						dUVdy[1] *= scale;
+					}
+				}
+
+				fetch(slot, quad, finiteU, finiteV, dUVdx, dUVdy, result);
+			}
+
+		private:
+			// Unsigned order is signed order with the sign bits flipped
+			static __forceinline __m128i Unsigned(const __m128 a) { return _mm_xor_si128(AsInt(a), _mm_set1_epi32(0x80000000)); }
+
+			// Operations without an SSE2 form run lane by lane
+			template<typename Func>
+			static __forceinline __m128 FloatLanes(const __m128 a, const __m128 b, Func func)
+			{
+				float x[4], y[4];
+				_mm_storeu_ps(x, a);
+				_mm_storeu_ps(y, b);
+				for (auto i = 0; i < 4; i++)
+					x[i] = func(x[i], y[i]);
+				return _mm_loadu_ps(x);
+			}
+
+			template<typename Func>
+			static __forceinline __m128 IntLanes(const __m128 a, const __m128 b, Func func)
+			{
+				int x[4], y[4];
+				_mm_storeu_si128((__m128i*)x, AsInt(a));
+				_mm_storeu_si128((__m128i*)y, AsInt(b));
+				for (auto i = 0; i < 4; i++)
+					x[i] = func(x[i], y[i]);
+				return AsFloat(_mm_loadu_si128((const __m128i*)x));
+			}
+
+			// Division by zero gives all bits set as on D3D hardware, INT_MIN / -1 wraps
+			static int SignedDiv(const int x, const int y) { return y == 0 ? -1 : (y == -1 ? int(0u - uint(x)) : x / y); }
+			static int SignedMod(const int x, const int y) { return y == 0 ? -1 : (y == -1 ? 0 : x % y); }
+			static int UnsignedDiv(const int x, const int y) { return y == 0 ? -1 : int(uint(x) / uint(y)); }
+			static int UnsignedMod(const int x, const int y) { return y == 0 ? -1 : int(uint(x) % uint(y)); }
+		};
+
+#if defined(__AVX2__)
+		// Two quads per register, one in each 128 bit half. What has no exact 8 wide form runs on the halves
+		template<>
+		struct ShaderOps<__m256>
+		{
+			static const int QUAD_COUNT = 2;
+
+			typedef ShaderOps<__m128> Half;
+
+			static __forceinline __m256i AsInt(const __m256 a) { return _mm256_castps_si256(a); }
+			static __forceinline __m256 AsFloat(const __m256i a) { return _mm256_castsi256_ps(a); }
+
+			static __forceinline __m256 Set(const uint bits) { return AsFloat(_mm256_set1_epi32(bits)); }
+			static __forceinline __m256 SetFloat(const float val) { return _mm256_set1_ps(val); }
+			static __forceinline __m256 Zero() { return _mm256_setzero_ps(); }
+			static __forceinline __m256 AllSet() { return AsFloat(_mm256_set1_epi32(-1)); }
+			static __forceinline __m256 SignMask() { return AsFloat(_mm256_set1_epi32(0x80000000)); }
+
+			static __forceinline __m256 LoadLanes(const float* pValues) { return _mm256_loadu_ps(pValues); }
+			static __forceinline void StoreLanes(float* pValues, const __m256 a) { _mm256_storeu_ps(pValues, a); }
+
+			static __forceinline bool Any(const __m256 mask) { return _mm256_movemask_ps(mask) != 0; }
+			static __forceinline __m256 And(const __m256 a, const __m256 b) { return _mm256_and_ps(a, b); }
+			static __forceinline __m256 AndNot(const __m256 a, const __m256 b) { return _mm256_andnot_ps(a, b); }
+			static __forceinline __m256 Or(const __m256 a, const __m256 b) { return _mm256_or_ps(a, b); }
+			static __forceinline __m256 Xor(const __m256 a, const __m256 b) { return _mm256_xor_ps(a, b); }
+			static __forceinline __m256 Not(const __m256 a) { return _mm256_xor_ps(a, AllSet()); }
+
+			static __forceinline __m256 Select(const __m256 mask, const __m256 a, const __m256 b)
+			{
+				return _mm256_or_ps(_mm256_and_ps(mask, a), _mm256_andnot_ps(mask, b));
+			}
+			static __forceinline __m256 Store(const __m256 exec, const __m256 value, const __m256 prev) { return Select(exec, value, prev); }
+			static __forceinline __m256 StoreIf(const __m256 exec, const __m256 value, const __m256 cond, const __m256 prev) { return Select(_mm256_and_ps(exec, cond), value, prev); }
+
+			static __forceinline __m256 FAdd(const __m256 a, const __m256 b) { return _mm256_add_ps(a, b); }
+			static __forceinline __m256 FSub(const __m256 a, const __m256 b) { return _mm256_sub_ps(a, b); }
+			static __forceinline __m256 FMul(const __m256 a, const __m256 b) { return _mm256_mul_ps(a, b); }
+			static __forceinline __m256 FDiv(const __m256 a, const __m256 b) { return _mm256_div_ps(a, b); }
+			static __forceinline __m256 FMad(const __m256 a, const __m256 b, const __m256 c) { return _mm256_add_ps(_mm256_mul_ps(a, b), c); }
+			static __forceinline __m256 FMin(const __m256 a, const __m256 b) { return _mm256_min_ps(a, b); }
+			static __forceinline __m256 FMax(const __m256 a, const __m256 b) { return _mm256_max_ps(a, b); }
+			static __forceinline __m256 FMod(const __m256 a, const __m256 b) { return Halves(a, b, Half::FMod); }
+			static __forceinline __m256 FNeg(const __m256 a) { return _mm256_xor_ps(a, SignMask()); }
+			static __forceinline __m256 FAbs(const __m256 a) { return _mm256_andnot_ps(SignMask(), a); }
+			static __forceinline __m256 FSqrt(const __m256 a) { return _mm256_sqrt_ps(a); }
+			static __forceinline __m256 FRsqrt(const __m256 a) { return Halves(a, Half::FRsqrt); }
+			static __forceinline __m256 FRcp(const __m256 a) { return Halves(a, Half::FRcp); }
+			static __forceinline __m256 FFloor(const __m256 a) { return Halves(a, Half::FFloor); }
+			static __forceinline __m256 FCeil(const __m256 a) { return Halves(a, Half::FCeil); }
+			static __forceinline __m256 FFrac(const __m256 a) { return Halves(a, Half::FFrac); }
+			static __forceinline __m256 FRound(const __m256 a) { return Halves(a, Half::FRound); }
+			static __forceinline __m256 FTrunc(const __m256 a) { return Halves(a, Half::FTrunc); }
+			static __forceinline __m256 FSaturate(const __m256 a) { return _mm256_min_ps(_mm256_max_ps(a, _mm256_setzero_ps()), _mm256_set1_ps(1.0f)); }
+			static __forceinline __m256 FExp(const __m256 a) { return Halves(a, Half::FExp); }
+			static __forceinline __m256 FExp2(const __m256 a) { return Halves(a, Half::FExp2); }
+			static __forceinline __m256 FLog(const __m256 a) { return Halves(a, Half::FLog); }
+			static __forceinline __m256 FLog2(const __m256 a) { return Halves(a, Half::FLog2); }
+			static __forceinline __m256 FPow(const __m256 a, const __m256 b) { return Halves(a, b, Half::FPow); }
+			static __forceinline __m256 FSin(const __m256 a) { return Halves(a, Half::FSin); }
+			static __forceinline __m256 FCos(const __m256 a) { return Halves(a, Half::FCos); }
+			static __forceinline __m256 FTan(const __m256 a) { return Halves(a, Half::FTan); }
+			static __forceinline __m256 FAsin(const __m256 a) { return Halves(a, Half::FAsin); }
+			static __forceinline __m256 FAcos(const __m256 a) { return Halves(a, Half::FAcos); }
+			static __forceinline __m256 FAtan(const __m256 a) { return Halves(a, Half::FAtan); }
+			static __forceinline __m256 FAtan2(const __m256 a, const __m256 b) { return Halves(a, b, Half::FAtan2); }
+			static __forceinline __m256 FLt(const __m256 a, const __m256 b) { return _mm256_cmp_ps(a, b, _CMP_LT_OS); }
+			static __forceinline __m256 FLe(const __m256 a, const __m256 b) { return _mm256_cmp_ps(a, b, _CMP_LE_OS); }
+			static __forceinline __m256 FEq(const __m256 a, const __m256 b) { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+			static __forceinline __m256 FNe(const __m256 a, const __m256 b) { return _mm256_cmp_ps(a, b, _CMP_NEQ_UQ); }
+
+			static __forceinline __m256 IAdd(const __m256 a, const __m256 b) { return AsFloat(_mm256_add_epi32(AsInt(a), AsInt(b))); }
+			static __forceinline __m256 ISub(const __m256 a, const __m256 b) { return AsFloat(_mm256_sub_epi32(AsInt(a), AsInt(b))); }
+			static __forceinline __m256 IMul(const __m256 a, const __m256 b) { return AsFloat(_mm256_mullo_epi32(AsInt(a), AsInt(b))); }
+			static __forceinline __m256 IDiv(const __m256 a, const __m256 b) { return Halves(a, b, Half::IDiv); }
+			static __forceinline __m256 IMod(const __m256 a, const __m256 b) { return Halves(a, b, Half::IMod); }
+			static __forceinline __m256 UDiv(const __m256 a, const __m256 b) { return Halves(a, b, Half::UDiv); }
+			static __forceinline __m256 UMod(const __m256 a, const __m256 b) { return Halves(a, b, Half::UMod); }
+			static __forceinline __m256 INeg(const __m256 a) { return AsFloat(_mm256_sub_epi32(_mm256_setzero_si256(), AsInt(a))); }
+			static __forceinline __m256 IAbs(const __m256 a) { return AsFloat(_mm256_abs_epi32(AsInt(a))); }
+			static __forceinline __m256 IMin(const __m256 a, const __m256 b) { return AsFloat(_mm256_min_epi32(AsInt(a), AsInt(b))); }
+			static __forceinline __m256 IMax(const __m256 a, const __m256 b) { return AsFloat(_mm256_max_epi32(AsInt(a), AsInt(b))); }
+			static __forceinline __m256 UMin(const __m256 a, const __m256 b) { return AsFloat(_mm256_min_epu32(AsInt(a), AsInt(b))); }
+			static __forceinline __m256 UMax(const __m256 a, const __m256 b) { return AsFloat(_mm256_max_epu32(AsInt(a), AsInt(b))); }
+			static __forceinline __m256 Shl(const __m256 a, const __m256 b) { return AsFloat(_mm256_sllv_epi32(AsInt(a), ShiftCount(b))); }
+			static __forceinline __m256 Shr(const __m256 a, const __m256 b) { return AsFloat(_mm256_srav_epi32(AsInt(a), ShiftCount(b))); }
+			static __forceinline __m256 UShr(const __m256 a, const __m256 b) { return AsFloat(_mm256_srlv_epi32(AsInt(a), ShiftCount(b))); }
+			static __forceinline __m256 ILt(const __m256 a, const __m256 b) { return AsFloat(_mm256_cmpgt_epi32(AsInt(b), AsInt(a))); }
+			static __forceinline __m256 ILe(const __m256 a, const __m256 b) { return Not(AsFloat(_mm256_cmpgt_epi32(AsInt(a), AsInt(b)))); }
+			static __forceinline __m256 IEq(const __m256 a, const __m256 b) { return AsFloat(_mm256_cmpeq_epi32(AsInt(a), AsInt(b))); }
+			static __forceinline __m256 INe(const __m256 a, const __m256 b) { return Not(AsFloat(_mm256_cmpeq_epi32(AsInt(a), AsInt(b)))); }
+			static __forceinline __m256 ULt(const __m256 a, const __m256 b) { return AsFloat(_mm256_cmpgt_epi32(Unsigned(b), Unsigned(a))); }
+			static __forceinline __m256 ULe(const __m256 a, const __m256 b) { return Not(AsFloat(_mm256_cmpgt_epi32(Unsigned(a), Unsigned(b)))); }
+
+			static __forceinline __m256 IToF(const __m256 a) { return _mm256_cvtepi32_ps(AsInt(a)); }
+			static __forceinline __m256 UToF(const __m256 a) { return Halves(a, Half::UToF); }
+			static __forceinline __m256 FToI(const __m256 a) { return AsFloat(_mm256_cvttps_epi32(a)); }
+			static __forceinline __m256 FToU(const __m256 a) { return Halves(a, Half::FToU); }
+
+			// Shuffles stay within each half, so each quad differences its own lanes
+			static __forceinline __m256 Ddx(const __m256 a) { return _mm256_sub_ps(_mm256_shuffle_ps(a, a, _MM_SHUFFLE(1, 1, 1, 1)), _mm256_shuffle_ps(a, a, _MM_SHUFFLE(0, 0, 0, 0))); }
+			static __forceinline __m256 Ddy(const __m256 a) { return _mm256_sub_ps(_mm256_shuffle_ps(a, a, _MM_SHUFFLE(2, 2, 2, 2)), _mm256_shuffle_ps(a, a, _MM_SHUFFLE(0, 0, 0, 0))); }
+
+			template<typename Fetch>
+			static __forceinline void Sample(const IROpcode op,
+				const int slot,
+				const int quad,
+				const __m256 exec,
+				const __m256 u,
+				const __m256 v,
+				const __m256* pExtra,
+				const Fetch& fetch,
+				__m256 result[4])
+			{
+				__m128 low[4], high[4], extraLow[4], extraHigh[4];
+				const int extraCount = op == IROpcode::SampleGrad ? 4 : (op == IROpcode::SampleBias ? 1 : 0);
+				for (auto i = 0; i < extraCount; i++)
+				{
+					extraLow[i] = Low(pExtra[i]);
+					extraHigh[i] = High(pExtra[i]);
+				}
+
+				Half::Sample(op, slot, 2 * quad, Low(exec), Low(u), Low(v), extraLow, fetch, low);
+				Half::Sample(op, slot, 2 * quad + 1, High(exec), High(u), High(v), extraHigh, fetch, high);
+				for (auto i = 0; i < 4; i++)
+					result[i] = Combine(low[i], high[i]);
+			}
+
+		private:
+			static __forceinline __m128 Low(const __m256 a) { return _mm256_castps256_ps128(a); }
+			static __forceinline __m128 High(const __m256 a) { return _mm256_extractf128_ps(a, 1); }
+			static __forceinline __m256 Combine(const __m128 low, const __m128 high) { return _mm256_insertf128_ps(_mm256_castps128_ps256(low), high, 1); }
+
+			template<typename Func>
+			static __forceinline __m256 Halves(const __m256 a, Func func) { return Combine(func(Low(a)), func(High(a))); }
+			template<typename Func>
+			static __forceinline __m256 Halves(const __m256 a, const __m256 b, Func func) { return Combine(func(Low(a), Low(b)), func(High(a), High(b))); }
+
+			static __forceinline __m256i Unsigned(const __m256 a) { return _mm256_xor_si256(AsInt(a), _mm256_set1_epi32(0x80000000)); }
+			static __forceinline __m256i ShiftCount(const __m256 a) { return _mm256_and_si256(AsInt(a), _mm256_set1_epi32(31)); }
+		};
+#endif
+	}
+}
\ No newline at end of file
@@ -0,0 +1,409 @@
+#include "X64Emitter.h"
+
+namespace EDX
+{
+	namespace ShaderCompiler
+	{
+		namespace
+		{
+			// Prefix as in the VEX pp field: none, 66, F3, F2. Map as in the VEX mmmmm field: 0F, 0F38, 0F3A
+			struct VecEncoding
+			{
+				_byte Prefix;
+				_byte Map;
+				_byte Opcode;
+			};
+
+			const VecEncoding VecEncodings[] =
+			{
+				{ 0, 1, 0x28 },	// Movaps
+				{ 0, 1, 0x10 },	// Movups
+				{ 0, 1, 0x58 },	// Addps
+				{ 0, 1, 0x5C },	// Subps
+				{ 0, 1, 0x59 },	// Mulps
+				{ 0, 1, 0x5E },	// Divps
+				{ 0, 1, 0x5D },	// Minps
+				{ 0, 1, 0x5F },	// Maxps
+				{ 0, 1, 0x51 },	// Sqrtps
+				{ 0, 1, 0x53 },	// Rcpps
+				{ 0, 1, 0x52 },	// Rsqrtps
+				{ 0, 1, 0x54 },	// Andps
+				{ 0, 1, 0x55 },	// Andnps
+				{ 0, 1, 0x56 },	// Orps
+				{ 0, 1, 0x57 },	// Xorps
+				{ 0, 1, 0xC2 },	// Cmpps
+				{ 0, 1, 0xC6 },	// Shufps
+				{ 0, 1, 0x5B },	// Cvtdq2ps
+				{ 2, 1, 0x5B },	// Cvttps2dq
+				{ 1, 1, 0x5B },	// Cvtps2dq
+				{ 1, 1, 0xFE },	// Paddd
+				{ 1, 1, 0xFA },	// Psubd
+				{ 1, 1, 0xF4 },	// Pmuludq
+				{ 1, 1, 0x76 },	// Pcmpeqd
+				{ 1, 1, 0x66 },	// Pcmpgtd
+				{ 1, 1, 0x62 },	// Punpckldq
+				{ 1, 1, 0x70 },	// Pshufd
+				{ 1, 1, 0xF2 },	// Pslld
+				{ 1, 1, 0xE2 },	// Psrad
+				{ 1, 1, 0xD2 },	// Psrld
+				{ 1, 2, 0x1E },	// Pabsd
+				{ 1, 2, 0x40 },	// Pmulld
+				{ 1, 2, 0x39 },	// Pminsd
+				{ 1, 2, 0x3D },	// Pmaxsd
+				{ 1, 2, 0x3B },	// Pminud
+				{ 1, 2, 0x3F },	// Pmaxud
+				{ 1, 3, 0x08 },	// Roundps
+				{ 1, 2, 0x47 },	// Psllvd
+				{ 1, 2, 0x46 },	// Psravd
+				{ 1, 2, 0x45 },	// Psrlvd
+			};
+			static_assert(sizeof(VecEncodings) / sizeof(VecEncodings[0]) == int(X64VecOp::Count), "encoding table out of sync");
+
+			const _byte LegacyPrefixes[] = { 0, 0x66, 0xF3, 0xF2 };
+
+			// 66 0F 72 /ext ib and 66 0F 73 /ext ib
+			const _byte ShiftOpcodes[] = { 0x72, 0x72, 0x72, 0x73 };
+			const _byte ShiftExtensions[] = { 6, 4, 2, 3 };
+		}
+
+		void X64Emitter::Vec(const X64VecOp op, const int dst, const int src0, const int src1, const int imm)
+		{
+			if (mVex)
+			{
+				EncodeVec(op, dst, src0, Operand(src1), mWide, imm);
+				return;
+			}
+
+			Assert(dst == src0 || dst != src1);
+			if (dst != src0)
+				EncodeVec(X64VecOp::Movaps, dst, 0, Operand(src0), false, -1);
+			EncodeVec(op, dst, 0, Operand(src1), false, imm);
+		}
+
+		void X64Emitter::Vec(const X64VecOp op, const int dst, const int src0, const X64Mem& src1, const int imm)
+		{
+			if (mVex)
+			{
+				EncodeVec(op, dst, src0, Operand(src1), mWide, imm);
+				return;
+			}
+
+			if (dst != src0)
+				EncodeVec(X64VecOp::Movaps, dst, 0, Operand(src0), false, -1);
+			EncodeVec(op, dst, 0, Operand(src1), false, imm);
+		}
+
+		void X64Emitter::VecUnary(const X64VecOp op, const int dst, const int src, const int imm)
+		{
+			EncodeVec(op, dst, 0, Operand(src), mWide, imm);
+		}
+
+		void X64Emitter::VecUnary(const X64VecOp op, const int dst, const X64Mem& src, const int imm)
+		{
+			EncodeVec(op, dst, 0, Operand(src), mWide, imm);
+		}
+
+		void X64Emitter::VecShift(const X64ShiftOp op, const int dst, const int src, const int count)
+		{
+			// The opcode extension sits in the reg field, VEX names the destination in vvvv
+			const _byte opcode = ShiftOpcodes[int(op)];
+			const int ext = ShiftExtensions[int(op)];
+			if (mVex)
+			{
+				EncodeVec(1, 1, opcode, ext, dst, Operand(src), mWide, count);
+				return;
+			}
+
+			if (dst != src)
+				EncodeVec(X64VecOp::Movaps, dst, 0, Operand(src), false, -1);
+			EncodeVec(1, 1, opcode, ext, 0, Operand(dst), false, count);
+		}
+
+		void X64Emitter::Blendv(const int dst, const int src0, const int src1, const int mask)
+		{
+			if (mVex)
+			{
+				// VEX.66.0F3A.W0 4A /r is4
+				EncodeVec(1, 3, 0x4A, dst, src0, Operand(src1), mWide, mask << 4);
+				return;
+			}
+
+			// 66 0F38 14 /r, the mask is xmm0
+			Assert(dst == src0 && mask == 0);
+			EncodeVec(1, 2, 0x14, dst, 0, Operand(src1), false, -1);
+		}
+
+		void X64Emitter::Load(const int dst, const X64Mem& src)
+		{
+			EncodeVec(X64VecOp::Movups, dst, 0, Operand(src), mWide, -1);
+		}
+
+		void X64Emitter::Store(const X64Mem& dst, const int src)
+		{
+			EncodeVec(0, 1, 0x11, src, 0, Operand(dst), mWide, -1);
+		}
+
+		void X64Emitter::Movmsk(const X64Reg dst, const int src)
+		{
+			EncodeVec(0, 1, 0x50, int(dst), 0, Operand(src), mWide, -1);
+		}
+
+		void X64Emitter::MovdToVec(const int dst, const X64Reg src)
+		{
+			// Always 128 bit, the upper lanes are cleared
+			EncodeVec(1, 1, 0x6E, dst, 0, Operand(int(src)), false, -1);
+		}
+
+		void X64Emitter::Vzeroupper()
+		{
+			Byte(0xC5);
+			Byte(0xF8);
+			Byte(0x77);
+		}
+
+		void X64Emitter::Push(const X64Reg reg)
+		{
+			if (int(reg) >= 8)
+				Byte(0x41);
+			Byte(0x50 | (int(reg) & 7));
+		}
+
+		void X64Emitter::Pop(const X64Reg reg)
+		{
+			if (int(reg) >= 8)
+				Byte(0x41);
+			Byte(0x58 | (int(reg) & 7));
+		}
+
+		void X64Emitter::Mov(const X64Reg dst, const X64Reg src)
+		{
+			EncodeGPR(true, 0x89, int(src), Operand(int(dst)));
+		}
+
+		void X64Emitter::MovImm(const X64Reg dst, const uint64 imm)
+		{
+			Byte(0x48 | (int(dst) >= 8));
+			Byte(0xB8 | (int(dst) & 7));
+			Int32(int(imm));
+			Int32(int(imm >> 32));
+		}
+
+		void X64Emitter::MovImm32(const X64Reg dst, const int imm)
+		{
+			if (int(dst) >= 8)
+				Byte(0x41);
+			Byte(0xB8 | (int(dst) & 7));
+			Int32(imm);
+		}
+
+		void X64Emitter::Load32(const X64Reg dst, const X64Mem& src)
+		{
+			EncodeGPR(false, 0x8B, int(dst), Operand(src));
+		}
+
+		void X64Emitter::Store64(const X64Mem& dst, const X64Reg src)
+		{
+			EncodeGPR(true, 0x89, int(src), Operand(dst));
+		}
+
+		void X64Emitter::Lea(const X64Reg dst, const X64Mem& src)
+		{
+			EncodeGPR(true, 0x8D, int(dst), Operand(src));
+		}
+
+		void X64Emitter::LeaLabel(const X64Reg dst, const int label)
+		{
+			// RIP relative, the displacement is the last field of the instruction
+			Byte(0x48 | ((int(dst) >= 8) << 2));
+			Byte(0x8D);
+			Byte(0x05 | ((int(dst) & 7) << 3));
+			EmitRel32(label);
+		}
+
+		void X64Emitter::And32(const X64Reg dst, const int imm)
+		{
+			EncodeGPR(false, 0x81, 4, Operand(int(dst)));
+			Int32(imm);
+		}
+
+		void X64Emitter::Or32(const X64Reg dst, const X64Reg src)
+		{
+			EncodeGPR(false, 0x09, int(src), Operand(int(dst)));
+		}
+
+		void X64Emitter::Test32(const X64Reg a, const X64Reg b)
+		{
+			EncodeGPR(false, 0x85, int(b), Operand(int(a)));
+		}
+
+		void X64Emitter::Test32(const X64Mem& a, const X64Reg b)
+		{
+			EncodeGPR(false, 0x85, int(b), Operand(a));
+		}
+
+		void X64Emitter::Add64(const X64Reg dst, const int imm)
+		{
+			EncodeGPR(true, 0x81, 0, Operand(int(dst)));
+			Int32(imm);
+		}
+
+		void X64Emitter::Sub64(const X64Reg dst, const int imm)
+		{
+			EncodeGPR(true, 0x81, 5, Operand(int(dst)));
+			Int32(imm);
+		}
+
+		void X64Emitter::Call(const X64Reg target)
+		{
+			EncodeGPR(false, 0xFF, 2, Operand(int(target)));
+		}
+
+		void X64Emitter::Ret()
+		{
+			Byte(0xC3);
+		}
+
+		int X64Emitter::NewLabel()
+		{
+			mLabels.Add(-1);
+			return mLabels.Size() - 1;
+		}
+
+		void X64Emitter::Bind(const int label)
+		{
+			Assert(mLabels[label] < 0);
+			mLabels[label] = mCode.Size();
+		}
+
+		void X64Emitter::Jump(const int label)
+		{
+			Byte(0xE9);
+			EmitRel32(label);
+		}
+
+		void X64Emitter::Jump(const X64Cond cond, const int label)
+		{
+			Byte(0x0F);
+			Byte(0x80 | int(cond));
+			EmitRel32(label);
+		}
+
+		void X64Emitter::Align(const int alignment, const _byte fill)
+		{
+			while (mCode.Size() % alignment != 0)
+				Byte(fill);
+		}
+
+		void X64Emitter::EmitData(const void* pData, const int size)
+		{
+			const _byte* pBytes = (const _byte*)pData;
+			for (auto i = 0; i < size; i++)
+				Byte(pBytes[i]);
+		}
+
+		const Array<_byte>& X64Emitter::Finish()
+		{
+			for (auto i = 0; i < mFixups.Size(); i++)
+			{
+				const Fixup& fixup = mFixups[i];
+				Assert(mLabels[fixup.Label] >= 0);
+
+				const int rel = mLabels[fixup.Label] - (fixup.Offset + 4);
+				for (auto b = 0; b < 4; b++)
+					mCode[fixup.Offset + b] = _byte(rel >> (8 * b));
+			}
+			mFixups.Clear();
+
+			return mCode;
+		}
+
+		void X64Emitter::EncodeVec(const X64VecOp op, const int reg, const int vvvv, const Operand& rm, const bool wide, const int imm)
+		{
+			const VecEncoding& enc = VecEncodings[int(op)];
+			EncodeVec(enc.Prefix, enc.Map, enc.Opcode, reg, vvvv, rm, wide, imm);
+		}
+
+		void X64Emitter::EncodeVec(const int prefix, const int map, const _byte opcode, const int reg, const int vvvv, const Operand& rm, const bool wide, const int imm)
+		{
+			const bool r = reg >= 8;
+			const bool b = rm.Reg >= 8;
+
+			if (mVex)
+			{
+				if (map == 1 && !b)
+				{
+					Byte(0xC5);
+					Byte((!r << 7) | ((~vvvv & 15) << 3) | (wide << 2) | prefix);
+				}
+				else
+				{
+					Byte(0xC4);
+					Byte((!r << 7) | 0x40 | (!b << 5) | map);
+					Byte(((~vvvv & 15) << 3) | (wide << 2) | prefix);
+				}
+			}
+			else
+			{
+				if (prefix)
+					Byte(LegacyPrefixes[prefix]);
+				if (r || b)
+					Byte(0x40 | (r << 2) | b);
+				Byte(0x0F);
+				if (map == 2)
+					Byte(0x38);
+				else if (map == 3)
+					Byte(0x3A);
+			}
+
+			Byte(opcode);
+			EncodeModRM(reg, rm);
+			if (imm >= 0)
+				Byte(imm);
+		}
+
+		void X64Emitter::EncodeGPR(const bool rexW, const _byte opcode, const int reg, const Operand& rm)
+		{
+			const bool r = reg >= 8;
+			const bool b = rm.Reg >= 8;
+			if (rexW || r || b)
+				Byte(0x40 | (rexW << 3) | (r << 2) | b);
+			Byte(opcode);
+			EncodeModRM(reg, rm);
+		}
+
+		void X64Emitter::EncodeModRM(const int reg, const Operand& rm)
+		{
+			if (!rm.Memory)
+			{
+				Byte(0xC0 | ((reg & 7) << 3) | (rm.Reg & 7));
+				return;
+			}
+
+			// RSP and R12 need a SIB byte, RBP and R13 have no form without displacement
+			const int base = int(rm.Base) & 7;
+			const int mod = rm.Disp == 0 && base != 5 ? 0 : (rm.Disp >= -128 && rm.Disp <= 127 ? 1 : 2);
+			Byte((mod << 6) | ((reg & 7) << 3) | base);
+			if (base == 4)
+				Byte(0x24);
+			if (mod == 1)
+				Byte(rm.Disp);
+			else if (mod == 2)
+				Int32(rm.Disp);
+		}
+
+		void X64Emitter::EmitRel32(const int label)
+		{
+			Fixup fixup;
+			fixup.Offset = mCode.Size();
+			fixup.Label = label;
+			mFixups.Add(fixup);
+			Int32(0);
+		}
+
+		void X64Emitter::Int32(const int val)
+		{
+			for (auto b = 0; b < 4; b++)
+				Byte(val >> (8 * b));
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,210 @@
+#pragma once
+
+#include "EDXPrerequisites.h"
+
+namespace EDX
+{
+	namespace ShaderCompiler
+	{
+		enum class X64Reg
+		{
+			RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+			R8, R9, R10, R11, R12, R13, R14, R15,
+		};
+
+		enum class X64Cond
+		{
+			Zero = 0x4,
+			NotZero = 0x5,
+		};
+
+		// [Base + Disp]
+		struct X64Mem
+		{
+			X64Reg Base;
+			int Disp;
+
+			X64Mem(const X64Reg base, const int disp = 0)
+				: Base(base)
+				, Disp(disp)
+			{
+			}
+		};
+
+		// Vector instructions by their SSE mnemonic
+		enum class X64VecOp
+		{
+			Movaps,
+			Movups,
+			Addps,
+			Subps,
+			Mulps,
+			Divps,
+			Minps,
+			Maxps,
+			Sqrtps,
+			Rcpps,
+			Rsqrtps,
+			Andps,
+			Andnps,
+			Orps,
+			Xorps,
+			Cmpps,
+			Shufps,
+			Cvtdq2ps,
+			Cvttps2dq,
+			Cvtps2dq,
+			Paddd,
+			Psubd,
+			Pmuludq,
+			Pcmpeqd,
+			Pcmpgtd,
+			Punpckldq,
+			Pshufd,
+			Pslld,		// Count in the low 64 bits of the second source
+			Psrad,
+			Psrld,
+
+			// SSSE3 and SSE4.1
+			Pabsd,
+			Pmulld,
+			Pminsd,
+			Pmaxsd,
+			Pminud,
+			Pmaxud,
+			Roundps,
+
+			// AVX2, per lane counts
+			Psllvd,
+			Psravd,
+			Psrlvd,
+
+			Count,
+		};
+
+		// Shifts by an immediate count, Psrldq shifts each 128 bit lane by bytes
+		enum class X64ShiftOp
+		{
+			Pslld,
+			Psrad,
+			Psrld,
+			Psrldq,
+		};
+
+		// Machine code for x86-64 into a byte buffer. Vector instructions take a destination and two sources
+		// and are VEX encoded once AVX is enabled, the legacy SSE forms first copy the first source to the
+		// destination. Jumps go to labels, which are resolved by Finish
+		class X64Emitter
+		{
+		private:
+			struct Operand
+			{
+				bool Memory;
+				int Reg;
+				X64Reg Base;
+				int Disp;
+
+				Operand(const int reg)
+					: Memory(false)
+					, Reg(reg)
+					, Base(X64Reg::RAX)
+					, Disp(0)
+				{
+				}
+
+				Operand(const X64Mem& mem)
+					: Memory(true)
+					, Reg(int(mem.Base))
+					, Base(mem.Base)
+					, Disp(mem.Disp)
+				{
+				}
+			};
+
+			struct Fixup
+			{
+				int Offset;
+				int Label;
+			};
+
+			Array<_byte> mCode;
+			Array<int> mLabels;
+			Array<Fixup> mFixups;
+			bool mVex;
+			bool mWide;
+
+		public:
+			X64Emitter()
+				: mVex(false)
+				, mWide(false)
+			{
+			}
+
+			// Wide vectors are 256 bit and need VEX
+			void SetVectorMode(const bool vex, const bool wide)
+			{
+				Assert(vex || !wide);
+				mVex = vex;
+				mWide = wide;
+			}
+			int GetVectorSize() const { return mWide ? 32 : 16; }
+
+			// dst = src0 op src1, imm is appended when not negative
+			void Vec(const X64VecOp op, const int dst, const int src0, const int src1, const int imm = -1);
+			void Vec(const X64VecOp op, const int dst, const int src0, const X64Mem& src1, const int imm = -1);
+			void VecUnary(const X64VecOp op, const int dst, const int src, const int imm = -1);
+			void VecUnary(const X64VecOp op, const int dst, const X64Mem& src, const int imm = -1);
+			void VecShift(const X64ShiftOp op, const int dst, const int src, const int count);
+
+			// dst = mask ? src1 : src0 per lane. Without VEX dst must be src0 and the mask register 0
+			void Blendv(const int dst, const int src0, const int src1, const int mask);
+
+			void Load(const int dst, const X64Mem& src);
+			void Store(const X64Mem& dst, const int src);
+			void Movmsk(const X64Reg dst, const int src);
+			void MovdToVec(const int dst, const X64Reg src);
+			void Vzeroupper();
+
+			void Push(const X64Reg reg);
+			void Pop(const X64Reg reg);
+			void Mov(const X64Reg dst, const X64Reg src);
+			void MovImm(const X64Reg dst, const uint64 imm);
+			void MovImm32(const X64Reg dst, const int imm);
+			void Load32(const X64Reg dst, const X64Mem& src);
+			void Store64(const X64Mem& dst, const X64Reg src);
+			void Lea(const X64Reg dst, const X64Mem& src);
+			void LeaLabel(const X64Reg dst, const int label);
+			void And32(const X64Reg dst, const int imm);
+			void Or32(const X64Reg dst, const X64Reg src);
+			void Test32(const X64Reg a, const X64Reg b);
+			void Test32(const X64Mem& a, const X64Reg b);
+			void Add64(const X64Reg dst, const int imm);
+			void Sub64(const X64Reg dst, const int imm);
+			void Call(const X64Reg target);
+			void Ret();
+
+			int NewLabel();
+			void Bind(const int label);
+			void Jump(const int label);
+			void Jump(const X64Cond cond, const int label);
+
+			void Align(const int alignment, const _byte fill);
+			void EmitData(const void* pData, const int size);
+
+			int GetSize() const { return mCode.Size(); }
+
+			// Resolves jumps, every label used must have been bound
+			const Array<_byte>& Finish();
+
+		private:
+			void EncodeVec(const X64VecOp op, const int reg, const int vvvv, const Operand& rm, const bool wide, const int imm);
+			void EncodeVec(const int prefix, const int map, const _byte opcode, const int reg, const int vvvv, const Operand& rm, const bool wide, const int imm);
+			void EncodeGPR(const bool rexW, const _byte opcode, const int reg, const Operand& rm);
+			void EncodeModRM(const int reg, const Operand& rm);
+			void EmitRel32(const int label);
+
+			__forceinline void Byte(const int val) { mCode.Add(_byte(val)); }
+			void Int32(const int val);
+		};
+	}
+}
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include "EDXPrerequisites.h"
 #include "Core/Memory.h"
+#include "VertexQuantization.h"
 
 namespace EDX
 {
@@ -10,7 +11,8 @@ namespace EDX
 		enum class VertexFormat
 		{
 			PositionNormalTex,
-			PositionNormalColor
+			PositionNormalColor,
+			PositionNormalTex_Quantized
 		};
 
 		struct Vertex_PositionNormalTex
@@ -39,6 +41,20 @@ namespace EDX
 			static const int TexOffset = -1;
 			static const int ColorOffset = 24;
 		};
+		struct Vertex_PositionNormalTex_Quantized
+		{
+			unsigned short Position[3]; // Unorm16 relative to mesh bounds
+			unsigned short Padding;
+			short Normal[2]; // Octahedral snorm16
+			unsigned short TexCoord[2]; // Half precision
+			static const VertexFormat Format = VertexFormat::PositionNormalTex_Quantized;
+			static const int Size = 16;
+
+			static const int PosOffset = 0;
+			static const int NormalOffset = 8;
+			static const int TexOffset = 12;
+			static const int ColorOffset = -1;
+		};
 
 		class IVertexBuffer
 		{
@@ -63,6 +79,21 @@ namespace EDX
 			{
 				return mVertexCount;
 			}
+
+			// Bulk decode used by the vertex stage, compressed formats override it with a SIMD path
+			virtual void DecodeVertices(const uint startIdx,
+				const uint count,
+				Vector3* pPositions,
+				Vector3* pNormals,
+				Vector2* pTexCoords) const
+			{
+				for (auto i = 0; i < count; i++)
+				{
+					pPositions[i] = GetPosition(startIdx + i);
+					pNormals[i] = GetNormal(startIdx + i);
+					pTexCoords[i] = GetTexCoord(startIdx + i);
+				}
+			}
 		};
 
 		template<typename VertexType = Vertex_PositionNormalTex>
@@ -145,61 +176,371 @@ namespace EDX
 			return ret;
 		}
 
+		class QuantizedVertexBuffer : public IVertexBuffer
+		{
+		private:
+			typedef Vertex_PositionNormalTex_Quantized VertexType;
+
+			_byte* mpBuffer;
+			Vector3 mPosOffset;
+			Vector3 mPosScale;
+
+		public:
+			QuantizedVertexBuffer()
+				: mpBuffer(nullptr)
+			{
+			}
+			~QuantizedVertexBuffer()
+			{
+				Release();
+			}
+
+			void NewBuffer(const uint vertexCount)
+			{
+				mVertexCount = vertexCount;
+				mBufSize = vertexCount * VertexType::Size;
+
+				mpBuffer = new _byte[mBufSize];
+			}
+			void Encode(const Vertex_PositionNormalTex* pVertices)
+			{
+				Vector3 minPos = Vector3(Math::EDX_INFINITY, Math::EDX_INFINITY, Math::EDX_INFINITY);
+				Vector3 maxPos = Vector3(-Math::EDX_INFINITY, -Math::EDX_INFINITY, -Math::EDX_INFINITY);
+				for (auto i = 0; i < mVertexCount; i++)
+				{
+					minPos = Vector3(Math::Min(minPos.x, pVertices[i].Position.x),
+						Math::Min(minPos.y, pVertices[i].Position.y),
+						Math::Min(minPos.z, pVertices[i].Position.z));
+					maxPos = Vector3(Math::Max(maxPos.x, pVertices[i].Position.x),
+						Math::Max(maxPos.y, pVertices[i].Position.y),
+						Math::Max(maxPos.z, pVertices[i].Position.z));
+				}
+
+				const Vector3 extent = maxPos - minPos;
+				mPosOffset = minPos;
+				mPosScale = extent / 65535.0f;
+				const Vector3 invExtent = Vector3(extent.x > 0.0f ? 1.0f / extent.x : 0.0f,
+					extent.y > 0.0f ? 1.0f / extent.y : 0.0f,
+					extent.z > 0.0f ? 1.0f / extent.z : 0.0f);
+
+				VertexType* pOut = (VertexType*)mpBuffer;
+				for (auto i = 0; i < mVertexCount; i++)
+				{
+					const Vertex_PositionNormalTex& vertex = pVertices[i];
+					pOut[i].Position[0] = VertexQuantization::QuantizeUnorm16(vertex.Position.x, minPos.x, invExtent.x);
+					pOut[i].Position[1] = VertexQuantization::QuantizeUnorm16(vertex.Position.y, minPos.y, invExtent.y);
+					pOut[i].Position[2] = VertexQuantization::QuantizeUnorm16(vertex.Position.z, minPos.z, invExtent.z);
+					pOut[i].Padding = 0;
+					VertexQuantization::OctEncode(vertex.Normal, pOut[i].Normal);
+					pOut[i].TexCoord[0] = VertexQuantization::FloatToHalf(vertex.TexCoord.x);
+					pOut[i].TexCoord[1] = VertexQuantization::FloatToHalf(vertex.TexCoord.y);
+				}
+			}
+			void* GetBuffer() const
+			{
+				return mpBuffer;
+			}
+			inline VertexFormat GetVertexFormat() const
+			{
+				return VertexType::Format;
+			}
+			inline int GetVertexSize() const
+			{
+				return VertexType::Size;
+			}
+			inline size_t GetBufferSize() const
+			{
+				return mBufSize;
+			}
+			inline Vector3 GetPosition(const uint idx) const
+			{
+				const VertexType& vertex = ((const VertexType*)mpBuffer)[idx];
+				return mPosOffset + mPosScale * Vector3(vertex.Position[0], vertex.Position[1], vertex.Position[2]);
+			}
+			inline Vector3 GetNormal(const uint idx) const
+			{
+				return VertexQuantization::OctDecode(((const VertexType*)mpBuffer)[idx].Normal);
+			}
+			inline Vector2 GetTexCoord(const uint idx) const
+			{
+				const VertexType& vertex = ((const VertexType*)mpBuffer)[idx];
+				return Vector2(VertexQuantization::HalfToFloat(vertex.TexCoord[0]), VertexQuantization::HalfToFloat(vertex.TexCoord[1]));
+			}
+			inline Color GetColor(const uint idx) const
+			{
+				return Color::WHITE;
+			}
+
+			void DecodeVertices(const uint startIdx,
+				const uint count,
+				Vector3* pPositions,
+				Vector3* pNormals,
+				Vector2* pTexCoords) const
+			{
+				const __m128i zero = _mm_setzero_si128();
+				const Vec3f_SSE posOffset = Vec3f_SSE(mPosOffset);
+				const Vec3f_SSE posScale = Vec3f_SSE(mPosScale);
+				const FloatSSE invSnormMax = FloatSSE(1.0f / 32767.0f);
+				const FloatSSE minusOne = FloatSSE(-1.0f);
+				const FloatSSE floatZero = FloatSSE(Math::EDX_ZERO);
+
+				const __m128i* pSrc = (const __m128i*)(mpBuffer + startIdx * VertexType::Size);
+				uint i = 0;
+				for (; i + 4 <= count; i += 4)
+				{
+					// Transpose 4 vertices of 8 16-bit channels each
+					const __m128i v0 = _mm_loadu_si128(pSrc + i + 0);
+					const __m128i v1 = _mm_loadu_si128(pSrc + i + 1);
+					const __m128i v2 = _mm_loadu_si128(pSrc + i + 2);
+					const __m128i v3 = _mm_loadu_si128(pSrc + i + 3);
+
+					const __m128i lo01 = _mm_unpacklo_epi16(v0, v1);
+					const __m128i hi01 = _mm_unpackhi_epi16(v0, v1);
+					const __m128i lo23 = _mm_unpacklo_epi16(v2, v3);
+					const __m128i hi23 = _mm_unpackhi_epi16(v2, v3);
+
+					const __m128i posXY = _mm_unpacklo_epi32(lo01, lo23);
+					const __m128i posZ = _mm_unpackhi_epi32(lo01, lo23);
+					const __m128i normalXY = _mm_unpacklo_epi32(hi01, hi23);
+					const __m128i texUV = _mm_unpackhi_epi32(hi01, hi23);
+
+					Vec3f_SSE position;
+					position.x = _mm_cvtepi32_ps(_mm_unpacklo_epi16(posXY, zero));
+					position.y = _mm_cvtepi32_ps(_mm_unpackhi_epi16(posXY, zero));
+					position.z = _mm_cvtepi32_ps(_mm_unpacklo_epi16(posZ, zero));
+					position = posOffset + posScale * position;
+
+					// Sign extend the snorm16 channels
+					Vec3f_SSE normal;
+					normal.x = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(normalXY, normalXY), 16));
+					normal.y = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(normalXY, normalXY), 16));
+					normal.x = SSE::Max(normal.x * invSnormMax, minusOne);
+					normal.y = SSE::Max(normal.y * invSnormMax, minusOne);
+					normal.z = FloatSSE(Math::EDX_ONE) - SSE::Abs(normal.x) - SSE::Abs(normal.y);
+
+					const FloatSSE t = SSE::Max(-normal.z, floatZero);
+					normal.x += SSE::Select(normal.x >= floatZero, -t, t);
+					normal.y += SSE::Select(normal.y >= floatZero, -t, t);
+					normal *= SSE::Rsqrt(Math::Dot(normal, normal));
+
+					const FloatSSE texU = VertexQuantization::HalfToFloat(_mm_unpacklo_epi16(texUV, zero));
+					const FloatSSE texV = VertexQuantization::HalfToFloat(_mm_unpackhi_epi16(texUV, zero));
+
+					for (auto j = 0; j < 4; j++)
+					{
+						pPositions[i + j] = Vector3(position.x[j], position.y[j], position.z[j]);
+						pNormals[i + j] = Vector3(normal.x[j], normal.y[j], normal.z[j]);
+						pTexCoords[i + j] = Vector2(texU[j], texV[j]);
+					}
+				}
+
+				for (; i < count; i++)
+				{
+					pPositions[i] = GetPosition(startIdx + i);
+					pNormals[i] = GetNormal(startIdx + i);
+					pTexCoords[i] = GetTexCoord(startIdx + i);
+				}
+			}
+
+			void Release()
+			{
+				Memory::SafeDeleteArray(mpBuffer);
+			}
+		};
+
+		static IVertexBuffer* CreateQuantizedVertexBuffer(const void* pData, const size_t vertexCount)
+		{
+			QuantizedVertexBuffer* ret = new QuantizedVertexBuffer;
+
+			ret->NewBuffer(vertexCount);
+			ret->Encode((const Vertex_PositionNormalTex*)pData);
+
+			return ret;
+		}
+
+		enum class IndexFormat
+		{
+			UInt16,
+			UInt32
+		};
+
+		enum class PrimitiveTopology
+		{
+			TriangleList,
+			TriangleStrip
+		};
+
 		class IndexBuffer
 		{
+		public:
+			static const uint RESTART_INDEX = 0xffffffff;
+			static const uint RESTART_INDEX_16 = 0xffff;
+
 		private:
-			Array<uint>	mBuffer;
+			Array<_byte> mBuffer;
+			IndexFormat mFormat;
+			PrimitiveTopology mTopology;
+			uint mIndexCount;
+			uint mTriangleCount;
+
+			// First index and first triangle id of every strip, restart indices split the strips
+			Array<uint> mStripStarts;
+			Array<uint> mStripFirstTris;
 
 		public:
+			IndexBuffer()
+				: mFormat(IndexFormat::UInt32)
+				, mTopology(PrimitiveTopology::TriangleList)
+				, mIndexCount(0)
+				, mTriangleCount(0)
+			{
+			}
 			~IndexBuffer()
 			{
 				Release();
 			}
-			
-			void ResizeBuffer(const uint triCount)
+
+			// Strip input uses RESTART_INDEX to start a new strip. Indices are stored in 16 bits whenever
+			// the vertex count allows it
+			void Init(const uint* pIndices, const uint indexCount, const uint vertexCount, const PrimitiveTopology topology)
+			{
+				mTopology = topology;
+				mIndexCount = indexCount;
+				mFormat = vertexCount <= RESTART_INDEX_16 ? IndexFormat::UInt16 : IndexFormat::UInt32;
+
+				if (mFormat == IndexFormat::UInt16)
+				{
+					mBuffer.Resize(indexCount * sizeof(unsigned short));
+					unsigned short* pBuffer = (unsigned short*)mBuffer.Data();
+					for (auto i = 0; i < indexCount; i++)
+						pBuffer[i] = pIndices[i] == RESTART_INDEX ? RESTART_INDEX_16 : (unsigned short)pIndices[i];
+				}
+				else
+				{
+					mBuffer.Resize(indexCount * sizeof(uint));
+					memcpy(mBuffer.Data(), pIndices, indexCount * sizeof(uint));
+				}
+
+				mStripStarts.Clear();
+				mStripFirstTris.Clear();
+				if (mTopology == PrimitiveTopology::TriangleList)
+				{
+					mTriangleCount = indexCount / 3;
+					return;
+				}
+
+				mTriangleCount = 0;
+				uint stripStart = 0;
+				for (auto i = 0; i <= indexCount; i++)
+				{
+					if (i < indexCount && pIndices[i] != RESTART_INDEX)
+						continue;
+
+					const uint stripLength = i - stripStart;
+					if (stripLength >= 3)
+					{
+						mStripStarts.Add(stripStart);
+						mStripFirstTris.Add(mTriangleCount);
+						mTriangleCount += stripLength - 2;
+					}
+					stripStart = i + 1;
+				}
+			}
+			inline IndexFormat GetIndexFormat() const
 			{
-				mBuffer.Resize(3 * triCount);
+				return mFormat;
 			}
-			inline uint* GetBuffer()
+			inline PrimitiveTopology GetTopology() const
 			{
-				return mBuffer.Data();
+				return mTopology;
 			}
 			inline uint GetTriangleCount() const
 			{
-				return mBuffer.Size() / 3;
+				return mTriangleCount;
 			}
-			inline size_t GetBufferSize() const
+			inline uint GetIndexCount() const
 			{
-				return mBuffer.Size();
+				return mIndexCount;
 			}
-			inline const uint* GetIndex(const uint idx) const
+			inline size_t GetBufferSize() const
 			{
-				Assert(3 * idx < mBuffer.Size());
-				return (uint*)&mBuffer[3 * idx];
+				return mBuffer.Size() + (mStripStarts.Size() + mStripFirstTris.Size()) * sizeof(uint);
 			}
-			inline void AppendTriangle(const int idx0, const int idx1, const int idx2)
+			inline uint ReadIndex(const uint i) const
 			{
-				mBuffer.Add(idx0);
-				mBuffer.Add(idx1);
-				mBuffer.Add(idx2);
+				if (mFormat == IndexFormat::UInt16)
+					return ((const unsigned short*)mBuffer.Data())[i];
+				else
+					return ((const uint*)mBuffer.Data())[i];
 			}
-			inline void CopyFrom(IndexBuffer& other)
+
+			// Sequential readers pass a strip hint to avoid the binary search
+			inline void GetIndex(const uint idx, uint* pIdx, uint* pStripHint = nullptr) const
 			{
-				mBuffer.Resize(other.GetBufferSize());
-				memcpy(mBuffer.Data(), other.GetBuffer(), other.GetBufferSize() * sizeof(uint));
+				Assert(idx < mTriangleCount);
+				if (mTopology == PrimitiveTopology::TriangleList)
+				{
+					pIdx[0] = ReadIndex(3 * idx + 0);
+					pIdx[1] = ReadIndex(3 * idx + 1);
+					pIdx[2] = ReadIndex(3 * idx + 2);
+					return;
+				}
+
+				const uint stripId = FindStrip(idx, pStripHint);
+				const uint triInStrip = idx - mStripFirstTris[stripId];
+				const uint base = mStripStarts[stripId] + triInStrip;
+
+				// Odd triangles are flipped to keep the winding consistent
+				pIdx[0] = ReadIndex(base + (triInStrip & 1));
+				pIdx[1] = ReadIndex(base + 1 - (triInStrip & 1));
+				pIdx[2] = ReadIndex(base + 2);
 			}
 			void Release()
 			{
+				mBuffer.Clear();
+				mStripStarts.Clear();
+				mStripFirstTris.Clear();
+			}
+
+		private:
+			inline uint FindStrip(const uint idx, uint* pStripHint) const
+			{
+				const uint stripCount = mStripFirstTris.Size();
+				if (pStripHint && *pStripHint < stripCount && mStripFirstTris[*pStripHint] <= idx)
+				{
+					uint stripId = *pStripHint;
+					while (stripId + 1 < stripCount && mStripFirstTris[stripId + 1] <= idx)
+						stripId++;
+
+					*pStripHint = stripId;
+					return stripId;
+				}
+
+				uint low = 0, high = stripCount;
+				while (high - low > 1)
+				{
+					const uint mid = (low + high) >> 1;
+					if (mStripFirstTris[mid] <= idx)
+						low = mid;
+					else
+						high = mid;
+				}
+
+				if (pStripHint)
+					*pStripHint = low;
+				return low;
 			}
 		};
 
-		static IndexBuffer* CreateIndexBuffer(const void* pData, const size_t triCount)
+		static IndexBuffer* CreateIndexBuffer(const uint* pIndices,
+			const size_t indexCount,
+			const uint vertexCount,
+			const PrimitiveTopology topology = PrimitiveTopology::TriangleList)
 		{
 			IndexBuffer* ret = nullptr;
 			ret = new IndexBuffer;
 
-			ret->ResizeBuffer(triCount);
-			memcpy(ret->GetBuffer(), pData, ret->GetBufferSize() * sizeof(uint));
+			ret->Init(pIndices, indexCount, vertexCount, topology);
 
 			return ret;
 		}
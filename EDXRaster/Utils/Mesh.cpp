@@ -3,6 +3,8 @@
 #include "Graphics/ObjMesh.h"
 #include "Core/Memory.h"
 
+#include <mutex>
+#include <ppl.h>
 
 namespace EDX
 {
@@ -11,26 +13,221 @@ namespace EDX
 		void Mesh::LoadMesh(const Vector3& pos,
 			const Vector3& scl,
 			const Vector3& rot,
-			const char* path)
+			const char* path,
+			const bool quantizeVertices)
 		{
 			ObjMesh mesh;
 			mesh.LoadFromObj(pos, scl, rot, path);
 
-			mpVertexBuf.Reset(CreateVertexBuffer(&mesh.GetVertexAt(0), mesh.GetVertexCount()));
-			mpIndexBuf.Reset(CreateIndexBuffer(mesh.GetIndexAt(0), mesh.GetTriangleCount()));
+			InitMaterials(mesh, nullptr);
+			BuildGeometryBuffers(mesh, quantizeVertices);
 
-			// Initialize materials
+			mBounds = mesh.GetBounds();
+		}
+
+		struct Mesh::AsyncLoadState
+		{
+			struct CompletedTexture
+			{
+				uint MaterialId;
+				TextureHandle pTexture;
+			};
+
+			std::mutex Lock;
+			UniquePtr<Mesh> pLoadedMesh;
+			bool GeometryCommitted;
+			uint PendingTextureCount;
+			Array<CompletedTexture> CompletedTextures;	// Null textures failed to load
+			bool Failed;
+			string FailureMessage;
+
+			AsyncLoadState()
+				: GeometryCommitted(false)
+				, PendingTextureCount(0)
+				, Failed(false)
+			{
+			}
+
+			// Exceptions left in a task nobody waits on end the process, so every loading task runs through
+			// here. Only the first failure is kept, later ones are often caused by it
+			template<typename Func>
+			void RunCaught(const string& path, const Func& func)
+			{
+				string message;
+				try
+				{
+					func();
+					return;
+				}
+				catch (const std::exception& e)
+				{
+					message = path + ": " + e.what();
+				}
+				catch (...)
+				{
+					message = path + ": unknown error";
+				}
+
+				std::lock_guard<std::mutex> lock(Lock);
+				if (!Failed)
+				{
+					Failed = true;
+					FailureMessage = message;
+				}
+			}
+		};
+
+		MeshLoadHandle Mesh::LoadMeshAsync(const Vector3& pos,
+			const Vector3& scl,
+			const Vector3& rot,
+			const char* path,
+			const bool quantizeVertices)
+		{
+			// A load still in flight keeps its own state alive and is simply never committed
+			auto pState = std::make_shared<AsyncLoadState>();
+			mpAsyncState = pState;
+			mLoadError.clear();
+
+			const string filePath = path;
+			return concurrency::create_task([=]() -> concurrency::task<void>
+			{
+				Array<string> texturePaths;
+				pState->RunCaught(filePath, [&]()
+				{
+					ObjMesh mesh;
+					mesh.LoadFromObj(pos, scl, rot, filePath.c_str());
+
+					UniquePtr<Mesh> pLoadedMesh = MakeUnique<Mesh>();
+					pLoadedMesh->InitMaterials(mesh, &texturePaths);
+					pLoadedMesh->BuildGeometryBuffers(mesh, quantizeVertices);
+					pLoadedMesh->mBounds = mesh.GetBounds();
+
+					std::lock_guard<std::mutex> lock(pState->Lock);
+					pState->pLoadedMesh = std::move(pLoadedMesh);
+					for (auto i = 0; i < texturePaths.Size(); i++)
+					{
+						if (!texturePaths[i].empty())
+							pState->PendingTextureCount++;
+					}
+				});
+
+				// Without geometry there is nothing to put the textures on
+				if (pState->Failed)
+					return concurrency::task_from_result();
+
+				// Textures are decoded and their mips generated in parallel
+				std::vector<concurrency::task<void>> textureTasks;
+				for (auto i = 0; i < texturePaths.Size(); i++)
+				{
+					if (texturePaths[i].empty())
+						continue;
+
+					const uint materialId = i;
+					const string texturePath = texturePaths[i];
+					textureTasks.push_back(concurrency::create_task([pState, materialId, texturePath]()
+					{
+						// A failed texture still completes, with a null texture that keeps the placeholder
+						AsyncLoadState::CompletedTexture completed;
+						completed.MaterialId = materialId;
+						pState->RunCaught(texturePath, [&]()
+						{
+							completed.pTexture = TextureCache::Instance()->Load(texturePath.c_str());
+						});
+
+						std::lock_guard<std::mutex> lock(pState->Lock);
+						pState->CompletedTextures.Add(completed);
+					}));
+				}
+
+				if (textureTasks.empty())
+					return concurrency::task_from_result();
+
+				return concurrency::when_all(textureTasks.begin(), textureTasks.end());
+			});
+		}
+
+		bool Mesh::CommitPendingResources()
+		{
+			if (!mpAsyncState)
+				return false;
+
+			bool geometryCommitted = false;
+			bool finished = false;
+			{
+				std::lock_guard<std::mutex> lock(mpAsyncState->Lock);
+				if (mpAsyncState->pLoadedMesh)
+				{
+					Mesh& loadedMesh = *mpAsyncState->pLoadedMesh;
+					mpVertexBuf = std::move(loadedMesh.mpVertexBuf);
+					mpIndexBuf = std::move(loadedMesh.mpIndexBuf);
+					mTextures = loadedMesh.mTextures;
+					mTexIdx = loadedMesh.mTexIdx;
+					mBounds = loadedMesh.mBounds;
+					mOptimizeStats = loadedMesh.mOptimizeStats;
+
+					mpAsyncState->pLoadedMesh.Reset(nullptr);
+					mpAsyncState->GeometryCommitted = true;
+					geometryCommitted = true;
+				}
+
+				if (mpAsyncState->GeometryCommitted)
+				{
+					for (auto& completed : mpAsyncState->CompletedTextures)
+					{
+						if (completed.pTexture)
+							mTextures[completed.MaterialId] = completed.pTexture;
+					}
+
+					mpAsyncState->PendingTextureCount -= mpAsyncState->CompletedTextures.Size();
+					mpAsyncState->CompletedTextures.Clear();
+					finished = mpAsyncState->PendingTextureCount == 0;
+				}
+				else if (mpAsyncState->Failed)
+				{
+					// The geometry failed, the previous mesh stays
+					finished = true;
+				}
+
+				if (mpAsyncState->Failed)
+					mLoadError = mpAsyncState->FailureMessage;
+			}
+
+			if (finished)
+				mpAsyncState = nullptr;
+
+			if (geometryCommitted)
+				TextureCache::Instance()->Trim();
+
+			return geometryCommitted;
+		}
+
+		void Mesh::InitMaterials(ObjMesh& mesh, Array<string>* pDeferredTexturePaths)
+		{
 			const auto& materialInfo = mesh.GetMaterialInfo();
+
+			// Textures are decoded and their mips generated in parallel, the cache is thread safe
+			Array<TextureHandle> loadedTextures;
+			loadedTextures.Resize(materialInfo.Size());
+			if (!pDeferredTexturePaths)
+			{
+				concurrency::parallel_for(0, int(materialInfo.Size()), [&](int i)
+				{
+					if (materialInfo[i].strTexturePath[0] != 0)
+						loadedTextures[i] = TextureCache::Instance()->Load(materialInfo[i].strTexturePath);
+				});
+			}
+
 			for (auto i = 0; i < materialInfo.Size(); i++)
 			{
-				if (materialInfo[i].strTexturePath[0])
-					mTextures.Add(MakeUnique<ImageTexture<Color, Color4b>>(materialInfo[i].strTexturePath, 1.0f));
+				const bool textured = materialInfo[i].strTexturePath[0] != 0;
+				if (loadedTextures[i])
+					mTextures.Add(loadedTextures[i]);
 				else
-					mTextures.Add(MakeUnique<ConstantTexture2D<Color>>(materialInfo[i].color));
-			}
-			mTexIdx = mesh.GetMaterialIdxBuf();
+					mTextures.Add(std::make_shared<ConstantQuadTexture>(materialInfo[i].color));
 
-			mBounds = mesh.GetBounds();
+				if (pDeferredTexturePaths)
+					pDeferredTexturePaths->Add(textured ? string(materialInfo[i].strTexturePath) : string());
+			}
 		}
 
 		void Mesh::LoadPlane(const Vector3& pos,
@@ -41,11 +238,8 @@ namespace EDX
 			ObjMesh mesh;
 			mesh.LoadPlane(pos, scl, rot, length);
 
-			mpVertexBuf.Reset(CreateVertexBuffer(&mesh.GetVertexAt(0), mesh.GetVertexCount()));
-			mpIndexBuf.Reset(CreateIndexBuffer(mesh.GetIndexAt(0), mesh.GetTriangleCount()));
-
-			mTextures.Add(MakeUnique<ConstantTexture2D<Color>>(0.9f * Color::WHITE));
-			mTexIdx = mesh.GetMaterialIdxBuf();
+			mTextures.Add(std::make_shared<ConstantQuadTexture>(0.9f * Color::WHITE));
+			BuildGeometryBuffers(mesh, false);
 
 			mBounds = mesh.GetBounds();
 		}
@@ -60,13 +254,45 @@ namespace EDX
 			ObjMesh mesh;
 			mesh.LoadSphere(pos, scl, rot, radius, slices, stacks);
 
-			mpVertexBuf.Reset(CreateVertexBuffer(&mesh.GetVertexAt(0), mesh.GetVertexCount()));
-			mpIndexBuf.Reset(CreateIndexBuffer(mesh.GetIndexAt(0), mesh.GetTriangleCount()));
+			mTextures.Add(std::make_shared<ConstantQuadTexture>(0.9f * Color::WHITE));
+			BuildGeometryBuffers(mesh, false);
+
+			mBounds = mesh.GetBounds();
+		}
+
+		void Mesh::BuildGeometryBuffers(ObjMesh& mesh, const bool quantizeVertices)
+		{
+			const uint vertexCount = mesh.GetVertexCount();
+			if (quantizeVertices)
+				mpVertexBuf.Reset(CreateQuantizedVertexBuffer(&mesh.GetVertexAt(0), vertexCount));
+			else
+				mpVertexBuf.Reset(CreateVertexBuffer(&mesh.GetVertexAt(0), vertexCount));
 
-			mTextures.Add(MakeUnique<ConstantTexture2D<Color>>(0.9f * Color::WHITE));
+			Array<uint> indices;
+			indices.Resize(3 * mesh.GetTriangleCount());
+			memcpy(indices.Data(), mesh.GetIndexAt(0), indices.Size() * sizeof(uint));
 			mTexIdx = mesh.GetMaterialIdxBuf();
 
-			mBounds = mesh.GetBounds();
+			MeshOptimizer::Optimize(mpVertexBuf.Get(), indices, mTexIdx, &mOptimizeStats);
+
+			// Strips are only kept when they actually take less space than the list. Both buffers are built to
+			// compare their real sizes, restart indices and per-strip tables included. The texture ids are one
+			// per triangle either way
+			Array<uint> stripIndices;
+			Array<uint> stripTexIdx = mTexIdx;
+			MeshOptimizer::GenerateStrips(indices, vertexCount, stripTexIdx, stripIndices);
+
+			UniquePtr<IndexBuffer> pStripBuf(CreateIndexBuffer(stripIndices.Data(), stripIndices.Size(), vertexCount, PrimitiveTopology::TriangleStrip));
+			UniquePtr<IndexBuffer> pListBuf(CreateIndexBuffer(indices.Data(), indices.Size(), vertexCount, PrimitiveTopology::TriangleList));
+			if (pStripBuf->GetBufferSize() < pListBuf->GetBufferSize())
+			{
+				mpIndexBuf = std::move(pStripBuf);
+				mTexIdx = stripTexIdx;
+			}
+			else
+			{
+				mpIndexBuf = std::move(pListBuf);
+			}
 		}
 
 		void Mesh::Release()
@@ -75,6 +301,9 @@ namespace EDX
 			mpIndexBuf.Reset(nullptr);
 			mTextures.Clear();
 			mTexIdx.Clear();
+
+			// Textures only this mesh referenced can now be evicted
+			TextureCache::Instance()->Trim();
 		}
 	}
 }
\ No newline at end of file
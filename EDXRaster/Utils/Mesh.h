@@ -3,9 +3,14 @@
 #include "Graphics/ObjMesh.h"
 #include "Graphics/Texture.h"
 #include "Math/BoundingBox.h"
+#include "MeshOptimizer.h"
+#include "TextureCache.h"
 
 #include "Core/SmartPointer.h"
 
+#include <ppltasks.h>
+#include <memory>
+
 namespace EDX
 {
 	namespace RasterRenderer
@@ -14,22 +19,54 @@ namespace EDX
 		class VertexBuffer;
 		class IndexBuffer;
 
+		// Completes once the geometry and every texture of an asynchronous load have been decoded
+		typedef concurrency::task<void> MeshLoadHandle;
+
 		class Mesh
 		{
 		private:
+			struct AsyncLoadState;
 			UniquePtr<class IVertexBuffer> mpVertexBuf;
 			UniquePtr<IndexBuffer> mpIndexBuf;
 
-			Array<UniquePtr<Texture2D<Color>>> mTextures;
+			Array<TextureHandle> mTextures;
 			Array<uint> mTexIdx;
 
 			BoundingBox mBounds;
+			MeshOptimizeStats mOptimizeStats;
+
+			std::shared_ptr<AsyncLoadState> mpAsyncState;
+			string mLoadError;
 
 		public:
 			void LoadMesh(const Vector3& pos,
 				const Vector3& scl,
 				const Vector3& rot,
-				const char* path);
+				const char* path,
+				const bool quantizeVertices = false);
+
+			// Parses the mesh and decodes its textures on background threads. The current geometry keeps
+			// being rendered until CommitPendingResources swaps the new one in, with constant placeholder
+			// materials that are replaced as each texture becomes ready. Failures are caught on the loading
+			// threads, the handle never rethrows and GetLoadError reports them once committed
+			MeshLoadHandle LoadMeshAsync(const Vector3& pos,
+				const Vector3& scl,
+				const Vector3& rot,
+				const char* path,
+				const bool quantizeVertices = false);
+
+			// Called between frames, returns true when new geometry has been swapped in
+			bool CommitPendingResources();
+			bool IsLoading() const
+			{
+				return mpAsyncState != nullptr;
+			}
+			// Empty unless the last asynchronous load failed. A mesh that failed keeps its previous geometry, a
+			// texture that failed keeps its placeholder
+			const string& GetLoadError() const
+			{
+				return mLoadError;
+			}
 
 			void LoadPlane(const Vector3& pos,
 				const Vector3& scl,
@@ -51,7 +88,7 @@ namespace EDX
 			{
 				return mpIndexBuf.Get();
 			}
-			const Array<UniquePtr<Texture2D<Color>>>& GetTextures() const
+			const Array<TextureHandle>& GetTextures() const
 			{
 				return mTextures;
 			}
@@ -64,8 +101,16 @@ namespace EDX
 			{
 				return mBounds;
 			}
+			inline const MeshOptimizeStats& GetOptimizeStats() const
+			{
+				return mOptimizeStats;
+			}
 
 			void Release();
+
+		private:
+			void InitMaterials(ObjMesh& mesh, Array<string>* pDeferredTexturePaths);
+			void BuildGeometryBuffers(ObjMesh& mesh, const bool quantizeVertices);
 		};
 	}
 }
\ No newline at end of file
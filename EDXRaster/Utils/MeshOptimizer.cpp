@@ -0,0 +1,485 @@
+#include "MeshOptimizer.h"
+#include "InputBuffer.h"
+#include "Math/EDXMath.h"
+
+namespace EDX
+{
+	namespace RasterRenderer
+	{
+		void MeshOptimizer::Optimize(IVertexBuffer* pVertexBuf,
+			Array<uint>& indices,
+			Array<uint>& texIdBuf,
+			MeshOptimizeStats* pStats)
+		{
+			const uint triCount = indices.Size() / 3;
+			const uint vertexCount = pVertexBuf->GetVertexCount();
+			if (triCount == 0)
+				return;
+
+			uint* pIndices = indices.Data();
+			if (pStats)
+				pStats->ACMRBefore = ComputeACMR(pIndices, triCount, vertexCount);
+
+			// Shading touches one texture at a time when triangles are grouped by material
+			Array<uint> rangeStarts;
+			uint rangeCount = SortByMaterial(pIndices, texIdBuf, rangeStarts);
+
+			for (auto i = 0; i < rangeCount; i++)
+			{
+				const uint startTri = rangeStarts[i];
+				const uint endTri = i + 1 < rangeCount ? rangeStarts[i + 1] : triCount;
+				OptimizeVertexCache(pIndices + 3 * startTri, endTri - startTri, vertexCount);
+			}
+
+			OptimizeVertexFetch(pVertexBuf, pIndices, 3 * triCount);
+
+			if (pStats)
+			{
+				pStats->ACMRAfter = ComputeACMR(pIndices, triCount, vertexCount);
+				pStats->MaterialRangeCount = rangeCount;
+			}
+		}
+
+		float MeshOptimizer::ComputeACMR(const uint* pIndices,
+			const uint triCount,
+			const uint vertexCount,
+			const int cacheSize)
+		{
+			if (triCount == 0)
+				return 0.0f;
+
+			// Simulate a FIFO post transform cache
+			Array<uint> cacheTimeStamps;
+			cacheTimeStamps.Resize(vertexCount);
+			for (auto i = 0; i < vertexCount; i++)
+				cacheTimeStamps[i] = 0;
+
+			uint timeStamp = cacheSize + 1;
+			uint missCount = 0;
+			for (auto i = 0; i < 3 * triCount; i++)
+			{
+				const uint idx = pIndices[i];
+				if (timeStamp - cacheTimeStamps[idx] > cacheSize)
+				{
+					cacheTimeStamps[idx] = timeStamp++;
+					missCount++;
+				}
+			}
+
+			return missCount / float(triCount);
+		}
+
+		uint MeshOptimizer::SortByMaterial(uint* pIndices, Array<uint>& texIdBuf, Array<uint>& rangeStarts)
+		{
+			const uint triCount = texIdBuf.Size();
+
+			uint maxTexId = 0;
+			for (auto i = 0; i < triCount; i++)
+				maxTexId = Math::Max(maxTexId, texIdBuf[i]);
+
+			// Stable counting sort, keeps the file order within each material
+			Array<uint> offsets;
+			offsets.Resize(maxTexId + 2);
+			for (auto i = 0; i < offsets.Size(); i++)
+				offsets[i] = 0;
+			for (auto i = 0; i < triCount; i++)
+				offsets[texIdBuf[i] + 1]++;
+			for (auto i = 1; i < offsets.Size(); i++)
+				offsets[i] += offsets[i - 1];
+
+			rangeStarts.Clear();
+			for (auto i = 0; i <= maxTexId; i++)
+			{
+				if (offsets[i + 1] > offsets[i])
+					rangeStarts.Add(offsets[i]);
+			}
+
+			Array<uint> sortedIndices;
+			Array<uint> sortedTexIds;
+			sortedIndices.Resize(3 * triCount);
+			sortedTexIds.Resize(triCount);
+			for (auto i = 0; i < triCount; i++)
+			{
+				const uint dst = offsets[texIdBuf[i]]++;
+				sortedIndices[3 * dst + 0] = pIndices[3 * i + 0];
+				sortedIndices[3 * dst + 1] = pIndices[3 * i + 1];
+				sortedIndices[3 * dst + 2] = pIndices[3 * i + 2];
+				sortedTexIds[dst] = texIdBuf[i];
+			}
+
+			memcpy(pIndices, sortedIndices.Data(), 3 * triCount * sizeof(uint));
+			texIdBuf = sortedTexIds;
+
+			return rangeStarts.Size();
+		}
+
+		namespace
+		{
+			const float CacheDecayPower = 1.5f;
+			const float LastTriScore = 0.75f;
+			const float ValenceBoostScale = 2.0f;
+			const float ValenceBoostPower = 0.5f;
+
+			float VertexScore(const int cachePosition, const uint activeTriCount)
+			{
+				if (activeTriCount == 0)
+					return -1.0f;
+
+				float score = 0.0f;
+				if (cachePosition >= 0)
+				{
+					if (cachePosition < 3)
+					{
+						// The three vertices of the last triangle get a fixed score
+						score = LastTriScore;
+					}
+					else
+					{
+						const float scaler = 1.0f / (MeshOptimizer::VERTEX_CACHE_SIZE - 3);
+						score = 1.0f - (cachePosition - 3) * scaler;
+						score = Math::Pow(score, CacheDecayPower);
+					}
+				}
+
+				// Boost vertices with few remaining triangles so that no lone triangles are left behind
+				score += ValenceBoostScale * Math::Pow(float(activeTriCount), -ValenceBoostPower);
+
+				return score;
+			}
+		}
+
+		void MeshOptimizer::OptimizeVertexCache(uint* pIndices, const uint triCount, const uint vertexCount)
+		{
+			if (triCount < 2)
+				return;
+
+			struct VertexData
+			{
+				float score;
+				int cachePosition;
+				uint activeTriCount;
+				uint triListOffset;
+			};
+
+			Array<VertexData> vertices;
+			vertices.Resize(vertexCount);
+			for (auto i = 0; i < vertexCount; i++)
+			{
+				vertices[i].score = 0.0f;
+				vertices[i].cachePosition = -1;
+				vertices[i].activeTriCount = 0;
+				vertices[i].triListOffset = 0;
+			}
+
+			for (auto i = 0; i < 3 * triCount; i++)
+				vertices[pIndices[i]].activeTriCount++;
+
+			// Vertex to triangle adjacency
+			uint offset = 0;
+			for (auto i = 0; i < vertexCount; i++)
+			{
+				vertices[i].triListOffset = offset;
+				offset += vertices[i].activeTriCount;
+			}
+
+			Array<uint> vertexTriList;
+			Array<uint> vertexTriFill;
+			vertexTriList.Resize(3 * triCount);
+			vertexTriFill.Resize(vertexCount);
+			for (auto i = 0; i < vertexCount; i++)
+				vertexTriFill[i] = 0;
+			for (auto i = 0; i < triCount; i++)
+			{
+				for (auto j = 0; j < 3; j++)
+				{
+					const uint v = pIndices[3 * i + j];
+					vertexTriList[vertices[v].triListOffset + vertexTriFill[v]++] = i;
+				}
+			}
+
+			for (auto i = 0; i < vertexCount; i++)
+				vertices[i].score = VertexScore(vertices[i].cachePosition, vertices[i].activeTriCount);
+
+			Array<float> triScores;
+			Array<bool> triAdded;
+			triScores.Resize(triCount);
+			triAdded.Resize(triCount);
+			for (auto i = 0; i < triCount; i++)
+			{
+				triScores[i] = vertices[pIndices[3 * i + 0]].score +
+					vertices[pIndices[3 * i + 1]].score +
+					vertices[pIndices[3 * i + 2]].score;
+				triAdded[i] = false;
+			}
+
+			// LRU cache with room for the vertices of the triangle being added
+			int cache[VERTEX_CACHE_SIZE + 3];
+			int cacheSize = 0;
+
+			Array<uint> output;
+			output.Resize(3 * triCount);
+
+			uint scanCursor = 0;
+			int bestTri = -1;
+			float bestScore = -1.0f;
+			for (auto i = 0; i < triCount; i++)
+			{
+				if (triScores[i] > bestScore)
+				{
+					bestScore = triScores[i];
+					bestTri = i;
+				}
+			}
+
+			for (auto outTri = 0; outTri < triCount; outTri++)
+			{
+				if (bestTri < 0)
+				{
+					// Cache neighbourhood exhausted, fall back to the best remaining triangle
+					bestScore = -1.0f;
+					for (auto i = scanCursor; i < triCount; i++)
+					{
+						if (triAdded[i])
+						{
+							if (i == scanCursor)
+								scanCursor++;
+							continue;
+						}
+						if (triScores[i] > bestScore)
+						{
+							bestScore = triScores[i];
+							bestTri = i;
+						}
+					}
+				}
+
+				Assert(bestTri >= 0);
+				triAdded[bestTri] = true;
+
+				int newCache[VERTEX_CACHE_SIZE + 3];
+				int newCacheSize = 0;
+				for (auto j = 0; j < 3; j++)
+				{
+					const uint v = pIndices[3 * bestTri + j];
+					output[3 * outTri + j] = v;
+					newCache[newCacheSize++] = v;
+
+					// Remove the triangle from the vertex adjacency
+					VertexData& vertex = vertices[v];
+					uint* pTriList = &vertexTriList[vertex.triListOffset];
+					for (auto k = 0; k < vertex.activeTriCount; k++)
+					{
+						if (pTriList[k] == bestTri)
+						{
+							Swap(pTriList[k], pTriList[vertex.activeTriCount - 1]);
+							break;
+						}
+					}
+					vertex.activeTriCount--;
+				}
+
+				for (auto j = 0; j < cacheSize; j++)
+				{
+					const int v = cache[j];
+					if (v != newCache[0] && v != newCache[1] && v != newCache[2])
+						newCache[newCacheSize++] = v;
+				}
+
+				// Vertices pushed out of the cache lose their cache score
+				for (auto j = VERTEX_CACHE_SIZE; j < newCacheSize; j++)
+				{
+					VertexData& vertex = vertices[newCache[j]];
+					vertex.cachePosition = -1;
+					vertex.score = VertexScore(vertex.cachePosition, vertex.activeTriCount);
+				}
+
+				cacheSize = Math::Min(newCacheSize, int(VERTEX_CACHE_SIZE));
+				for (auto j = 0; j < cacheSize; j++)
+				{
+					cache[j] = newCache[j];
+					VertexData& vertex = vertices[cache[j]];
+					vertex.cachePosition = j;
+					vertex.score = VertexScore(vertex.cachePosition, vertex.activeTriCount);
+				}
+
+				// Only triangles touching the cache can have changed their score
+				bestTri = -1;
+				bestScore = -1.0f;
+				for (auto j = 0; j < cacheSize; j++)
+				{
+					const VertexData& vertex = vertices[cache[j]];
+					for (auto k = 0; k < vertex.activeTriCount; k++)
+					{
+						const uint tri = vertexTriList[vertex.triListOffset + k];
+						const float score = vertices[pIndices[3 * tri + 0]].score +
+							vertices[pIndices[3 * tri + 1]].score +
+							vertices[pIndices[3 * tri + 2]].score;
+						triScores[tri] = score;
+
+						if (score > bestScore)
+						{
+							bestScore = score;
+							bestTri = tri;
+						}
+					}
+				}
+			}
+
+			memcpy(pIndices, output.Data(), 3 * triCount * sizeof(uint));
+		}
+
+		void MeshOptimizer::OptimizeVertexFetch(IVertexBuffer* pVertexBuf, uint* pIndices, const uint indexCount)
+		{
+			const uint vertexCount = pVertexBuf->GetVertexCount();
+			const int vertexSize = pVertexBuf->GetVertexSize();
+
+			const uint Unused = uint(-1);
+			Array<uint> remap;
+			remap.Resize(vertexCount);
+			for (auto i = 0; i < vertexCount; i++)
+				remap[i] = Unused;
+
+			uint nextVertex = 0;
+			for (auto i = 0; i < indexCount; i++)
+			{
+				uint& newIdx = remap[pIndices[i]];
+				if (newIdx == Unused)
+					newIdx = nextVertex++;
+
+				pIndices[i] = newIdx;
+			}
+
+			// Unreferenced vertices are kept at the end of the buffer
+			for (auto i = 0; i < vertexCount; i++)
+			{
+				if (remap[i] == Unused)
+					remap[i] = nextVertex++;
+			}
+
+			Array<_byte> reordered;
+			reordered.Resize(pVertexBuf->GetBufferSize());
+			const _byte* pSrc = (const _byte*)pVertexBuf->GetBuffer();
+			for (auto i = 0; i < vertexCount; i++)
+				memcpy(reordered.Data() + remap[i] * vertexSize, pSrc + i * vertexSize, vertexSize);
+
+			memcpy(pVertexBuf->GetBuffer(), reordered.Data(), pVertexBuf->GetBufferSize());
+		}
+
+		void MeshOptimizer::GenerateStrips(const Array<uint>& indices,
+			const uint vertexCount,
+			Array<uint>& texIdBuf,
+			Array<uint>& stripIndices)
+		{
+			const uint triCount = indices.Size() / 3;
+
+			// Vertex to triangle adjacency
+			Array<uint> adjOffsets;
+			Array<uint> adjTris;
+			adjOffsets.Resize(vertexCount + 1);
+			for (auto i = 0; i <= vertexCount; i++)
+				adjOffsets[i] = 0;
+			for (auto i = 0; i < 3 * triCount; i++)
+				adjOffsets[indices[i] + 1]++;
+			for (auto i = 1; i <= vertexCount; i++)
+				adjOffsets[i] += adjOffsets[i - 1];
+
+			Array<uint> adjFill;
+			adjFill.Resize(vertexCount);
+			for (auto i = 0; i < vertexCount; i++)
+				adjFill[i] = 0;
+			adjTris.Resize(3 * triCount);
+			for (auto i = 0; i < triCount; i++)
+			{
+				for (auto j = 0; j < 3; j++)
+				{
+					const uint v = indices[3 * i + j];
+					adjTris[adjOffsets[v] + adjFill[v]++] = i;
+				}
+			}
+
+			Array<bool> triUsed;
+			triUsed.Resize(triCount);
+			for (auto i = 0; i < triCount; i++)
+				triUsed[i] = false;
+
+			// Finds an unused triangle of the same material whose winding is (v0, v1, x), returns x
+			auto FindNext = [&](const uint v0, const uint v1, const uint texId, uint* pNextVert) -> int
+			{
+				for (auto k = adjOffsets[v0]; k < adjOffsets[v0 + 1]; k++)
+				{
+					const uint tri = adjTris[k];
+					if (triUsed[tri] || texIdBuf[tri] != texId)
+						continue;
+
+					for (auto j = 0; j < 3; j++)
+					{
+						if (indices[3 * tri + j] == v0 && indices[3 * tri + (j + 1) % 3] == v1)
+						{
+							*pNextVert = indices[3 * tri + (j + 2) % 3];
+							return tri;
+						}
+					}
+				}
+
+				return -1;
+			};
+
+			stripIndices.Clear();
+			Array<uint> stripTexIds;
+			uint nextVert;
+			for (auto i = 0; i < triCount; i++)
+			{
+				if (triUsed[i])
+					continue;
+
+				const uint texId = texIdBuf[i];
+
+				// Start with the rotation which can be continued
+				uint start = 0;
+				for (auto r = 0; r < 3; r++)
+				{
+					const uint v1 = indices[3 * i + (r + 1) % 3];
+					const uint v2 = indices[3 * i + (r + 2) % 3];
+					triUsed[i] = true;
+					const bool canContinue = FindNext(v2, v1, texId, &nextVert) >= 0;
+					triUsed[i] = false;
+					if (canContinue)
+					{
+						start = r;
+						break;
+					}
+				}
+
+				if (stripIndices.Size() > 0)
+					stripIndices.Add(uint(IndexBuffer::RESTART_INDEX));
+
+				uint a = indices[3 * i + start];
+				uint b = indices[3 * i + (start + 1) % 3];
+				uint c = indices[3 * i + (start + 2) % 3];
+				stripIndices.Add(a);
+				stripIndices.Add(b);
+				stripIndices.Add(c);
+				stripTexIds.Add(texId);
+				triUsed[i] = true;
+
+				// The next triangle is (c, b, x) after an even triangle and (b, c, x) after an odd one
+				uint triInStrip = 1;
+				while (true)
+				{
+					const int tri = (triInStrip & 1) ? FindNext(c, b, texId, &nextVert) : FindNext(b, c, texId, &nextVert);
+					if (tri < 0)
+						break;
+
+					triUsed[tri] = true;
+					stripIndices.Add(nextVert);
+					stripTexIds.Add(texId);
+					b = c;
+					c = nextVert;
+					triInStrip++;
+				}
+			}
+
+			texIdBuf = stripTexIds;
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "EDXPrerequisites.h"
+
+namespace EDX
+{
+	namespace RasterRenderer
+	{
+		class IVertexBuffer;
+
+		struct MeshOptimizeStats
+		{
+			float ACMRBefore; // Average cache miss ratio, transformed vertices per triangle
+			float ACMRAfter;
+			uint MaterialRangeCount;
+
+			MeshOptimizeStats()
+				: ACMRBefore(0.0f)
+				, ACMRAfter(0.0f)
+				, MaterialRangeCount(0)
+			{
+			}
+		};
+
+		class MeshOptimizer
+		{
+		public:
+			static const int VERTEX_CACHE_SIZE = 32;
+
+			// Groups triangles by material, reorders them within each material for vertex locality (Forsyth)
+			// and finally reorders the vertex buffer in first use order
+			static void Optimize(IVertexBuffer* pVertexBuf,
+				Array<uint>& indices,
+				Array<uint>& texIdBuf,
+				MeshOptimizeStats* pStats = nullptr);
+
+			// Greedy stripification of a triangle list, strips never cross materials and are separated
+			// by IndexBuffer::RESTART_INDEX. texIdBuf is reordered to follow the strip triangle order
+			static void GenerateStrips(const Array<uint>& indices,
+				const uint vertexCount,
+				Array<uint>& texIdBuf,
+				Array<uint>& stripIndices);
+
+			static float ComputeACMR(const uint* pIndices,
+				const uint triCount,
+				const uint vertexCount,
+				const int cacheSize = VERTEX_CACHE_SIZE);
+
+		private:
+			static uint SortByMaterial(uint* pIndices, Array<uint>& texIdBuf, Array<uint>& rangeStarts);
+			static void OptimizeVertexCache(uint* pIndices, const uint triCount, const uint vertexCount);
+			static void OptimizeVertexFetch(IVertexBuffer* pVertexBuf, uint* pIndices, const uint indexCount);
+		};
+	}
+}
\ No newline at end of file
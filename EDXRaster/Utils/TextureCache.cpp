@@ -0,0 +1,408 @@
+#include "TextureCache.h"
+
+#include <stdio.h>
+#include <direct.h>
+
+namespace EDX
+{
+	namespace RasterRenderer
+	{
+		TextureCache* TextureCache::mpInstance = nullptr;
+		std::mutex TextureCache::mInstanceLock;
+
+		TextureCache::TextureCache()
+			: mCompressOnImport(false)
+			, mMipFilter(MipFilter::Box)
+			, mBudget(size_t(2048) << 20)
+			, mUseCounter(0)
+			, mFrame(0)
+			, mHitCount(0)
+			, mDuplicateCount(0)
+			, mEvictionCount(0)
+			, mStreamedLevelCount(0)
+			, mEvictedLevelCount(0)
+		{
+		}
+
+		TextureCache::~TextureCache()
+		{
+			// Loads still running hold their texture, their results are observed so failures are not left unhandled
+			for (auto& it : mEntries)
+			{
+				if (!it.second.Streaming)
+					continue;
+
+				try
+				{
+					it.second.LoadTask.get();
+				}
+				catch (...)
+				{
+				}
+			}
+		}
+
+		TextureHandle TextureCache::Load(const char* path)
+		{
+			bool compress = CompressedQuadTexture::IsCompressedFile(path);
+			MipFilter mipFilter;
+			string mipCacheDirectory;
+			string key = path;
+			{
+				std::lock_guard<std::mutex> lock(mLock);
+
+				// Compressed and uncompressed versions of an image are separate entries, and so are
+				// versions with different mip filters
+				compress = compress || mCompressOnImport;
+				if (compress)
+					key += "|BC";
+				mipFilter = mMipFilter;
+				if (mipFilter == MipFilter::Kaiser)
+					key += "|Kaiser";
+				mipCacheDirectory = mMipCacheDirectory;
+
+				auto pathIt = mPathToHash.find(key);
+				if (pathIt != mPathToHash.end())
+				{
+					auto entryIt = mEntries.find(pathIt->second);
+					if (entryIt != mEntries.end())
+					{
+						entryIt->second.LastUse = ++mUseCounter;
+						mHitCount++;
+						return entryIt->second.pTexture;
+					}
+				}
+			}
+
+			// Unreadable files still get a hash so that they are decoded (and fail) the usual way
+			uint64 hash;
+			const bool hashed = HashFile(path, &hash);
+			if (!hashed)
+				hash = std::hash<string>()(key);
+			else
+			{
+				if (compress)
+					hash ^= 0x9e3779b97f4a7c15ULL;
+				if (mipFilter == MipFilter::Kaiser)
+					hash ^= 0xc2b2ae3d27d4eb4fULL;
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(mLock);
+				mPathToHash[key] = hash;
+
+				auto entryIt = mEntries.find(hash);
+				if (entryIt != mEntries.end())
+				{
+					entryIt->second.LastUse = ++mUseCounter;
+					mDuplicateCount++;
+					return entryIt->second.pTexture;
+				}
+			}
+
+			// The hash covers the variant as well, so it names the cached chain on its own
+			char mipCachePath[MAX_PATH];
+			const bool cached = hashed && !mipCacheDirectory.empty();
+			if (cached)
+				sprintf_s(mipCachePath, MAX_PATH, "%s/%016llx.mip", mipCacheDirectory.c_str(), hash);
+
+			TextureHandle pTexture;
+			if (compress)
+				pTexture = std::make_shared<CompressedQuadTexture>(path, mipFilter, cached ? mipCachePath : nullptr);
+			else
+				pTexture = std::make_shared<ImageQuadTexture>(path, TexelLayout::Linear, mipFilter, cached ? mipCachePath : nullptr);
+
+			std::lock_guard<std::mutex> lock(mLock);
+
+			// Another thread may have decoded the same image in the meantime
+			auto entryIt = mEntries.find(hash);
+			if (entryIt != mEntries.end())
+			{
+				entryIt->second.LastUse = ++mUseCounter;
+				mDuplicateCount++;
+				return entryIt->second.pTexture;
+			}
+
+			// Starts fully resident, levels nobody samples are evicted once the feedback hold expires
+			Entry& entry = mEntries[hash];
+			entry.pTexture = pTexture;
+			entry.LastUse = ++mUseCounter;
+			entry.RequestedLevel = 0;
+			entry.RequestFrame = mFrame;
+			entry.TargetLevel = 0;
+			entry.Streaming = false;
+			entry.LoadFailed = false;
+
+			TrimLocked();
+
+			return pTexture;
+		}
+
+		void TextureCache::SetImportCompression(const bool compress)
+		{
+			std::lock_guard<std::mutex> lock(mLock);
+			mCompressOnImport = compress;
+		}
+
+		void TextureCache::SetMipFilter(const MipFilter filter)
+		{
+			std::lock_guard<std::mutex> lock(mLock);
+			mMipFilter = filter;
+		}
+
+		void TextureCache::SetMipCacheDirectory(const char* directory)
+		{
+			// Fails harmlessly when the directory already exists
+			if (directory[0])
+				_mkdir(directory);
+
+			std::lock_guard<std::mutex> lock(mLock);
+			mMipCacheDirectory = directory;
+		}
+
+		void TextureCache::SetMemoryBudget(const size_t bytes)
+		{
+			std::lock_guard<std::mutex> lock(mLock);
+			mBudget = bytes;
+			TrimLocked();
+		}
+
+		void TextureCache::Trim()
+		{
+			std::lock_guard<std::mutex> lock(mLock);
+			TrimLocked();
+		}
+
+		void TextureCache::TrimLocked()
+		{
+			// Evict least recently used textures that only the cache still references
+			size_t residentBytes = ResidentBytesLocked();
+			while (residentBytes > mBudget)
+			{
+				auto victim = mEntries.end();
+				for (auto it = mEntries.begin(); it != mEntries.end(); ++it)
+				{
+					if (it->second.pTexture.use_count() > 1)
+						continue;
+
+					if (victim == mEntries.end() || it->second.LastUse < victim->second.LastUse)
+						victim = it;
+				}
+
+				if (victim == mEntries.end())
+					break;
+
+				residentBytes -= victim->second.pTexture->GetMemorySize();
+				mEvictionCount++;
+				mEntries.erase(victim);
+			}
+		}
+
+		TextureResidency TextureCache::GetResidency() const
+		{
+			std::lock_guard<std::mutex> lock(mLock);
+
+			TextureResidency ret;
+			ret.TextureCount = mEntries.size();
+			ret.ReferencedCount = 0;
+			for (const auto& it : mEntries)
+			{
+				if (it.second.pTexture.use_count() > 1)
+					ret.ReferencedCount++;
+			}
+			ret.ResidentBytes = ResidentBytesLocked();
+			ret.BudgetBytes = mBudget;
+			ret.HitCount = mHitCount;
+			ret.DuplicateCount = mDuplicateCount;
+			ret.EvictionCount = mEvictionCount;
+			ret.StreamingCount = 0;
+			ret.FailedCount = 0;
+			for (const auto& it : mEntries)
+			{
+				if (it.second.Streaming)
+					ret.StreamingCount++;
+				if (it.second.LoadFailed)
+					ret.FailedCount++;
+			}
+			ret.StreamedLevelCount = mStreamedLevelCount;
+			ret.EvictedLevelCount = mEvictedLevelCount;
+
+			return ret;
+		}
+
+		size_t TextureCache::ResidentBytesLocked() const
+		{
+			size_t size = 0;
+			for (const auto& it : mEntries)
+				size += it.second.pTexture->GetMemorySize();
+
+			return size;
+		}
+
+		void TextureCache::UpdateStreaming()
+		{
+			std::lock_guard<std::mutex> lock(mLock);
+			mFrame++;
+
+			// Levels that finished loading in the background
+			for (auto& it : mEntries)
+			{
+				Entry& entry = it.second;
+				if (!entry.Streaming || !entry.LoadTask.is_done())
+					continue;
+
+				std::shared_ptr<MipChain> pLevels;
+				try
+				{
+					pLevels = entry.LoadTask.get();
+				}
+				catch (...)
+				{
+				}
+				entry.LoadTask = concurrency::task<std::shared_ptr<MipChain>>();
+				entry.Streaming = false;
+
+				// Failed loads are not retried, the texture keeps its resident levels
+				if (!pLevels)
+				{
+					entry.LoadFailed = true;
+					continue;
+				}
+
+				// Levels evicted while loading leave a gap, the next load fills it
+				QuadTexture* pTexture = entry.pTexture.get();
+				const int residentLevel = pTexture->GetResidentLevel();
+				const int firstLevel = Math::Max(entry.LoadLevel, entry.TargetLevel);
+				if (firstLevel >= residentLevel || residentLevel > entry.LoadEndLevel)
+					continue;
+
+				if (!pTexture->CommitLevels(*pLevels, firstLevel))
+					entry.LoadFailed = true;
+				mStreamedLevelCount += residentLevel - pTexture->GetResidentLevel();
+			}
+
+			// Finer requests apply at once, coarser ones only after the finer one has not been seen for a while
+			size_t targetBytes = 0;
+			for (auto& it : mEntries)
+			{
+				Entry& entry = it.second;
+				QuadTexture* pTexture = entry.pTexture.get();
+				const int coarsestLevel = pTexture->GetLevelCount() - 1;
+
+				const int feedback = pTexture->ConsumeFeedback();
+				if (feedback != QuadTexture::NO_FEEDBACK)
+				{
+					const int level = Math::Min(feedback, coarsestLevel);
+					if (level <= entry.RequestedLevel || mFrame - entry.RequestFrame > FEEDBACK_HOLD_FRAMES)
+					{
+						entry.RequestedLevel = level;
+						entry.RequestFrame = mFrame;
+					}
+				}
+				else if (mFrame - entry.RequestFrame > FEEDBACK_HOLD_FRAMES)
+				{
+					entry.RequestedLevel = coarsestLevel;
+				}
+
+				entry.TargetLevel = entry.RequestedLevel;
+				for (auto level = entry.TargetLevel; level <= coarsestLevel; level++)
+					targetBytes += pTexture->GetLevelMemorySize(level);
+			}
+
+			// Over budget, drop the largest finest level first, ties go to the least recently requested texture
+			while (targetBytes > mBudget)
+			{
+				Entry* pVictim = nullptr;
+				size_t victimSize = 0;
+				for (auto& it : mEntries)
+				{
+					Entry& entry = it.second;
+					if (entry.TargetLevel >= entry.pTexture->GetLevelCount() - 1)
+						continue;
+
+					const size_t size = entry.pTexture->GetLevelMemorySize(entry.TargetLevel);
+					if (!pVictim || size > victimSize || (size == victimSize && entry.RequestFrame < pVictim->RequestFrame))
+					{
+						pVictim = &entry;
+						victimSize = size;
+					}
+				}
+
+				if (!pVictim)
+					break;
+
+				pVictim->TargetLevel++;
+				targetBytes -= victimSize;
+			}
+
+			uint streamingCount = 0;
+			for (const auto& it : mEntries)
+			{
+				if (it.second.Streaming)
+					streamingCount++;
+			}
+
+			for (auto& it : mEntries)
+			{
+				Entry& entry = it.second;
+				QuadTexture* pTexture = entry.pTexture.get();
+				const int residentLevel = pTexture->GetResidentLevel();
+
+				if (entry.TargetLevel > residentLevel)
+				{
+					pTexture->EvictLevels(entry.TargetLevel);
+					mEvictedLevelCount += pTexture->GetResidentLevel() - residentLevel;
+				}
+				else if (entry.TargetLevel < residentLevel && !entry.Streaming && !entry.LoadFailed && streamingCount < MAX_STREAMING_LOADS)
+				{
+					StartLoad(entry);
+					streamingCount++;
+				}
+			}
+		}
+
+		void TextureCache::StartLoad(Entry& entry)
+		{
+			entry.Streaming = true;
+			entry.LoadLevel = entry.TargetLevel;
+			entry.LoadEndLevel = entry.pTexture->GetResidentLevel();
+
+			// Only the missing levels are read, holding the texture keeps it from being trimmed meanwhile
+			TextureHandle pTexture = entry.pTexture;
+			const int firstLevel = entry.LoadLevel;
+			const int endLevel = entry.LoadEndLevel;
+			entry.LoadTask = concurrency::create_task([pTexture, firstLevel, endLevel]()
+			{
+				std::shared_ptr<MipChain> pLevels = std::make_shared<MipChain>();
+				if (!pTexture->LoadLevels(firstLevel, endLevel, *pLevels))
+					pLevels = nullptr;
+
+				return pLevels;
+			});
+		}
+
+		bool TextureCache::HashFile(const char* path, uint64* pHash)
+		{
+			FILE* pFile = nullptr;
+			if (fopen_s(&pFile, path, "rb") != 0 || !pFile)
+				return false;
+
+			// 64 bit FNV-1a over the file content
+			uint64 hash = 14695981039346656037ULL;
+			_byte buffer[64 * 1024];
+			size_t readSize;
+			while ((readSize = fread(buffer, 1, sizeof(buffer), pFile)) > 0)
+			{
+				for (auto i = 0; i < readSize; i++)
+				{
+					hash ^= buffer[i];
+					hash *= 1099511628211ULL;
+				}
+			}
+			fclose(pFile);
+
+			*pHash = hash;
+			return true;
+		}
+	}
+}
\ No newline at end of file
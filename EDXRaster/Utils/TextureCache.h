@@ -0,0 +1,130 @@
+#pragma once
+
+#include "EDXPrerequisites.h"
+#include "../Core/Texture.h"
+#include "../Core/CompressedTexture.h"
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <ppltasks.h>
+
+namespace EDX
+{
+	namespace RasterRenderer
+	{
+		typedef std::shared_ptr<QuadTexture> TextureHandle;
+
+		struct TextureResidency
+		{
+			uint TextureCount;
+			uint ReferencedCount;
+			size_t ResidentBytes;
+			size_t BudgetBytes;
+			uint HitCount;
+			uint DuplicateCount; // Loads resolved to an identical image under another path
+			uint EvictionCount;
+			uint StreamingCount; // Textures with mip levels being loaded
+			uint FailedCount; // Textures whose levels could not be loaded back, they are not retried
+			uint StreamedLevelCount;
+			uint EvictedLevelCount;
+		};
+
+		class TextureCache
+		{
+		private:
+			struct Entry
+			{
+				TextureHandle pTexture;
+				uint64 LastUse;
+
+				// Mip streaming, the requested level comes from sampler feedback
+				int RequestedLevel;
+				uint64 RequestFrame;
+				int TargetLevel;
+				bool Streaming;
+				bool LoadFailed;
+
+				// Levels [LoadLevel, LoadEndLevel) being read in the background, null result when they could not be
+				concurrency::task<std::shared_ptr<MipChain>> LoadTask;
+				int LoadLevel;
+				int LoadEndLevel;
+			};
+
+			static const uint FEEDBACK_HOLD_FRAMES = 60;
+			static const uint MAX_STREAMING_LOADS = 4;
+
+			mutable std::mutex mLock;
+			std::unordered_map<string, uint64> mPathToHash;
+			std::unordered_map<uint64, Entry> mEntries; // Keyed by content hash
+
+			bool mCompressOnImport;
+			MipFilter mMipFilter;
+			string mMipCacheDirectory;
+			size_t mBudget;
+			uint64 mUseCounter;
+			uint64 mFrame;
+			uint mHitCount;
+			uint mDuplicateCount;
+			uint mEvictionCount;
+			uint mStreamedLevelCount;
+			uint mEvictedLevelCount;
+
+		private:
+			TextureCache();
+			~TextureCache();
+			static TextureCache* mpInstance;
+			static std::mutex mInstanceLock;
+
+		public:
+			// Locked, the first call can come from several loader tasks at once
+			static TextureCache* Instance()
+			{
+				std::lock_guard<std::mutex> lock(mInstanceLock);
+				if (!mpInstance)
+					mpInstance = new TextureCache;
+
+				return mpInstance;
+			}
+			static void DeleteInstance()
+			{
+				std::lock_guard<std::mutex> lock(mInstanceLock);
+				if (mpInstance)
+				{
+					delete mpInstance;
+					mpInstance = nullptr;
+				}
+			}
+
+		public:
+			// Thread safe, decoding happens outside of the cache lock
+			TextureHandle Load(const char* path);
+
+			// Images loaded afterwards are kept block compressed, DDS files always are
+			void SetImportCompression(const bool compress);
+
+			// Images loaded afterwards get their mips built with this filter
+			void SetMipFilter(const MipFilter filter);
+
+			// Finished mip chains are stored in the directory, named by the content hash of the image,
+			// so loading an unchanged image again skips decoding and filtering. Empty to disable
+			void SetMipCacheDirectory(const char* directory);
+
+			// Mip levels are streamed to fit the budget, whole textures are evicted only once no mesh holds them
+			void SetMemoryBudget(const size_t bytes);
+			void Trim();
+			TextureResidency GetResidency() const;
+
+			// Call once per frame while no renderer in the process is drawing, the cache is shared by all of
+			// them. Commits mip levels loaded in the background, evicts levels the sampler no longer asks for
+			// and starts loading the ones it does
+			void UpdateStreaming();
+
+		private:
+			void TrimLocked();
+			size_t ResidentBytesLocked() const;
+			void StartLoad(Entry& entry);
+			static bool HashFile(const char* path, uint64* pHash);
+		};
+	}
+}
\ No newline at end of file
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "EDXPrerequisites.h"
+#include "Math/Vector.h"
+#include "Math/EDXMath.h"
+#include "SIMD/SSE.h"
+
+namespace EDX
+{
+	namespace RasterRenderer
+	{
+		namespace VertexQuantization
+		{
+			typedef unsigned short ushort;
+
+			// Positions are stored as unorm16 relative to the mesh bounds
+			__forceinline ushort QuantizeUnorm16(const float val, const float offset, const float scale)
+			{
+				const float normalized = Math::Clamp((val - offset) * scale, 0.0f, 1.0f);
+				return ushort(normalized * 65535.0f + 0.5f);
+			}
+
+			__forceinline short QuantizeSnorm16(const float val)
+			{
+				const float clamped = Math::Clamp(val, -1.0f, 1.0f);
+				return short(clamped >= 0.0f ? clamped * 32767.0f + 0.5f : clamped * 32767.0f - 0.5f);
+			}
+
+			// Octahedral normal encoding, see "A Survey of Efficient Representations for Independent Unit Vectors"
+			__forceinline void OctEncode(const Vector3& normal, short* pOut)
+			{
+				const float invL1 = 1.0f / (Math::Abs(normal.x) + Math::Abs(normal.y) + Math::Abs(normal.z) + 1e-20f);
+				float x = normal.x * invL1;
+				float y = normal.y * invL1;
+				if (normal.z < 0.0f)
+				{
+					const float foldX = (1.0f - Math::Abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+					const float foldY = (1.0f - Math::Abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+					x = foldX;
+					y = foldY;
+				}
+
+				pOut[0] = QuantizeSnorm16(x);
+				pOut[1] = QuantizeSnorm16(y);
+			}
+
+			__forceinline Vector3 OctDecode(const short* pIn)
+			{
+				const float x = Math::Max(pIn[0] / 32767.0f, -1.0f);
+				const float y = Math::Max(pIn[1] / 32767.0f, -1.0f);
+				Vector3 ret = Vector3(x, y, 1.0f - Math::Abs(x) - Math::Abs(y));
+				const float t = Math::Max(-ret.z, 0.0f);
+				ret.x += ret.x >= 0.0f ? -t : t;
+				ret.y += ret.y >= 0.0f ? -t : t;
+
+				return Math::Normalize(ret);
+			}
+
+			// Round to nearest even half, denormals are flushed to zero
+			__forceinline ushort FloatToHalf(const float val)
+			{
+				uint bits;
+				memcpy(&bits, &val, sizeof(float));
+
+				const uint sign = (bits >> 16) & 0x8000;
+				const int exponent = int((bits >> 23) & 0xff) - 127 + 15;
+				uint mantissa = bits & 0x7fffff;
+
+				if (exponent <= 0)
+					return ushort(sign);
+				if (exponent >= 31)
+					return ushort(sign | 0x7c00);
+
+				uint half = sign | (exponent << 10) | (mantissa >> 13);
+				const uint roundBits = mantissa & 0x1fff;
+				if (roundBits > 0x1000 || (roundBits == 0x1000 && (half & 1)))
+					half++;
+
+				return ushort(half);
+			}
+
+			__forceinline float HalfToFloat(const ushort val)
+			{
+				const uint sign = uint(val & 0x8000) << 16;
+				const uint exponent = (val >> 10) & 0x1f;
+				const uint mantissa = val & 0x3ff;
+
+				// Denormals are mantissa * 2^-24, exact in float and the same value the SSE path computes
+				if (exponent == 0)
+				{
+					const float denormal = float(mantissa) * (1.0f / 16777216.0f);
+					return sign ? -denormal : denormal;
+				}
+
+				uint bits;
+				if (exponent == 31)
+					bits = sign | 0x7f800000 | (mantissa << 13);
+				else
+					bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+
+				float ret;
+				memcpy(&ret, &bits, sizeof(float));
+				return ret;
+			}
+
+			// SSE2 conversion of 4 halfs stored in the low 16 bits of each lane
+			__forceinline FloatSSE HalfToFloat(const __m128i& val)
+			{
+				const __m128i maskNoSign = _mm_set1_epi32(0x7fff);
+				const __m128 magic = _mm_castsi128_ps(_mm_set1_epi32((254 - 15) << 23));
+				const __m128i wasInfNan = _mm_set1_epi32(0x7bff);
+				const __m128 expInfNan = _mm_castsi128_ps(_mm_set1_epi32(255 << 23));
+
+				const __m128i expMant = _mm_and_si128(maskNoSign, val);
+				const __m128i justSign = _mm_xor_si128(val, expMant);
+				const __m128 scaled = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(expMant, 13)), magic);
+				const __m128 infNanExp = _mm_and_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(expMant, wasInfNan)), expInfNan);
+				const __m128 sign = _mm_castsi128_ps(_mm_slli_epi32(justSign, 16));
+
+				return _mm_or_ps(scaled, _mm_or_ps(sign, infNanExp));
+			}
+		}
+	}
+}
\ No newline at end of file
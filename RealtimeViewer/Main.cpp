@@ -5,6 +5,7 @@
 #include "Core/Rasterizer.h"
 #include "Graphics/Camera.h"
 #include "Utils/Mesh.h"
+#include "Utils/TextureCache.h"
 
 #include "Graphics/EDXGui.h"
 #include "Windows/Timer.h"
@@ -21,6 +22,8 @@ int giWindowHeight = 720;
 int gTexFilterId = 2;
 int gMSAAId = 0;
 bool gHRas = true;
+bool gCompressTextures = false;
+bool gKaiserMips = false;
 bool gRecord = false;
 
 // Global variables
@@ -38,6 +41,11 @@ void OnInit(Object* pSender, EventArgs args)
 	gpRenderer->Initialize(giWindowWidth, giWindowHeight);
 	gCamera.Init(-5.0f * Vector3::UNIT_Z, Vector3::ZERO, Vector3::UNIT_Y, giWindowWidth, giWindowHeight, 65, 0.01f);
 
+	// Warm starts load finished mip chains instead of decoding and filtering images
+	char mipCacheDirectory[MAX_PATH];
+	sprintf_s(mipCacheDirectory, MAX_PATH, "%s../../Media/MipCache", Application::GetBaseDirectory());
+	TextureCache::Instance()->SetMipCacheDirectory(mipCacheDirectory);
+
 	//gMesh.LoadPlane(Vector3::ZERO, Vector3(1, 1, 1), Vector3(-90.0f, 0.0f, 0.0f), 1.2f);
 	gMesh.LoadSphere(Vector3::ZERO, Vector3::UNIT_SCALE, Vector3::ZERO, 1.2f);
 	//gMesh.LoadMesh(Vector3(0, -10, 35), Vector3::UNIT_SCALE, Vector3(0, 180, 0), "../../Media/bunny.obj");
@@ -66,6 +74,20 @@ void OnRender(Object* pSender, EventArgs args)
 {
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+	// Swap in geometry and textures finished by background loads
+	if (gMesh.CommitPendingResources())
+	{
+		Vector3 center;
+		float radius;
+		gMesh.GetBounds().BoundingSphere(&center, &radius);
+
+		gCamera.Init(Vector3::ZERO, Vector3::UNIT_Z, Vector3::UNIT_Y, giWindowWidth, giWindowHeight, 65, radius * 0.02f, radius * 5.0f);
+		gCamera.mMoveScaler = radius / 50.0f;
+	}
+
+	// Stream texture mips toward what the previous frame sampled
+	TextureCache::Instance()->UpdateStreaming();
+
 	gCamera.Transform();
 
 	gpRenderer->SetTransform(gCamera.GetViewMatrix(), gCamera.GetProjMatrix(), gCamera.GetRasterMatrix());
@@ -81,10 +103,29 @@ void OnRender(Object* pSender, EventArgs args)
 	{
 		EDXGui::Text("Image Res: %i, %i", giWindowWidth, giWindowHeight);
 		EDXGui::Text("Triangle Count: %i", gMesh.GetIndexBuffer()->GetTriangleCount());
+		EDXGui::Text("ACMR: %.3f -> %.3f", gMesh.GetOptimizeStats().ACMRBefore, gMesh.GetOptimizeStats().ACMRAfter);
+		EDXGui::Text("Index Data: %i KB", int(gMesh.GetIndexBuffer()->GetBufferSize() >> 10));
+
+		const TextureResidency residency = TextureCache::Instance()->GetResidency();
+		EDXGui::Text("Textures: %i (%i in use)", residency.TextureCount, residency.ReferencedCount);
+		EDXGui::Text("Texture Memory: %i / %i MB", int(residency.ResidentBytes >> 20), int(residency.BudgetBytes >> 20));
+		EDXGui::Text("Mips Streamed: %i, Evicted: %i", residency.StreamedLevelCount, residency.EvictedLevelCount);
+		if (residency.StreamingCount > 0)
+			EDXGui::Text("Streaming %i textures...", residency.StreamingCount);
+		if (residency.FailedCount > 0)
+			EDXGui::Text("Streaming failed for %i textures", residency.FailedCount);
 		EDXGui::Text(gTimer.GetFrameRate());
+		if (gMesh.IsLoading())
+			EDXGui::Text("Loading...");
+		if (!gMesh.GetLoadError().empty())
+			EDXGui::Text("Load failed: %s", gMesh.GetLoadError().c_str());
 
 		EDXGui::CheckBox("Hierarchical Rasterize", gHRas);
 		EDXGui::CheckBox("Record Frames", gRecord);
+		EDXGui::CheckBox("Compress Textures", gCompressTextures);
+		TextureCache::Instance()->SetImportCompression(gCompressTextures);
+		EDXGui::CheckBox("Kaiser Mip Filter", gKaiserMips);
+		TextureCache::Instance()->SetMipFilter(gKaiserMips ? MipFilter::Kaiser : MipFilter::Box);
 
 		ComboBoxItem AAItems[] = {
 				{ 0, "off" },
@@ -114,15 +155,7 @@ void OnRender(Object* pSender, EventArgs args)
 			sprintf_s(directory, MAX_PATH, "%s../../Media", Application::GetBaseDirectory());
 			if (Application::GetMainWindow()->OpenFileDialog(directory, "obj", "Wavefront Object\0*.obj", filePath))
 			{
-				gMesh.Release();
-				gMesh.LoadMesh(Vector3(0, 0, 0), 0.01f * Vector3::UNIT_SCALE, Vector3(0, 0, 0), filePath);
-
-				Vector3 center;
-				float radius;
-				gMesh.GetBounds().BoundingSphere(&center, &radius);
-
-				gCamera.Init(Vector3::ZERO, Vector3::UNIT_Z, Vector3::UNIT_Y, giWindowWidth, giWindowHeight, 65, radius * 0.02f, radius * 5.0f);
-				gCamera.mMoveScaler = radius / 50.0f;
+				gMesh.LoadMeshAsync(Vector3(0, 0, 0), 0.01f * Vector3::UNIT_SCALE, Vector3(0, 0, 0), filePath);
 			}
 		}
 	}
@@ -156,6 +189,8 @@ void OnResize(Object* pSender, ResizeEventArgs args)
 void OnRelease(Object* pSender, EventArgs args)
 {
 	Memory::SafeDelete(gpRenderer);
+	gMesh.Release();
+	TextureCache::DeleteInstance();
 	EDXGui::Release();
 }
 
@@ -0,0 +1,57 @@
+#include "Core/ScriptShader.h"
+#include "Core/ShaderCodeGenerator.h"
+
+#include <stdio.h>
+
+using namespace EDX;
+using namespace EDX::RasterRenderer;
+using namespace EDX::ShaderCompiler;
+
+// Compiles an HLSL entry point and writes it out as a shader class header, so builds without the compiler
+// can use the shader through PipelineState::Create
+int main(int argc, char** argv)
+{
+	if (argc < 5 || (strcmp(argv[2], "vs") != 0 && strcmp(argv[2], "ps") != 0))
+	{
+		printf("usage: ShaderCodeGen <file.hlsl> <vs|ps> <ClassName> <out.h> [entry point, default Main]\n");
+		return 1;
+	}
+
+	const char* pSourcePath = argv[1];
+	const ShaderStage stage = strcmp(argv[2], "vs") == 0 ? ShaderStage::Vertex : ShaderStage::Pixel;
+	const string entryPoint = argc > 5 ? argv[5] : "Main";
+
+	Array<CompileError> errors;
+	auto pProgram = ShaderProgram::CompileFromFile(pSourcePath, entryPoint, stage, errors);
+	for (auto i = 0; i < errors.Size(); i++)
+		printf("%s\n", errors[i].ToString().c_str());
+
+	if (!pProgram)
+		return 1;
+
+	const IROptimizeStats& stats = pProgram->GetOptimizeStats();
+	printf("%s: %i instructions, %i in setup\n", pSourcePath, stats.InstructionCountAfter, stats.SetupInstructionCount);
+
+	// Only the file name is quoted so the header does not change with the checkout location
+	const char* pSourceName = pSourcePath;
+	for (const char* pChar = pSourcePath; *pChar; pChar++)
+	{
+		if (*pChar == '/' || *pChar == '\\')
+			pSourceName = pChar + 1;
+	}
+
+	ShaderCodeGenerator generator;
+	const string source = generator.Generate(*pProgram, argv[3], pSourceName);
+
+	FILE* pFile = nullptr;
+	if (fopen_s(&pFile, argv[4], "wb") != 0 || !pFile)
+	{
+		printf("cannot open '%s' for writing\n", argv[4]);
+		return 1;
+	}
+
+	fwrite(source.data(), 1, source.size(), pFile);
+	fclose(pFile);
+
+	return 0;
+}
\ No newline at end of file